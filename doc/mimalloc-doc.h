@@ -662,16 +662,41 @@ void mi_heap_delete(mi_heap_t* heap);
 /// allocated in the heap. However, this can be a very
 /// efficient way to free all heap memory in one go.
 ///
+/// Other threads should not free blocks of the heap concurrently.
+/// When \a mi_option_remote_free_batch is enabled, threads that
+/// freed blocks of the heap should also flush their pending frees
+/// (by calling mi_collect() or by terminating) before the heap is
+/// destroyed.
+///
 /// If \a heap is the default heap, the default
 /// heap is set to the backing heap.
 void mi_heap_destroy(mi_heap_t* heap);
 
+/// Reset a heap, freeing all its still allocated blocks
+/// but keeping its pages for the next allocations.
+/// This is like mi_heap_destroy() but the heap stays usable,
+/// which suits allocation in epochs (like one heap per request)
+/// as the pages do not need to be initialized again.
+///
+/// The same preconditions as for mi_heap_destroy() apply:
+/// the heap must allow destroying (as heaps from mi_heap_new() do, see mi_heap_new_ex()),
+/// other threads should not free blocks of the heap concurrently, and
+/// with \a mi_option_remote_free_batch enabled they should flush their
+/// pending frees first. The pending frees of the calling thread are
+/// flushed by the reset itself. A detached fiber heap is attached for
+/// the reset and detached again afterwards.
+/// The reset is ignored (with a warning) for heaps that cannot be destroyed,
+/// and in guarded builds (\a MI_GUARDED).
+void mi_heap_reset(mi_heap_t* heap);
+
 /// Set the default heap to use in the current thread for mi_malloc() et al.
 /// @param heap  The new default heap.
 /// @returns The previous default heap.
 mi_heap_t* mi_heap_set_default(mi_heap_t* heap);
 
 /// Get the default heap that is used for mi_malloc() et al. (for the current thread).
+/// With \a mi_option_cpu_heaps enabled, small objects may come from a heap that the thread
+/// leased from its CPU; such a heap is never returned and the thread's own heap is returned instead.
 /// @returns The current default heap.
 mi_heap_t* mi_heap_get_default();
 
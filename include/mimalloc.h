@@ -150,6 +150,8 @@ mi_decl_export void mi_register_error(mi_error_fun* fun, void* arg);
 
 mi_decl_export void mi_collect(bool force)    mi_attr_noexcept;
 mi_decl_export void mi_collect_reduce(size_t target_thread_owned) mi_attr_noexcept;
+mi_decl_export size_t mi_collect_target(size_t target_committed) mi_attr_noexcept;  // purge (also in other threads) until at most `target_committed` bytes are committed
+mi_decl_export void mi_memory_pressure_notify(void) mi_attr_noexcept;  // signal memory pressure (handled as a cgroup pressure signal, see `mi_option_pressure_interval`)
 mi_decl_export int  mi_version(void)          mi_attr_noexcept;
 mi_decl_export void mi_stats_reset(void)      mi_attr_noexcept;
 mi_decl_export void mi_stats_merge(void)      mi_attr_noexcept;
@@ -164,6 +166,8 @@ mi_decl_export void mi_thread_stats_print_out(mi_output_fun* out, void* arg) mi_
 mi_decl_export void mi_process_info(size_t* elapsed_msecs, size_t* user_msecs, size_t* system_msecs,
                                     size_t* current_rss, size_t* peak_rss,
                                     size_t* current_commit, size_t* peak_commit, size_t* page_faults) mi_attr_noexcept;
+mi_decl_export void mi_numa_node_stats(int numa_node, size_t* current_segments, size_t* peak_segments,
+                                       size_t* reclaimed, size_t* reclaimed_remote) mi_attr_noexcept;
 
 // -------------------------------------------------------------------------------------
 // Aligned allocation
@@ -191,6 +195,7 @@ typedef struct mi_heap_s mi_heap_t;
 mi_decl_nodiscard mi_decl_export mi_heap_t* mi_heap_new(void);
 mi_decl_export void       mi_heap_delete(mi_heap_t* heap);
 mi_decl_export void       mi_heap_destroy(mi_heap_t* heap);
+mi_decl_export void       mi_heap_reset(mi_heap_t* heap);  // free all blocks but keep the pages (same preconditions as `mi_heap_destroy`)
 mi_decl_export mi_heap_t* mi_heap_set_default(mi_heap_t* heap);
 mi_decl_export mi_heap_t* mi_heap_get_default(void);
 mi_decl_export mi_heap_t* mi_heap_get_backing(void);
@@ -202,6 +207,12 @@ mi_decl_nodiscard mi_decl_export mi_decl_restrict void* mi_heap_calloc(mi_heap_t
 mi_decl_nodiscard mi_decl_export mi_decl_restrict void* mi_heap_mallocn(mi_heap_t* heap, size_t count, size_t size) mi_attr_noexcept mi_attr_malloc mi_attr_alloc_size2(2, 3);
 mi_decl_nodiscard mi_decl_export mi_decl_restrict void* mi_heap_malloc_small(mi_heap_t* heap, size_t size) mi_attr_noexcept mi_attr_malloc mi_attr_alloc_size(2);
 
+// Batched allocation: fill `blocks` with up to `count` blocks of `size` bytes; returns the number of blocks allocated.
+// Free them with `mi_free_batch` (or individually with `mi_free`).
+mi_decl_export size_t mi_heap_malloc_batch(mi_heap_t* heap, size_t size, void** blocks, size_t count) mi_attr_noexcept;
+mi_decl_export size_t mi_malloc_batch(size_t size, void** blocks, size_t count) mi_attr_noexcept;
+mi_decl_export void   mi_free_batch(void** blocks, size_t count) mi_attr_noexcept;
+
 mi_decl_nodiscard mi_decl_export void* mi_heap_realloc(mi_heap_t* heap, void* p, size_t newsize)              mi_attr_noexcept mi_attr_alloc_size(3);
 mi_decl_nodiscard mi_decl_export void* mi_heap_reallocn(mi_heap_t* heap, void* p, size_t count, size_t size)  mi_attr_noexcept mi_attr_alloc_size2(3,4);
 mi_decl_nodiscard mi_decl_export void* mi_heap_reallocf(mi_heap_t* heap, void* p, size_t newsize)             mi_attr_noexcept mi_attr_alloc_size(3);
@@ -274,11 +285,96 @@ mi_decl_nodiscard mi_decl_export bool mi_is_redirected(void) mi_attr_noexcept;
 mi_decl_export int mi_reserve_huge_os_pages_interleave(size_t pages, size_t numa_nodes, size_t timeout_msecs) mi_attr_noexcept;
 mi_decl_export int mi_reserve_huge_os_pages_at(size_t pages, int numa_node, size_t timeout_msecs) mi_attr_noexcept;
 
+// Reserve huge OS pages in the background: only the first page is reserved before returning, and the rest
+// is reserved (per numa node, or interleaved if `numa_node < 0`) by a background thread that adds each reserved
+// chunk as an arena. The progress function is called after each chunk, and once more with `done` at the end.
+// Returns 0 if (at least) the first page was reserved.
+typedef void (mi_cdecl mi_reserve_progress_fun)(size_t pages_reserved, size_t pages_requested, bool done, void* arg);
+mi_decl_export int  mi_reserve_huge_os_pages_async(size_t pages, int numa_node, size_t timeout_msecs, mi_reserve_progress_fun* progress, void* arg) mi_attr_noexcept;
+mi_decl_export void mi_register_reserve_progress(mi_reserve_progress_fun* progress, void* arg) mi_attr_noexcept;
+
 mi_decl_export int  mi_reserve_os_memory(size_t size, bool commit, bool allow_large) mi_attr_noexcept;
 mi_decl_export bool mi_manage_os_memory(void* start, size_t size, bool is_committed, bool is_large, bool is_zero, int numa_node) mi_attr_noexcept;
 
 mi_decl_export void mi_debug_show_arenas(bool show_inuse) mi_attr_noexcept;
 
+// Snapshot of the block usage of an arena (see `mi_arenas_stats`)
+typedef struct mi_arena_stats_s {
+  int    id;              // arena id
+  size_t size;            // total size of the arena in bytes
+  size_t inuse;           // bytes in blocks that are in use (by segments or huge objects)
+  size_t committed;       // bytes in committed blocks (equal to `size` for memory that cannot be decommitted)
+  size_t purge_pending;   // bytes in blocks that are scheduled to be purged
+  size_t abandoned;       // bytes in blocks that start an abandoned segment
+  int    numa_node;       // associated numa node (or -1)
+  bool   exclusive;       // only used for heaps allocating in this arena
+  bool   is_large;        // consists of large or huge OS pages
+  bool   is_pinned;       // memory cannot be decommitted or reset
+} mi_arena_stats_t;
+
+// Machine readable statistics: these do not take locks or allocate and are cheap enough to poll.
+mi_decl_export size_t mi_arenas_stats(mi_arena_stats_t* stats, size_t max_count) mi_attr_noexcept;
+mi_decl_export size_t mi_stats_get_json(char* buf, size_t buf_size) mi_attr_noexcept;
+mi_decl_export bool   mi_memory_pressure_stats(bool* under_pressure, size_t* episodes, size_t* pressure_msecs, size_t* collects) mi_attr_noexcept;
+
+// Fragmentation of the pages of a heap per size bin (see `mi_heap_frag_bins`)
+typedef struct mi_frag_bin_s {
+  size_t block_size;      // block size of the bin (the largest block size for the huge bin)
+  size_t pages;           // number of pages
+  size_t used;            // blocks in use
+  size_t capacity;        // blocks that are committed and initialized
+  size_t reserved;        // blocks that fit in the reserved page area
+} mi_frag_bin_t;
+
+// Fragmentation of a segment owned by the current thread (see `mi_thread_frag_segments`)
+typedef struct mi_frag_segment_s {
+  void*  segment;         // start of the segment
+  size_t size;            // size of the segment in bytes
+  size_t committed;       // committed bytes
+  size_t page_slices;     // slices used by pages
+  size_t free_spans;      // number of free span runs
+  size_t free_slices;     // slices in the free spans
+  size_t free_largest;    // slices in the largest free span
+  size_t free_committed;  // committed bytes in the free spans (these can be purged)
+} mi_frag_segment_t;
+
+// Fragmentation summary of the heaps and segments of the current thread (see `mi_thread_frag_summary`)
+typedef struct mi_frag_summary_s {
+  size_t live;              // bytes in blocks that are in use
+  size_t page_committed;    // committed (initialized) bytes in pages
+  size_t page_reserved;     // reserved bytes in pages
+  size_t segment_committed; // committed bytes in segments
+  size_t free_committed;    // committed bytes in free spans of segments
+  double ratio;             // `segment_committed / live` (or 0 if there are no live blocks)
+} mi_frag_summary_t;
+
+// These walk the pages and segments of the current thread (and are not cheap).
+// The functions returning a `size_t` return the total count which can be larger than `max_count`.
+mi_decl_export size_t mi_heap_frag_bins(const mi_heap_t* heap, mi_frag_bin_t* bins, size_t max_count) mi_attr_noexcept;
+mi_decl_export size_t mi_thread_frag_segments(mi_frag_segment_t* segments, size_t max_count) mi_attr_noexcept;
+mi_decl_export void   mi_thread_frag_summary(mi_frag_summary_t* summary) mi_attr_noexcept;
+mi_decl_export void   mi_thread_frag_print_out(mi_output_fun* out, void* arg) mi_attr_noexcept;
+
+// Relocate blocks out of sparsely used pages (with less than `max_used_percent` of the blocks in use, 5% if 0)
+// so those pages (and eventually their segments) can be freed. For each block in such a page, a new block is
+// allocated from another page and the `block_size` bytes are copied into it; the callback should update all
+// references to `block` and return `true`, after which `block` is freed, or return `false` to keep `block` in
+// place (for example for blocks it does not know). The callback must not free blocks of the heap and the blocks
+// must not be freed concurrently by other threads. Only for heaps of the current thread; returns the number
+// of relocated blocks.
+typedef bool (mi_cdecl mi_block_relocate_fun)(const mi_heap_t* heap, void* block, void* new_block, size_t block_size, void* arg);
+mi_decl_export size_t mi_heap_relocate_candidates(mi_heap_t* heap, size_t max_used_percent, mi_block_relocate_fun* relocate, void* arg);
+
+// Destroy or (force) collect a heap with the help of other threads. Pages are freed by the calling thread,
+// but releasing the freed segments to the arenas and the OS (decommit or unmap), and on a collect also the
+// purging of the arenas, is split in (at most) `workers` tasks. The executor must call `task(i, task_arg)` once
+// for each `i < count` (on any thread, for example in a thread pool) and return when all tasks are done.
+// If `executor` is NULL, the tasks are run on fresh threads and the calling thread.
+typedef void (mi_cdecl mi_parallel_task_fun)(size_t index, void* task_arg);
+typedef void (mi_cdecl mi_executor_fun)(mi_parallel_task_fun* task, void* task_arg, size_t count, void* arg);
+mi_decl_export void mi_heap_destroy_parallel(mi_heap_t* heap, size_t workers, mi_executor_fun* executor, void* arg) mi_attr_noexcept;
+mi_decl_export void mi_heap_collect_parallel(mi_heap_t* heap, size_t workers, mi_executor_fun* executor, void* arg) mi_attr_noexcept;
+
 // Experimental: heaps associated with specific memory arena's
 typedef int mi_arena_id_t;
 mi_decl_export void* mi_arena_area(mi_arena_id_t arena_id, size_t* size);
@@ -291,6 +387,26 @@ mi_decl_export bool  mi_manage_os_memory_ex(void* start, size_t size, bool is_co
 mi_decl_nodiscard mi_decl_export mi_heap_t* mi_heap_new_in_arena(mi_arena_id_t arena_id);
 #endif
 
+// Experimental: arenas backed by a file (for example on a tmpfs or hugetlbfs) that persist between runs.
+// If the file already contains an arena it is mapped again at the same address, and all allocated
+// blocks stay valid (and are reclaimed by the heaps of this process); `size` is then ignored.
+// The root is a pointer in the file header where a program can store the entry point to its objects.
+mi_decl_export int    mi_reserve_file_memory_ex(const char* path, size_t size, bool exclusive, mi_arena_id_t* arena_id) mi_attr_noexcept;
+mi_decl_export void** mi_arena_file_root(mi_arena_id_t arena_id) mi_attr_noexcept;
+
+// Experimental: exclusive arenas in shared memory (a file in `/dev/shm` or a `memfd`) that cooperating processes
+// map at the same address. Each process allocates from its own heaps (using `mi_heap_new_in_arena`) while the
+// arena blocks are shared, so blocks can be passed between processes without copying. A block must be freed
+// by the process that allocated it.
+mi_decl_export int    mi_reserve_shared_memory_ex(const char* path, size_t size, mi_arena_id_t* arena_id) mi_attr_noexcept;
+mi_decl_export int    mi_reserve_shared_fd_ex(int fd, size_t size, mi_arena_id_t* arena_id) mi_attr_noexcept;
+
+// Experimental: write a binary trace of all allocations and frees to a memory mapped file (see `mimalloc/trace.h`)
+// of at most `max_size` bytes (or `mi_option_trace_max_size` if 0). Only supported when built with `MI_TRACK_TRACE=1`
+// and returns `ENOTSUP` otherwise. Tracing also starts at process start if the `MIMALLOC_TRACE_FILE` environment variable is set.
+mi_decl_export int    mi_trace_start(const char* path, size_t max_size) mi_attr_noexcept;
+mi_decl_export void   mi_trace_stop(void) mi_attr_noexcept;
+
 
 // Experimental: allow sub-processes whose memory segments stay separated (and no reclamation between them)
 // Used for example for separate interpreter's in one process.
@@ -308,6 +424,70 @@ mi_decl_export bool mi_abandoned_visit_blocks(mi_subproc_id_t subproc_id, int he
 // fall back to `mi_heap_delete`.
 mi_decl_nodiscard mi_decl_export mi_heap_t* mi_heap_new_ex(int heap_tag, bool allow_destroy, mi_arena_id_t arena_id);
 
+// Experimental: attach a policy to a heap tag. The size rounding and page kind apply to heaps created with that tag
+// afterwards; the commit and purge settings apply to the segments that are allocated for such heaps (use an exclusive
+// arena for the tag to keep its memory fully separate). Use `mi_heap_tag_get_policy` to start from the defaults.
+typedef enum mi_heap_tag_page_kind_e {
+  mi_heap_tag_page_default,   // choose the page kind by the block size
+  mi_heap_tag_page_small,     // use the smallest possible pages (to reduce the footprint of cold objects)
+  mi_heap_tag_page_medium     // use medium pages for small blocks as well (to reduce page switches for hot objects)
+} mi_heap_tag_page_kind_t;
+
+typedef struct mi_heap_tag_policy_s {
+  size_t bin_granularity;             // round allocation sizes up to a multiple of this power of two (0 = use the regular size classes)
+  mi_heap_tag_page_kind_t page_kind;  // preferred page kind
+  int    eager_commit;                // commit fresh segments eagerly: -1 = use `mi_option_eager_commit`, 0 = no, 1 = yes
+  long   purge_delay;                 // purge delay in milli-seconds: -2 = use `mi_option_purge_delay`, -1 = never purge, 0 = immediately
+  int    populate;                    // commit and prefault fresh segments fully: -1 = use `mi_option_populate`, 0 = no, 1 = yes
+} mi_heap_tag_policy_t;
+
+mi_decl_export bool mi_heap_tag_get_policy(int heap_tag, mi_heap_tag_policy_t* policy) mi_attr_noexcept;
+mi_decl_export bool mi_heap_tag_set_policy(int heap_tag, const mi_heap_tag_policy_t* policy) mi_attr_noexcept;
+mi_decl_export void mi_heap_tag_stats(int heap_tag, size_t* current_pages, size_t* peak_pages,
+                                      size_t* current_normal, size_t* peak_normal) mi_attr_noexcept;
+
+// Experimental: limit the memory of a heap (in bytes of the pages it owns; 0 is unlimited).
+// When the soft limit is reached the heap is collected and the pressure function is called (once, until the
+// size drops below the soft limit again). Beyond the hard limit no fresh pages are allocated, so allocation fails.
+typedef void (mi_cdecl mi_heap_pressure_fun)(mi_heap_t* heap, size_t heap_size, size_t soft_limit, void* arg);
+mi_decl_export void   mi_heap_set_limits(mi_heap_t* heap, size_t soft_limit, size_t hard_limit) mi_attr_noexcept;
+mi_decl_export void   mi_heap_register_pressure(mi_heap_t* heap, mi_heap_pressure_fun* fun, void* arg) mi_attr_noexcept;
+mi_decl_export size_t mi_heap_get_size(const mi_heap_t* heap) mi_attr_noexcept;
+
+// Experimental: limit the memory of an arena (in bytes of the arena blocks in use; 0 is unlimited).
+// Reaching the soft limit purges the arena eagerly, and beyond the hard limit no more blocks are allocated from it.
+mi_decl_export bool   mi_arena_set_limits(mi_arena_id_t arena_id, size_t soft_limit, size_t hard_limit) mi_attr_noexcept;
+
+// Experimental: live heap profiling. With `mi_option_heap_sample_rate` set to N, 1 out of N allocations (on average)
+// is recorded with a tag until it is freed. The tag is the return address of the allocation call unless a tag function
+// is registered (which can compute a stack hash for example, but should not allocate itself).
+// The sampled live allocations can be visited from any thread at any time; visiting does not allocate or take locks.
+typedef struct mi_heap_sample_s {
+  void*  block;                         // start of the sampled block
+  size_t size;                          // requested size in bytes
+  size_t tag;                           // stack tag
+  size_t thread_id;                     // id of the allocating thread
+} mi_heap_sample_t;
+
+typedef size_t (mi_cdecl mi_heap_sample_tag_fun)(void* block, size_t size, void* return_address, void* arg);
+typedef bool   (mi_cdecl mi_heap_sample_visit_fun)(const mi_heap_sample_t* sample, void* arg);
+mi_decl_export void   mi_register_heap_sample_tag(mi_heap_sample_tag_fun* fun, void* arg) mi_attr_noexcept;
+mi_decl_export bool   mi_heap_sample_visit(mi_heap_sample_visit_fun* visitor, void* arg) mi_attr_noexcept;
+mi_decl_export size_t mi_heap_sample_snapshot(mi_heap_sample_t* samples, size_t count) mi_attr_noexcept;
+
+// Experimental: abandon all heaps that were parked in the heap pool by terminated threads (see `mi_option_heap_pool`)
+// so their memory can be reclaimed by other threads. Returns the number of heaps abandoned.
+mi_decl_export size_t mi_heap_pool_collect(void) mi_attr_noexcept;
+
+// Experimental: fiber heaps have their own segments so ownership can move to another thread with the fiber:
+// detach the heap in the old thread and attach it in the new one (without abandoning and reclaiming its pages).
+// Use `mi_heap_switch` to make it the default heap in constant time when the fiber is resumed.
+// A fiber heap that is still attached when its thread terminates is detached; a detached heap can be deleted from any thread.
+mi_decl_nodiscard mi_decl_export mi_heap_t* mi_heap_new_fiber(void);
+mi_decl_export mi_heap_t* mi_heap_switch(mi_heap_t* heap) mi_attr_noexcept;
+mi_decl_export void       mi_heap_fiber_detach(mi_heap_t* heap) mi_attr_noexcept;
+mi_decl_export bool       mi_heap_fiber_attach(mi_heap_t* heap) mi_attr_noexcept;
+
 // deprecated
 mi_decl_export int mi_reserve_huge_os_pages(size_t pages, double max_secs, size_t* pages_reserved) mi_attr_noexcept;
 
@@ -380,6 +560,25 @@ typedef enum mi_option_e {
   mi_option_guarded_sample_rate,        // 1 out of N allocations in the min/max range will be guarded (=1000)
   mi_option_guarded_sample_seed,        // can be set to allow for a (more) deterministic re-execution when a guard page is triggered (=0)
   mi_option_target_segments_per_thread, // experimental (=0)
+  mi_option_remote_free_batch,          // batch up to N cross-thread frees per page in a thread-local magazine before pushing them with a single atomic operation (=0, disabled). Flush them (`mi_collect`) before destroying a heap they belong to
+  mi_option_purge_background_interval,  // if > 0, use a background thread that purges expired memory every N milli-seconds (instead of purging on allocation/free paths) (=0, disabled)
+  mi_option_thp_aware,                  // transparent huge page (THP) aware mode: keep THP enabled, and commit and purge segment memory only in whole (2MiB) aligned huge OS pages (=0)
+  mi_option_alloc_sample_rate,          // if > 0, sample 1 out of N slow path allocations into a per size class histogram with latencies (also in release builds) (=0)
+  mi_option_heap_sample_rate,           // if > 0, record 1 out of N allocations (on average) with a stack tag for live heap profiling (see `mi_heap_sample_visit`) (=0)
+  mi_option_heap_pool,                  // park up to N heaps of terminated threads (with all their pages) for adoption by new threads, instead of abandoning them (=0)
+  mi_option_page_bump,                  // hand out the fresh capacity of a page by bumping a pointer instead of building a free list first (not in secure mode) (=0)
+  mi_option_free_cache,                 // keep up to N recently freed small blocks per size class in a LIFO cache of their heap for immediate reuse (not in secure mode) (=0)
+  mi_option_reserve_huge_os_pages_async, // reserve only the first of the `reserve_huge_os_pages` at startup and the rest on a background thread (see `mi_reserve_huge_os_pages_async`) (=0)
+  mi_option_commit_ahead,               // when a segment commits frequently, commit ahead in growing chunks up to this size (in KiB; use `mi_option_get_size`) (=0, disabled)
+  mi_option_populate,                   // populate (prefault) segments when they are allocated, and memory reserved at startup, so first accesses do not page fault (=0)
+  mi_option_purge_adaptive,             // if > 1, scale the purge delay by up to N times when purged memory is soon needed again (=0)
+  mi_option_purge_adaptive_ceiling,     // do not scale the purge delay while more memory than this is committed (in KiB; use `mi_option_get_size`) (=0, no ceiling)
+  mi_option_trace_max_size,             // maximal size of an allocation trace file (in KiB; use `mi_option_get_size`) (=1GiB) (only with `MI_TRACK_TRACE=1`)
+  mi_option_calloc_decommit_min,        // zero large blocks of at least this size by decommitting and recommitting them instead of writing them (in KiB; use `mi_option_get_size`) (=0, disabled)
+  mi_option_fast_start,                 // reduce the startup time by parsing options on first read, and deferring secure seeding, OS queries, and the startup reservations until first needed (=0)
+  mi_option_nontemporal_min,            // copy and zero blocks of at least this size in `realloc` and `calloc` with non-temporal stores that bypass the cache (in KiB; use `mi_option_get_size`) (=0, disabled)
+  mi_option_pressure_interval,          // if > 0, poll the memory pressure of the cgroup (on Linux) at most every N milli-seconds; under pressure purge immediately, collect the arenas, and force the deferred free function (=0, disabled)
+  mi_option_cpu_heaps,                  // Linux only: the default heap of a thread allocates small objects from a heap leased from its CPU (with its own heap as a fallback) so memory scales with the cores instead of the threads (=0)
   _mi_option_last,
   // legacy option names
   mi_option_large_os_pages = mi_option_allow_large_os_pages,
@@ -432,6 +631,7 @@ mi_decl_nodiscard mi_decl_export mi_decl_restrict unsigned char*  mi_mbsdup(cons
 mi_decl_export int mi_dupenv_s(char** buf, size_t* size, const char* name)                      mi_attr_noexcept;
 mi_decl_export int mi_wdupenv_s(unsigned short** buf, size_t* size, const unsigned short* name) mi_attr_noexcept;
 
+// Free with a size hint: `mi_free_size` is only for blocks allocated without an explicit alignment (like C++ sized delete)
 mi_decl_export void mi_free_size(void* p, size_t size)                           mi_attr_noexcept;
 mi_decl_export void mi_free_size_aligned(void* p, size_t size, size_t alignment) mi_attr_noexcept;
 mi_decl_export void mi_free_aligned(void* p, size_t alignment)                   mi_attr_noexcept;
@@ -449,6 +649,10 @@ mi_decl_nodiscard mi_decl_export void* mi_new_reallocn(void* p, size_t newcount,
 mi_decl_nodiscard mi_decl_export mi_decl_restrict void* mi_heap_alloc_new(mi_heap_t* heap, size_t size)                mi_attr_malloc mi_attr_alloc_size(2);
 mi_decl_nodiscard mi_decl_export mi_decl_restrict void* mi_heap_alloc_new_n(mi_heap_t* heap, size_t count, size_t size) mi_attr_malloc mi_attr_alloc_size2(2, 3);
 
+// allocate a small object (`size <= MI_SMALL_SIZE_MAX`) directly from the small object fast path (see `mi_new_fixed`)
+mi_decl_nodiscard mi_decl_export mi_decl_restrict void* mi_new_small(size_t size)                          mi_attr_malloc mi_attr_alloc_size(1);
+mi_decl_nodiscard mi_decl_export mi_decl_restrict void* mi_heap_alloc_new_small(mi_heap_t* heap, size_t size) mi_attr_malloc mi_attr_alloc_size(2);
+
 #ifdef __cplusplus
 }
 #endif
@@ -519,6 +723,42 @@ template<class T1,class T2> bool operator==(const mi_stl_allocator<T1>& , const
 template<class T1,class T2> bool operator!=(const mi_stl_allocator<T1>& , const mi_stl_allocator<T2>& ) mi_attr_noexcept { return false; }
 
 
+// Allocate an object of a size `N` known at compile time: small sizes are resolved at compile time
+// to the small object fast path (skipping the size checks of `mi_new`), while larger sizes use `mi_new`.
+template<std::size_t N> mi_decl_nodiscard inline void* mi_new_fixed() {
+  return (N <= MI_SMALL_SIZE_MAX ? mi_new_small(N) : mi_new(N));
+}
+
+// An allocator for node based containers (like `std::list` or `std::map`) that allocate one element at a time:
+// single elements use `mi_new_fixed` and are freed with their size.
+template<class T> struct mi_stl_fixed_allocator : public _mi_stl_allocator_common<T> {
+  using typename _mi_stl_allocator_common<T>::size_type;
+  using typename _mi_stl_allocator_common<T>::value_type;
+  using typename _mi_stl_allocator_common<T>::pointer;
+  template <class U> struct rebind { typedef mi_stl_fixed_allocator<U> other; };
+
+  mi_stl_fixed_allocator()                                                   mi_attr_noexcept = default;
+  mi_stl_fixed_allocator(const mi_stl_fixed_allocator&)                      mi_attr_noexcept = default;
+  template<class U> mi_stl_fixed_allocator(const mi_stl_fixed_allocator<U>&) mi_attr_noexcept { }
+  mi_stl_fixed_allocator  select_on_container_copy_construction() const { return *this; }
+  void                    deallocate(T* p, size_type count) { if (count == 1) { mi_free_size(p, sizeof(T)); } else { mi_free(p); } }
+
+  #if (__cplusplus >= 201703L)  // C++17
+  mi_decl_nodiscard T* allocate(size_type count) { return static_cast<T*>(count == 1 ? mi_new_fixed<sizeof(T)>() : mi_new_n(count, sizeof(T))); }
+  mi_decl_nodiscard T* allocate(size_type count, const void*) { return allocate(count); }
+  #else
+  mi_decl_nodiscard pointer allocate(size_type count, const void* = 0) { return static_cast<pointer>(count == 1 ? mi_new_fixed<sizeof(T)>() : mi_new_n(count, sizeof(value_type))); }
+  #endif
+
+  #if ((__cplusplus >= 201103L) || (_MSC_VER > 1900))  // C++11
+  using is_always_equal = std::true_type;
+  #endif
+};
+
+template<class T1,class T2> bool operator==(const mi_stl_fixed_allocator<T1>& , const mi_stl_fixed_allocator<T2>& ) mi_attr_noexcept { return true; }
+template<class T1,class T2> bool operator!=(const mi_stl_fixed_allocator<T1>& , const mi_stl_fixed_allocator<T2>& ) mi_attr_noexcept { return false; }
+
+
 #if (__cplusplus >= 201103L) || (_MSC_VER >= 1900)  // C++11
 #define MI_HAS_HEAP_STL_ALLOCATOR 1
 
@@ -27,26 +27,31 @@ terms of the MIT license. A copy of the license can be found in the file
 #if defined(_MSC_VER)
 #pragma warning(disable:4127)   // suppress constant conditional warning (due to MI_SECURE paths)
 #pragma warning(disable:26812)  // unscoped enum warning
+#include <intrin.h>                // _ReturnAddress
 #define mi_decl_noinline        __declspec(noinline)
 #define mi_decl_thread          __declspec(thread)
+#define mi_return_address()     _ReturnAddress()
 #define mi_decl_cache_align     __declspec(align(MI_CACHE_LINE))
 #define mi_decl_weak
 #define mi_decl_hidden
 #elif (defined(__GNUC__) && (__GNUC__ >= 3)) || defined(__clang__) // includes clang and icc
 #define mi_decl_noinline        __attribute__((noinline))
 #define mi_decl_thread          __thread
+#define mi_return_address()     __builtin_return_address(0)
 #define mi_decl_cache_align     __attribute__((aligned(MI_CACHE_LINE)))
 #define mi_decl_weak            __attribute__((weak))
 #define mi_decl_hidden          __attribute__((visibility("hidden")))
 #elif __cplusplus >= 201103L    // c++11
 #define mi_decl_noinline
 #define mi_decl_thread          thread_local
+#define mi_return_address()     NULL
 #define mi_decl_cache_align     alignas(MI_CACHE_LINE)
 #define mi_decl_weak
 #define mi_decl_hidden
 #else
 #define mi_decl_noinline
 #define mi_decl_thread          __thread        // hope for the best :-)
+#define mi_return_address()     NULL
 #define mi_decl_cache_align
 #define mi_decl_weak
 #define mi_decl_hidden
@@ -73,6 +78,8 @@ void        _mi_strlcat(char* dest, const char* src, size_t dest_size);
 size_t      _mi_strlen(const char* s);
 size_t      _mi_strnlen(const char* s, size_t max_len);
 bool        _mi_getenv(const char* name, char* result, size_t result_size);
+void        _mi_memcpy_large(void* dst, const void* src, size_t n, size_t block_size);  // uses non-temporal stores for large blocks
+void        _mi_memzero_large(void* dst, size_t n, size_t block_size);
 
 // "options.c"
 void        _mi_fputs(mi_output_fun* out, void* arg, const char* prefix, const char* message);
@@ -112,6 +119,11 @@ mi_threadid_t _mi_thread_id(void) mi_attr_noexcept;
 mi_heap_t*    _mi_heap_main_get(void);     // statically allocated main backing heap
 mi_subproc_t* _mi_subproc_from_id(mi_subproc_id_t subproc_id);
 void        _mi_heap_guarded_init(mi_heap_t* heap);
+bool        _mi_heap_fiber_claim(mi_heap_t* heap);
+void        _mi_heap_fiber_free(mi_heap_t* heap, bool destroy);
+mi_heap_t*  _mi_heap_cpu_enter(mi_heap_t* heap, size_t size, size_t huge_alignment);
+void        _mi_heap_cpu_leave(mi_heap_t* heap);
+void        _mi_heap_cpu_release(mi_heap_t* host);
 
 // os.c
 void        _mi_os_init(void);                                            // called from process init
@@ -125,19 +137,27 @@ bool        _mi_os_has_overcommit(void);
 bool        _mi_os_has_virtual_reserve(void);
 
 bool        _mi_os_reset(void* addr, size_t size);
+void        _mi_os_populate(void* addr, size_t size);
 bool        _mi_os_commit(void* p, size_t size, bool* is_zero);
 bool        _mi_os_decommit(void* addr, size_t size);
 bool        _mi_os_protect(void* addr, size_t size);
 bool        _mi_os_unprotect(void* addr, size_t size);
 bool        _mi_os_purge(void* p, size_t size);
 bool        _mi_os_purge_ex(void* p, size_t size, bool allow_reset, size_t stat_size);
+bool        _mi_os_purge_is_zero(void);
+bool        _mi_os_zero_decommit(void* p, size_t size);
+void        _mi_os_purge_batch_init(mi_os_purge_batch_t* batch);
+bool        _mi_os_purge_batch_add(mi_os_purge_batch_t* batch, void* p, size_t size);
+bool        _mi_os_purge_batch_flush(mi_os_purge_batch_t* batch, bool* is_zero);
 
 void*       _mi_os_alloc_aligned(size_t size, size_t alignment, bool commit, bool allow_large, mi_memid_t* memid);
 void*       _mi_os_alloc_aligned_at_offset(size_t size, size_t alignment, size_t align_offset, bool commit, bool allow_large, mi_memid_t* memid);
+void*       _mi_os_remap(void* addr, size_t size, size_t newsize, size_t alignment, mi_memid_t* memid);
 
 void*       _mi_os_get_aligned_hint(size_t try_alignment, size_t size);
 bool        _mi_os_use_large_page(size_t size, size_t alignment);
 size_t      _mi_os_large_page_size(void);
+size_t      _mi_os_thp_size(void);
 
 void*       _mi_os_alloc_huge_os_pages(size_t pages, int numa_node, mi_msecs_t max_secs, size_t* pages_reserved, size_t* psize, mi_memid_t* memid);
 
@@ -147,9 +167,19 @@ void        _mi_arena_free(void* p, size_t size, size_t still_committed_size, mi
 void*       _mi_arena_alloc(size_t size, bool commit, bool allow_large, mi_arena_id_t req_arena_id, mi_memid_t* memid);
 void*       _mi_arena_alloc_aligned(size_t size, size_t alignment, size_t align_offset, bool commit, bool allow_large, mi_arena_id_t req_arena_id, mi_memid_t* memid);
 bool        _mi_arena_memid_is_suitable(mi_memid_t memid, mi_arena_id_t request_arena_id);
+int         _mi_arena_memid_numa_node(mi_memid_t memid);
+bool        _mi_arena_memid_is_os_backed(mi_memid_t memid);
 bool        _mi_arena_contains(const void* p);
 void        _mi_arenas_collect(bool force_purge);
+void        _mi_arenas_collect_part(size_t part, size_t parts);
+void        _mi_arenas_purger_done(void);
+void        _mi_arenas_reserve_done(void);
+void        _mi_arenas_reserve_startup(bool defer);
+long        _mi_purge_delay_adapt(long delay);
+void        _mi_purge_adapt_reused(mi_msecs_t purged_at, long delay);
+bool        _mi_mem_pressure_poll(void);
 void        _mi_arena_unsafe_destroy_all(void);
+bool        _mi_arena_stats_at(size_t arena_index, mi_arena_stats_t* stats);
 
 bool        _mi_arena_segment_clear_abandoned(mi_segment_t* segment);
 void        _mi_arena_segment_mark_abandoned(mi_segment_t* segment);
@@ -158,14 +188,20 @@ void*       _mi_arena_meta_zalloc(size_t size, mi_memid_t* memid);
 void        _mi_arena_meta_free(void* p, mi_memid_t memid, size_t size);
 
 typedef struct mi_arena_field_cursor_s { // abstract struct
-  size_t         os_list_count;           // max entries to visit in the OS abandoned list
+  size_t         os_list_count;           // max entries to visit in the current OS abandoned shard
+  size_t         os_shard;                // current OS abandoned shard (may need to be wrapped)
+  size_t         os_shard_end;            // end OS abandoned shard (exclusive, may need to be wrapped)
   size_t         start;                   // start arena idx (may need to be wrapped)
   size_t         end;                     // end arena idx (exclusive, may need to be wrapped)
   size_t         bitmap_idx;              // current bit idx for an arena
   mi_subproc_t*  subproc;                 // only visit blocks in this sub-process
   bool           visit_all;               // ensure all abandoned blocks are seen (blocking)
-  bool           hold_visit_lock;         // if the subproc->abandoned_os_visit_lock is held
+  bool           hold_visit_lock;         // if the visit lock of the current OS abandoned shard is held
+  int            numa_node;               // if >= 0, first visit the arena's on this numa node (and then the others)
+  size_t         fit_slices;              // if > 0, only visit segments with a free span of at least `fit_slices` ...
+  size_t         fit_bins;                // ... or with available blocks in one of these bins (see `mi_abandoned_fit_bin`)
 } mi_arena_field_cursor_t;
+void          _mi_subproc_init(mi_subproc_t* subproc);
 void          _mi_arena_field_cursor_init(mi_heap_t* heap, mi_subproc_t* subproc, bool visit_all, mi_arena_field_cursor_t* current);
 mi_segment_t* _mi_arena_segment_clear_abandoned_next(mi_arena_field_cursor_t* previous);
 void          _mi_arena_field_cursor_done(mi_arena_field_cursor_t* current);
@@ -177,10 +213,14 @@ void        _mi_segment_map_unsafe_destroy(void);
 
 // "segment.c"
 mi_page_t* _mi_segment_page_alloc(mi_heap_t* heap, size_t block_size, size_t page_alignment, mi_segments_tld_t* tld);
+bool       _mi_segment_large_page_try_extend(mi_page_t* page, size_t block_size, mi_segments_tld_t* tld);
+bool       _mi_segment_page_zero_decommit(mi_page_t* page, void* p, size_t size);
+mi_page_t* _mi_segment_huge_page_try_remap(mi_page_t* page, size_t required, mi_segments_tld_t* tld);
 void       _mi_segment_page_free(mi_page_t* page, bool force, mi_segments_tld_t* tld);
 void       _mi_segment_page_abandon(mi_page_t* page, mi_segments_tld_t* tld);
 bool       _mi_segment_try_reclaim_abandoned( mi_heap_t* heap, bool try_all, mi_segments_tld_t* tld);
 void       _mi_segment_collect(mi_segment_t* segment, bool force);
+void       _mi_segment_batch_release(mi_segment_batch_t* batch, size_t part);
 
 #if MI_HUGE_PAGE_ABANDON
 void        _mi_segment_huge_page_free(mi_segment_t* segment, mi_page_t* page, mi_block_t* block);
@@ -191,20 +231,27 @@ void        _mi_segment_huge_page_reset(mi_segment_t* segment, mi_page_t* page,
 uint8_t*   _mi_segment_page_start(const mi_segment_t* segment, const mi_page_t* page, size_t* page_size); // page start for any page
 void       _mi_abandoned_reclaim_all(mi_heap_t* heap, mi_segments_tld_t* tld);
 void       _mi_abandoned_collect(mi_heap_t* heap, bool force, mi_segments_tld_t* tld);
+void       _mi_abandoned_purge(mi_subproc_t* subproc, bool force);
+void       _mi_segments_purge_requested(mi_heap_t* heap);
 bool       _mi_segment_attempt_reclaim(mi_heap_t* heap, mi_segment_t* segment);
+bool       _mi_segment_reattach(mi_segment_t* segment, size_t block_index, mi_arena_id_t arena_id, bool is_exclusive, mi_subproc_t* subproc);
 bool       _mi_segment_visit_blocks(mi_segment_t* segment, int heap_tag, bool visit_blocks, mi_block_visit_fun* visitor, void* arg);
 
 // "page.c"
 void*       _mi_malloc_generic(mi_heap_t* heap, size_t size, bool zero, size_t huge_alignment)  mi_attr_noexcept mi_attr_malloc;
 
 void        _mi_page_retire(mi_page_t* page) mi_attr_noexcept;                  // free the page if there are no other pages with many free blocks
+mi_page_t*  _mi_page_try_grow(mi_page_t* page, size_t size);                  // grow the block of a large or huge page in place (for realloc)
 void        _mi_page_unfull(mi_page_t* page);
+void        _mi_page_exclude(mi_page_t* page);                                 // move to the full list so no blocks are allocated from it
 void        _mi_page_free(mi_page_t* page, mi_page_queue_t* pq, bool force);   // free the page
 void        _mi_page_abandon(mi_page_t* page, mi_page_queue_t* pq);            // abandon the page, to be picked up by another thread...
 void        _mi_page_force_abandon(mi_page_t* page);
 
 void        _mi_heap_delayed_free_all(mi_heap_t* heap);
 bool        _mi_heap_delayed_free_partial(mi_heap_t* heap);
+bool        _mi_heap_delayed_free_is_empty(mi_heap_t* heap);
+void        _mi_heap_delayed_free_push(mi_heap_t* heap, size_t shard, mi_block_t* block);
 void        _mi_heap_collect_retired(mi_heap_t* heap, bool force);
 
 void        _mi_page_use_delayed_free(mi_page_t* page, mi_delayed_t delay, bool override_never);
@@ -226,8 +273,13 @@ void        _mi_heap_set_default_direct(mi_heap_t* heap);
 bool        _mi_heap_memid_is_suitable(mi_heap_t* heap, mi_memid_t memid);
 void        _mi_heap_unsafe_destroy_all(mi_heap_t* heap);
 mi_heap_t*  _mi_heap_by_tag(mi_heap_t* heap, uint8_t tag);
+const mi_heap_tag_policy_t* _mi_heap_tag_policy(uint8_t tag);
 void        _mi_heap_area_init(mi_heap_area_t* area, mi_page_t* page);
 bool        _mi_heap_area_visit_blocks(const mi_heap_area_t* area, mi_page_t* page, mi_block_visit_fun* visitor, void* arg);
+void        _mi_heap_sample_alloc(mi_heap_t* heap, mi_page_t* page, mi_block_t* block, size_t size, void* return_address);
+void        _mi_heap_sample_free(mi_page_t* page, mi_block_t* block);
+void        _mi_heap_sample_page_free(mi_page_t* page);
+void        _mi_heap_tcache_flush(mi_heap_t* heap);
 
 // "stats.c"
 void        _mi_stats_done(mi_stats_t* stats);
@@ -244,6 +296,7 @@ void*       _mi_heap_malloc_zero_ex(mi_heap_t* heap, size_t size, bool zero, siz
 void*       _mi_heap_realloc_zero(mi_heap_t* heap, void* p, size_t newsize, bool zero) mi_attr_noexcept;
 mi_block_t* _mi_page_ptr_unalign(const mi_page_t* page, const void* p);
 bool        _mi_free_delayed_block(mi_block_t* block);
+void        _mi_free_remote_flush(mi_tld_t* tld);                                    // flush pending cross-thread frees (from `mi_option_remote_free_batch`)
 void        _mi_free_generic(mi_segment_t* segment, mi_page_t* page, bool is_local, void* p) mi_attr_noexcept;  // for runtime integration
 void        _mi_padding_shrink(const mi_page_t* page, const mi_block_t* block, const size_t min_size);
 
@@ -267,6 +320,15 @@ bool        _mi_page_is_valid(mi_page_t* page);
 #define mi_likely(x)       (x)
 #endif
 
+// prefetch memory that is soon written to (like a block that is about to be allocated)
+#if defined(__GNUC__) || defined(__clang__)
+#define mi_prefetch(p)     __builtin_prefetch((p),1)
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#define mi_prefetch(p)     _mm_prefetch((const char*)(p),_MM_HINT_T0)
+#else
+#define mi_prefetch(p)     ((void)(p))
+#endif
+
 #ifndef __has_builtin
 #define __has_builtin(x)  0
 #endif
@@ -446,6 +508,13 @@ static inline bool mi_heap_is_backing(const mi_heap_t* heap) {
   return (heap->tld->heap_backing == heap);
 }
 
+// A leased per-CPU heap is only used as the default heap of a thread (see `init.c`); the
+// API exposes the backing heap of the thread instead (which is the host of the leased heap).
+static inline mi_heap_t* _mi_heap_cpu_host(mi_heap_t* heap) {
+  mi_heap_t* const host = heap->fiber_host;
+  return (host != NULL && host->tld->cpu_heap == heap ? host : heap);
+}
+
 static inline bool mi_heap_is_initialized(mi_heap_t* heap) {
   mi_assert_internal(heap != NULL);
   return (heap != NULL && heap != &_mi_heap_empty);
@@ -508,6 +577,25 @@ static inline mi_slice_t* mi_slice_first(const mi_slice_t* slice) {
   return start;
 }
 
+// The free space summary of an abandoned segment (`segment->abandoned_fit`) is used to quickly
+// find segments that can satisfy a reclaim request: the low bits hold the largest free span (in slices),
+// and the other bits are a (folded) bitmask of the bins that have pages with available blocks.
+#define MI_ABANDONED_FIT_SPAN_BITS  (16)
+#define MI_ABANDONED_FIT_SPAN_MASK  (((size_t)1 << MI_ABANDONED_FIT_SPAN_BITS) - 1)
+
+static inline size_t mi_abandoned_fit_bin(size_t bin) {
+  return ((size_t)1 << (MI_ABANDONED_FIT_SPAN_BITS + (bin % (MI_SIZE_BITS - MI_ABANDONED_FIT_SPAN_BITS))));
+}
+
+static inline size_t mi_abandoned_fit_span(size_t fit, size_t slice_count) {
+  const size_t span = (slice_count > MI_ABANDONED_FIT_SPAN_MASK ? MI_ABANDONED_FIT_SPAN_MASK : slice_count);
+  return ((fit & MI_ABANDONED_FIT_SPAN_MASK) >= span ? fit : ((fit & ~MI_ABANDONED_FIT_SPAN_MASK) | span));
+}
+
+static inline bool mi_abandoned_fit_matches(size_t fit, size_t slices_needed, size_t bins) {
+  return ((fit & MI_ABANDONED_FIT_SPAN_MASK) >= slices_needed || (fit & bins) != 0);
+}
+
 // Get the page containing the pointer (performance critical as it is called in mi_free)
 static inline mi_page_t* _mi_segment_page_of(const mi_segment_t* segment, const void* p) {
   mi_assert_internal(p > (void*)segment);
@@ -547,6 +635,13 @@ static inline bool mi_page_is_huge(const mi_page_t* page) {
   return page->is_huge;
 }
 
+// Get the shard of the heap delayed free list for blocks in this page.
+// Neighbouring pages (and pages of the same size class) are spread over the shards.
+static inline size_t mi_page_delayed_shard(const mi_page_t* page) {
+  const uint32_t h = (uint32_t)((uintptr_t)page / sizeof(mi_page_t)) * 0x9E3779B9UL;
+  return (h >> 16) & (MI_DELAYED_SHARDS - 1);
+}
+
 // Get the usable block size of a page without fixed padding.
 // This may still include internal padding due to alignment and rounding up size classes.
 static inline size_t mi_page_usable_block_size(const mi_page_t* page) {
@@ -562,13 +657,59 @@ static inline uint8_t* mi_segment_end(mi_segment_t* segment) {
   return (uint8_t*)segment + mi_segment_size(segment);
 }
 
+// Thread free list helpers (see `mi_thread_free_t`)
+static inline mi_delayed_t mi_tf_delayed(mi_thread_free_t tf) {
+  return (mi_delayed_t)(tf & 0x03);
+}
+static inline mi_thread_free_t mi_tf_set_delayed(mi_thread_free_t tf, mi_delayed_t delayed) {
+  return ((tf & ~(mi_thread_free_t)0x03) | (mi_thread_free_t)delayed);
+}
+static inline mi_thread_free_t mi_tf_clear(mi_thread_free_t tf) {  // empty the list (but keep the delayed state)
+  return (tf & 0x03);
+}
+
+#if MI_TF_SPLICE
+static inline mi_block_t* mi_tf_ofs_block(const mi_page_t* page, mi_thread_free_t tf, size_t shift) {
+  return (mi_block_t*)(page->page_start + (((tf >> shift) & MI_TF_OFS_MASK) * MI_INTPTR_SIZE));
+}
+static inline mi_thread_free_t mi_tf_block_ofs(const mi_page_t* page, const mi_block_t* block, size_t shift) {
+  const size_t ofs = (size_t)((const uint8_t*)block - page->page_start) / MI_INTPTR_SIZE;
+  mi_assert_internal((const uint8_t*)block >= page->page_start && ofs <= MI_TF_OFS_MASK);
+  return ((mi_thread_free_t)ofs << shift);
+}
+static inline size_t mi_tf_count(mi_thread_free_t tf) {
+  return (size_t)(tf >> MI_TF_COUNT_SHIFT);
+}
+static inline mi_block_t* mi_tf_block(const mi_page_t* page, mi_thread_free_t tf) {
+  return (mi_tf_count(tf) == 0 ? NULL : mi_tf_ofs_block(page, tf, MI_TF_HEAD_SHIFT));
+}
+static inline mi_block_t* mi_tf_tail(const mi_page_t* page, mi_thread_free_t tf) {
+  return (mi_tf_count(tf) == 0 ? NULL : mi_tf_ofs_block(page, tf, MI_TF_TAIL_SHIFT));
+}
+// Prepend the list `head` to `tail` with `count` blocks; the caller links `tail` to `mi_tf_block(page,tf)`
+static inline mi_thread_free_t mi_tf_push(const mi_page_t* page, mi_thread_free_t tf, mi_block_t* head, mi_block_t* tail, size_t count) {
+  mi_assert_internal(mi_tf_count(tf) + count <= MI_TF_COUNT_MAX);
+  const mi_thread_free_t tailx = (mi_tf_count(tf) == 0 ? mi_tf_block_ofs(page, tail, MI_TF_TAIL_SHIFT) : (tf & (MI_TF_OFS_MASK << MI_TF_TAIL_SHIFT)));
+  return (((mi_thread_free_t)(mi_tf_count(tf) + count) << MI_TF_COUNT_SHIFT) | tailx | mi_tf_block_ofs(page, head, MI_TF_HEAD_SHIFT) | (tf & 0x03));
+}
+#else
+static inline mi_block_t* mi_tf_block(const mi_page_t* page, mi_thread_free_t tf) {
+  MI_UNUSED(page);
+  return (mi_block_t*)(tf & ~(mi_thread_free_t)0x03);
+}
+static inline mi_thread_free_t mi_tf_push(const mi_page_t* page, mi_thread_free_t tf, mi_block_t* head, mi_block_t* tail, size_t count) {
+  MI_UNUSED(page); MI_UNUSED(tail); MI_UNUSED(count);
+  return ((mi_thread_free_t)head | (tf & 0x03));
+}
+#endif
+
 // Thread free access
 static inline mi_block_t* mi_page_thread_free(const mi_page_t* page) {
-  return (mi_block_t*)(mi_atomic_load_relaxed(&((mi_page_t*)page)->xthread_free) & ~3);
+  return mi_tf_block(page, mi_atomic_load_relaxed(&((mi_page_t*)page)->xthread_free));
 }
 
 static inline mi_delayed_t mi_page_thread_free_flag(const mi_page_t* page) {
-  return (mi_delayed_t)(mi_atomic_load_relaxed(&((mi_page_t*)page)->xthread_free) & 3);
+  return mi_tf_delayed(mi_atomic_load_relaxed(&((mi_page_t*)page)->xthread_free));
 }
 
 // Heap access
@@ -582,23 +723,6 @@ static inline void mi_page_set_heap(mi_page_t* page, mi_heap_t* heap) {
   if (heap != NULL) { page->heap_tag = heap->tag; }
 }
 
-// Thread free flag helpers
-static inline mi_block_t* mi_tf_block(mi_thread_free_t tf) {
-  return (mi_block_t*)(tf & ~0x03);
-}
-static inline mi_delayed_t mi_tf_delayed(mi_thread_free_t tf) {
-  return (mi_delayed_t)(tf & 0x03);
-}
-static inline mi_thread_free_t mi_tf_make(mi_block_t* block, mi_delayed_t delayed) {
-  return (mi_thread_free_t)((uintptr_t)block | (uintptr_t)delayed);
-}
-static inline mi_thread_free_t mi_tf_set_delayed(mi_thread_free_t tf, mi_delayed_t delayed) {
-  return mi_tf_make(mi_tf_block(tf),delayed);
-}
-static inline mi_thread_free_t mi_tf_set_block(mi_thread_free_t tf, mi_block_t* block) {
-  return mi_tf_make(block, mi_tf_delayed(tf));
-}
-
 // are all blocks in a page freed?
 // note: needs up-to-date used count, (as the `xthread_free` list may not be empty). see `_mi_page_collect_free`.
 static inline bool mi_page_all_free(const mi_page_t* page) {
@@ -618,6 +742,17 @@ static inline bool mi_page_immediate_available(const mi_page_t* page) {
   return (page->free != NULL);
 }
 
+// are there blocks available in the bump region of a page, i.e. the fresh capacity `[capacity,reserved)`
+// that is handed out before building a free list? (see `mi_option_page_bump`)
+static inline bool mi_page_bump_available(const mi_heap_t* heap, const mi_page_t* page) {
+  #if (MI_SECURE==0)
+  return (heap->page_bump && page->free == NULL && page->capacity < page->reserved);
+  #else
+  MI_UNUSED(heap); MI_UNUSED(page);
+  return false;
+  #endif
+}
+
 // is more than 7/8th of a page in use?
 static inline bool mi_page_is_mostly_used(const mi_page_t* page) {
   if (page==NULL) return true;
@@ -650,6 +785,36 @@ static inline void mi_page_set_has_aligned(mi_page_t* page, bool has_aligned) {
   page->flags.x.has_aligned = has_aligned;
 }
 
+// Does the page contain blocks that are recorded for heap profiling (see `heap.c:_mi_heap_sample_alloc`)?
+static inline bool mi_page_has_sampled(const mi_page_t* page) {
+  return page->flags.x.has_sampled;
+}
+
+static inline void mi_page_set_has_sampled(mi_page_t* page, bool has_sampled) {
+  page->flags.x.has_sampled = has_sampled;
+}
+
+// Are freed blocks of the page kept in the free cache of its heap (see `free.c:mi_heap_tcache_push`)?
+// Such pages take the generic free path so the cache is not checked on the `mi_free` fast path.
+static inline bool mi_page_has_free_cache(const mi_page_t* page) {
+  return page->flags.x.has_free_cache;
+}
+
+static inline void mi_page_set_has_free_cache(mi_page_t* page, const mi_heap_t* heap) {
+  page->flags.x.has_free_cache = (MI_SECURE == 0 && heap->tcache_max != 0 && mi_page_block_size(page) / MI_INTPTR_SIZE < MI_TCACHE_SLOTS);
+}
+
+// Is an allocation of `size` with the given `alignment` satisfied by a regular allocation?
+// Objects up to `MI_MAX_ALIGN_GUARANTEE` are allocated aligned to their size (see `segment.c:_mi_segment_page_start`),
+// and such aligned allocations always point to the start of a block.
+static inline bool _mi_malloc_is_naturally_aligned(size_t size, size_t alignment) {
+  mi_assert_internal(_mi_is_power_of_two(alignment) && (alignment > 0));
+  if (alignment > size) return false;
+  if (alignment <= MI_MAX_ALIGN_SIZE) return true;
+  const size_t bsize = mi_good_size(size);
+  return (bsize <= MI_MAX_ALIGN_GUARANTEE && (bsize & (alignment-1)) == 0);
+}
+
 /* -------------------------------------------------------------------
   Guarded objects
 ------------------------------------------------------------------- */
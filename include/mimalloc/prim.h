@@ -30,6 +30,7 @@ typedef struct mi_os_mem_config_s {
   bool    has_overcommit;       // can we reserve more memory than can be actually committed?
   bool    has_partial_free;     // can allocated blocks be freed partially? (true for mmap, false for VirtualAlloc)
   bool    has_virtual_reserve;  // supports virtual address space reservation? (if true we can reserve virtual address space without using commit or physical memory)
+  bool    has_zero_decommit;    // does decommitted (anonymous) memory read as zero once it is used again? (true for `MADV_DONTNEED` on Linux and `MEM_DECOMMIT` on Windows)
 } mi_os_mem_config_t;
 
 // Initialize
@@ -66,6 +67,39 @@ int _mi_prim_reset(void* addr, size_t size);
 // Protect memory. Returns error code or 0 on success.
 int _mi_prim_protect(void* addr, size_t size, bool protect);
 
+// Decommit (or reset if not `decommit`) a vector of page aligned ranges with a single system call.
+// Returns error code or 0 on success; on an error (like `ENOTSUP`) the caller purges the ranges one by one.
+// pre: needs_recommit != NULL, count <= MI_OS_PURGE_BATCH_MAX
+int _mi_prim_purge_vec(const mi_os_range_t* ranges, size_t count, bool decommit, bool* needs_recommit);
+
+// Populate (prefault) committed memory so the first access does not page fault (see `mi_option_populate`).
+// Returns error code or 0 on success; on an error (like `ENOTSUP`) the caller touches the memory instead.
+int _mi_prim_populate(void* addr, size_t size);
+
+// Grow a mapping of `size` bytes at `addr` to `newsize` bytes without copying its contents.
+// If the mapping cannot grow in place it may move to a new address aligned to `alignment` (in `newaddr`).
+// On failure the original mapping is unchanged. Returns error code or 0 on success (and `ENOTSUP` if not supported).
+// pre: `addr` is `alignment` aligned, and `size < newsize` are multiples of the OS page size
+int _mi_prim_remap(void* addr, size_t size, size_t newsize, size_t alignment, void** newaddr);
+
+// Open (or create) the file at `path` for reading and writing. Returns error code or 0 on success (and `ENOTSUP` if not supported).
+int _mi_prim_file_open(const char* path, int* fd);
+
+// Close a file opened with `_mi_prim_file_open`.
+void _mi_prim_file_close(int fd);
+
+// Get the size of an open file. Returns error code or 0 on success.
+int _mi_prim_file_size(int fd, size_t* size);
+
+// Read `size` bytes at `offset` from an open file. Returns error code or 0 on success.
+int _mi_prim_file_read(int fd, size_t offset, void* buf, size_t size);
+
+// Map an open file as shared read/write memory of `size` bytes, extending the file if needed.
+// If `addr` is not NULL the file is mapped at exactly that address (and fails with `EEXIST` if that is not possible),
+// and otherwise at an address aligned to `alignment`. The mapping stays valid after the file is closed
+// and is unmapped with `_mi_prim_free`. Returns error code or 0 on success.
+int _mi_prim_file_map(int fd, size_t size, void* addr, size_t alignment, void** mapped);
+
 // Allocate huge (1GiB) pages possibly associated with a NUMA node.
 // `is_zero` is set to true if the memory was zero initialized (as on most OS's)
 // pre: size > 0  and a multiple of 1GiB.
@@ -81,6 +115,9 @@ size_t _mi_prim_numa_node_count(void);
 // Clock ticks
 mi_msecs_t _mi_prim_clock_now(void);
 
+// High resolution clock in nano-seconds (only used for latency sampling)
+int64_t _mi_prim_clock_nsecs(void);
+
 // Return process information (only for statistics)
 typedef struct mi_process_info_s {
   mi_msecs_t  elapsed;
@@ -117,6 +154,30 @@ void _mi_prim_thread_done_auto_done(void);
 // Called when the default heap for a thread changes
 void _mi_prim_thread_associate_default_heap(mi_heap_t* heap);
 
+// Start a (detached) background thread that runs `fun(arg)`; returns `false` if this is not supported.
+// (used for background purging)
+bool _mi_prim_thread_start(void (*fun)(void* arg), void* arg);
+
+// Sleep the current thread for about `msecs` milli-seconds.
+void _mi_prim_thread_sleep(mi_msecs_t msecs);
+
+// Call `fun` in the child process after a `fork` (if supported). Background threads are not
+// inherited by the child, so this is used to reset their state.
+void _mi_prim_thread_atfork_child(void (*fun)(void));
+
+// Start monitoring the memory pressure of the process (on Linux through the `memory.pressure`
+// or `memory.events` files of its cgroup); returns `false` if this is not supported.
+// Only called once (see `arena.c:_mi_mem_pressure_poll`).
+bool _mi_prim_mem_pressure_init(void);
+
+// Returns `true` if there was memory pressure since the previous poll (without blocking).
+// Not called concurrently.
+bool _mi_prim_mem_pressure_poll(void);
+
+// Return the index of the CPU the current thread runs on, or `SIZE_MAX` if not supported.
+// The result can be stale by the time it is used (and is only used to select a per-CPU heap).
+size_t _mi_prim_cpu_id(void);
+
 
 
 
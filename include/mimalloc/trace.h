@@ -0,0 +1,60 @@
+/* ----------------------------------------------------------------------------
+Copyright (c) 2018-2025, Microsoft Research, Daan Leijen
+This is free software; you can redistribute it and/or modify it under the
+terms of the MIT license. A copy of the license can be found in the file
+"LICENSE" at the root of this distribution.
+-----------------------------------------------------------------------------*/
+#pragma once
+#ifndef MIMALLOC_TRACE_H
+#define MIMALLOC_TRACE_H
+
+/* ------------------------------------------------------------------------------------------------------
+The binary format of allocation trace files written by a `MI_TRACK_TRACE=1` build (see `src/trace.c`).
+This header only depends on `<stdint.h>` so tools can read traces (see `test/test-trace-replay.c`).
+
+A trace file starts with a `mi_trace_header_t` followed by `mi_trace_record_t` records.
+All fields are in the native byte order of the traced process (as indicated by `MI_TRACE_MAGIC`).
+
+- `size` is the number of bytes of records that follow the header. The file itself can be
+  larger (up to the maximal trace size) where the remainder is zero.
+- Records are appended in batches per thread, so records from different threads are not ordered
+  in the file; sort them on `nsecs` (and keep the file order for equal timestamps) to get a
+  global order. Per thread the records are always in program order.
+- A record with `op == MI_TRACE_OP_NONE` was reserved but not yet written when the trace was
+  read (for example if the process was killed) and should be skipped.
+- `dropped` is the number of records that were lost as the trace file was full.
+-------------------------------------------------------------------------------------------------------*/
+
+#include <stdint.h>
+
+#define MI_TRACE_MAGIC      (0x6563617274696D00ULL)  // "\0mitrace" in little-endian
+#define MI_TRACE_VERSION    (1)
+
+typedef enum mi_trace_op_e {
+  MI_TRACE_OP_NONE   = 0,     // not written (yet)
+  MI_TRACE_OP_MALLOC = 1,     // `size` is the requested size
+  MI_TRACE_OP_FREE   = 2      // `size` is 0
+} mi_trace_op_t;
+
+// 32 bytes per record
+typedef struct mi_trace_record_s {
+  uint64_t nsecs;             // nano seconds since the start of the trace
+  uint64_t ptr;               // the block address
+  uint64_t size;              // size in bytes
+  uint32_t thread;            // small thread id (starting at 1; ids are reused after a thread terminates)
+  uint32_t op;                // a `mi_trace_op_t`
+} mi_trace_record_t;
+
+// 64 bytes
+typedef struct mi_trace_header_s {
+  uint64_t magic;             // `MI_TRACE_MAGIC`
+  uint32_t version;           // `MI_TRACE_VERSION`
+  uint32_t record_size;       // `sizeof(mi_trace_record_t)`
+  int64_t  size;              // bytes of records following this header
+  int64_t  dropped;           // number of records that did not fit in the file
+  uint64_t capacity;          // maximal bytes of records
+  uint64_t start_nsecs;       // process local clock at the start of the trace
+  uint64_t reserved[2];
+} mi_trace_header_t;
+
+#endif
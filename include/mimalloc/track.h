@@ -28,11 +28,14 @@ Optional:
   #define mi_track_align(p,alignedp,offset,size)
   #define mi_track_resize(p,oldsize,newsize)
   #define mi_track_init()
+  #define mi_track_thread_done()
+  #define mi_track_done()
 
 The `mi_track_align` is called right after a `mi_track_malloc` for aligned pointers in a block.
 The corresponding `mi_track_free` still uses the block start pointer and original size (corresponding to the `mi_track_malloc`).
 The `mi_track_resize` is currently unused but could be called on reallocations within a block.
-`mi_track_init` is called at program start.
+`mi_track_init` is called at program start, `mi_track_thread_done` when a thread terminates,
+and `mi_track_done` at program exit.
 
 The following macros are for tools like asan and valgrind to track whether memory is
 defined, undefined, or not accessible at all:
@@ -88,6 +91,25 @@ defined, undefined, or not accessible at all:
 #define mi_track_malloc_size(p,reqsize,size,zero) EventWriteETW_MI_ALLOC((UINT64)(p), size)
 #define mi_track_free_size(p,size)                EventWriteETW_MI_FREE((UINT64)(p), size)
 
+#elif MI_TRACK_TRACE
+// binary allocation traces (see `src/trace.c` and `mimalloc/trace.h`)
+
+#define MI_TRACK_ENABLED      0           // no need to disable any checks
+#define MI_TRACK_HEAP_DESTROY 1
+#define MI_TRACK_TOOL         "trace"
+
+void _mi_trace_init(void);
+void _mi_trace_done(void);
+void _mi_trace_thread_done(void);
+void _mi_trace_malloc(const void* p, size_t size);
+void _mi_trace_free(const void* p);
+
+#define mi_track_init()                           _mi_trace_init()
+#define mi_track_thread_done()                    _mi_trace_thread_done()
+#define mi_track_done()                           _mi_trace_done()
+#define mi_track_malloc_size(p,reqsize,size,zero) _mi_trace_malloc(p,reqsize)
+#define mi_track_free_size(p,size)                _mi_trace_free(p)   // note: `size` is not evaluated as the padding may be overwritten already in debug mode
+
 #else
 // no tracking
 
@@ -115,6 +137,14 @@ defined, undefined, or not accessible at all:
 #define mi_track_init()
 #endif
 
+#ifndef mi_track_thread_done
+#define mi_track_thread_done()
+#endif
+
+#ifndef mi_track_done
+#define mi_track_done()
+#endif
+
 #ifndef mi_track_mem_defined
 #define mi_track_mem_defined(p,size)
 #endif
@@ -210,6 +210,9 @@ typedef int32_t  mi_ssize_t;
 #error "mimalloc internal: define more bins"
 #endif
 
+// Slots of the per heap free cache (see `mi_option_free_cache`), indexed by the word size of the block size (up to `MI_SMALL_SIZE_MAX`)
+#define MI_TCACHE_SLOTS  (MI_SMALL_WSIZE_MAX + 1)
+
 // Maximum block size for which blocks are guaranteed to be block size aligned. (see `segment.c:_mi_segment_page_start`)
 #define MI_MAX_ALIGN_GUARANTEE            (MI_MEDIUM_OBJ_SIZE_MAX)
 
@@ -260,15 +263,35 @@ typedef enum mi_delayed_e {
   MI_NEVER_DELAYED_FREE = 3  // sticky: used for abandoned pages without a owning heap; this only resets on page reclaim
 } mi_delayed_t;
 
+// The heap delayed free list is sharded by page so that threads freeing into
+// different full pages do not contend on one list (see `free.c:mi_free_block_delayed_mt`).
+// Each shard is on its own cache line, and a summary mask in the heap flags the shards
+// that may be non-empty so the owner only checks a single word when there is nothing to do.
+// (must be a power of 2, at most the bits in a `uintptr_t`)
+#ifndef MI_DELAYED_SHARDS
+#define MI_DELAYED_SHARDS  (4)
+#endif
+
+#if (MI_DELAYED_SHARDS <= 0) || ((MI_DELAYED_SHARDS & (MI_DELAYED_SHARDS-1)) != 0) || (MI_DELAYED_SHARDS > MI_INTPTR_BITS)
+#error "mimalloc internal: MI_DELAYED_SHARDS must be a power of 2 (and at most MI_INTPTR_BITS)"
+#endif
+
+typedef struct mi_delayed_shard_s {
+  _Atomic(mi_block_t*)  list;                      // blocks in (formerly) full pages freed by other threads
+  uint8_t               padding[64 - sizeof(void*)];
+} mi_delayed_shard_t;
+
 
-// The `in_full` and `has_aligned` page flags are put in a union to efficiently
-// test if both are false (`full_aligned == 0`) in the `mi_free` routine.
+// The `in_full`, `has_aligned`, `has_sampled`, and `has_free_cache` page flags are put in a union to
+// efficiently test if all are false (`full_aligned == 0`) in the `mi_free` routine.
 #if !MI_TSAN
 typedef union mi_page_flags_s {
   uint8_t full_aligned;
   struct {
     uint8_t in_full : 1;
     uint8_t has_aligned : 1;
+    uint8_t has_sampled : 1;
+    uint8_t has_free_cache : 1;
   } x;
 } mi_page_flags_t;
 #else
@@ -278,14 +301,36 @@ typedef union mi_page_flags_s {
   struct {
     uint8_t in_full;
     uint8_t has_aligned;
+    uint8_t has_sampled;
+    uint8_t has_free_cache;
   } x;
 } mi_page_flags_t;
 #endif
 
 // Thread free list.
-// We use the bottom 2 bits of the pointer for mi_delayed_t flags
+// We use the bottom 2 bits for mi_delayed_t flags. On 64-bit, the other bits hold the offsets
+// (in words from the page start) of the first and last block, and the number of blocks in the list,
+// so the owning thread can splice the whole list onto its `local_free` list in constant time
+// (see `page.c:_mi_page_thread_free_collect`). On 32-bit, the other bits are the pointer to the first block.
+// In secure mode the list is always walked (to detect a cycle due to a double multi-threaded free)
+// so the splicing is not used.
 typedef uintptr_t mi_thread_free_t;
 
+#if (MI_INTPTR_SIZE == 8) && (MI_SECURE == 0) && !defined(MI_TF_SPLICE)
+#define MI_TF_SPLICE        1
+#endif
+#if MI_TF_SPLICE
+#define MI_TF_OFS_BITS      (22)                                    // word offset of a block in a (non-huge) page
+#define MI_TF_OFS_MASK      ((MI_ZU(1) << MI_TF_OFS_BITS) - 1)
+#define MI_TF_HEAD_SHIFT    (2)
+#define MI_TF_TAIL_SHIFT    (MI_TF_HEAD_SHIFT + MI_TF_OFS_BITS)
+#define MI_TF_COUNT_SHIFT   (MI_TF_TAIL_SHIFT + MI_TF_OFS_BITS)      // the count uses the remaining 18 bits
+#define MI_TF_COUNT_MAX     ((MI_ZU(1) << (MI_INTPTR_BITS - MI_TF_COUNT_SHIFT)) - 1)
+#if (MI_SEGMENT_SHIFT - MI_INTPTR_SHIFT > MI_TF_OFS_BITS)
+#error "the segment size is too large for the thread free list encoding (use -DMI_TF_SPLICE=0)"
+#endif
+#endif
+
 // A page contains blocks of one specific size (`block_size`).
 // Each page has three list of free blocks:
 // `free` for blocks that can be allocated,
@@ -309,10 +354,10 @@ typedef uintptr_t mi_thread_free_t;
 //   (and 14 words on 32-bit, and encoded free lists add 2 words)
 // - `xthread_free` uses the bottom bits as a delayed-free flags to optimize
 //   concurrent frees where only the first concurrent free adds to the owning
-//   heap `thread_delayed_free` list (see `free.c:mi_free_block_mt`).
+//   heap `thread_delayed_free` lists (see `free.c:mi_free_block_mt`).
 //   The invariant is that no-delayed-free is only set if there is
 //   at least one block that will be added, or as already been added, to
-//   the owning heap `thread_delayed_free` list. This guarantees that pages
+//   the owning heap `thread_delayed_free` lists. This guarantees that pages
 //   will be freed correctly even if only other threads free blocks.
 typedef struct mi_page_s {
   // "owned" by the segment
@@ -443,6 +488,22 @@ typedef struct mi_memid_s {
 } mi_memid_t;
 
 
+// A batch of address ranges to purge (see `os.c:_mi_os_purge_batch_add`). Adjacent ranges are
+// coalesced and the batch is purged with a single system call where the OS supports it.
+#define MI_OS_PURGE_BATCH_MAX  (64)
+
+typedef struct mi_os_range_s {
+  void*         start;
+  size_t        size;
+} mi_os_range_t;
+
+typedef struct mi_os_purge_batch_s {
+  size_t        count;                            // ranges in the batch
+  size_t        requests;                         // purge requests added (before coalescing)
+  mi_os_range_t ranges[MI_OS_PURGE_BATCH_MAX];
+} mi_os_purge_batch_t;
+
+
 // -----------------------------------------------------------------------------------------
 // Segments are large allocated memory blocks (32mb on 64 bit) from arenas or the OS.
 //
@@ -464,13 +525,22 @@ typedef struct mi_segment_s {
   mi_memid_t        memid;              // memory id for arena/OS allocation
   bool              allow_decommit;     // can we decommmit the memory
   bool              allow_purge;        // can we purge the memory (reset or decommit)
+  bool              populate;           // populate (prefault) the memory when it is committed (see `mi_option_populate`)
+  bool              os_backed;          // anonymous OS memory (so purged slices read as zero again, see `zero_mask`)
   size_t            segment_size;
   mi_subproc_t*     subproc;            // segment belongs to sub process
+  int               numa_node;          // numa node of the segment memory (of the arena, or of the allocating thread)
 
   // segment fields
   mi_msecs_t        purge_expire;       // purge slices in the `purge_mask` after this time
+  long              purge_delay;        // purge delay of the tag policy (or `-2` to use `mi_option_purge_delay`)
+  mi_msecs_t        commit_last;        // time of the last commit (to adapt the commit ahead size)
+  size_t            commit_ahead;       // commit this many bytes ahead on the next commit (see `mi_option_commit_ahead`)
   mi_commit_mask_t  purge_mask;         // slices that can be purged
   mi_commit_mask_t  commit_mask;        // slices that are currently committed
+  mi_commit_mask_t  purged_mask;        // slices purged at `purged_at` that were not used since (see `mi_option_purge_adaptive`)
+  mi_commit_mask_t  zero_mask;          // slices that read as zero (fresh from the OS or decommitted) and were not used since
+  mi_msecs_t        purged_at;
 
   // from here is zero initialized
   struct mi_segment_s* next;            // the list of freed segments in the cache (must be first field, see `segment.c:mi_segment_init`)
@@ -479,6 +549,7 @@ typedef struct mi_segment_s {
 
   size_t            abandoned;          // abandoned pages (i.e. the original owning thread stopped) (`abandoned <= used`)
   size_t            abandoned_visits;   // count how often this segment is visited during abondoned reclamation (to force reclaim if it takes too long)
+  size_t            abandoned_fit;      // summary of the free space when abandoned (see `mi_abandoned_fit_bin`) to quickly find a segment to reclaim
   size_t            used;               // count of pages in use
   uintptr_t         cookie;             // verify addresses in debug mode: `mi_ptr_cookie(segment) == segment->cookie`
 
@@ -550,18 +621,33 @@ typedef struct mi_padding_s {
 // A heap owns a set of pages.
 struct mi_heap_s {
   mi_tld_t*             tld;
-  _Atomic(mi_block_t*)  thread_delayed_free;
+  _Atomic(uintptr_t)    thread_delayed_mask;                 // bit `i` is set if the `thread_delayed_free[i]` shard may be non-empty
   mi_threadid_t         thread_id;                           // thread this heap belongs too
   mi_arena_id_t         arena_id;                            // arena id if the heap belongs to a specific arena (or 0)
   uintptr_t             cookie;                              // random cookie to verify pointers (see `_mi_ptr_cookie`)
-  uintptr_t             keys[2];                             // two random keys used to encode the `thread_delayed_free` list
+  uintptr_t             keys[2];                             // two random keys used to encode the `thread_delayed_free` lists
   mi_random_ctx_t       random;                              // random number context used for secure allocation
   size_t                page_count;                          // total number of pages in the `pages` queues.
+  size_t                pages_size;                          // total size in bytes of the pages in the `pages` queues.
+  size_t                limit_soft;                          // when `pages_size` reaches this, the heap is collected and the pressure callback is called (0 if unlimited)
+  size_t                limit_hard;                          // no fresh pages are allocated beyond this `pages_size` (0 if unlimited)
+  bool                  limit_pressure;                      // `true` if the soft limit was reached (until `pages_size` drops below it again)
+  mi_heap_pressure_fun* pressure_fun;                        // called when the soft limit is reached
+  void*                 pressure_arg;                        // argument for `pressure_fun`
   size_t                page_retired_min;                    // smallest retired index (retired pages are fully free, but still in the page queues)
   size_t                page_retired_max;                    // largest retired index into the `pages` array.
   mi_heap_t*            next;                                // list of heaps per thread
   bool                  no_reclaim;                          // `true` if this heap should not reclaim abandoned pages
   uint8_t               tag;                                 // custom tag, can be used for separating heaps based on the object types
+  uint8_t               page_kind;                           // preferred page kind of the tag policy (see `mi_heap_tag_set_policy`)
+  size_t                size_round;                          // if not 0, round allocation sizes up to a multiple of `size_round+1` (see `mi_heap_tag_set_policy`)
+  bool                  page_bump;                           // `true` if fresh page capacity is handed out by bumping (see `mi_option_page_bump`)
+  mi_heap_t*            fiber_host;                          // for an attached fiber heap: the backing heap of the thread it is attached to (see `mi_heap_new_fiber`)
+  mi_heap_t*            fiber_next;                          // next attached fiber heap of the same host (see `mi_tld_t.fibers`)
+  size_t                sample_count;                        // count down to the next allocation recorded for heap profiling, or 0 if disabled (see `mi_option_heap_sample_rate`)
+  uint8_t               tcache_max;                          // maximum number of cached blocks per size class (see `mi_option_free_cache`)
+  uint8_t               tcache_count[MI_TCACHE_SLOTS];       // number of cached blocks per block size
+  mi_block_t*           tcache[MI_TCACHE_SLOTS];             // LIFO list of recently freed small blocks per block size (still counted as `used` in their page)
   #if MI_GUARDED
   size_t                guarded_size_min;                    // minimal size for guarded objects
   size_t                guarded_size_max;                    // maximal size for guarded objects
@@ -571,6 +657,7 @@ struct mi_heap_s {
   #endif
   mi_page_t*            pages_free_direct[MI_PAGES_DIRECT];  // optimize: array where every entry points a page with possibly free blocks in the corresponding queue for that size.
   mi_page_queue_t       pages[MI_BIN_FULL + 1];              // queue of pages for each size class (or "bin")
+  mi_delayed_shard_t    thread_delayed_free[MI_DELAYED_SHARDS]; // blocks freed by other threads in full pages, sharded by page (see `mi_page_delayed_shard`)
 };
 
 
@@ -633,6 +720,12 @@ typedef struct mi_stat_counter_s {
   int64_t count;
 } mi_stat_counter_t;
 
+// Per numa node statistics are kept for at most MI_NUMA_STATS_MAX nodes (higher nodes wrap around)
+#define MI_NUMA_STATS_MAX  (8)
+
+// Per heap tag statistics are kept for at most MI_TAG_STATS_MAX tags (higher tags wrap around)
+#define MI_TAG_STATS_MAX   (16)
+
 typedef struct mi_stats_s {
   mi_stat_count_t segments;
   mi_stat_count_t pages;
@@ -653,7 +746,9 @@ typedef struct mi_stats_s {
   mi_stat_counter_t mmap_calls;
   mi_stat_counter_t commit_calls;
   mi_stat_counter_t reset_calls;
-  mi_stat_counter_t purge_calls;
+  mi_stat_counter_t purge_calls;        // purge system calls
+  mi_stat_counter_t purge_ranges;       // purged ranges (more than `purge_calls` when ranges are purged in one call)
+  mi_stat_counter_t zero_decommit;      // blocks zeroed by a decommit instead of a memset (see `mi_option_calloc_decommit_min`)
   mi_stat_counter_t page_no_retire;
   mi_stat_counter_t searches;
   mi_stat_counter_t normal_count;
@@ -663,6 +758,19 @@ typedef struct mi_stats_s {
   mi_stat_counter_t arena_crossover_count;
   mi_stat_counter_t arena_rollback_count;
   mi_stat_counter_t guarded_alloc_count;
+  mi_stat_counter_t pressure_events;    // count: ended episodes of memory pressure, total: their duration (in milli-seconds) (only in the main statistics)
+  mi_stat_counter_t pressure_collects;  // collections on a memory pressure signal (only in the main statistics)
+  mi_stat_counter_t purge_reused;       // reuses of purged memory within the adaptive purge delay (see `mi_option_purge_adaptive`) (only in the main statistics)
+  // per numa node statistics (always kept in the main statistics)
+  mi_stat_count_t   numa_segments[MI_NUMA_STATS_MAX];        // segments allocated on a node
+  mi_stat_counter_t numa_reclaim[MI_NUMA_STATS_MAX];         // abandoned segments reclaimed by threads on a node
+  mi_stat_counter_t numa_reclaim_remote[MI_NUMA_STATS_MAX];  // of which the segment memory was on another node
+  // per heap tag statistics (pages are always kept in the main statistics)
+  mi_stat_count_t   tag_pages[MI_TAG_STATS_MAX];             // pages in use by heaps with a tag
+  mi_stat_count_t   tag_normal[MI_TAG_STATS_MAX];            // bytes in use by small and medium blocks of heaps with a tag
+  // sampled slow path allocations per size class (also in release builds, see `mi_option_alloc_sample_rate`)
+  mi_stat_counter_t sample_bins[MI_BIN_HUGE+1];              // count: sampled allocations, total: their requested bytes
+  mi_stat_counter_t sample_bins_latency[MI_BIN_HUGE+1];      // count: sampled allocations, total: their slow path latency (in nano-seconds)
 #if MI_STAT>1
   mi_stat_count_t normal_bins[MI_BIN_HUGE+1];
 #endif
@@ -677,6 +785,8 @@ void _mi_stat_adjust_increase(mi_stat_count_t* stat, size_t amount);
 void _mi_stat_adjust_decrease(mi_stat_count_t* stat, size_t amount);
 // counters can just be increased
 void _mi_stat_counter_increase(mi_stat_counter_t* stat, size_t amount);
+// record a sampled slow path allocation (always enabled, see `mi_option_alloc_sample_rate`)
+void _mi_stat_sample_alloc(mi_stats_t* stats, size_t bin, size_t size, int64_t latency_ns);
 
 #if (MI_STAT)
 #define mi_stat_increase(stat,amount)         _mi_stat_increase( &(stat), amount)
@@ -702,13 +812,24 @@ void _mi_stat_counter_increase(mi_stat_counter_t* stat, size_t amount);
 // from other sub processes
 // ------------------------------------------------------
 
+// Abandoned segments outside of arena's (in OS allocated memory) are kept in
+// a set of shards (selected by the segment address) to reduce lock contention
+// when many threads terminate (or reclaim) at the same time.
+#define MI_ABANDONED_OS_SHARDS  (8)
+
+typedef struct mi_abandoned_os_shard_s {
+  mi_lock_t          lock;                    // lock for the abandoned os segment list (this lock protect list operations)
+  mi_lock_t          visit_lock;              // ensure only one thread at a time visits this list
+  mi_segment_t*      list;                    // doubly-linked list of abandoned segments
+  mi_segment_t*      list_tail;               // the tail-end of the list
+  _Atomic(size_t)    count;                   // count of abandoned segments in the list
+} mi_abandoned_os_shard_t;
+
 struct mi_subproc_s {
   _Atomic(size_t)    abandoned_count;         // count of abandoned segments for this sub-process
-  _Atomic(size_t)    abandoned_os_list_count; // count of abandoned segments in the os-list
-  mi_lock_t          abandoned_os_lock;       // lock for the abandoned os segment list (outside of arena's) (this lock protect list operations)
-  mi_lock_t          abandoned_os_visit_lock; // ensure only one thread per subproc visits the abandoned os list
-  mi_segment_t*      abandoned_os_list;       // doubly-linked list of abandoned segments outside of arena's (in OS allocated memory)
-  mi_segment_t*      abandoned_os_list_tail;  // the tail-end of the list
+  _Atomic(size_t)    abandoned_os_list_count; // count of abandoned segments in all the os-lists
+  _Atomic(size_t)    abandoned_os_shards;     // summary bitmap: bit `i` is set if shard `i` is (potentially) non-empty
+  mi_abandoned_os_shard_t abandoned_os[MI_ABANDONED_OS_SHARDS]; // shards of abandoned segments outside of arena's
   mi_memid_t         memid;                   // provenance of this memory block
 };
 
@@ -726,6 +847,17 @@ typedef struct mi_span_queue_s {
 
 #define MI_SEGMENT_BIN_MAX (35)     // 35 == mi_segment_bin(MI_SLICES_PER_SEGMENT)
 
+// Segments freed while a batch is installed in the segments tld are not released right away
+// but linked in one of the parts; each part is then released to the arenas and the OS by a
+// separate task (see `heap.c:mi_heap_destroy_parallel`).
+#define MI_SEGMENT_BATCH_PARTS_MAX (64)
+
+typedef struct mi_segment_batch_s {
+  size_t              parts;        // number of parts in use (at most `MI_SEGMENT_BATCH_PARTS_MAX`)
+  size_t              count;        // number of segments added (used to spread them over the parts)
+  mi_segment_t*       segments[MI_SEGMENT_BATCH_PARTS_MAX]; // list of segments per part (linked through `next`)
+} mi_segment_batch_t;
+
 // Segments thread local data
 typedef struct mi_segments_tld_s {
   mi_span_queue_t     spans[MI_SEGMENT_BIN_MAX+1];  // free slice spans inside segments
@@ -736,16 +868,41 @@ typedef struct mi_segments_tld_s {
   size_t              reclaim_count;// number of reclaimed (abandoned) segments
   mi_subproc_t*       subproc;      // sub-process this thread belongs to.
   mi_stats_t*         stats;        // points to tld stats
+  size_t              purge_epoch;  // last handled purge request (see `mi_collect_target`)
+  mi_segment_batch_t* batch;        // if not NULL, freed segments are released later (see `_mi_segment_batch_release`)
 } mi_segments_tld_t;
 
 // Thread local data
+// A thread-local "magazine" of blocks that were freed by this thread but belong to pages owned
+// by other threads. Blocks are gathered per page and pushed on the page `xthread_free` list
+// with a single CAS once a batch fills up (see `mi_option_remote_free_batch`), or when the
+// thread collects or terminates.
+#define MI_REMOTE_FREE_SLOTS  (8)
+
+typedef struct mi_remote_free_slot_s {
+  mi_page_t*          page;          // page owning the blocks (or NULL if the slot is unused)
+  mi_block_t*         head;          // first block of the batch (linked using `page` keys)
+  mi_block_t*         tail;          // last block of the batch
+  size_t              count;         // number of blocks in the batch
+} mi_remote_free_slot_t;
+
+typedef struct mi_remote_free_s {
+  size_t                 evict;                        // next slot to flush when all slots are in use
+  mi_remote_free_slot_t  slots[MI_REMOTE_FREE_SLOTS];
+} mi_remote_free_t;
+
 struct mi_tld_s {
   unsigned long long  heartbeat;     // monotonic heartbeat count
   bool                recurse;       // true if deferred was called; used to prevent infinite recursion.
   mi_heap_t*          heap_backing;  // backing heap of this thread (cannot be deleted)
   mi_heap_t*          heaps;         // list of heaps in this thread (so we can abandon all when the thread terminates)
+  mi_heap_t*          fibers;        // list of fiber heaps attached to this thread (so we can detach all when the thread terminates)
+  mi_heap_t*          cpu_heap;      // the per-CPU heap leased by this thread (see `mi_option_cpu_heaps`)
+  size_t              cpu_slot;      // the slot of the leased per-CPU heap
   mi_segments_tld_t   segments;      // segment tld
   mi_stats_t          stats;         // statistics
+  mi_remote_free_t    remote_free;   // pending cross-thread frees
+  size_t              alloc_sample_count; // countdown to the next sampled slow path allocation
 };
 
 #endif
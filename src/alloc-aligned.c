@@ -15,15 +15,6 @@ terms of the MIT license. A copy of the license can be found in the file
 // Aligned Allocation
 // ------------------------------------------------------
 
-static bool mi_malloc_is_naturally_aligned( size_t size, size_t alignment ) {
-  // objects up to `MI_MAX_ALIGN_GUARANTEE` are allocated aligned to their size (see `segment.c:_mi_segment_page_start`).
-  mi_assert_internal(_mi_is_power_of_two(alignment) && (alignment > 0));
-  if (alignment > size) return false;
-  if (alignment <= MI_MAX_ALIGN_SIZE) return true;
-  const size_t bsize = mi_good_size(size);
-  return (bsize <= MI_MAX_ALIGN_GUARANTEE && (bsize & (alignment-1)) == 0);
-}
-
 #if MI_GUARDED
 static mi_decl_restrict void* mi_heap_malloc_guarded_aligned(mi_heap_t* heap, size_t size, size_t alignment, bool zero) mi_attr_noexcept {
   // use over allocation for guarded blocksl
@@ -146,7 +137,7 @@ static mi_decl_noinline void* mi_heap_malloc_zero_aligned_at_generic(mi_heap_t*
   // use regular allocation if it is guaranteed to fit the alignment constraints.
   // this is important to try as the fast path in `mi_heap_malloc_zero_aligned` only works when there exist
   // a page with the right block size, and if we always use the over-alloc fallback that would never happen.
-  if (offset == 0 && mi_malloc_is_naturally_aligned(size,alignment)) {
+  if (offset == 0 && _mi_malloc_is_naturally_aligned(size,alignment)) {
     void* p = mi_heap_malloc_zero_no_guarded(heap, size, zero);
     mi_assert_internal(p == NULL || ((uintptr_t)p % alignment) == 0);
     const bool is_aligned_or_null = (((uintptr_t)p) & (alignment-1))==0;
@@ -160,6 +151,22 @@ static mi_decl_noinline void* mi_heap_malloc_zero_aligned_at_generic(mi_heap_t*
     }
   }
 
+  // otherwise round up the size such that the block size is a multiple of the alignment: those size classes
+  // are naturally aligned as well (as small pages start at a multiple of the block size), which avoids over-allocation
+  // and unaligning the pointer on free (and such blocks are served by the fast path in `mi_heap_malloc_zero_aligned_at`)
+  if (offset == 0 && alignment <= MI_MAX_ALIGN_GUARANTEE && size <= MI_MEDIUM_OBJ_SIZE_MAX) {
+    const size_t asize = _mi_align_up(size + MI_PADDING_SIZE, alignment) - MI_PADDING_SIZE;
+    const size_t bsize = mi_good_size(asize);
+    if (bsize <= MI_MAX_ALIGN_GUARANTEE && (bsize & (alignment-1)) == 0) {
+      void* p = mi_heap_malloc_zero_no_guarded(heap, asize, zero);
+      if mi_likely((((uintptr_t)p) & (alignment-1))==0) {
+        return p;
+      }
+      mi_assert(false);
+      mi_free(p);
+    }
+  }
+
   // fall back to over-allocation
   return mi_heap_malloc_zero_aligned_at_overalloc(heap,size,alignment,offset,zero);
 }
@@ -183,9 +190,11 @@ static void* mi_heap_malloc_zero_aligned_at(mi_heap_t* const heap, const size_t
   #endif
 
   // try first if there happens to be a small block available with just the right alignment
-  if mi_likely(size <= MI_SMALL_SIZE_MAX && alignment <= size) {
+  // (without an offset, we use the size class with a block size that is a multiple of the alignment)
+  const bool use_class = (offset == 0 && alignment <= MI_SMALL_SIZE_MAX);
+  const size_t padsize = (use_class ? _mi_align_up(size + MI_PADDING_SIZE, alignment) : size + MI_PADDING_SIZE);
+  if mi_likely(size <= MI_SMALL_SIZE_MAX && padsize <= MI_SMALL_SIZE_MAX + MI_PADDING_SIZE && (use_class || alignment <= size)) {
     const uintptr_t align_mask = alignment-1;       // for any x, `(x & align_mask) == (x % alignment)`
-    const size_t padsize = size + MI_PADDING_SIZE;
     mi_page_t* page = _mi_heap_get_free_small_page(heap, padsize);
     if mi_likely(page->free != NULL) {
       const bool is_aligned = (((uintptr_t)page->free + offset) & align_mask)==0;
@@ -197,7 +206,7 @@ static void* mi_heap_malloc_zero_aligned_at(mi_heap_t* const heap, const size_t
         void* p = (zero ? _mi_page_malloc_zeroed(heap,page,padsize) : _mi_page_malloc(heap,page,padsize)); // call specific page malloc for better codegen
         mi_assert_internal(p != NULL);
         mi_assert_internal(((uintptr_t)p + offset) % alignment == 0);
-        mi_track_malloc(p,size,zero);
+        mi_track_malloc(p,padsize - MI_PADDING_SIZE,zero);
         return p;
       }
     }
@@ -25,6 +25,41 @@ terms of the MIT license. A copy of the license can be found in the file
 // Allocation
 // ------------------------------------------------------
 
+// set the padding after a block of `size` bytes (including the padding)
+static inline void mi_block_set_padding(const mi_page_t* page, mi_block_t* block, size_t size) {
+  #if MI_PADDING // && !MI_TRACK_ENABLED
+    mi_padding_t* const padding = (mi_padding_t*)((uint8_t*)block + mi_page_usable_block_size(page));
+    ptrdiff_t delta = ((uint8_t*)padding - (uint8_t*)block - (size - MI_PADDING_SIZE));
+    #if (MI_DEBUG>=2)
+    mi_assert_internal(delta >= 0 && mi_page_usable_block_size(page) >= (size - MI_PADDING_SIZE + delta));
+    #endif
+    mi_track_mem_defined(padding,sizeof(mi_padding_t));  // note: re-enable since mi_page_usable_block_size may set noaccess
+    padding->canary = mi_ptr_encode_canary(page,block,page->keys);
+    padding->delta  = (uint32_t)(delta);
+    #if MI_PADDING_CHECK
+    if (!mi_page_is_huge(page)) {
+      uint8_t* fill = (uint8_t*)padding - delta;
+      const size_t maxpad = (delta > MI_MAX_ALIGN_SIZE ? MI_MAX_ALIGN_SIZE : delta); // set at most N initial padding bytes
+      for (size_t i = 0; i < maxpad; i++) { fill[i] = MI_DEBUG_PADDING; }
+    }
+    #endif
+  #else
+    MI_UNUSED(page); MI_UNUSED(block); MI_UNUSED(size);
+  #endif
+}
+
+#if (MI_SECURE==0)
+// Take the next block from the fresh (not yet initialized) capacity of a page
+static inline mi_block_t* mi_page_bump_block(mi_heap_t* heap, mi_page_t* page) {
+  mi_assert_internal(page->capacity < page->reserved);
+  mi_block_t* const block = (mi_block_t*)(page->page_start + ((size_t)page->capacity * page->block_size));
+  page->capacity++;
+  mi_heap_stat_increase(heap, page_committed, page->block_size);
+  MI_UNUSED(heap);
+  return block;
+}
+#endif
+
 // Fast allocation in a page: just pop from the free list.
 // Fall back to generic allocation only if the list is empty.
 // Note: in release mode the (inlined) routine is about 7 instructions with a single test.
@@ -33,14 +68,25 @@ extern inline void* _mi_page_malloc_zero(mi_heap_t* heap, mi_page_t* page, size_
   mi_assert_internal(page->block_size == 0 /* empty heap */ || mi_page_block_size(page) >= size);
 
   // check the free list
-  mi_block_t* const block = page->free;
+  mi_block_t* block = page->free;
   if mi_unlikely(block == NULL) {
-    return _mi_malloc_generic(heap, size, zero, 0);
+    #if (MI_SECURE==0)
+    if (heap->page_bump && page->capacity < page->reserved) {
+      // bump allocate from the fresh capacity of the page (see `mi_option_page_bump`);
+      // as we do not extend the free list in that case, this is the first choice until blocks get recycled
+      block = mi_page_bump_block(heap, page);
+    }
+    else
+    #endif
+    {
+      return _mi_malloc_generic(heap, size, zero, 0);
+    }
+  }
+  else {
+    // pop from the free list
+    page->free = mi_block_next(page, block);
   }
   mi_assert_internal(block != NULL && _mi_ptr_page(block) == page);
-
-  // pop from the free list
-  page->free = mi_block_next(page, block);
   page->used++;
   mi_assert_internal(page->free == NULL || _mi_ptr_page(page->free) == page);
   mi_assert_internal(page->block_size < MI_MAX_ALIGN_SIZE || _mi_is_aligned(block, MI_MAX_ALIGN_SIZE));
@@ -67,6 +113,9 @@ extern inline void* _mi_page_malloc_zero(mi_heap_t* heap, mi_page_t* page, size_
       block->next = 0;
       mi_track_mem_defined(block, page->block_size - MI_PADDING_SIZE);
     }
+    else if mi_unlikely(page->block_size > MI_MEDIUM_OBJ_SIZE_MAX) {
+      _mi_memzero_large(block, page->block_size - MI_PADDING_SIZE, page->block_size);
+    }
     else {
       _mi_memzero_aligned(block, page->block_size - MI_PADDING_SIZE);
     }
@@ -84,6 +133,7 @@ extern inline void* _mi_page_malloc_zero(mi_heap_t* heap, mi_page_t* page, size_
   const size_t bsize = mi_page_usable_block_size(page);
   if (bsize <= MI_MEDIUM_OBJ_SIZE_MAX) {
     mi_heap_stat_increase(heap, normal, bsize);
+    mi_heap_stat_increase(heap, tag_normal[heap->tag % MI_TAG_STATS_MAX], bsize);
     mi_heap_stat_counter_increase(heap, normal_count, 1);
     #if (MI_STAT>1)
     const size_t bin = _mi_bin(bsize);
@@ -92,24 +142,13 @@ extern inline void* _mi_page_malloc_zero(mi_heap_t* heap, mi_page_t* page, size_
   }
   #endif
 
-  #if MI_PADDING // && !MI_TRACK_ENABLED
-    mi_padding_t* const padding = (mi_padding_t*)((uint8_t*)block + mi_page_usable_block_size(page));
-    ptrdiff_t delta = ((uint8_t*)padding - (uint8_t*)block - (size - MI_PADDING_SIZE));
-    #if (MI_DEBUG>=2)
-    mi_assert_internal(delta >= 0 && mi_page_usable_block_size(page) >= (size - MI_PADDING_SIZE + delta));
-    #endif
-    mi_track_mem_defined(padding,sizeof(mi_padding_t));  // note: re-enable since mi_page_usable_block_size may set noaccess
-    padding->canary = mi_ptr_encode_canary(page,block,page->keys);
-    padding->delta  = (uint32_t)(delta);
-    #if MI_PADDING_CHECK
-    if (!mi_page_is_huge(page)) {
-      uint8_t* fill = (uint8_t*)padding - delta;
-      const size_t maxpad = (delta > MI_MAX_ALIGN_SIZE ? MI_MAX_ALIGN_SIZE : delta); // set at most N initial padding bytes
-      for (size_t i = 0; i < maxpad; i++) { fill[i] = MI_DEBUG_PADDING; }
-    }
-    #endif
-  #endif
+  mi_block_set_padding(page, block, size);
 
+  // record 1 out of N allocations for live heap profiling (see `heap.c:_mi_heap_sample_alloc`)
+  // (a zero count means sampling is disabled so we do not write to the heap on every allocation)
+  if mi_unlikely(heap->sample_count != 0 && --heap->sample_count == 0) {
+    _mi_heap_sample_alloc(heap, page, block, size, mi_return_address());
+  }
   return block;
 }
 
@@ -125,6 +164,43 @@ extern void* _mi_page_malloc_zeroed(mi_heap_t* heap, mi_page_t* page, size_t siz
 mi_decl_restrict void* _mi_heap_malloc_guarded(mi_heap_t* heap, size_t size, bool zero) mi_attr_noexcept;
 #endif
 
+// Pop a recently freed block from the free cache of the heap (see `free.c:mi_heap_tcache_push`).
+// The cache is indexed by block size, and `page` is the direct page for `size` which has the same block size
+// as the page of a cached block. The block is still counted as used in its page so we only need to prepare
+// it like `_mi_page_malloc_zero`.
+static inline void* mi_heap_tcache_pop(mi_heap_t* heap, mi_page_t* page, size_t size, bool zero) {
+  const size_t slot = page->block_size / MI_INTPTR_SIZE;  // the empty page has block size 0 and slot 0 is never used
+  if mi_unlikely(slot >= MI_TCACHE_SLOTS) return NULL;
+  mi_block_t* const block = heap->tcache[slot];
+  if (block == NULL) return NULL;
+  heap->tcache[slot] = mi_block_nextx(heap, block, heap->keys);
+  heap->tcache_count[slot]--;
+  #if MI_PADDING || (MI_DEBUG>1)
+  page = _mi_ptr_page(block);
+  mi_assert_internal(mi_page_heap(page) == heap && mi_page_block_size(page) == slot * MI_INTPTR_SIZE);
+  #endif
+  mi_track_mem_undefined(block, mi_page_usable_block_size(page));
+  if mi_unlikely(zero) {
+    _mi_memzero_aligned(block, page->block_size - MI_PADDING_SIZE);
+  }
+  #if (MI_DEBUG>0) && !MI_TRACK_ENABLED && !MI_TSAN
+  else {
+    memset(block, MI_DEBUG_UNINIT, mi_page_usable_block_size(page));
+  }
+  #endif
+  #if (MI_STAT>0)
+  const size_t bsize = mi_page_usable_block_size(page);
+  mi_heap_stat_increase(heap, normal, bsize);
+  mi_heap_stat_increase(heap, tag_normal[heap->tag % MI_TAG_STATS_MAX], bsize);
+  mi_heap_stat_counter_increase(heap, normal_count, 1);
+  #if (MI_STAT>1)
+  mi_heap_stat_increase(heap, normal_bins[_mi_bin(bsize)], 1);
+  #endif
+  #endif
+  mi_block_set_padding(page, block, size);
+  return block;
+}
+
 static inline mi_decl_restrict void* mi_heap_malloc_small_zero(mi_heap_t* heap, size_t size, bool zero) mi_attr_noexcept {
   mi_assert(heap != NULL);
   mi_assert(size <= MI_SMALL_SIZE_MAX);
@@ -141,9 +217,15 @@ static inline mi_decl_restrict void* mi_heap_malloc_small_zero(mi_heap_t* heap,
   }
   #endif
 
-  // get page in constant time, and allocate from it
+  // get page in constant time, and allocate from it (or reuse a recently freed block of the same block size)
   mi_page_t* page = _mi_heap_get_free_small_page(heap, size + MI_PADDING_SIZE);
-  void* const p = _mi_page_malloc_zero(heap, page, size + MI_PADDING_SIZE, zero);
+  void* p;
+  #if (MI_SECURE==0)
+  if (mi_likely(heap->tcache_max == 0) || (p = mi_heap_tcache_pop(heap, page, size + MI_PADDING_SIZE, zero)) == NULL)
+  #endif
+  {
+    p = _mi_page_malloc_zero(heap, page, size + MI_PADDING_SIZE, zero);
+  }
   mi_track_malloc(p,size,zero);
 
   #if MI_STAT>1
@@ -250,6 +332,57 @@ mi_decl_nodiscard mi_decl_restrict void* mi_mallocn(size_t count, size_t size) m
   return mi_heap_mallocn(mi_prim_get_default_heap(),count,size);
 }
 
+// Batched allocation of `count` blocks of the same `size`.
+// For small sizes we pop whole runs off the free list of the direct page and only
+// take the generic path once that page is exhausted.
+size_t mi_heap_malloc_batch(mi_heap_t* heap, size_t size, void** blocks, size_t count) mi_attr_noexcept {
+  if (blocks == NULL || count == 0) return 0;
+  size_t n = 0;
+  #if !MI_GUARDED
+  if mi_likely(size <= MI_SMALL_SIZE_MAX) {
+    mi_assert(heap != NULL);
+    mi_assert(heap->thread_id == 0 || heap->thread_id == _mi_thread_id()); // heaps are thread local
+    #if MI_PADDING
+    if (size == 0) { size = sizeof(void*); }
+    #endif
+    while (n < count) {
+      mi_page_t* const page = _mi_heap_get_free_small_page(heap, size + MI_PADDING_SIZE);
+      // pop a run of blocks from the page free list (or its bump region)
+      while (n < count && (page->free != NULL || mi_page_bump_available(heap, page))) {
+        void* const p = _mi_page_malloc_zero(heap, page, size + MI_PADDING_SIZE, false);
+        mi_track_malloc(p, size, false);
+        #if MI_STAT>1
+        mi_heap_stat_increase(heap, malloc, mi_usable_size(p));
+        #endif
+        blocks[n++] = p;
+      }
+      if (n == count) break;
+      // the page is exhausted: find (or allocate) a fresh page through the generic path
+      void* const p = _mi_malloc_generic(heap, size + MI_PADDING_SIZE, false, 0);
+      if (p == NULL) break;
+      if (!mi_heap_is_initialized(heap)) { heap = mi_prim_get_default_heap(); }  // the thread was just initialized
+      mi_track_malloc(p, size, false);
+      #if MI_STAT>1
+      mi_heap_stat_increase(heap, malloc, mi_usable_size(p));
+      #endif
+      blocks[n++] = p;
+    }
+    return n;
+  }
+  #endif
+  // larger (or guarded) blocks are allocated one by one
+  for (; n < count; n++) {
+    void* const p = mi_heap_malloc(heap, size);
+    if (p == NULL) break;
+    blocks[n] = p;
+  }
+  return n;
+}
+
+size_t mi_malloc_batch(size_t size, void** blocks, size_t count) mi_attr_noexcept {
+  return mi_heap_malloc_batch(mi_prim_get_default_heap(), size, blocks, count);
+}
+
 // Expand (or shrink) in place (or fail)
 void* mi_expand(void* p, size_t newsize) mi_attr_noexcept {
   #if MI_PADDING
@@ -264,6 +397,34 @@ void* mi_expand(void* p, size_t newsize) mi_attr_noexcept {
   #endif
 }
 
+#if !MI_TRACK_ENABLED
+// Grow a large or huge block of the current thread without copying by extending its page into the free
+// slices that follow it, or by remapping its huge segment. Returns the (possibly moved) block or NULL.
+static void* mi_try_grow_in_place(void* p, size_t size, size_t newsize, bool zero) {
+  if mi_unlikely(newsize > PTRDIFF_MAX - MI_PADDING_SIZE) return NULL;
+  mi_segment_t* const segment = _mi_ptr_segment(p);
+  if (mi_atomic_load_relaxed(&segment->thread_id) != _mi_prim_thread_id()) return NULL;
+  mi_page_t* page = _mi_segment_page_of(segment, p);
+  if (mi_page_block_size(page) <= MI_MEDIUM_OBJ_SIZE_MAX || mi_page_has_aligned(page) || (uint8_t*)p != page->page_start) return NULL;
+  mi_heap_t* const heap = mi_page_heap(page);
+  page = _mi_page_try_grow(page, newsize + MI_PADDING_SIZE);
+  if (page == NULL) return NULL;
+  uint8_t* const newp = page->page_start;   // the block start is unchanged unless a huge segment moved
+  mi_block_set_padding(page, (mi_block_t*)newp, newsize + MI_PADDING_SIZE);
+  #if MI_STAT>1
+  mi_heap_stat_increase(heap, malloc, mi_usable_size(newp) - size);
+  #else
+  MI_UNUSED(heap);
+  #endif
+  if (zero) {
+    // also set last word in the previous allocation to zero to ensure any padding is zero-initialized
+    const size_t start = (size >= sizeof(intptr_t) ? size - sizeof(intptr_t) : 0);
+    _mi_memzero_large(newp + start, newsize - start, mi_page_block_size(page));
+  }
+  return newp;
+}
+#endif
+
 void* _mi_heap_realloc_zero(mi_heap_t* heap, void* p, size_t newsize, bool zero) mi_attr_noexcept {
   // if p == NULL then behave as malloc.
   // else if size == 0 then reallocate to a zero-sized block (and don't return NULL, just as mi_malloc(0)).
@@ -276,12 +437,22 @@ void* _mi_heap_realloc_zero(mi_heap_t* heap, void* p, size_t newsize, bool zero)
     // if (newsize < size) { mi_track_mem_noaccess((uint8_t*)p + newsize, size - newsize); }
     return p;  // reallocation still fits and not more than 50% waste
   }
+  #if !MI_TRACK_ENABLED
+  if (p != NULL && newsize > size && newsize > MI_MEDIUM_OBJ_SIZE_MAX) {
+    // try to grow large and huge blocks in place
+    void* newp = mi_try_grow_in_place(p, size, newsize, zero);
+    if (newp != NULL) return newp;
+  }
+  #endif
   void* newp = mi_heap_malloc(heap,newsize);
   if mi_likely(newp != NULL) {
+    // large blocks may be copied and zeroed with non-temporal stores (see `mi_option_nontemporal_min`)
+    const bool is_large = (newsize > MI_MEDIUM_OBJ_SIZE_MAX);
     if (zero && newsize > size) {
       // also set last word in the previous allocation to zero to ensure any padding is zero-initialized
       const size_t start = (size >= sizeof(intptr_t) ? size - sizeof(intptr_t) : 0);
-      _mi_memzero((uint8_t*)newp + start, newsize - start);
+      if (is_large) { _mi_memzero_large((uint8_t*)newp + start, newsize - start, mi_page_block_size(_mi_ptr_page(newp))); }
+               else { _mi_memzero((uint8_t*)newp + start, newsize - start); }
     }
     else if (newsize == 0) {
       ((uint8_t*)newp)[0] = 0; // work around for applications that expect zero-reallocation to be zero initialized (issue #725)
@@ -289,7 +460,8 @@ void* _mi_heap_realloc_zero(mi_heap_t* heap, void* p, size_t newsize, bool zero)
     if mi_likely(p != NULL) {
       const size_t copysize = (newsize > size ? size : newsize);
       mi_track_mem_defined(p,copysize);  // _mi_useable_size may be too large for byte precise memory tracking..
-      _mi_memcpy(newp, p, copysize);
+      if (is_large) { _mi_memcpy_large(newp, p, copysize, mi_page_block_size(_mi_ptr_page(newp))); }
+               else { _mi_memcpy(newp, p, copysize); }
       mi_free(p); // only free the original pointer if successful
     }
   }
@@ -560,6 +732,19 @@ mi_decl_nodiscard mi_decl_restrict void* mi_new_n(size_t count, size_t size) {
 }
 
 
+// small objects where the caller resolved the size class at compile time (see `mi_new_fixed` in `mimalloc.h`)
+mi_decl_nodiscard mi_decl_restrict void* mi_heap_alloc_new_small(mi_heap_t* heap, size_t size) {
+  mi_assert(size <= MI_SMALL_SIZE_MAX);
+  void* p = mi_heap_malloc_small_zero(heap, size, false);
+  if mi_unlikely(p == NULL) return mi_heap_try_new(heap, size, false);
+  return p;
+}
+
+mi_decl_nodiscard mi_decl_restrict void* mi_new_small(size_t size) {
+  return mi_heap_alloc_new_small(mi_prim_get_default_heap(), size);
+}
+
+
 mi_decl_nodiscard mi_decl_restrict void* mi_new_nothrow(size_t size) mi_attr_noexcept {
   void* p = mi_malloc(size);
   if mi_unlikely(p == NULL) return mi_try_new(size, true);
@@ -35,10 +35,12 @@ bool        mi_arena_memid_indices(mi_memid_t memid, size_t* arena_index, mi_bit
 
   Abandoned segments are atomically marked in the `block_abandoned`
   bitmap of arenas. Any segments allocated outside arenas are put
-  in the sub-process `abandoned_os_list`. This list is accessed
-  using locks but this should be uncommon and generally uncontended.
+  in one of the sub-process `abandoned_os` shards (selected by the
+  segment address). Each shard list is accessed using its own lock
+  which keeps contention low even if many threads terminate at once,
+  and a summary bitmap lets reclaim skip empty shards without locking.
   Reclaim and visiting either scan through the `block_abandoned`
-  bitmaps of the arena's, or visit the `abandoned_os_list`
+  bitmaps of the arena's, or visit the `abandoned_os` shards
 
   A potentially nicer design is to use arena's for everything
   and perhaps have virtual arena's to map OS allocated memory
@@ -46,46 +48,64 @@ bool        mi_arena_memid_indices(mi_memid_t memid, size_t* arena_index, mi_bit
 ----------------------------------------------------------- */
 
 
+void _mi_subproc_init(mi_subproc_t* subproc) {
+  for (size_t i = 0; i < MI_ABANDONED_OS_SHARDS; i++) {
+    mi_lock_init(&subproc->abandoned_os[i].lock);
+    mi_lock_init(&subproc->abandoned_os[i].visit_lock);
+  }
+}
+
+// the abandoned OS shard of a segment
+static size_t mi_abandoned_os_shard_index(const mi_segment_t* segment) {
+  return (size_t)(((uintptr_t)segment >> MI_SEGMENT_SHIFT) % MI_ABANDONED_OS_SHARDS);
+}
+
 // reclaim a specific OS abandoned segment; `true` on success.
 // sets the thread_id.
 static bool mi_arena_segment_os_clear_abandoned(mi_segment_t* segment, bool take_lock) {
   mi_assert(segment->memid.memkind != MI_MEM_ARENA);
   // not in an arena, remove from list of abandoned os segments
   mi_subproc_t* const subproc = segment->subproc;
-  if (take_lock && !mi_lock_try_acquire(&subproc->abandoned_os_lock)) {
+  const size_t shard_idx = mi_abandoned_os_shard_index(segment);
+  mi_abandoned_os_shard_t* const shard = &subproc->abandoned_os[shard_idx];
+  if (take_lock && !mi_lock_try_acquire(&shard->lock)) {
     return false;  // failed to acquire the lock, we just give up
   }
   // remove atomically from the abandoned os list (if possible!)
   bool reclaimed = false;
   mi_segment_t* const next = segment->abandoned_os_next;
   mi_segment_t* const prev = segment->abandoned_os_prev;
-  if (next != NULL || prev != NULL || subproc->abandoned_os_list == segment) {
+  if (next != NULL || prev != NULL || shard->list == segment) {
     #if MI_DEBUG>3
     // find ourselves in the abandoned list (and check the count)
     bool found = false;
     size_t count = 0;
-    for (mi_segment_t* current = subproc->abandoned_os_list; current != NULL; current = current->abandoned_os_next) {
+    for (mi_segment_t* current = shard->list; current != NULL; current = current->abandoned_os_next) {
       if (current == segment) { found = true; }
       count++;
     }
     mi_assert_internal(found);
-    mi_assert_internal(count == mi_atomic_load_relaxed(&subproc->abandoned_os_list_count));
+    mi_assert_internal(count == mi_atomic_load_relaxed(&shard->count));
     #endif
     // remove (atomically) from the list and reclaim
     if (prev != NULL) { prev->abandoned_os_next = next; }
-    else { subproc->abandoned_os_list = next; }
+    else { shard->list = next; }
     if (next != NULL) { next->abandoned_os_prev = prev; }
-    else { subproc->abandoned_os_list_tail = prev; }
+    else { shard->list_tail = prev; }
     segment->abandoned_os_next = NULL;
     segment->abandoned_os_prev = NULL;
+    if (shard->list == NULL) {
+      mi_atomic_and_acq_rel(&subproc->abandoned_os_shards, ~((size_t)1 << shard_idx));
+    }
     mi_atomic_decrement_relaxed(&subproc->abandoned_count);
     mi_atomic_decrement_relaxed(&subproc->abandoned_os_list_count);
+    mi_atomic_decrement_relaxed(&shard->count);
     if (take_lock) { // don't reset the thread_id when iterating
       mi_atomic_store_release(&segment->thread_id, _mi_thread_id());
     }
     reclaimed = true;
   }
-  if (take_lock) { mi_lock_release(&segment->subproc->abandoned_os_lock); }
+  if (take_lock) { mi_lock_release(&shard->lock); }
   return reclaimed;
 }
 
@@ -120,17 +140,21 @@ static void mi_arena_segment_os_mark_abandoned(mi_segment_t* segment) {
   mi_assert(segment->memid.memkind != MI_MEM_ARENA);
   // not in an arena; we use a list of abandoned segments
   mi_subproc_t* const subproc = segment->subproc;
-  mi_lock(&subproc->abandoned_os_lock) {
+  const size_t shard_idx = mi_abandoned_os_shard_index(segment);
+  mi_abandoned_os_shard_t* const shard = &subproc->abandoned_os[shard_idx];
+  mi_lock(&shard->lock) {
     // push on the tail of the list (important for the visitor)
-    mi_segment_t* prev = subproc->abandoned_os_list_tail;
+    mi_segment_t* prev = shard->list_tail;
     mi_assert_internal(prev == NULL || prev->abandoned_os_next == NULL);
     mi_assert_internal(segment->abandoned_os_prev == NULL);
     mi_assert_internal(segment->abandoned_os_next == NULL);
     if (prev != NULL) { prev->abandoned_os_next = segment; }
-    else { subproc->abandoned_os_list = segment; }
-    subproc->abandoned_os_list_tail = segment;
+    else { shard->list = segment; }
+    shard->list_tail = segment;
     segment->abandoned_os_prev = prev;
     segment->abandoned_os_next = NULL;
+    mi_atomic_increment_relaxed(&shard->count);
+    mi_atomic_or_acq_rel(&subproc->abandoned_os_shards, (size_t)1 << shard_idx);
     mi_atomic_increment_relaxed(&subproc->abandoned_os_list_count);
     mi_atomic_increment_relaxed(&subproc->abandoned_count);
     // and release the lock
@@ -156,6 +180,7 @@ void _mi_arena_segment_mark_abandoned(mi_segment_t* segment)
   mi_assert_internal(arena != NULL);
   // set abandonment atomically
   mi_subproc_t* const subproc = segment->subproc; // don't access the segment after setting it abandoned
+  mi_atomic_store_relaxed(&arena->blocks_abandoned_fit[bitmap_idx], segment->abandoned_fit); // set before the abandoned bit
   const bool was_unmarked = _mi_bitmap_claim(arena->blocks_abandoned, arena->field_count, 1, bitmap_idx, NULL);
   if (was_unmarked) { mi_atomic_increment_relaxed(&subproc->abandoned_count); }
   mi_assert_internal(was_unmarked);
@@ -175,6 +200,12 @@ void _mi_arena_field_cursor_init(mi_heap_t* heap, mi_subproc_t* subproc, bool vi
   current->subproc = subproc;
   current->visit_all = visit_all;
   current->hold_visit_lock = false;
+  current->numa_node = -1;
+  current->fit_slices = 0;
+  current->fit_bins = 0;
+  current->os_list_count = 0;
+  current->os_shard = 0;
+  current->os_shard_end = 0;
   const size_t abandoned_count = mi_atomic_load_relaxed(&subproc->abandoned_count);
   const size_t abandoned_list_count = mi_atomic_load_relaxed(&subproc->abandoned_os_list_count);
   const size_t max_arena = mi_arena_get_count();
@@ -182,26 +213,34 @@ void _mi_arena_field_cursor_init(mi_heap_t* heap, mi_subproc_t* subproc, bool vi
     // for a heap that is bound to one arena, only visit that arena
     current->start = mi_arena_id_index(heap->arena_id);
     current->end = current->start + 1;
-    current->os_list_count = 0;
   }
   else {
     // otherwise visit all starting at a random location
     if (abandoned_count > abandoned_list_count && max_arena > 0) {
       current->start = (heap == NULL || max_arena == 0 ? 0 : (mi_arena_id_t)(_mi_heap_random_next(heap) % max_arena));
       current->end = current->start + max_arena;
+      if (heap != NULL && !visit_all && _mi_os_numa_node_count() > 1) {
+        // visit the arena's twice: first the ones local to our numa node, and then the others
+        current->numa_node = _mi_os_numa_node();
+        current->end += max_arena;
+      }
     }
     else {
       current->start = 0;
       current->end = 0;
     }
-    current->os_list_count = abandoned_list_count; // max entries to visit in the os abandoned list
+    if (abandoned_list_count > 0 || visit_all) {
+      // visit all the os abandoned shards (starting at a random one)
+      current->os_shard = (heap == NULL ? 0 : (size_t)(_mi_heap_random_next(heap) % MI_ABANDONED_OS_SHARDS));
+      current->os_shard_end = current->os_shard + MI_ABANDONED_OS_SHARDS;
+    }
   }
   mi_assert_internal(current->start <= max_arena);
 }
 
 void _mi_arena_field_cursor_done(mi_arena_field_cursor_t* current) {
   if (current->hold_visit_lock) {
-    mi_lock_release(&current->subproc->abandoned_os_visit_lock);
+    mi_lock_release(&current->subproc->abandoned_os[current->os_shard % MI_ABANDONED_OS_SHARDS].visit_lock);
     current->hold_visit_lock = false;
   }
 }
@@ -238,6 +277,12 @@ static mi_segment_t* mi_arena_segment_clear_abandoned_next_field(mi_arena_field_
     // index wraps around
     size_t arena_idx = (previous->start >= max_arena ? previous->start % max_arena : previous->start);
     mi_arena_t* arena = mi_arena_from_index(arena_idx);
+    if (arena != NULL && previous->numa_node >= 0) {
+      // in the first pass only visit numa local arena's, and in the second pass only the others
+      const bool first_pass = (previous->end - previous->start > max_arena);
+      const bool numa_local = (arena->numa_node < 0 || arena->numa_node == previous->numa_node);
+      if (first_pass != numa_local) { arena = NULL; }
+    }
     if (arena != NULL) {
       bool has_lock = false;
       // visit the abandoned fields (starting at previous_idx)
@@ -262,6 +307,12 @@ static mi_segment_t* mi_arena_segment_clear_abandoned_next_field(mi_arena_field_
             size_t mask = ((size_t)1 << bit_idx);
             if mi_unlikely((field & mask) == mask) {
               mi_bitmap_index_t bitmap_idx = mi_bitmap_index_create(field_idx, bit_idx);
+              // skip segments that cannot satisfy the request without claiming them
+              // (a stale summary just means we miss a segment or reclaim one that cannot be used)
+              if (previous->fit_slices > 0 &&
+                  !mi_abandoned_fit_matches(mi_atomic_load_relaxed(&arena->blocks_abandoned_fit[bitmap_idx]), previous->fit_slices, previous->fit_bins)) {
+                continue;
+              }
               mi_segment_t* const segment = mi_arena_segment_clear_abandoned_at(arena, previous->subproc, bitmap_idx);
               if (segment != NULL) {
                 //mi_assert_internal(arena->blocks_committed == NULL || _mi_bitmap_is_claimed(arena->blocks_committed, arena->field_count, 1, bitmap_idx));
@@ -280,34 +331,62 @@ static mi_segment_t* mi_arena_segment_clear_abandoned_next_field(mi_arena_field_
 }
 
 static mi_segment_t* mi_arena_segment_clear_abandoned_next_list(mi_arena_field_cursor_t* previous) {
-  // go through the abandoned_os_list
-  // we only allow one thread per sub-process to do to visit guarded by the `abandoned_os_visit_lock`.
-  // The lock is released when the cursor is released.
-  if (!previous->hold_visit_lock) {
-    previous->hold_visit_lock = (previous->visit_all ? (mi_lock_acquire(&previous->subproc->abandoned_os_visit_lock),true)
-                                                     : mi_lock_try_acquire(&previous->subproc->abandoned_os_visit_lock));
+  // go through the abandoned os shards
+  // we only allow one thread per shard to visit it, guarded by the shard `visit_lock`.
+  // The lock is released when we move to the next shard or when the cursor is released.
+  mi_subproc_t* const subproc = previous->subproc;
+  for (; previous->os_shard < previous->os_shard_end; previous->os_shard++) {
+    const size_t shard_idx = previous->os_shard % MI_ABANDONED_OS_SHARDS;
+    mi_abandoned_os_shard_t* const shard = &subproc->abandoned_os[shard_idx];
     if (!previous->hold_visit_lock) {
-      if (previous->visit_all) {
-        _mi_error_message(EFAULT, "internal error: failed to visit all abandoned segments due to failure to acquire the OS visitor lock");
+      // skip empty shards quickly without taking locks
+      if (!previous->visit_all && (mi_atomic_load_relaxed(&subproc->abandoned_os_shards) & ((size_t)1 << shard_idx)) == 0) continue;
+      previous->hold_visit_lock = (previous->visit_all ? (mi_lock_acquire(&shard->visit_lock),true)
+                                                       : mi_lock_try_acquire(&shard->visit_lock));
+      if (!previous->hold_visit_lock) {
+        if (previous->visit_all) {
+          _mi_error_message(EFAULT, "internal error: failed to visit all abandoned segments due to failure to acquire the OS visitor lock");
+        }
+        continue; // we cannot get the lock, try the next shard
       }
-      return NULL; // we cannot get the lock, give up
+      previous->os_list_count = mi_atomic_load_relaxed(&shard->count); // max entries to visit in this shard
     }
-  }
-  // One list entry at a time
-  while (previous->os_list_count > 0) {
-    previous->os_list_count--;
-    mi_lock_acquire(&previous->subproc->abandoned_os_lock); // this could contend with concurrent OS block abandonment and reclaim from `free`
-    mi_segment_t* segment = previous->subproc->abandoned_os_list;
-    // pop from head of the list, a subsequent mark will push at the end (and thus we iterate through os_list_count entries)
-    if (segment == NULL || mi_arena_segment_os_clear_abandoned(segment, false /* we already have the lock */)) {
-      mi_lock_release(&previous->subproc->abandoned_os_lock);
-      return segment;
+    // One list entry at a time
+    while (previous->os_list_count > 0) {
+      previous->os_list_count--;
+      mi_lock_acquire(&shard->lock); // this could contend with concurrent OS block abandonment and reclaim from `free`
+      mi_segment_t* segment = shard->list;
+      // pop from head of the list, a subsequent mark will push at the end (and thus we iterate through os_list_count entries)
+      if (segment == NULL) {
+        mi_lock_release(&shard->lock);
+        break;
+      }
+      if (previous->fit_slices > 0 && !mi_abandoned_fit_matches(segment->abandoned_fit, previous->fit_slices, previous->fit_bins)) {
+        // cannot satisfy the request: rotate it to the end of the list (so we iterate through os_list_count entries)
+        if (segment != shard->list_tail) {
+          shard->list = segment->abandoned_os_next;
+          shard->list->abandoned_os_prev = NULL;
+          segment->abandoned_os_prev = shard->list_tail;
+          segment->abandoned_os_next = NULL;
+          shard->list_tail->abandoned_os_next = segment;
+          shard->list_tail = segment;
+        }
+        mi_lock_release(&shard->lock);
+        continue;
+      }
+      if (mi_arena_segment_os_clear_abandoned(segment, false /* we already have the lock */)) {
+        mi_lock_release(&shard->lock);
+        return segment;
+      }
+      // already abandoned, try again
+      mi_lock_release(&shard->lock);
     }
-    // already abandoned, try again
-    mi_lock_release(&previous->subproc->abandoned_os_lock);
+    // done with this shard
+    mi_lock_release(&shard->visit_lock);
+    previous->hold_visit_lock = false;
+    previous->os_list_count = 0;
   }
   // done
-  mi_assert_internal(previous->os_list_count == 0);
   return NULL;
 }
 
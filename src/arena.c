@@ -22,6 +22,7 @@ The arena allocation needs to be thread safe and we use an atomic bitmap to allo
 #include "mimalloc.h"
 #include "mimalloc/internal.h"
 #include "mimalloc/atomic.h"
+#include "mimalloc/prim.h"      // _mi_prim_thread_start
 #include "bitmap.h"
 
 
@@ -44,24 +45,50 @@ typedef struct mi_arena_s {
   mi_lock_t           abandoned_visit_lock; // lock is only used when abandoned segments are being visited
   _Atomic(size_t)     search_idx;           // optimization to start the search for free blocks
   _Atomic(mi_msecs_t) purge_expire;         // expiration time when blocks should be purged from `blocks_purge`.
-  
+  _Atomic(size_t)     blocks_used;          // number of blocks currently claimed (to check the limits)
+  size_t              limit_soft;           // purge eagerly when the claimed blocks exceed this size (in bytes, 0 if not set)
+  size_t              limit_hard;           // fail to claim blocks beyond this size (in bytes, 0 if not set)
+  void*               file_header;          // the header of a file backed arena (or NULL)
+
   mi_bitmap_field_t*  blocks_dirty;         // are the blocks potentially non-zero?
   mi_bitmap_field_t*  blocks_committed;     // are the blocks committed? (can be NULL for memory that cannot be decommitted)
   mi_bitmap_field_t*  blocks_purge;         // blocks that can be (reset) decommitted. (can be NULL for memory that cannot be (reset) decommitted)
   mi_bitmap_field_t*  blocks_abandoned;     // blocks that start with an abandoned segment. (This crosses API's but it is convenient to have here)
-  mi_bitmap_field_t   blocks_inuse[1];      // in-place bitmap of in-use blocks (of size `field_count`)
-  // do not add further fields here as the dirty, committed, purged, and abandoned bitmaps follow the inuse bitmap fields.
+  mi_bitmap_field_t*  blocks_inuse_summary; // summary of the in-use bitmap: one bit per field that may have free blocks (to speed up searching in large arena's)
+  _Atomic(size_t)*    blocks_abandoned_fit; // free space summary of the abandoned segment starting at each block (of size `field_count * MI_BITMAP_FIELD_BITS`)
+  mi_bitmap_field_t*  blocks_inuse;         // bitmap of in-use blocks (of size `field_count`)
+  // usually the inuse, dirty, abandoned, committed, and purged bitmaps (and the summaries) follow the arena structure.
 } mi_arena_t;
 
 
 #define MI_ARENA_BLOCK_SIZE   (MI_SEGMENT_SIZE)        // 64MiB  (must be at least MI_SEGMENT_ALIGN)
 #define MI_ARENA_MIN_OBJ_SIZE (MI_ARENA_BLOCK_SIZE/2)  // 32MiB
-#define MI_MAX_ARENAS         (132)                    // Limited as the reservation exponentially increases (and takes up .bss)
-
-// The available arenas
-static mi_decl_cache_align _Atomic(mi_arena_t*) mi_arenas[MI_MAX_ARENAS];
-static mi_decl_cache_align _Atomic(size_t)      mi_arena_count; // = 0
+#define MI_ARENAS_STATIC      (132)                    // Arenas in the static table (as the reservation exponentially increases)
+#define MI_ARENAS_CHUNK_SIZE  (1024)                   // Arenas per dynamically allocated chunk of the arena table
+#define MI_ARENAS_CHUNKS      (64)                     // Maximum number of chunks
+#define MI_MAX_ARENAS         (MI_ARENAS_STATIC + MI_ARENAS_CHUNKS*MI_ARENAS_CHUNK_SIZE)
+
+// The available arenas: the first ones are in a static table, beyond that
+// chunks of the table are allocated on demand (and never freed)
+static mi_decl_cache_align _Atomic(mi_arena_t*)  mi_arenas[MI_ARENAS_STATIC];
+static mi_decl_cache_align _Atomic(mi_arena_t*)* mi_arenas_chunks[MI_ARENAS_CHUNKS];
+static mi_decl_cache_align _Atomic(size_t)       mi_arena_count; // = 0
+
+// Non-exclusive arenas are also registered in a candidate list per NUMA node (where
+// the last list is for arenas without a NUMA node) so a search for a free block does not
+// visit the exclusive arenas. If a list overflows we fall back to visiting all arenas.
+#define MI_ARENA_NUMA_LISTS   (8)
+#define MI_ARENA_LIST_SIZE    (MI_ARENAS_STATIC)
+
+typedef struct mi_arena_list_s {
+  _Atomic(size_t) count;
+  _Atomic(size_t) indices[MI_ARENA_LIST_SIZE];         // arena index + 1 (so 0 is not yet published)
+} mi_arena_list_t;
+
+static mi_decl_cache_align mi_arena_list_t mi_arena_lists[MI_ARENA_NUMA_LISTS+1];
+static mi_decl_cache_align _Atomic(size_t) mi_arena_lists_overflow; // = 0
 static mi_decl_cache_align _Atomic(int64_t)     mi_arenas_purge_expire; // set if there exist purgeable arenas
+static mi_decl_cache_align _Atomic(size_t)      mi_arenas_startup;      // startup reservation; 0: not yet, 1: deferred, 2: reserved
 
 #define MI_IN_ARENA_C
 #include "arena-abandon.c"
@@ -99,6 +126,26 @@ bool _mi_arena_memid_is_suitable(mi_memid_t memid, mi_arena_id_t request_arena_i
   }
 }
 
+// numa node of the arena memory, or -1 if the memory is not associated with a specific node
+int _mi_arena_memid_numa_node(mi_memid_t memid) {
+  if (memid.memkind != MI_MEM_ARENA) return -1;
+  const size_t arena_index = mi_arena_id_index(memid.mem.arena.id);
+  mi_arena_t* arena = mi_arena_from_index(arena_index);
+  return (arena == NULL ? -1 : arena->numa_node);
+}
+
+// is the memory anonymous memory that we allocated from the OS (directly or for an arena)?
+// (only then does decommitted memory read as zero again, see `_mi_os_purge_is_zero`)
+bool _mi_arena_memid_is_os_backed(mi_memid_t memid) {
+  if (memid.is_pinned) return false;
+  if (memid.memkind == MI_MEM_ARENA) {
+    mi_arena_t* arena = mi_arena_from_index(mi_arena_id_index(memid.mem.arena.id));
+    if (arena == NULL) return false;
+    memid = arena->memid;
+  }
+  return mi_memkind_is_os(memid.memkind);
+}
+
 bool _mi_arena_memid_is_os_allocated(mi_memid_t memid) {
   return (memid.memkind == MI_MEM_OS);
 }
@@ -107,9 +154,31 @@ size_t mi_arena_get_count(void) {
   return mi_atomic_load_relaxed(&mi_arena_count);
 }
 
+// Get the slot in the arena table for an arena index, allocating its chunk if `create` is set.
+static _Atomic(mi_arena_t*)* mi_arena_slot(size_t idx, bool create) {
+  if mi_likely(idx < MI_ARENAS_STATIC) return &mi_arenas[idx];
+  if (idx >= MI_MAX_ARENAS) return NULL;
+  const size_t chunk_idx = (idx - MI_ARENAS_STATIC) / MI_ARENAS_CHUNK_SIZE;
+  _Atomic(mi_arena_t*)* chunk = mi_atomic_load_ptr_acquire(_Atomic(mi_arena_t*), &mi_arenas_chunks[chunk_idx]);
+  if (chunk == NULL) {
+    if (!create) return NULL;
+    const size_t chunk_size = MI_ARENAS_CHUNK_SIZE * sizeof(_Atomic(mi_arena_t*));
+    mi_memid_t memid;
+    chunk = (_Atomic(mi_arena_t*)*)_mi_arena_meta_zalloc(chunk_size, &memid);
+    if (chunk == NULL) return NULL;
+    _Atomic(mi_arena_t*)* expected = NULL;
+    if (!mi_atomic_cas_ptr_strong_release(_Atomic(mi_arena_t*), &mi_arenas_chunks[chunk_idx], &expected, chunk)) {
+      // another thread allocated the chunk concurrently
+      _mi_arena_meta_free(chunk, memid, chunk_size);
+      chunk = mi_atomic_load_ptr_acquire(_Atomic(mi_arena_t*), &mi_arenas_chunks[chunk_idx]);
+    }
+  }
+  return &chunk[(idx - MI_ARENAS_STATIC) % MI_ARENAS_CHUNK_SIZE];
+}
+
 mi_arena_t* mi_arena_from_index(size_t idx) {
-  mi_assert_internal(idx < mi_arena_get_count());
-  return mi_atomic_load_ptr_acquire(mi_arena_t, &mi_arenas[idx]);
+  _Atomic(mi_arena_t*)* slot = mi_arena_slot(idx, false);
+  return (slot == NULL ? NULL : mi_atomic_load_ptr_acquire(mi_arena_t, slot));
 }
 
 
@@ -208,7 +277,7 @@ void _mi_arena_meta_free(void* p, mi_memid_t memid, size_t size) {
     _mi_os_free(p, size, memid);
   }
   else {
-    mi_assert(memid.memkind == MI_MEM_STATIC);
+    mi_assert(memid.memkind == MI_MEM_STATIC || memid.memkind == MI_MEM_EXTERNAL);
   }
 }
 
@@ -224,9 +293,12 @@ void* mi_arena_block_start(mi_arena_t* arena, mi_bitmap_index_t bindex) {
 // claim the `blocks_inuse` bits
 static bool mi_arena_try_claim(mi_arena_t* arena, size_t blocks, mi_bitmap_index_t* bitmap_idx)
 {
+  // respect the hard limit (this is not exact under concurrent claims but that is ok)
+  if (arena->limit_hard > 0 && mi_arena_block_size(mi_atomic_load_relaxed(&arena->blocks_used) + blocks) > arena->limit_hard) return false;
   size_t idx = 0; // mi_atomic_load_relaxed(&arena->search_idx);  // start from last search; ok to be relaxed as the exact start does not matter
-  if (_mi_bitmap_try_find_from_claim_across(arena->blocks_inuse, arena->field_count, idx, blocks, bitmap_idx)) {
+  if (_mi_bitmap_try_find_from_claim_across_summary(arena->blocks_inuse, arena->blocks_inuse_summary, arena->field_count, idx, blocks, bitmap_idx)) {
     mi_atomic_store_relaxed(&arena->search_idx, mi_bitmap_index_field(*bitmap_idx));  // start search from found location next time around
+    mi_atomic_add_relaxed(&arena->blocks_used, blocks);
     return true;
   };
   return false;
@@ -237,6 +309,8 @@ static bool mi_arena_try_claim(mi_arena_t* arena, size_t blocks, mi_bitmap_index
   Arena Allocation
 ----------------------------------------------------------- */
 
+static bool mi_arena_try_purge(mi_arena_t* arena, mi_msecs_t now, bool force);
+
 static mi_decl_noinline void* mi_arena_try_alloc_at(mi_arena_t* arena, size_t arena_index, size_t needed_bcount,
                                                     bool commit, mi_memid_t* memid)
 {
@@ -248,6 +322,12 @@ static mi_decl_noinline void* mi_arena_try_alloc_at(mi_arena_t* arena, size_t ar
 
   // claimed it!
   void* p = mi_arena_block_start(arena, bitmap_index);
+
+  // under pressure, purge the blocks scheduled for a purge right away
+  if (arena->limit_soft > 0 && mi_atomic_loadi64_relaxed(&arena->purge_expire) != 0 &&
+      mi_arena_block_size(mi_atomic_load_relaxed(&arena->blocks_used)) > arena->limit_soft) {
+    mi_arena_try_purge(arena, _mi_clock_now(), true);
+  }
   *memid = mi_memid_create_arena(arena->id, arena->exclusive, bitmap_index);
   memid->is_pinned = arena->memid.is_pinned;
 
@@ -319,6 +399,36 @@ static void* mi_arena_try_alloc_at_id(mi_arena_id_t arena_id, bool match_numa_no
 }
 
 
+// The candidate list of non-exclusive arenas for a NUMA node
+static mi_arena_list_t* mi_arena_list_of(int numa_node) {
+  return &mi_arena_lists[numa_node < 0 ? MI_ARENA_NUMA_LISTS : (size_t)numa_node % MI_ARENA_NUMA_LISTS];
+}
+
+// Register a non-exclusive arena in the candidate list of its NUMA node
+static void mi_arena_list_add(mi_arena_t* arena, size_t arena_index) {
+  mi_arena_list_t* const list = mi_arena_list_of(arena->numa_node);
+  const size_t i = mi_atomic_increment_acq_rel(&list->count);
+  if (i >= MI_ARENA_LIST_SIZE) {
+    mi_atomic_store_release(&mi_arena_lists_overflow, (size_t)1);
+    return;
+  }
+  mi_atomic_store_release(&list->indices[i], arena_index + 1);
+}
+
+// allocate in one of the arenas of a candidate list
+static void* mi_arena_try_alloc_from_list(mi_arena_list_t* list, bool match_numa_node, int numa_node, size_t size, size_t alignment,
+                                          bool commit, bool allow_large, mi_memid_t* memid)
+{
+  const size_t count = mi_atomic_load_acquire(&list->count);
+  for (size_t i = 0; i < count && i < MI_ARENA_LIST_SIZE; i++) {
+    const size_t idx = mi_atomic_load_acquire(&list->indices[i]);
+    if (idx == 0) continue;  // not yet published
+    void* p = mi_arena_try_alloc_at_id(mi_arena_id_create(idx - 1), match_numa_node, numa_node, size, alignment, commit, allow_large, _mi_arena_id_none(), memid);
+    if (p != NULL) return p;
+  }
+  return NULL;
+}
+
 // allocate from an arena with fallback to the OS
 static mi_decl_noinline void* mi_arena_try_alloc(int numa_node, size_t size, size_t alignment,
                                                   bool commit, bool allow_large,
@@ -336,7 +446,8 @@ static mi_decl_noinline void* mi_arena_try_alloc(int numa_node, size_t size, siz
       if (p != NULL) return p;
     }
   }
-  else {
+  else if mi_unlikely(mi_atomic_load_relaxed(&mi_arena_lists_overflow) != 0) {
+    // too many non-exclusive arenas for the candidate lists: visit all arenas
     // try numa affine allocation
     for (size_t i = 0; i < max_arena; i++) {
       void* p = mi_arena_try_alloc_at_id(mi_arena_id_create(i), true, numa_node, size, alignment, commit, allow_large, req_arena_id, memid);
@@ -351,6 +462,26 @@ static mi_decl_noinline void* mi_arena_try_alloc(int numa_node, size_t size, siz
       }
     }
   }
+  else if (numa_node < 0) {
+    // no specific affinity: all non-exclusive arenas are suitable
+    for (size_t n = 0; n <= MI_ARENA_NUMA_LISTS; n++) {
+      void* p = mi_arena_try_alloc_from_list(&mi_arena_lists[n], true, numa_node, size, alignment, commit, allow_large, memid);
+      if (p != NULL) return p;
+    }
+  }
+  else {
+    // try numa affine allocation (including arenas without a numa node)
+    void* p = mi_arena_try_alloc_from_list(mi_arena_list_of(numa_node), true, numa_node, size, alignment, commit, allow_large, memid);
+    if (p != NULL) return p;
+    p = mi_arena_try_alloc_from_list(mi_arena_list_of(-1), true, numa_node, size, alignment, commit, allow_large, memid);
+    if (p != NULL) return p;
+
+    // try from another numa node instead..
+    for (size_t n = 0; n < MI_ARENA_NUMA_LISTS; n++) {
+      p = mi_arena_try_alloc_from_list(&mi_arena_lists[n], false /* only proceed if not numa local */, numa_node, size, alignment, commit, allow_large, memid);
+      if (p != NULL) return p;
+    }
+  }
   return NULL;
 }
 
@@ -398,6 +529,9 @@ void* _mi_arena_alloc_aligned(size_t size, size_t alignment, size_t align_offset
 
   const int numa_node = _mi_os_numa_node(); // current numa node
 
+  // reserve the startup memory on first use in fast start mode
+  if mi_unlikely(mi_atomic_load_relaxed(&mi_arenas_startup) == 1) { _mi_arenas_reserve_startup(false); }
+
   // try to allocate in an arena if the alignment is small enough and the object is not too small (as for heap meta data)
   if (!mi_option_is_enabled(mi_option_disallow_arena_alloc)) {  // is arena allocation allowed?
     if (size >= MI_ARENA_MIN_OBJ_SIZE && alignment <= MI_SEGMENT_ALIGN && align_offset == 0) 
@@ -443,7 +577,7 @@ void* mi_arena_area(mi_arena_id_t arena_id, size_t* size) {
   if (size != NULL) *size = 0;
   size_t arena_index = mi_arena_id_index(arena_id);
   if (arena_index >= MI_MAX_ARENAS) return NULL;
-  mi_arena_t* arena = mi_atomic_load_ptr_acquire(mi_arena_t, &mi_arenas[arena_index]);
+  mi_arena_t* arena = mi_arena_from_index(arena_index);
   if (arena == NULL) return NULL;
   if (size != NULL) { *size = mi_arena_block_size(arena->block_count); }
   return arena->start;
@@ -454,9 +588,195 @@ void* mi_arena_area(mi_arena_id_t arena_id, size_t* size) {
   Arena purge
 ----------------------------------------------------------- */
 
+/* -----------------------------------------------------------
+  Memory pressure
+
+  With `mi_option_pressure_interval` set, the memory pressure of
+  the process is polled at most once per interval (on Linux using
+  a PSI trigger on the cgroup `memory.pressure`, or the counters of
+  `memory.events`). The polling is done by allocating threads (see
+  `page.c:_mi_deferred_free`) and the background purger, so no
+  extra thread is needed. The application can also signal the
+  pressure itself with `mi_memory_pressure_notify` (for example
+  from its own monitor, or on platforms that are not monitored).
+  On a pressure signal the arenas and abandoned segments are
+  purged, and the deferred free function is called with `force`.
+  Until there was no signal for `MI_PRESSURE_HOLD` milli-seconds
+  (or the option is disabled) the purge delays are shortened to
+  1ms, after which normal behaviour is restored.
+----------------------------------------------------------- */
+
+#define MI_PRESSURE_UNINIT      (0)
+#define MI_PRESSURE_MONITORING  (1)
+#define MI_PRESSURE_DISABLED    (2)   // not supported or failed to initialize
+
+#define MI_PRESSURE_HOLD        (4000)  // two PSI trigger windows
+
+static _Atomic(size_t)  mi_pressure_state;    // = MI_PRESSURE_UNINIT
+static _Atomic(size_t)  mi_pressure_active;   // are we under memory pressure?
+static _Atomic(size_t)  mi_pressure_notified; // signalled by `mi_memory_pressure_notify` since the last poll?
+static _Atomic(int64_t) mi_pressure_next;     // time of the next poll
+static _Atomic(int64_t) mi_pressure_start;    // start of the current pressure episode
+static _Atomic(int64_t) mi_pressure_last;     // time of the last pressure signal
+
+static bool mi_pressure_is_monitoring(void) {
+  size_t state = mi_atomic_load_acquire(&mi_pressure_state);
+  if mi_likely(state != MI_PRESSURE_UNINIT) return (state == MI_PRESSURE_MONITORING);
+  static mi_atomic_once_t init_once;
+  if (mi_atomic_once(&init_once)) {
+    const bool ok = _mi_prim_mem_pressure_init();
+    if (ok) { _mi_verbose_message("monitoring memory pressure (poll interval %ld ms)\n", mi_option_get(mi_option_pressure_interval)); }
+       else { _mi_verbose_message("unable to monitor the memory pressure\n"); }
+    mi_atomic_store_release(&mi_pressure_state, (size_t)(ok ? MI_PRESSURE_MONITORING : MI_PRESSURE_DISABLED));
+    return ok;
+  }
+  return false;  // another thread is initializing
+}
+
+// End the current pressure episode (if any): record it and restore the purge delays
+static void mi_pressure_end(mi_msecs_t now) {
+  if (mi_atomic_exchange_acq_rel(&mi_pressure_active, (size_t)0) == 0) return;
+  const mi_msecs_t start = mi_atomic_loadi64_relaxed(&mi_pressure_start);
+  _mi_stat_counter_increase(&_mi_stats_main.pressure_events, (size_t)(now - start));
+  _mi_verbose_message("memory pressure dropped after %lld ms\n", (long long)(now - start));
+}
+
+// Poll the memory pressure (at most once per `mi_option_pressure_interval`) and collect under
+// pressure. Returns `true` if there was a pressure signal in this call (so the caller can
+// force its deferred free function).
+bool _mi_mem_pressure_poll(void) {
+  const long interval = mi_option_get(mi_option_pressure_interval);
+  if mi_likely(interval <= 0) {
+    // restore normal behaviour if the option was disabled under pressure
+    if mi_unlikely(mi_atomic_load_relaxed(&mi_pressure_active) != 0) { mi_pressure_end(_mi_clock_now()); }
+    return false;
+  }
+  if (_mi_preloading()) return false;
+  const mi_msecs_t now = _mi_clock_now();
+  mi_msecs_t next = mi_atomic_loadi64_relaxed(&mi_pressure_next);
+  if (now < next || !mi_atomic_casi64_strong_acq_rel(&mi_pressure_next, &next, now + interval)) return false;
+  const bool monitoring = mi_pressure_is_monitoring();
+  if (!monitoring && mi_atomic_load_relaxed(&mi_pressure_notified) == 0 && mi_atomic_load_relaxed(&mi_pressure_active) == 0) return false;
+
+  bool signalled = false;
+  static mi_atomic_guard_t poll_guard;
+  mi_atomic_guard(&poll_guard)
+  {
+    signalled = (monitoring && _mi_prim_mem_pressure_poll());
+    if (mi_atomic_exchange_acq_rel(&mi_pressure_notified, (size_t)0) != 0) { signalled = true; }
+    if (signalled) {
+      mi_atomic_storei64_release(&mi_pressure_last, now);
+      if (mi_atomic_exchange_acq_rel(&mi_pressure_active, (size_t)1) == 0) {
+        mi_atomic_storei64_release(&mi_pressure_start, now);
+        _mi_verbose_message("memory pressure: purge immediately\n");
+      }
+    }
+    else if (mi_atomic_load_relaxed(&mi_pressure_active) != 0 && now - mi_atomic_loadi64_relaxed(&mi_pressure_last) >= MI_PRESSURE_HOLD) {
+      // the pressure dropped
+      mi_pressure_end(now);
+    }
+  }
+  if (signalled) {
+    _mi_stat_counter_increase(&_mi_stats_main.pressure_collects, 1);
+    _mi_arenas_collect(true /* force purge */);
+    _mi_abandoned_purge(_mi_subproc_from_id(mi_subproc_main()), true /* force? */);
+  }
+  return signalled;
+}
+
+// Signal memory pressure; it is handled on the next poll (with `mi_option_pressure_interval` set).
+void mi_memory_pressure_notify(void) mi_attr_noexcept {
+  mi_atomic_store_release(&mi_pressure_notified, (size_t)1);
+}
+
+// Memory pressure statistics. Returns `false` if the cgroup memory pressure is not monitored
+// (see `mi_option_pressure_interval`), in which case only signals of `mi_memory_pressure_notify` are counted.
+bool mi_memory_pressure_stats(bool* under_pressure, size_t* episodes, size_t* pressure_msecs, size_t* collects) mi_attr_noexcept {
+  const bool monitoring = (mi_atomic_load_acquire(&mi_pressure_state) == MI_PRESSURE_MONITORING);
+  const bool active = (mi_atomic_load_acquire(&mi_pressure_active) != 0);
+  int64_t count = mi_atomic_loadi64_relaxed((_Atomic(int64_t)*)&_mi_stats_main.pressure_events.count);
+  int64_t msecs = mi_atomic_loadi64_relaxed((_Atomic(int64_t)*)&_mi_stats_main.pressure_events.total);
+  const int64_t ncollects = mi_atomic_loadi64_relaxed((_Atomic(int64_t)*)&_mi_stats_main.pressure_collects.count);
+  if (active) {  // include the current episode
+    count++;
+    msecs += _mi_clock_now() - mi_atomic_loadi64_relaxed(&mi_pressure_start);
+  }
+  if (under_pressure != NULL) *under_pressure = active;
+  if (episodes != NULL)       *episodes       = (count < 0 ? 0 : (size_t)count);
+  if (pressure_msecs != NULL) *pressure_msecs = (msecs < 0 ? 0 : (size_t)msecs);
+  if (collects != NULL)       *collects       = (ncollects < 0 ? 0 : (size_t)ncollects);
+  return monitoring;
+}
+
+
+/* -----------------------------------------------------------
+  Adaptive purge delay
+
+  With `mi_option_purge_adaptive` set to a maximal factor N, the
+  purge delay is scaled by a factor between 1 and N. Segments
+  report the reuse of purged memory within the maximal (scaled)
+  delay, as such memory was purged just before it was needed again.
+  Once per (unscaled) delay interval the factor is doubled if there
+  was such reuse in that interval, and halved otherwise so an idle
+  process still returns its memory. While more memory is committed
+  than the ceiling of `mi_option_purge_adaptive_ceiling` the factor
+  is 1. The factor is global as all threads share the purge delay
+  options and the arenas.
+----------------------------------------------------------- */
+
+static _Atomic(int64_t) mi_purge_adapt_start;    // start of the current interval
+static _Atomic(size_t)  mi_purge_adapt_reuses;   // reuses of purged memory in the current interval
+static _Atomic(size_t)  mi_purge_adapt_factor = MI_ATOMIC_VAR_INIT(1);
+
+static size_t mi_purge_adapt_max(void) {
+  return (size_t)mi_option_get_clamp(mi_option_purge_adaptive, 0, 1024);
+}
+
+// Called by a segment that reuses memory that was purged at `purged_at` with an (unscaled) `delay`.
+void _mi_purge_adapt_reused(mi_msecs_t purged_at, long delay) {
+  const size_t factor_max = mi_purge_adapt_max();
+  if (factor_max <= 1 || delay <= 0) return;
+  if (_mi_clock_now() - purged_at <= delay * (mi_msecs_t)factor_max) {
+    mi_atomic_increment_relaxed(&mi_purge_adapt_reuses);
+    _mi_stat_counter_increase(&_mi_stats_main.purge_reused, 1);
+  }
+}
+
+static size_t mi_purge_adapt_update(long delay, size_t factor_max) {
+  size_t factor = mi_atomic_load_relaxed(&mi_purge_adapt_factor);
+  const size_t ceiling = mi_option_get_size(mi_option_purge_adaptive_ceiling);
+  if (ceiling > 0 && _mi_stats_main.committed.current > (int64_t)ceiling) {
+    if (factor != 1) { mi_atomic_store_relaxed(&mi_purge_adapt_factor, (size_t)1); }
+    return 1;
+  }
+  const mi_msecs_t now = _mi_clock_now();
+  int64_t start = mi_atomic_loadi64_relaxed(&mi_purge_adapt_start);
+  if (now - start < delay || !mi_atomic_casi64_strong_acq_rel(&mi_purge_adapt_start, &start, now)) {
+    return factor;  // not at the end of the interval (or another thread updates)
+  }
+  if (mi_atomic_exchange_relaxed(&mi_purge_adapt_reuses, (size_t)0) > 0) {
+    factor = (2*factor > factor_max ? factor_max : 2*factor);  // purged memory was needed again: purge later
+  }
+  else if (factor > 1) {
+    factor = factor / 2;  // purge sooner
+  }
+  if (factor > factor_max) { factor = factor_max; }
+  mi_atomic_store_relaxed(&mi_purge_adapt_factor, factor);
+  return factor;
+}
+
+// Return the adapted purge delay
+long _mi_purge_delay_adapt(long delay) {
+  if (delay <= 0) return delay;  // never or immediately
+  if (mi_atomic_load_relaxed(&mi_pressure_active) != 0) return 1;  // purge as soon as possible under memory pressure
+  const size_t factor_max = mi_purge_adapt_max();
+  if (factor_max <= 1) return delay;
+  return delay * (long)mi_purge_adapt_update(delay, factor_max);
+}
+
 static long mi_arena_purge_delay(void) {
   // <0 = no purging allowed, 0=immediate purging, >0=milli-second delay
-  return (mi_option_get(mi_option_purge_delay) * mi_option_get(mi_option_arena_purge_mult));
+  return _mi_purge_delay_adapt(mi_option_get(mi_option_purge_delay) * mi_option_get(mi_option_arena_purge_mult));
 }
 
 // reset or decommit in an arena and update the committed/decommit bitmaps
@@ -467,6 +787,7 @@ static void mi_arena_purge(mi_arena_t* arena, size_t bitmap_idx, size_t blocks)
   mi_assert_internal(!arena->memid.is_pinned);
   const size_t size = mi_arena_block_size(blocks);
   void* const p = mi_arena_block_start(arena, bitmap_idx);
+  const bool purge_is_zero = (mi_memkind_is_os(arena->memid.memkind) && _mi_os_purge_is_zero());
   bool needs_recommit;
   if (_mi_bitmap_is_claimed_across(arena->blocks_committed, arena->field_count, blocks, bitmap_idx)) {
     // all blocks are committed, we can purge freely
@@ -483,6 +804,10 @@ static void mi_arena_purge(mi_arena_t* arena, size_t bitmap_idx, size_t blocks)
 
   // clear the purged blocks
   _mi_bitmap_unclaim_across(arena->blocks_purge, arena->field_count, blocks, bitmap_idx);
+  // and if they read as zero now, they can be handed out as zero initialized again
+  if (purge_is_zero && arena->blocks_dirty != NULL) {
+    _mi_bitmap_unclaim_across(arena->blocks_dirty, arena->field_count, blocks, bitmap_idx);
+  }
   // update committed bitmap
   if (needs_recommit) {
     _mi_bitmap_unclaim_across(arena->blocks_committed, arena->field_count, blocks, bitmap_idx);
@@ -516,10 +841,64 @@ static void mi_arena_schedule_purge(mi_arena_t* arena, size_t bitmap_idx, size_t
   }
 }
 
+// Purges of fully committed ranges are collected in an OS purge batch so adjacent ranges (also across
+// bitmap fields) are coalesced and purged with a single system call where possible. The claimed `in_use`
+// ranges are kept until the batch is flushed, after which the purge and commit bitmaps are updated.
+typedef struct mi_arena_purge_batch_s {
+  mi_os_purge_batch_t os;
+  size_t              purged_count;                         // pending purged ranges
+  mi_bitmap_index_t   purged_index[MI_OS_PURGE_BATCH_MAX];
+  size_t              purged_blocks[MI_OS_PURGE_BATCH_MAX];
+  size_t              claimed_count;                        // pending claimed `in_use` ranges
+  mi_bitmap_index_t   claimed_index[MI_OS_PURGE_BATCH_MAX];
+  size_t              claimed_bitlen[MI_OS_PURGE_BATCH_MAX];
+} mi_arena_purge_batch_t;
+
+static void mi_arena_purge_batch_flush(mi_arena_t* arena, mi_arena_purge_batch_t* batch) {
+  bool is_zero = false;
+  const bool needs_recommit = _mi_os_purge_batch_flush(&batch->os, &is_zero);
+  const bool purge_is_zero = (is_zero && mi_memkind_is_os(arena->memid.memkind) && arena->blocks_dirty != NULL);
+  for (size_t i = 0; i < batch->purged_count; i++) {
+    // clear the purged blocks and update the committed bitmap
+    _mi_bitmap_unclaim_across(arena->blocks_purge, arena->field_count, batch->purged_blocks[i], batch->purged_index[i]);
+    // (and if they read as zero now, they can be handed out as zero initialized again)
+    if (purge_is_zero) {
+      _mi_bitmap_unclaim_across(arena->blocks_dirty, arena->field_count, batch->purged_blocks[i], batch->purged_index[i]);
+    }
+    if (needs_recommit) {
+      _mi_bitmap_unclaim_across(arena->blocks_committed, arena->field_count, batch->purged_blocks[i], batch->purged_index[i]);
+    }
+  }
+  batch->purged_count = 0;
+  for (size_t i = 0; i < batch->claimed_count; i++) {
+    // release the claimed `in_use` bits again
+    _mi_bitmap_unclaim(arena->blocks_inuse, arena->field_count, batch->claimed_bitlen[i], batch->claimed_index[i]);
+    _mi_bitmap_summary_set_free(arena->blocks_inuse_summary, batch->claimed_bitlen[i], batch->claimed_index[i]);
+  }
+  batch->claimed_count = 0;
+}
+
+// purge a range of blocks (or add it to the batch)
+// assumes we own the area (i.e. blocks_in_use is claimed by us)
+static void mi_arena_purge_batched(mi_arena_t* arena, mi_arena_purge_batch_t* batch, size_t bitmap_idx, size_t blocks) {
+  if (!_mi_bitmap_is_claimed_across(arena->blocks_committed, arena->field_count, blocks, bitmap_idx)) {
+    mi_arena_purge(arena, bitmap_idx, blocks);  // partially committed: purge right away
+    return;
+  }
+  if (batch->purged_count >= MI_OS_PURGE_BATCH_MAX) {
+    mi_arena_purge_batch_flush(arena, batch);
+  }
+  const bool added = _mi_os_purge_batch_add(&batch->os, mi_arena_block_start(arena, bitmap_idx), mi_arena_block_size(blocks));
+  mi_assert_internal(added); MI_UNUSED(added);  // as there are at most as many ranges as purged ranges
+  batch->purged_index[batch->purged_count] = bitmap_idx;
+  batch->purged_blocks[batch->purged_count] = blocks;
+  batch->purged_count++;
+}
+
 // purge a range of blocks
 // return true if the full range was purged.
 // assumes we own the area (i.e. blocks_in_use is claimed by us)
-static bool mi_arena_purge_range(mi_arena_t* arena, size_t idx, size_t startidx, size_t bitlen, size_t purge) {
+static bool mi_arena_purge_range(mi_arena_t* arena, mi_arena_purge_batch_t* batch, size_t idx, size_t startidx, size_t bitlen, size_t purge) {
   const size_t endidx = startidx + bitlen;
   size_t bitidx = startidx;
   bool all_purged = false;
@@ -532,7 +911,7 @@ static bool mi_arena_purge_range(mi_arena_t* arena, size_t idx, size_t startidx,
     if (count > 0) {
       // found range to be purged
       const mi_bitmap_index_t range_idx = mi_bitmap_index_create(idx, bitidx);
-      mi_arena_purge(arena, range_idx, count);
+      mi_arena_purge_batched(arena, batch, range_idx, count);
       if (count == bitlen) {
         all_purged = true;
       }
@@ -556,6 +935,10 @@ static bool mi_arena_try_purge(mi_arena_t* arena, mi_msecs_t now, bool force)
   mi_atomic_casi64_strong_acq_rel(&arena->purge_expire, &expire, (mi_msecs_t)0);
   
   // potential purges scheduled, walk through the bitmap
+  mi_arena_purge_batch_t batch;
+  _mi_os_purge_batch_init(&batch.os);
+  batch.purged_count = 0;
+  batch.claimed_count = 0;
   bool any_purged = false;
   bool full_purge = true;
   for (size_t i = 0; i < arena->field_count; i++) {
@@ -581,17 +964,23 @@ static bool mi_arena_try_purge(mi_arena_t* arena, mi_msecs_t now, bool force)
         if (bitlen > 0) {
           // read purge again now that we have the in_use bits
           purge = mi_atomic_load_acquire(&arena->blocks_purge[i]);
-          if (!mi_arena_purge_range(arena, i, bitidx, bitlen, purge)) {
+          if (!mi_arena_purge_range(arena, &batch, i, bitidx, bitlen, purge)) {
             full_purge = false;
           }
           any_purged = true;
-          // release the claimed `in_use` bits again
-          _mi_bitmap_unclaim(arena->blocks_inuse, arena->field_count, bitlen, bitmap_index);
+          // the claimed `in_use` bits are released again when the batch is flushed
+          if (batch.claimed_count >= MI_OS_PURGE_BATCH_MAX) {
+            mi_arena_purge_batch_flush(arena, &batch);
+          }
+          batch.claimed_index[batch.claimed_count] = bitmap_index;
+          batch.claimed_bitlen[batch.claimed_count] = bitlen;
+          batch.claimed_count++;
         }
         bitidx += (bitlen+1);  // +1 to skip the zero (or end)
       } // while bitidx
     } // purge != 0
   }
+  mi_arena_purge_batch_flush(arena, &batch);
   // if not fully purged, make sure to purge again in the future
   if (!full_purge) {
     const long delay = mi_arena_purge_delay();
@@ -622,7 +1011,7 @@ static void mi_arenas_try_purge( bool force, bool visit_all )
     size_t max_purge_count = (visit_all ? max_arena : 2);
     bool all_visited = true;
     for (size_t i = 0; i < max_arena; i++) {
-      mi_arena_t* arena = mi_atomic_load_ptr_acquire(mi_arena_t, &mi_arenas[i]);
+      mi_arena_t* arena = mi_arena_from_index(i);
       if (arena != NULL) {
         if (mi_arena_try_purge(arena, now, force)) {
           if (max_purge_count <= 1) {
@@ -641,6 +1030,78 @@ static void mi_arenas_try_purge( bool force, bool visit_all )
 }
 
 
+/* -----------------------------------------------------------
+  Background purging
+
+  If `mi_option_purge_background_interval` is set, a background thread
+  purges the arena's and the abandoned segments whose purge delay has
+  expired. This keeps the purge system calls (like `madvise`) off the
+  allocation and free paths of the mutator threads. Segments owned by
+  a live thread are still purged by that thread (as only the owner can
+  access its segments), and abandoned segments are only purged for the
+  main sub-process.
+----------------------------------------------------------- */
+
+#define MI_PURGER_NONE      (0)   // not started (yet)
+#define MI_PURGER_RUNNING   (1)
+#define MI_PURGER_STOPPING  (2)   // asked to stop
+#define MI_PURGER_STOPPED   (3)   // stopped, or failed to start
+
+#define MI_PURGER_SLEEP_MAX (10)  // sleep at most 10ms at a time to react quickly when stopping
+
+static _Atomic(size_t) mi_arenas_purger_state; // = MI_PURGER_NONE
+
+static void mi_arenas_purger(void* arg) {
+  MI_UNUSED(arg);
+  while (mi_atomic_load_acquire(&mi_arenas_purger_state) == MI_PURGER_RUNNING) {
+    // sleep for the wake interval
+    const mi_msecs_t interval = (mi_msecs_t)mi_option_get_clamp(mi_option_purge_background_interval, 1, 60*1000);
+    for (mi_msecs_t slept = 0; slept < interval && mi_atomic_load_relaxed(&mi_arenas_purger_state) == MI_PURGER_RUNNING; slept += MI_PURGER_SLEEP_MAX) {
+      _mi_prim_thread_sleep(interval - slept < MI_PURGER_SLEEP_MAX ? interval - slept : MI_PURGER_SLEEP_MAX);
+    }
+    if (mi_atomic_load_acquire(&mi_arenas_purger_state) != MI_PURGER_RUNNING) break;
+    // and purge what has expired
+    _mi_mem_pressure_poll();
+    mi_arenas_try_purge(false, true /* visit all */);
+    _mi_abandoned_purge(_mi_subproc_from_id(mi_subproc_main()), false /* force? */);
+  }
+  mi_atomic_store_release(&mi_arenas_purger_state, (size_t)MI_PURGER_STOPPED);
+}
+
+// The purger thread is not inherited by a forked child; it is restarted there on demand.
+static void mi_arenas_purger_atfork_child(void) {
+  mi_atomic_store_release(&mi_arenas_purger_state, (size_t)MI_PURGER_NONE);
+}
+
+// Returns `true` if the background purger is running (and starts it if needed)
+static bool mi_arenas_purger_ensure_started(void) {
+  size_t state = mi_atomic_load_relaxed(&mi_arenas_purger_state);
+  if mi_likely(state != MI_PURGER_NONE) return (state == MI_PURGER_RUNNING);
+  if (_mi_preloading() || mi_option_get(mi_option_purge_background_interval) <= 0) return false;
+  if (!mi_atomic_cas_strong_acq_rel(&mi_arenas_purger_state, &state, (size_t)MI_PURGER_RUNNING)) {
+    return (state == MI_PURGER_RUNNING);  // another thread started it
+  }
+  if (!_mi_prim_thread_start(&mi_arenas_purger, NULL)) {
+    _mi_verbose_message("unable to start the background purge thread\n");
+    mi_atomic_store_release(&mi_arenas_purger_state, (size_t)MI_PURGER_STOPPED);
+    return false;
+  }
+  static mi_atomic_once_t atfork_once;
+  if (mi_atomic_once(&atfork_once)) { _mi_prim_thread_atfork_child(&mi_arenas_purger_atfork_child); }
+  _mi_verbose_message("background purge thread started (interval %ld ms)\n", mi_option_get(mi_option_purge_background_interval));
+  return true;
+}
+
+// Stop the background purger (on process exit) and wait until it is no longer purging.
+void _mi_arenas_purger_done(void) {
+  size_t expected = MI_PURGER_RUNNING;
+  if (!mi_atomic_cas_strong_acq_rel(&mi_arenas_purger_state, &expected, (size_t)MI_PURGER_STOPPING)) return;
+  while (mi_atomic_load_acquire(&mi_arenas_purger_state) == MI_PURGER_STOPPING) {
+    _mi_prim_thread_sleep(1);
+  }
+}
+
+
 /* -----------------------------------------------------------
   Arena free
 ----------------------------------------------------------- */
@@ -669,7 +1130,7 @@ void _mi_arena_free(void* p, size_t size, size_t committed_size, mi_memid_t memi
     size_t bitmap_idx;
     mi_arena_memid_indices(memid, &arena_idx, &bitmap_idx);
     mi_assert_internal(arena_idx < MI_MAX_ARENAS);
-    mi_arena_t* arena = mi_atomic_load_ptr_acquire(mi_arena_t,&mi_arenas[arena_idx]);
+    mi_arena_t* arena = mi_arena_from_index(arena_idx);
     mi_assert_internal(arena != NULL);
     const size_t blocks = mi_block_count_of_size(size);
 
@@ -711,18 +1172,22 @@ void _mi_arena_free(void* p, size_t size, size_t committed_size, mi_memid_t memi
 
     // and make it available to others again
     bool all_inuse = _mi_bitmap_unclaim_across(arena->blocks_inuse, arena->field_count, blocks, bitmap_idx);
+    _mi_bitmap_summary_set_free(arena->blocks_inuse_summary, blocks, bitmap_idx);
     if (!all_inuse) {
       _mi_error_message(EAGAIN, "trying to free an already freed arena block: %p, size %zu\n", p, size);
       return;
     };
+    mi_atomic_sub_relaxed(&arena->blocks_used, blocks);
   }
   else {
     // arena was none, external, or static; nothing to do
     mi_assert_internal(memid.memkind < MI_MEM_OS);
   }
 
-  // purge expired decommits
-  mi_arenas_try_purge(false, false);
+  // purge expired decommits (unless the background purger takes care of it)
+  if (!mi_arenas_purger_ensure_started()) {
+    mi_arenas_try_purge(false, false);
+  }
 }
 
 // destroy owned arenas; this is unsafe and should only be done using `mi_option_destroy_on_exit`
@@ -731,11 +1196,11 @@ static void mi_arenas_unsafe_destroy(void) {
   const size_t max_arena = mi_atomic_load_relaxed(&mi_arena_count);
   size_t new_max_arena = 0;
   for (size_t i = 0; i < max_arena; i++) {
-    mi_arena_t* arena = mi_atomic_load_ptr_acquire(mi_arena_t, &mi_arenas[i]);
+    mi_arena_t* arena = mi_arena_from_index(i);
     if (arena != NULL) {
       mi_lock_done(&arena->abandoned_visit_lock);
       if (arena->start != NULL && mi_memkind_is_os(arena->memid.memkind)) {
-        mi_atomic_store_ptr_release(mi_arena_t, &mi_arenas[i], NULL);
+        mi_atomic_store_ptr_release(mi_arena_t, mi_arena_slot(i, false), NULL);
         _mi_os_free(arena->start, mi_arena_size(arena), arena->memid);
       }
       else {
@@ -748,6 +1213,16 @@ static void mi_arenas_unsafe_destroy(void) {
   // try to lower the max arena.
   size_t expected = max_arena;
   mi_atomic_cas_strong_acq_rel(&mi_arena_count, &expected, new_max_arena);
+
+  // and reset the candidate lists (from the remaining arenas)
+  for (size_t n = 0; n <= MI_ARENA_NUMA_LISTS; n++) {
+    mi_atomic_store_release(&mi_arena_lists[n].count, (size_t)0);
+  }
+  mi_atomic_store_release(&mi_arena_lists_overflow, (size_t)0);
+  for (size_t i = 0; i < mi_atomic_load_relaxed(&mi_arena_count); i++) {
+    mi_arena_t* arena = mi_arena_from_index(i);
+    if (arena != NULL && !arena->exclusive) { mi_arena_list_add(arena, i); }
+  }
 }
 
 // Purge the arenas; if `force_purge` is true, amenable parts are purged even if not yet expired
@@ -755,6 +1230,20 @@ void _mi_arenas_collect(bool force_purge) {
   mi_arenas_try_purge(force_purge, force_purge /* visit all? */);
 }
 
+// Force purge the arenas whose index is `part` modulo `parts`; the parts can be purged
+// concurrently by different threads (see `heap.c:mi_heap_collect_parallel`)
+void _mi_arenas_collect_part(size_t part, size_t parts) {
+  if (_mi_preloading() || mi_arena_purge_delay() <= 0 || parts == 0) return;
+  const mi_msecs_t now = _mi_clock_now();
+  const size_t max_arena = mi_atomic_load_acquire(&mi_arena_count);
+  for (size_t i = part; i < max_arena; i += parts) {
+    mi_arena_t* arena = mi_arena_from_index(i);
+    if (arena != NULL) {
+      mi_arena_try_purge(arena, now, true);
+    }
+  }
+}
+
 // destroy owned arenas; this is unsafe and should only be done using `mi_option_destroy_on_exit`
 // for dynamic libraries that are unloaded and need to release all their allocated memory.
 void _mi_arena_unsafe_destroy_all(void) {
@@ -766,7 +1255,7 @@ void _mi_arena_unsafe_destroy_all(void) {
 bool _mi_arena_contains(const void* p) {
   const size_t max_arena = mi_atomic_load_relaxed(&mi_arena_count);
   for (size_t i = 0; i < max_arena; i++) {
-    mi_arena_t* arena = mi_atomic_load_ptr_relaxed(mi_arena_t, &mi_arenas[i]);
+    mi_arena_t* arena = mi_arena_from_index(i);
     if (arena != NULL && arena->start <= (const uint8_t*)p && arena->start + mi_arena_block_size(arena->block_count) > (const uint8_t*)p) {
       return true;
     }
@@ -785,17 +1274,78 @@ static bool mi_arena_add(mi_arena_t* arena, mi_arena_id_t* arena_id, mi_stats_t*
   if (arena_id != NULL) { *arena_id = -1; }
 
   size_t i = mi_atomic_increment_acq_rel(&mi_arena_count);
-  if (i >= MI_MAX_ARENAS) {
+  _Atomic(mi_arena_t*)* slot = mi_arena_slot(i, true);
+  if (slot == NULL) {
     mi_atomic_decrement_acq_rel(&mi_arena_count);
     return false;
   }
   _mi_stat_counter_increase(&stats->arena_count,1);
   arena->id = mi_arena_id_create(i);
-  mi_atomic_store_ptr_release(mi_arena_t,&mi_arenas[i], arena);
+  mi_atomic_store_ptr_release(mi_arena_t, slot, arena);
+  if (!arena->exclusive) { mi_arena_list_add(arena, i); }
   if (arena_id != NULL) { *arena_id = arena->id; }
   return true;
 }
 
+// Size of the arena meta data: the arena structure including its bitmaps
+static size_t mi_arena_meta_size(size_t bcount, bool is_pinned) {
+  const size_t fields = _mi_divide_up(bcount, MI_BITMAP_FIELD_BITS);
+  const size_t bitmaps = (is_pinned ? 3 : 5);
+  const size_t summary_fields = mi_bitmap_summary_fields(fields);
+  return sizeof(mi_arena_t) + ((bitmaps*fields + summary_fields)*sizeof(mi_bitmap_field_t)) + (fields*MI_BITMAP_FIELD_BITS*sizeof(size_t));
+}
+
+// Set the fields that are not persistent
+static void mi_arena_init_runtime(mi_arena_t* arena, int numa_node, bool exclusive) {
+  arena->id = _mi_arena_id_none();
+  arena->exclusive    = exclusive;
+  arena->numa_node    = numa_node; // TODO: or get the current numa node if -1? (now it allows anyone to allocate on -1)
+  arena->purge_expire = 0;
+  arena->search_idx   = 0;
+  arena->blocks_used  = 0;
+  arena->limit_soft   = 0;
+  arena->limit_hard   = 0;
+  arena->file_header  = NULL;
+  mi_lock_init(&arena->abandoned_visit_lock);
+  // consecutive bitmaps after the arena structure
+  const size_t fields  = arena->field_count;
+  const size_t bitmaps = (arena->memid.is_pinned ? 3 : 5);
+  arena->blocks_inuse     = (mi_bitmap_field_t*)(arena + 1);
+  arena->blocks_dirty     = &arena->blocks_inuse[fields];     // just after inuse bitmap
+  arena->blocks_abandoned = &arena->blocks_inuse[2 * fields]; // just after dirty bitmap
+  arena->blocks_committed = (arena->memid.is_pinned ? NULL : &arena->blocks_inuse[3*fields]); // just after abandoned bitmap
+  arena->blocks_purge     = (arena->memid.is_pinned ? NULL : &arena->blocks_inuse[4*fields]); // just after committed bitmap
+  arena->blocks_inuse_summary = &arena->blocks_inuse[bitmaps*fields];  // just after the last bitmap
+  arena->blocks_abandoned_fit = (_Atomic(size_t)*)&arena->blocks_inuse[bitmaps*fields + mi_bitmap_summary_fields(fields)]; // just after the summary
+}
+
+// Initialize a fresh arena structure of `asize` bytes (which is zero initialized)
+static void mi_arena_init(mi_arena_t* arena, size_t asize, mi_memid_t meta_memid, void* start, size_t bcount, bool is_large, int numa_node, bool exclusive, mi_memid_t memid) {
+  arena->memid = memid;
+  arena->meta_size = asize;
+  arena->meta_memid = meta_memid;
+  arena->block_count = bcount;
+  arena->field_count = _mi_divide_up(bcount, MI_BITMAP_FIELD_BITS);
+  arena->start = (uint8_t*)start;
+  arena->is_large     = is_large;
+  mi_arena_init_runtime(arena, numa_node, exclusive);
+  const size_t fields = arena->field_count;
+  _mi_bitmap_summary_init(arena->blocks_inuse_summary, fields);
+  // initialize committed bitmap?
+  if (arena->blocks_committed != NULL && arena->memid.initially_committed) {
+    memset((void*)arena->blocks_committed, 0xFF, fields*sizeof(mi_bitmap_field_t)); // cast to void* to avoid atomic warning
+  }
+
+  // and claim leftover blocks if needed (so we never allocate there)
+  ptrdiff_t post = (fields * MI_BITMAP_FIELD_BITS) - bcount;
+  mi_assert_internal(post >= 0);
+  if (post > 0) {
+    // don't use leftover bits at the end
+    mi_bitmap_index_t postidx = mi_bitmap_index_create(fields - 1, MI_BITMAP_FIELD_BITS - post);
+    _mi_bitmap_claim(arena->blocks_inuse, fields, post, postidx, NULL);
+  }
+}
+
 static bool mi_manage_os_memory_ex2(void* start, size_t size, bool is_large, int numa_node, bool exclusive, mi_memid_t memid, mi_arena_id_t* arena_id) mi_attr_noexcept
 {
   if (arena_id != NULL) *arena_id = _mi_arena_id_none();
@@ -818,46 +1368,14 @@ static bool mi_manage_os_memory_ex2(void* start, size_t size, bool is_large, int
   }
 
   const size_t bcount = size / MI_ARENA_BLOCK_SIZE;
-  const size_t fields = _mi_divide_up(bcount, MI_BITMAP_FIELD_BITS);
-  const size_t bitmaps = (memid.is_pinned ? 3 : 5);
-  const size_t asize  = sizeof(mi_arena_t) + (bitmaps*fields*sizeof(mi_bitmap_field_t));
+  const size_t asize  = mi_arena_meta_size(bcount, memid.is_pinned);
   mi_memid_t meta_memid;
   mi_arena_t* arena   = (mi_arena_t*)_mi_arena_meta_zalloc(asize, &meta_memid);
   if (arena == NULL) return false;
 
   // already zero'd due to zalloc
   // _mi_memzero(arena, asize);
-  arena->id = _mi_arena_id_none();
-  arena->memid = memid;
-  arena->exclusive = exclusive;
-  arena->meta_size = asize;
-  arena->meta_memid = meta_memid;
-  arena->block_count = bcount;
-  arena->field_count = fields;
-  arena->start = (uint8_t*)start;
-  arena->numa_node    = numa_node; // TODO: or get the current numa node if -1? (now it allows anyone to allocate on -1)
-  arena->is_large     = is_large;
-  arena->purge_expire = 0;
-  arena->search_idx   = 0;
-  mi_lock_init(&arena->abandoned_visit_lock);
-  // consecutive bitmaps
-  arena->blocks_dirty     = &arena->blocks_inuse[fields];     // just after inuse bitmap
-  arena->blocks_abandoned = &arena->blocks_inuse[2 * fields]; // just after dirty bitmap
-  arena->blocks_committed = (arena->memid.is_pinned ? NULL : &arena->blocks_inuse[3*fields]); // just after abandoned bitmap
-  arena->blocks_purge     = (arena->memid.is_pinned ? NULL : &arena->blocks_inuse[4*fields]); // just after committed bitmap
-  // initialize committed bitmap?
-  if (arena->blocks_committed != NULL && arena->memid.initially_committed) {
-    memset((void*)arena->blocks_committed, 0xFF, fields*sizeof(mi_bitmap_field_t)); // cast to void* to avoid atomic warning
-  }
-
-  // and claim leftover blocks if needed (so we never allocate there)
-  ptrdiff_t post = (fields * MI_BITMAP_FIELD_BITS) - bcount;
-  mi_assert_internal(post >= 0);
-  if (post > 0) {
-    // don't use leftover bits at the end
-    mi_bitmap_index_t postidx = mi_bitmap_index_create(fields - 1, MI_BITMAP_FIELD_BITS - post);
-    _mi_bitmap_claim(arena->blocks_inuse, fields, post, postidx, NULL);
-  }
+  mi_arena_init(arena, asize, meta_memid, start, bcount, is_large, numa_node, exclusive, memid);
   return mi_arena_add(arena, arena_id, &_mi_stats_main);
 
 }
@@ -899,6 +1417,324 @@ int mi_reserve_os_memory(size_t size, bool commit, bool allow_large) mi_attr_noe
 }
 
 
+// count the set bits for the first `block_count` blocks (the bits beyond that are always set in the inuse bitmap)
+static size_t mi_bitmap_count_bits(const mi_bitmap_field_t* fields, size_t block_count) {
+  size_t count = 0;
+  const size_t field_count = _mi_divide_up(block_count, MI_BITMAP_FIELD_BITS);
+  for (size_t i = 0; i < field_count; i++) {
+    size_t field = mi_atomic_load_relaxed(&((mi_bitmap_field_t*)fields)[i]);
+    const size_t bits = block_count - (i * MI_BITMAP_FIELD_BITS);
+    if (bits < MI_BITMAP_FIELD_BITS) { field &= (((size_t)1 << bits) - 1); }
+    while (field != 0) { field &= (field - 1); count++; }  // clear lowest bit
+  }
+  return count;
+}
+
+/* -----------------------------------------------------------
+  File backed arenas
+  The file layout is the arena blocks followed by a header and the
+  arena structure itself (including the persistent bitmaps). The
+  header records the address as blocks contain absolute pointers.
+----------------------------------------------------------- */
+
+#define MI_ARENA_FILE_MAGIC   (0x616e6572612d696dULL)  // "mi-arena"
+#define MI_ARENA_FILE_VERSION (1)
+
+typedef struct mi_arena_file_header_s {
+  uint64_t    magic;
+  uint64_t    version;
+  uintptr_t   start;          // address the file is mapped at
+  size_t      block_count;
+  size_t      meta_size;      // size of the arena structure that follows the header
+  size_t      layout;         // sizes of the arena, segment, and page structures (to detect incompatible builds)
+  void*       root;           // user root pointer
+} mi_arena_file_header_t;
+
+#define MI_ARENA_FILE_HEADER_SIZE  _mi_align_up(sizeof(mi_arena_file_header_t), MI_MAX_ALIGN_SIZE)
+
+static size_t mi_arena_file_layout(void) {
+  return (sizeof(mi_arena_t) ^ (sizeof(mi_segment_t) << 16) ^ (sizeof(mi_page_t) << 40) ^ ((size_t)MI_ARENA_BLOCK_SIZE >> 16));
+}
+
+// Re-attach the arena of a mapped file: reset the runtime state and make all segments abandoned
+static bool mi_arena_file_reattach(mi_arena_t* arena, mi_arena_file_header_t* header, bool exclusive, mi_arena_id_t* arena_id) {
+  mi_arena_init_runtime(arena, -1, exclusive);
+  arena->file_header = header;
+  arena->blocks_used = mi_bitmap_count_bits(arena->blocks_inuse, arena->block_count);
+  // clear the abandoned state of the previous process (and set it again once the segments are re-attached)
+  memset((void*)arena->blocks_abandoned, 0, arena->field_count*sizeof(mi_bitmap_field_t));
+  if (!mi_arena_add(arena, arena_id, &_mi_stats_main)) return false;
+
+  mi_subproc_t* const subproc = mi_heap_get_default()->tld->segments.subproc;
+  size_t reattached = 0;
+  for (size_t bidx = 0; bidx < arena->block_count; bidx++) {
+    const mi_bitmap_index_t bitmap_idx = mi_bitmap_index_create(bidx / MI_BITMAP_FIELD_BITS, bidx % MI_BITMAP_FIELD_BITS);
+    if (!_mi_bitmap_is_claimed(arena->blocks_inuse, arena->field_count, 1, bitmap_idx)) continue;
+    mi_segment_t* const segment = (mi_segment_t*)mi_arena_block_start(arena, bitmap_idx);
+    if (!_mi_segment_reattach(segment, bitmap_idx, arena->id, arena->exclusive, subproc)) {
+      _mi_warning_message("unable to re-attach the arena block at %p (the block stays in use)\n", segment);
+      continue;
+    }
+    _mi_arena_segment_mark_abandoned(segment);
+    reattached++;
+    bidx += mi_block_count_of_size(mi_segment_size(segment)) - 1;  // skip the remaining blocks of the segment
+  }
+  _mi_verbose_message("re-attached %zu segments in the arena at %p\n", reattached, arena->start);
+  return true;
+}
+
+// Reserve an arena backed by an open file, re-attaching an existing arena in the file
+static int mi_reserve_file_memory_fd(int fd, const char* path, size_t size, bool exclusive, mi_arena_id_t* arena_id) {
+  // read the header of an existing arena
+  size_t file_size = 0;
+  int err = _mi_prim_file_size(fd, &file_size);
+  if (err != 0) return err;
+  mi_arena_file_header_t existing;
+  _mi_memzero_var(existing);
+  size_t bcount = file_size / MI_ARENA_BLOCK_SIZE;
+  if (file_size > 0) {
+    err = (bcount == 0 ? EINVAL : _mi_prim_file_read(fd, bcount * MI_ARENA_BLOCK_SIZE, &existing, sizeof(existing)));
+    if (err == 0 && (existing.magic != MI_ARENA_FILE_MAGIC || existing.version != MI_ARENA_FILE_VERSION ||
+                     existing.block_count != bcount || existing.meta_size != mi_arena_meta_size(bcount, true) ||
+                     existing.layout != mi_arena_file_layout() || existing.start == 0)) {
+      err = EINVAL;
+    }
+    if (err != 0) {
+      _mi_warning_message("the file does not contain a compatible arena: %s (error %d)\n", path, err);
+      return err;
+    }
+  }
+  else {
+    bcount = _mi_divide_up(size, MI_ARENA_BLOCK_SIZE);
+    if (bcount == 0) return EINVAL;
+  }
+
+  // and map the file
+  mi_memid_t memid = _mi_memid_create(MI_MEM_EXTERNAL);
+  memid.initially_committed = true;
+  memid.initially_zero = true;   // fresh files are zero and existing arenas keep their dirty bitmap
+  memid.is_pinned = true;        // file backed memory is not decommitted
+  const size_t asize = mi_arena_meta_size(bcount, memid.is_pinned);
+  const size_t arena_size = bcount * MI_ARENA_BLOCK_SIZE;
+  const size_t mapped_size = arena_size + _mi_align_up(MI_ARENA_FILE_HEADER_SIZE + asize, _mi_os_large_page_size());
+  void* start = NULL;
+  err = _mi_prim_file_map(fd, mapped_size, (void*)existing.start, MI_SEGMENT_ALIGN, &start);
+  if (err != 0) {
+    _mi_warning_message("unable to map the arena file: %s (error %d%s)\n", path, err, (err == EEXIST ? ", the address is already in use" : ""));
+    return err;
+  }
+  mi_assert_internal(_mi_is_aligned(start, MI_SEGMENT_ALIGN));
+  mi_arena_file_header_t* const header = (mi_arena_file_header_t*)((uint8_t*)start + arena_size);
+  mi_arena_t* const arena = (mi_arena_t*)((uint8_t*)header + MI_ARENA_FILE_HEADER_SIZE);
+  const mi_memid_t meta_memid = _mi_memid_create(MI_MEM_EXTERNAL);
+  bool ok;
+  if (header->magic == MI_ARENA_FILE_MAGIC) {
+    // an existing arena
+    arena->memid = memid;
+    arena->meta_memid = meta_memid;
+    arena->start = (uint8_t*)start;
+    ok = mi_arena_file_reattach(arena, header, exclusive, arena_id);
+  }
+  else {
+    // a fresh arena; the header magic is set last
+    mi_arena_init(arena, asize, meta_memid, start, bcount, false, -1, exclusive, memid);
+    arena->file_header = header;
+    header->version = MI_ARENA_FILE_VERSION;
+    header->start = (uintptr_t)start;
+    header->block_count = bcount;
+    header->meta_size = asize;
+    header->layout = mi_arena_file_layout();
+    header->root = NULL;
+    header->magic = MI_ARENA_FILE_MAGIC;
+    ok = mi_arena_add(arena, arena_id, &_mi_stats_main);
+  }
+  if (!ok) {
+    _mi_prim_free(start, mapped_size);
+    return ENOMEM;
+  }
+  _mi_verbose_message("reserved %zu KiB file backed memory at %p (%s)\n", _mi_divide_up(arena_size, 1024), start, path);
+  return 0;
+}
+
+// Reserve an arena backed by the file at `path`, re-attaching an existing arena in the file
+int mi_reserve_file_memory_ex(const char* path, size_t size, bool exclusive, mi_arena_id_t* arena_id) mi_attr_noexcept {
+  if (arena_id != NULL) *arena_id = _mi_arena_id_none();
+  if (path == NULL) return EINVAL;
+  int fd = -1;
+  int err = _mi_prim_file_open(path, &fd);
+  if (err != 0) return err;
+  err = mi_reserve_file_memory_fd(fd, path, size, exclusive, arena_id);
+  _mi_prim_file_close(fd);
+  return err;
+}
+
+// Return the location of the user root pointer of a file backed arena (or NULL)
+void** mi_arena_file_root(mi_arena_id_t arena_id) mi_attr_noexcept {
+  mi_arena_t* const arena = mi_arena_from_index(mi_arena_id_index(arena_id));
+  if (arena == NULL || arena->file_header == NULL) return NULL;
+  return &((mi_arena_file_header_t*)arena->file_header)->root;
+}
+
+
+/* -----------------------------------------------------------
+  Shared arenas
+  Cooperating processes map the same shared memory at the same address.
+  The in-use and dirty bitmaps (and the in-use summary) are in the shared
+  memory after the arena blocks and are updated atomically by all processes.
+  The arena structure itself and the abandoned bitmap are local to each
+  process such that a process only reclaims its own segments.
+----------------------------------------------------------- */
+
+#define MI_ARENA_SHARED_MAGIC         ((size_t)0x6d692d73)   // "mi-s"
+#define MI_ARENA_SHARED_INITIALIZING  ((size_t)1)
+#define MI_ARENA_SHARED_VERSION       (1)
+
+typedef struct mi_arena_shared_header_s {
+  _Atomic(size_t) magic;          // 0, initializing, or the magic once initialized
+  size_t          version;
+  uintptr_t       start;          // address at which all processes map the memory
+  size_t          block_count;
+  size_t          layout;         // to detect incompatible builds
+  _Atomic(size_t) attach_count;   // number of times a process attached
+} mi_arena_shared_header_t;
+
+#define MI_ARENA_SHARED_HEADER_SIZE  _mi_align_up(sizeof(mi_arena_shared_header_t), MI_MAX_ALIGN_SIZE)
+
+static size_t mi_arena_shared_size(size_t bcount) {
+  const size_t fields = _mi_divide_up(bcount, MI_BITMAP_FIELD_BITS);
+  const size_t shared_size = MI_ARENA_SHARED_HEADER_SIZE + (2*fields + mi_bitmap_summary_fields(fields))*sizeof(mi_bitmap_field_t);
+  return (bcount * MI_ARENA_BLOCK_SIZE) + _mi_align_up(shared_size, _mi_os_large_page_size());
+}
+
+static mi_arena_shared_header_t* mi_arena_shared_header(void* start, size_t bcount) {
+  return (mi_arena_shared_header_t*)((uint8_t*)start + (bcount * MI_ARENA_BLOCK_SIZE));
+}
+
+static mi_bitmap_field_t* mi_arena_shared_bitmaps(mi_arena_shared_header_t* header) {
+  return (mi_bitmap_field_t*)((uint8_t*)header + MI_ARENA_SHARED_HEADER_SIZE);
+}
+
+// Initialize the shared header and bitmaps if this is the first process to use the memory
+static void mi_arena_shared_try_init(mi_arena_shared_header_t* header, void* start, size_t bcount) {
+  size_t expected = 0;
+  if (!mi_atomic_cas_strong_acq_rel(&header->magic, &expected, MI_ARENA_SHARED_INITIALIZING)) return;
+  const size_t fields = _mi_divide_up(bcount, MI_BITMAP_FIELD_BITS);
+  mi_bitmap_field_t* const bitmaps = mi_arena_shared_bitmaps(header);
+  _mi_bitmap_summary_init(&bitmaps[2*fields], fields);
+  const ptrdiff_t post = (fields * MI_BITMAP_FIELD_BITS) - bcount;
+  if (post > 0) {
+    // don't use leftover bits at the end
+    mi_bitmap_index_t postidx = mi_bitmap_index_create(fields - 1, MI_BITMAP_FIELD_BITS - post);
+    _mi_bitmap_claim(bitmaps, fields, post, postidx, NULL);
+  }
+  header->version = MI_ARENA_SHARED_VERSION;
+  header->start = (uintptr_t)start;
+  header->block_count = bcount;
+  header->layout = mi_arena_file_layout();
+  mi_atomic_store_release(&header->magic, MI_ARENA_SHARED_MAGIC);
+}
+
+// Reserve an arena in shared memory given by an open file (like a `memfd` or a file in `/dev/shm`)
+int mi_reserve_shared_fd_ex(int fd, size_t size, mi_arena_id_t* arena_id) mi_attr_noexcept {
+  if (arena_id != NULL) *arena_id = _mi_arena_id_none();
+
+  // is the memory already initialized by another process?
+  size_t file_size = 0;
+  int err = _mi_prim_file_size(fd, &file_size);
+  if (err != 0) return err;
+  mi_arena_shared_header_t existing;
+  _mi_memzero_var(existing);
+  size_t bcount = (file_size > 0 ? file_size / MI_ARENA_BLOCK_SIZE : _mi_divide_up(size, MI_ARENA_BLOCK_SIZE));
+  if (bcount == 0) return EINVAL;
+  if (file_size > 0) {
+    err = _mi_prim_file_read(fd, bcount * MI_ARENA_BLOCK_SIZE, &existing, sizeof(existing));
+    if (err != 0) return err;
+  }
+  const bool initialized = (mi_atomic_load_relaxed(&existing.magic) == MI_ARENA_SHARED_MAGIC);
+
+  // map it (at the shared address if it is initialized already)
+  size_t mapped_size = mi_arena_shared_size(bcount);
+  void* start = NULL;
+  err = _mi_prim_file_map(fd, mapped_size, (initialized ? (void*)existing.start : NULL), MI_SEGMENT_ALIGN, &start);
+  mi_arena_shared_header_t* header = (err == 0 ? mi_arena_shared_header(start, bcount) : NULL);
+  if (header != NULL) {
+    mi_arena_shared_try_init(header, start, bcount);
+    for (size_t i = 0; i < 1000 && mi_atomic_load_acquire(&header->magic) == MI_ARENA_SHARED_INITIALIZING; i++) {
+      _mi_prim_thread_sleep(1);  // another process is initializing
+    }
+    if (mi_atomic_load_acquire(&header->magic) != MI_ARENA_SHARED_MAGIC || header->version != MI_ARENA_SHARED_VERSION ||
+        header->layout != mi_arena_file_layout() || header->start == 0 || header->block_count == 0) {
+      _mi_prim_free(start, mapped_size);
+      header = NULL;
+      err = EINVAL;
+    }
+    else if (header->start != (uintptr_t)start || header->block_count != bcount) {
+      // initialized concurrently by another process: map again at its address and size
+      void* const shared_start = (void*)header->start;
+      const size_t shared_bcount = header->block_count;
+      _mi_prim_free(start, mapped_size);
+      bcount = shared_bcount;
+      mapped_size = mi_arena_shared_size(bcount);
+      err = _mi_prim_file_map(fd, mapped_size, shared_start, MI_SEGMENT_ALIGN, &start);
+      header = (err == 0 ? mi_arena_shared_header(start, bcount) : NULL);
+    }
+  }
+  if (header == NULL) {
+    _mi_warning_message("unable to map the shared arena memory (error %d%s)\n", err, (err == EEXIST ? ", the address is already in use" : ""));
+    return err;
+  }
+
+  // create the local arena structure with a local abandoned bitmap
+  const size_t fields = _mi_divide_up(bcount, MI_BITMAP_FIELD_BITS);
+  const size_t asize  = sizeof(mi_arena_t) + (fields*sizeof(mi_bitmap_field_t)) + (fields*MI_BITMAP_FIELD_BITS*sizeof(size_t));
+  mi_memid_t meta_memid;
+  mi_arena_t* arena = (mi_arena_t*)_mi_arena_meta_zalloc(asize, &meta_memid);
+  if (arena == NULL) {
+    _mi_prim_free(start, mapped_size);
+    return ENOMEM;
+  }
+  mi_memid_t memid = _mi_memid_create(MI_MEM_EXTERNAL);
+  memid.initially_committed = true;
+  memid.initially_zero = true;   // shared memory starts out zero and the dirty bitmap is shared
+  memid.is_pinned = true;        // shared memory is not decommitted
+  arena->memid = memid;
+  arena->meta_size = asize;
+  arena->meta_memid = meta_memid;
+  arena->block_count = bcount;
+  arena->field_count = fields;
+  arena->start = (uint8_t*)start;
+  arena->is_large = false;
+  mi_arena_init_runtime(arena, -1, true /* exclusive */);
+  mi_bitmap_field_t* const shared = mi_arena_shared_bitmaps(header);
+  arena->blocks_inuse = shared;
+  arena->blocks_dirty = &shared[fields];
+  arena->blocks_inuse_summary = &shared[2*fields];
+  arena->blocks_abandoned = (mi_bitmap_field_t*)(arena + 1);
+  arena->blocks_abandoned_fit = (_Atomic(size_t)*)&arena->blocks_abandoned[fields];
+  arena->blocks_used = mi_bitmap_count_bits(arena->blocks_inuse, bcount);
+  if (!mi_arena_add(arena, arena_id, &_mi_stats_main)) {
+    _mi_arena_meta_free(arena, meta_memid, asize);
+    _mi_prim_free(start, mapped_size);
+    return ENOMEM;
+  }
+  const size_t count = mi_atomic_increment_relaxed(&header->attach_count);
+  _mi_verbose_message("attached %zu KiB shared memory at %p (attached %zu times)\n", _mi_divide_up(bcount * MI_ARENA_BLOCK_SIZE, 1024), start, count + 1);
+  return 0;
+}
+
+// Reserve an arena in shared memory backed by the file at `path` (like a file in `/dev/shm` or on a hugetlbfs)
+int mi_reserve_shared_memory_ex(const char* path, size_t size, mi_arena_id_t* arena_id) mi_attr_noexcept {
+  if (arena_id != NULL) *arena_id = _mi_arena_id_none();
+  if (path == NULL) return EINVAL;
+  int fd = -1;
+  int err = _mi_prim_file_open(path, &fd);
+  if (err != 0) return err;
+  err = mi_reserve_shared_fd_ex(fd, size, arena_id);
+  _mi_prim_file_close(fd);
+  return err;
+}
+
+
 /* -----------------------------------------------------------
   Debugging
 ----------------------------------------------------------- */
@@ -933,7 +1769,7 @@ void mi_debug_show_arenas(bool show_inuse) mi_attr_noexcept {
   //size_t abandoned_total = 0;
   //size_t purge_total = 0;
   for (size_t i = 0; i < max_arenas; i++) {
-    mi_arena_t* arena = mi_atomic_load_ptr_relaxed(mi_arena_t, &mi_arenas[i]);
+    mi_arena_t* arena = mi_arena_from_index(i);
     if (arena == NULL) break;
     _mi_verbose_message("arena %zu: %zu blocks of size %zuMiB (in %zu fields) %s\n", i, arena->block_count, MI_ARENA_BLOCK_SIZE / MI_MiB, arena->field_count, (arena->memid.is_pinned ? ", pinned" : ""));
     if (show_inuse) {
@@ -954,33 +1790,82 @@ void mi_debug_show_arenas(bool show_inuse) mi_attr_noexcept {
   //if (show_purge)     _mi_verbose_message("total purgeable blocks: %zu\n", purge_total);
 }
 
+// Snapshot the block usage of the arena at `arena_index` (without locks or allocation)
+bool _mi_arena_stats_at(size_t arena_index, mi_arena_stats_t* st) {
+  if (arena_index >= mi_atomic_load_relaxed(&mi_arena_count)) return false;
+  mi_arena_t* arena = mi_arena_from_index(arena_index);
+  if (arena == NULL) return false;
+  st->id            = arena->id;
+  st->size          = arena->block_count * MI_ARENA_BLOCK_SIZE;
+  st->inuse         = mi_bitmap_count_bits(arena->blocks_inuse, arena->block_count) * MI_ARENA_BLOCK_SIZE;
+  st->committed     = (arena->blocks_committed == NULL ? st->size : mi_bitmap_count_bits(arena->blocks_committed, arena->block_count) * MI_ARENA_BLOCK_SIZE);
+  st->purge_pending = (arena->blocks_purge == NULL ? 0 : mi_bitmap_count_bits(arena->blocks_purge, arena->block_count) * MI_ARENA_BLOCK_SIZE);
+  st->abandoned     = mi_bitmap_count_bits(arena->blocks_abandoned, arena->block_count) * MI_ARENA_BLOCK_SIZE;
+  st->numa_node     = arena->numa_node;
+  st->exclusive     = arena->exclusive;
+  st->is_large      = arena->is_large;
+  st->is_pinned     = arena->memid.is_pinned;
+  return true;
+}
+
+// Snapshot the block usage of each arena into `stats` (for at most `max_count` arenas).
+// Returns the total number of arenas (which can be larger than `max_count`).
+size_t mi_arenas_stats(mi_arena_stats_t* stats, size_t max_count) mi_attr_noexcept {
+  mi_arena_stats_t st;
+  size_t count = 0;
+  while (_mi_arena_stats_at(count, (stats != NULL && count < max_count ? &stats[count] : &st))) {
+    count++;
+  }
+  return count;
+}
+
+// Limit the memory claimed from an arena: beyond the `soft_limit` any pending
+// purges are done eagerly, and beyond the `hard_limit` allocation from the arena fails.
+// A limit of 0 means no limit.
+bool mi_arena_set_limits(mi_arena_id_t arena_id, size_t soft_limit, size_t hard_limit) mi_attr_noexcept {
+  const size_t arena_index = mi_arena_id_index(arena_id);
+  if (arena_index >= mi_atomic_load_relaxed(&mi_arena_count)) return false;
+  mi_arena_t* arena = mi_arena_from_index(arena_index);
+  if (arena == NULL) return false;
+  arena->limit_soft = soft_limit;
+  arena->limit_hard = hard_limit;
+  return true;
+}
+
 
 /* -----------------------------------------------------------
   Reserve a huge page arena.
 ----------------------------------------------------------- */
-// reserve at a specific numa node
-int mi_reserve_huge_os_pages_at_ex(size_t pages, int numa_node, size_t timeout_msecs, bool exclusive, mi_arena_id_t* arena_id) mi_attr_noexcept {
+// reserve at a specific numa node (and return the number of pages actually reserved in `pages_reserved`)
+static int mi_reserve_huge_os_pages_at_ex2(size_t pages, int numa_node, size_t timeout_msecs, bool exclusive, mi_arena_id_t* arena_id, size_t* pages_reserved) {
   if (arena_id != NULL) *arena_id = -1;
+  *pages_reserved = 0;
   if (pages==0) return 0;
   if (numa_node < -1) numa_node = -1;
   if (numa_node >= 0) numa_node = numa_node % _mi_os_numa_node_count();
   size_t hsize = 0;
-  size_t pages_reserved = 0;
+  size_t reserved = 0;
   mi_memid_t memid;
-  void* p = _mi_os_alloc_huge_os_pages(pages, numa_node, timeout_msecs, &pages_reserved, &hsize, &memid);
-  if (p==NULL || pages_reserved==0) {
+  void* p = _mi_os_alloc_huge_os_pages(pages, numa_node, timeout_msecs, &reserved, &hsize, &memid);
+  if (p==NULL || reserved==0) {
     _mi_warning_message("failed to reserve %zu GiB huge pages\n", pages);
     return ENOMEM;
   }
-  _mi_verbose_message("numa node %i: reserved %zu GiB huge pages (of the %zu GiB requested)\n", numa_node, pages_reserved, pages);
+  _mi_verbose_message("numa node %i: reserved %zu GiB huge pages (of the %zu GiB requested)\n", numa_node, reserved, pages);
 
   if (!mi_manage_os_memory_ex2(p, hsize, true, numa_node, exclusive, memid, arena_id)) {
     _mi_os_free(p, hsize, memid);
     return ENOMEM;
   }
+  *pages_reserved = reserved;
   return 0;
 }
 
+int mi_reserve_huge_os_pages_at_ex(size_t pages, int numa_node, size_t timeout_msecs, bool exclusive, mi_arena_id_t* arena_id) mi_attr_noexcept {
+  size_t pages_reserved = 0;
+  return mi_reserve_huge_os_pages_at_ex2(pages, numa_node, timeout_msecs, exclusive, arena_id, &pages_reserved);
+}
+
 int mi_reserve_huge_os_pages_at(size_t pages, int numa_node, size_t timeout_msecs) mi_attr_noexcept {
   return mi_reserve_huge_os_pages_at_ex(pages, numa_node, timeout_msecs, false, NULL);
 }
@@ -1021,3 +1906,181 @@ int mi_reserve_huge_os_pages(size_t pages, double max_secs, size_t* pages_reserv
   if (err==0 && pages_reserved!=NULL) *pages_reserved = pages;
   return err;
 }
+
+
+/* -----------------------------------------------------------
+  Reserve huge pages in the background
+
+  Reserving many 1GiB huge pages can take seconds. With
+  `mi_reserve_huge_os_pages_async` only the first page is reserved
+  synchronously; the rest is reserved by a background thread in chunks
+  of at most `MI_RESERVE_CHUNK_MAX` pages per numa node where each chunk
+  is added as an arena as soon as it is reserved. Until then allocation
+  just uses regular OS memory.
+----------------------------------------------------------- */
+
+#define MI_RESERVE_CHUNK_MAX  (8)   // reserve at most 8 GiB per arena in the background
+
+typedef struct mi_reserve_job_s {
+  size_t      pages;          // total pages requested
+  size_t      reserved;       // pages reserved so far
+  size_t      first_pages;    // pages reserved synchronously on the first numa node
+  int         numa_node;      // reserve at this numa node, or interleave over all nodes if < 0
+  size_t      timeout_msecs;  // timeout for all pages
+  mi_reserve_progress_fun* progress;
+  void*       arg;
+  mi_memid_t  memid;          // memory of this job
+} mi_reserve_job_t;
+
+static _Atomic(size_t) mi_reserve_jobs_running; // = 0
+static _Atomic(size_t) mi_reserve_jobs_stop;    // = 0, set on process exit
+
+static mi_reserve_progress_fun* volatile mi_reserve_progress_default; // = NULL
+static _Atomic(void*) mi_reserve_progress_default_arg; // = NULL
+
+void mi_register_reserve_progress(mi_reserve_progress_fun* progress, void* arg) mi_attr_noexcept {
+  mi_reserve_progress_default = progress;
+  mi_atomic_store_ptr_release(void, &mi_reserve_progress_default_arg, arg);
+}
+
+static void mi_reserve_job_progress(const mi_reserve_job_t* job, bool done) {
+  if (job->progress != NULL) {
+    (*job->progress)(job->reserved, job->pages, done, job->arg);
+  }
+}
+
+// reserve `pages` at a numa node in chunks; returns `false` if the job should stop
+static bool mi_reserve_job_at(mi_reserve_job_t* job, size_t pages, int numa_node) {
+  while (pages > 0) {
+    if (mi_atomic_load_relaxed(&mi_reserve_jobs_stop) != 0) return false;
+    const size_t chunk = (pages > MI_RESERVE_CHUNK_MAX ? MI_RESERVE_CHUNK_MAX : pages);
+    const size_t timeout = (job->timeout_msecs == 0 ? 0 : (job->timeout_msecs * chunk / job->pages) + 50);
+    size_t reserved = 0;
+    mi_reserve_huge_os_pages_at_ex2(chunk, numa_node, timeout, false, NULL, &reserved);
+    if (reserved == 0) return true;  // no more huge pages on this node (continue with the next one)
+    job->reserved += reserved;
+    mi_reserve_job_progress(job, false);
+    if (reserved < chunk) return true;
+    pages -= chunk;
+  }
+  return true;
+}
+
+static void mi_reserve_job_run(void* arg) {
+  mi_reserve_job_t* const job = (mi_reserve_job_t*)arg;
+  bool stopped = false;
+  if (job->numa_node >= 0) {
+    stopped = !mi_reserve_job_at(job, job->pages - job->first_pages, job->numa_node);
+  }
+  else {
+    // interleave as in `mi_reserve_huge_os_pages_interleave`
+    const size_t numa_count = _mi_os_numa_node_count();
+    const size_t pages_per = job->pages / numa_count;
+    const size_t pages_mod = job->pages % numa_count;
+    for (size_t numa_node = 0; numa_node < numa_count && !stopped; numa_node++) {
+      size_t node_pages = pages_per;  // can be 0
+      if (numa_node < pages_mod) node_pages++;
+      if (numa_node == 0) node_pages -= job->first_pages;  // node 0 has at least one page
+      stopped = !mi_reserve_job_at(job, node_pages, (int)numa_node);
+    }
+  }
+  if (!stopped) { mi_reserve_job_progress(job, true); }  // don't call back during process exit
+  _mi_verbose_message("background reservation done: %zu GiB huge pages (of the %zu GiB requested)\n", job->reserved, job->pages);
+  _mi_arena_meta_free(job, job->memid, sizeof(mi_reserve_job_t));
+  mi_atomic_decrement_acq_rel(&mi_reserve_jobs_running);
+}
+
+// The reservation threads are not inherited by a forked child (so it should not wait for them on exit)
+static void mi_reserve_jobs_atfork_child(void) {
+  mi_atomic_store_release(&mi_reserve_jobs_running, (size_t)0);
+}
+
+int mi_reserve_huge_os_pages_async(size_t pages, int numa_node, size_t timeout_msecs, mi_reserve_progress_fun* progress, void* arg) mi_attr_noexcept {
+  if (pages == 0) return 0;
+  if (progress == NULL) {
+    progress = mi_reserve_progress_default;
+    arg = mi_atomic_load_ptr_acquire(void, &mi_reserve_progress_default_arg);
+  }
+  if (numa_node >= 0) numa_node = numa_node % _mi_os_numa_node_count();
+
+  // reserve the first page synchronously
+  const size_t timeout_first = (timeout_msecs == 0 ? 0 : (timeout_msecs / pages) + 50);
+  size_t reserved = 0;
+  const int err = mi_reserve_huge_os_pages_at_ex2(1, (numa_node >= 0 ? numa_node : 0), timeout_first, false, NULL, &reserved);
+  if (err != 0 || pages == 1) {
+    if (progress != NULL) { (*progress)(reserved, pages, true, arg); }
+    return err;
+  }
+
+  // and the rest in the background
+  mi_memid_t memid;
+  mi_reserve_job_t* const job = (mi_reserve_job_t*)_mi_arena_meta_zalloc(sizeof(mi_reserve_job_t), &memid);
+  if (job == NULL) {
+    // keep the first page (and report it) just like a partially successful synchronous reservation
+    if (progress != NULL) { (*progress)(reserved, pages, true, arg); }
+    return 0;
+  }
+  job->pages = pages;
+  job->reserved = reserved;
+  job->first_pages = reserved;
+  job->numa_node = numa_node;
+  job->timeout_msecs = timeout_msecs;
+  job->progress = progress;
+  job->arg = arg;
+  job->memid = memid;
+  mi_reserve_job_progress(job, false);
+  static mi_atomic_once_t atfork_once;
+  if (mi_atomic_once(&atfork_once)) { _mi_prim_thread_atfork_child(&mi_reserve_jobs_atfork_child); }
+  mi_atomic_increment_acq_rel(&mi_reserve_jobs_running);
+  if (!_mi_prim_thread_start(&mi_reserve_job_run, job)) {
+    _mi_verbose_message("unable to start a background thread to reserve huge pages (reserving synchronously)\n");
+    mi_reserve_job_run(job);
+  }
+  return 0;
+}
+
+// Reserve the memory requested by the `reserve_huge_os_pages` and `reserve_os_memory` options.
+// In fast start mode this is deferred to the first arena allocation.
+
+void _mi_arenas_reserve_startup(bool defer) {
+  size_t expected = 0;
+  if (defer) {
+    mi_atomic_cas_strong_acq_rel(&mi_arenas_startup, &expected, (size_t)1);
+    return;
+  }
+  expected = mi_atomic_load_relaxed(&mi_arenas_startup);
+  if (expected == 2 || !mi_atomic_cas_strong_acq_rel(&mi_arenas_startup, &expected, (size_t)2)) return;
+  if (mi_option_is_enabled(mi_option_reserve_huge_os_pages)) {
+    size_t pages = mi_option_get_clamp(mi_option_reserve_huge_os_pages, 0, 128*1024);
+    long reserve_at = mi_option_get(mi_option_reserve_huge_os_pages_at);
+    if (mi_option_is_enabled(mi_option_reserve_huge_os_pages_async)) {
+      mi_reserve_huge_os_pages_async(pages, (int)reserve_at, pages*500, NULL /* use the registered progress function */, NULL);
+    } else if (reserve_at != -1) {
+      mi_reserve_huge_os_pages_at(pages, reserve_at, pages*500);
+    } else {
+      mi_reserve_huge_os_pages_interleave(pages, 0, pages*500);
+    }
+  }
+  if (mi_option_is_enabled(mi_option_reserve_os_memory)) {
+    long ksize = mi_option_get(mi_option_reserve_os_memory);
+    if (ksize > 0) {
+      mi_arena_id_t arena_id = _mi_arena_id_none();
+      if (mi_reserve_os_memory_ex((size_t)ksize*MI_KiB, true /* commit? */, true /* allow large pages? */, false /* exclusive? */, &arena_id) == 0 &&
+          mi_option_is_enabled(mi_option_populate))
+      {
+        // move the page faults to startup
+        size_t size = 0;
+        void* const start = mi_arena_area(arena_id, &size);
+        if (start != NULL) { _mi_os_populate(start, size); }
+      }
+    }
+  }
+}
+
+// Stop background reservations (on process exit) and wait until they no longer add arenas.
+void _mi_arenas_reserve_done(void) {
+  mi_atomic_store_release(&mi_reserve_jobs_stop, (size_t)1);
+  while (mi_atomic_load_acquire(&mi_reserve_jobs_running) > 0) {
+    _mi_prim_thread_sleep(1);
+  }
+}
@@ -434,3 +434,79 @@ bool _mi_bitmap_is_any_claimed_across(mi_bitmap_t bitmap, size_t bitmap_fields,
   mi_bitmap_is_claimedx_across(bitmap, bitmap_fields, count, bitmap_idx, &any_ones);
   return any_ones;
 }
+
+
+/* --------------------------------------------------------------------------------
+  Summary bitmaps
+
+  For large bitmaps a linear scan over all fields gets slow (a 512GiB arena has
+  256 in-use fields). The summary has one bit per field that is set if the field
+  may have free bits, so a search skips `MI_BITMAP_FIELD_BITS` full fields per
+  summary field. Stale bits (of full fields) are cleared as we encounter them.
+  To never lose a field with free bits due to a concurrent unclaim, a summary bit
+  is only cleared if the field is still full after clearing (as the unclaim first
+  frees the bits and then sets the summary bit).
+-------------------------------------------------------------------------------- */
+
+void _mi_bitmap_summary_init(mi_bitmap_t summary, size_t bitmap_fields) {
+  for (size_t i = 0; i < bitmap_fields; i += MI_BITMAP_FIELD_BITS) {
+    const size_t n = (bitmap_fields - i < MI_BITMAP_FIELD_BITS ? bitmap_fields - i : MI_BITMAP_FIELD_BITS);
+    mi_atomic_store_release(&summary[i / MI_BITMAP_FIELD_BITS], mi_bitmap_mask_(n, 0));
+  }
+}
+
+void _mi_bitmap_summary_set_free(mi_bitmap_t summary, size_t count, mi_bitmap_index_t bitmap_idx) {
+  mi_assert_internal(count > 0);
+  const size_t first = mi_bitmap_index_field(bitmap_idx);
+  const size_t last  = mi_bitmap_index_field(bitmap_idx + count - 1);
+  for (size_t idx = first; idx <= last; idx++) {
+    mi_atomic_or_acq_rel(&summary[idx / MI_BITMAP_FIELD_BITS], (size_t)1 << (idx % MI_BITMAP_FIELD_BITS));
+  }
+}
+
+// clear the summary bit of a field if it is full
+static void mi_bitmap_summary_clear_if_full(mi_bitmap_t bitmap, mi_bitmap_t summary, size_t idx) {
+  if (mi_atomic_load_relaxed(&bitmap[idx]) != MI_BITMAP_FIELD_FULL) return;
+  mi_bitmap_field_t* const sfield = &summary[idx / MI_BITMAP_FIELD_BITS];
+  const size_t mask = ((size_t)1 << (idx % MI_BITMAP_FIELD_BITS));
+  mi_atomic_and_acq_rel(sfield, ~mask);
+  if (mi_atomic_load_acquire(&bitmap[idx]) != MI_BITMAP_FIELD_FULL) {
+    // a concurrent unclaim freed bits in the meantime; restore the summary bit
+    mi_atomic_or_acq_rel(sfield, mask);
+  }
+}
+
+// try to claim in the fields `[idx, end)` that may have free bits
+static bool mi_bitmap_try_find_claim_summary_range(mi_bitmap_t bitmap, mi_bitmap_t summary, const size_t bitmap_fields, size_t idx, const size_t end, const size_t count, mi_bitmap_index_t* bitmap_idx) {
+  while (idx < end) {
+    // skip to the next field that may have free bits
+    const size_t sbits = (mi_atomic_load_relaxed(&summary[idx / MI_BITMAP_FIELD_BITS]) >> (idx % MI_BITMAP_FIELD_BITS));
+    if (sbits == 0) {
+      idx = _mi_align_up(idx + 1, MI_BITMAP_FIELD_BITS);
+      continue;
+    }
+    idx += mi_ctz(sbits);
+    if (idx >= end) break;
+    // and try to claim there (just like `_mi_bitmap_try_find_from_claim_across`)
+    const bool claimed = (count <= 2 ? _mi_bitmap_try_find_claim_field(bitmap, idx, count, bitmap_idx)
+                                     : mi_bitmap_try_find_claim_field_across(bitmap, bitmap_fields, idx, count, 0, bitmap_idx));
+    if (claimed) {
+      const size_t last = mi_bitmap_index_field(*bitmap_idx + count - 1);
+      for (size_t i = mi_bitmap_index_field(*bitmap_idx); i <= last; i++) {
+        mi_bitmap_summary_clear_if_full(bitmap, summary, i);
+      }
+      return true;
+    }
+    mi_bitmap_summary_clear_if_full(bitmap, summary, idx);
+    idx++;
+  }
+  return false;
+}
+
+bool _mi_bitmap_try_find_from_claim_across_summary(mi_bitmap_t bitmap, mi_bitmap_t summary, const size_t bitmap_fields, const size_t start_field_idx, const size_t count, mi_bitmap_index_t* bitmap_idx) {
+  mi_assert_internal(count > 0);
+  mi_assert_internal(start_field_idx <= bitmap_fields);
+  // visit the fields from `start_field_idx` and wrap around
+  return (mi_bitmap_try_find_claim_summary_range(bitmap, summary, bitmap_fields, start_field_idx, bitmap_fields, count, bitmap_idx) ||
+          mi_bitmap_try_find_claim_summary_range(bitmap, summary, bitmap_fields, 0, start_field_idx, count, bitmap_idx));
+}
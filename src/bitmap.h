@@ -116,4 +116,26 @@ bool _mi_bitmap_claim_across(mi_bitmap_t bitmap, size_t bitmap_fields, size_t co
 bool _mi_bitmap_is_claimed_across(mi_bitmap_t bitmap, size_t bitmap_fields, size_t count, mi_bitmap_index_t bitmap_idx);
 bool _mi_bitmap_is_any_claimed_across(mi_bitmap_t bitmap, size_t bitmap_fields, size_t count, mi_bitmap_index_t bitmap_idx);
 
+
+//--------------------------------------------------------------------------
+// A summary bitmap has one bit per field of a bitmap that is set if that
+// field may have free (zero) bits. This is used to quickly skip full fields
+// when searching large bitmaps (like the in-use bitmap of a large arena).
+// A field with free bits always has its summary bit set (but a set bit can be stale).
+//--------------------------------------------------------------------------
+
+// The number of fields in a summary bitmap for a bitmap of `bitmap_fields` fields
+static inline size_t mi_bitmap_summary_fields(size_t bitmap_fields) {
+  return (bitmap_fields + MI_BITMAP_FIELD_BITS - 1) / MI_BITMAP_FIELD_BITS;
+}
+
+// Initialize the summary for `bitmap_fields` (all may have free bits)
+void _mi_bitmap_summary_init(mi_bitmap_t summary, size_t bitmap_fields);
+
+// Mark the fields of `count` bits at `bitmap_idx` as having free bits (call after unclaiming them)
+void _mi_bitmap_summary_set_free(mi_bitmap_t summary, size_t count, mi_bitmap_index_t bitmap_idx);
+
+// As `_mi_bitmap_try_find_from_claim_across` but uses (and maintains) the `summary` to skip full fields.
+bool _mi_bitmap_try_find_from_claim_across_summary(mi_bitmap_t bitmap, mi_bitmap_t summary, const size_t bitmap_fields, const size_t start_field_idx, const size_t count, mi_bitmap_index_t* bitmap_idx);
+
 #endif
@@ -17,6 +17,7 @@ static void   mi_check_padding(const mi_page_t* page, const mi_block_t* block);
 static bool   mi_check_is_double_free(const mi_page_t* page, const mi_block_t* block);
 static size_t mi_page_usable_size_of(const mi_page_t* page, const mi_block_t* block);
 static void   mi_stat_free(const mi_page_t* page, const mi_block_t* block);
+static bool   mi_remote_free_push(mi_page_t* page, mi_block_t* block);
 
 
 // ------------------------------------------------------
@@ -26,12 +27,12 @@ static void   mi_stat_free(const mi_page_t* page, const mi_block_t* block);
 // forward declaration of multi-threaded free (`_mt`) (or free in huge block if compiled with MI_HUGE_PAGE_ABANDON)
 static mi_decl_noinline void mi_free_block_mt(mi_page_t* page, mi_segment_t* segment, mi_block_t* block);
 
-// regular free of a (thread local) block pointer
-// fast path written carefully to prevent spilling on the stack
-static inline void mi_free_block_local(mi_page_t* page, mi_block_t* block, bool track_stats, bool check_full)
+// push a (thread local) block on the local free list without adjusting the `used` count
+// returns `false` if the block was not freed (on a double free)
+static inline bool mi_free_block_local_push(mi_page_t* page, mi_block_t* block, bool track_stats)
 {
   // checks
-  if mi_unlikely(mi_check_is_double_free(page, block)) return;
+  if mi_unlikely(mi_check_is_double_free(page, block)) return false;
   mi_check_padding(page, block);
   if (track_stats) { mi_stat_free(page, block); }
   #if (MI_DEBUG>0) && !MI_TRACK_ENABLED  && !MI_TSAN && !MI_GUARDED
@@ -44,6 +45,14 @@ static inline void mi_free_block_local(mi_page_t* page, mi_block_t* block, bool
   // actual free: push on the local free list
   mi_block_set_next(page, block, page->local_free);
   page->local_free = block;
+  return true;
+}
+
+// regular free of a (thread local) block pointer
+// fast path written carefully to prevent spilling on the stack
+static inline void mi_free_block_local(mi_page_t* page, mi_block_t* block, bool track_stats, bool check_full)
+{
+  if mi_unlikely(!mi_free_block_local_push(page, block, track_stats)) return;
   if mi_unlikely(--page->used == 0) {
     _mi_page_retire(page);
   }
@@ -52,6 +61,64 @@ static inline void mi_free_block_local(mi_page_t* page, mi_block_t* block, bool
   }
 }
 
+#if (MI_SECURE==0)
+// push a (thread local) small block on the free cache of its heap (see `mi_option_free_cache`)
+// without adjusting the `used` count; it is reused by `alloc.c:mi_heap_tcache_pop`.
+// returns `false` if the block should be freed normally (as the cache for its size class is full)
+static inline bool mi_heap_tcache_push(mi_heap_t* heap, mi_page_t* page, mi_block_t* block)
+{
+  const size_t slot = mi_page_block_size(page) / MI_INTPTR_SIZE;
+  if (slot >= MI_TCACHE_SLOTS || heap->tcache_count[slot] >= heap->tcache_max) return false;
+
+  // checks
+  #if (MI_DEBUG>0)
+  for (const mi_block_t* b = heap->tcache[slot]; b != NULL; b = mi_block_nextx(heap, b, heap->keys)) {
+    if mi_unlikely(b == block) {
+      _mi_error_message(EAGAIN, "double free detected of block %p with size %zu\n", block, mi_page_block_size(page));
+      return true;
+    }
+  }
+  #endif
+  if mi_unlikely(mi_check_is_double_free(page, block)) return true;
+  mi_check_padding(page, block);
+  mi_stat_free(page, block);
+  #if (MI_DEBUG>0) && !MI_TRACK_ENABLED  && !MI_TSAN && !MI_GUARDED
+  memset(block, MI_DEBUG_FREED, mi_page_block_size(page));
+  #endif
+  mi_track_free_size(block, mi_page_usable_size_of(page, block));
+
+  // and push on the cache
+  mi_block_set_nextx(heap, block, heap->tcache[slot], heap->keys);
+  heap->tcache[slot] = block;
+  heap->tcache_count[slot]++;
+  return true;
+}
+#endif
+
+// Free all blocks in the free cache of a heap (on collection, and before the heap is deleted)
+void _mi_heap_tcache_flush(mi_heap_t* heap) {
+  for (size_t slot = 0; slot < MI_TCACHE_SLOTS; slot++) {
+    mi_block_t* block = heap->tcache[slot];
+    if (block == NULL) continue;
+    heap->tcache[slot] = NULL;
+    heap->tcache_count[slot] = 0;
+    while (block != NULL) {
+      mi_block_t* const next = mi_block_nextx(heap, block, heap->keys);
+      mi_page_t* const page = _mi_ptr_page(block);
+      // the checks and statistics were already done when the block was cached
+      mi_block_set_next(page, block, page->local_free);
+      page->local_free = block;
+      if (--page->used == 0) {
+        _mi_page_retire(page);
+      }
+      else if (mi_page_is_in_full(page)) {
+        _mi_page_unfull(page);
+      }
+      block = next;
+    }
+  }
+}
+
 // Adjust a block that was allocated aligned, to the actual start of the block in the page.
 // note: this can be called from `mi_free_generic_mt` where a non-owning thread accesses the
 // `page_start` and `block_size` fields; however these are constant and the page won't be
@@ -86,8 +153,17 @@ static inline void mi_block_check_unguard(mi_page_t* page, mi_block_t* block, vo
 // free a local pointer  (page parameter comes first for better codegen)
 static void mi_decl_noinline mi_free_generic_local(mi_page_t* page, mi_segment_t* segment, void* p) mi_attr_noexcept {
   MI_UNUSED(segment);
+  #if (MI_SECURE==0)
+  if (mi_page_has_free_cache(page) && !mi_page_is_in_full(page) && !mi_page_has_aligned(page) && !mi_page_has_sampled(page)) {
+    // keep the block in the free cache of its heap
+    if (mi_heap_tcache_push(mi_page_heap(page), page, (mi_block_t*)p)) return;
+    mi_free_block_local(page, (mi_block_t*)p, true /* track stats */, false /* no need to check if the page is full */);
+    return;
+  }
+  #endif
   mi_block_t* const block = (mi_page_has_aligned(page) ? _mi_page_ptr_unalign(page, p) : (mi_block_t*)p);
   mi_block_check_unguard(page, block, p);
+  if mi_unlikely(mi_page_has_sampled(page)) { _mi_heap_sample_free(page, block); }
   mi_free_block_local(page, block, true /* track stats */, true /* check for a full page */);
 }
 
@@ -95,6 +171,7 @@ static void mi_decl_noinline mi_free_generic_local(mi_page_t* page, mi_segment_t
 static void mi_decl_noinline mi_free_generic_mt(mi_page_t* page, mi_segment_t* segment, void* p) mi_attr_noexcept {
   mi_block_t* const block = _mi_page_ptr_unalign(page, p); // don't check `has_aligned` flag to avoid a race (issue #865)
   mi_block_check_unguard(page, block, p);
+  if mi_unlikely(mi_page_has_sampled(page)) { _mi_heap_sample_free(page, block); }  // set by the owner before `p` was handed out
   mi_free_block_mt(page, segment, block);
 }
 
@@ -157,13 +234,13 @@ void mi_free(void* p) mi_attr_noexcept
   mi_page_t* const page = _mi_segment_page_of(segment, p);
 
   if mi_likely(is_local) {                        // thread-local free?
-    if mi_likely(page->flags.full_aligned == 0) { // and it is not a full page (full pages need to move from the full bin), nor has aligned blocks (aligned blocks need to be unaligned)
+    if mi_likely(page->flags.full_aligned == 0) { // and it is not a full page (full pages need to move from the full bin), nor has aligned blocks (aligned blocks need to be unaligned), nor sampled blocks, nor a free cache
       // thread-local, aligned, and not a full page
       mi_block_t* const block = (mi_block_t*)p;
       mi_free_block_local(page, block, true /* track stats */, false /* no need to check if the page is full */);
     }
     else {
-      // page is full or contains (inner) aligned blocks; use generic path
+      // page is full, contains (inner) aligned blocks, sampled blocks, or uses a free cache; use generic path
       mi_free_generic_local(page, segment, p);
     }
   }
@@ -173,6 +250,43 @@ void mi_free(void* p) mi_attr_noexcept
   }
 }
 
+// Free an array of blocks (as allocated by `mi_heap_malloc_batch` for example).
+// Consecutive thread-local blocks in the same page share the segment and page lookup,
+// and the page is only checked for retirement once at the end of such a run.
+void mi_free_batch(void** blocks, size_t count) mi_attr_noexcept
+{
+  if (blocks == NULL) return;
+  const mi_threadid_t tid = _mi_prim_thread_id();
+  size_t i = 0;
+  while (i < count) {
+    void* const p = blocks[i++];
+    mi_segment_t* const segment = mi_checked_ptr_segment(p,"mi_free_batch");
+    if mi_unlikely(segment==NULL) continue;
+    mi_page_t* const page = _mi_segment_page_of(segment, p);
+    if mi_unlikely(tid != mi_atomic_load_relaxed(&segment->thread_id)) {
+      mi_free_generic_mt(page, segment, p);
+    }
+    else if mi_unlikely(page->flags.full_aligned != 0) {
+      mi_free_generic_local(page, segment, p);
+    }
+    else {
+      // thread-local, aligned, and not a full page: free the run of blocks that follow in the same page
+      size_t freed = (mi_free_block_local_push(page, (mi_block_t*)p, true) ? 1 : 0);
+      while (i < count) {
+        void* const q = blocks[i];
+        if (q == NULL || _mi_ptr_segment(q) != segment || _mi_segment_page_of(segment, q) != page) break;
+        if (mi_free_block_local_push(page, (mi_block_t*)q, true)) { freed++; }
+        i++;
+      }
+      mi_assert_internal(page->used >= freed);
+      page->used -= (uint16_t)freed;
+      if mi_unlikely(freed > 0 && page->used == 0) {
+        _mi_page_retire(page);
+      }
+    }
+  }
+}
+
 // return true if successful
 bool _mi_free_delayed_block(mi_block_t* block) {
   // get segment and page
@@ -204,7 +318,7 @@ bool _mi_free_delayed_block(mi_block_t* block) {
 // ------------------------------------------------------
 
 // Push a block that is owned by another thread on its page-local thread free
-// list or it's heap delayed free list. Such blocks are later collected by
+// list or it's heap delayed free list (in the shard of the page). Such blocks are later collected by
 // the owning thread in `_mi_free_delayed_block`.
 static void mi_decl_noinline mi_free_block_delayed_mt( mi_page_t* page, mi_block_t* block )
 {
@@ -221,8 +335,8 @@ static void mi_decl_noinline mi_free_block_delayed_mt( mi_page_t* page, mi_block
     }
     else {
       // usual: directly add to page thread_free list
-      mi_block_set_next(page, block, mi_tf_block(tfree));
-      tfreex = mi_tf_set_block(tfree,block);
+      mi_block_set_next(page, block, mi_tf_block(page, tfree));
+      tfreex = mi_tf_push(page, tfree, block, block, 1);
     }
   } while (!mi_atomic_cas_weak_release(&page->xthread_free, &tfree, tfreex));
 
@@ -232,11 +346,8 @@ static void mi_decl_noinline mi_free_block_delayed_mt( mi_page_t* page, mi_block
     mi_heap_t* const heap = (mi_heap_t*)(mi_atomic_load_acquire(&page->xheap)); //mi_page_heap(page);
     mi_assert_internal(heap != NULL);
     if (heap != NULL) {
-      // add to the delayed free list of this heap. (do this atomically as the lock only protects heap memory validity)
-      mi_block_t* dfree = mi_atomic_load_ptr_relaxed(mi_block_t, &heap->thread_delayed_free);
-      do {
-        mi_block_set_nextx(heap,block,dfree, heap->keys);
-      } while (!mi_atomic_cas_ptr_weak_release(mi_block_t,&heap->thread_delayed_free, &dfree, block));
+      // add to the delayed free list shard of this page. (do this atomically as the lock only protects heap memory validity)
+      _mi_heap_delayed_free_push(heap, mi_page_delayed_shard(page), block);
     }
 
     // and reset the MI_DELAYED_FREEING flag
@@ -299,11 +410,100 @@ static void mi_decl_noinline mi_free_block_mt(mi_page_t* page, mi_segment_t* seg
   }
 
   // and finally free the actual block by pushing it on the owning heap
-  // thread_delayed free list (or heap delayed free list)
+  // thread_delayed free list (or heap delayed free list), possibly batched in our remote free magazine
+  if (segment->kind != MI_SEGMENT_HUGE && _mi_option_get_fast(mi_option_remote_free_batch) > 0) {
+    if (mi_remote_free_push(page, block)) return;
+  }
   mi_free_block_delayed_mt(page,block);
 }
 
 
+// ------------------------------------------------------
+// Remote free magazine: batch cross-thread frees per page
+// so they are pushed on the page `xthread_free` list with a single CAS.
+// This is only safe as the pending blocks are still counted as `used` in their
+// page which therefore cannot be freed (except by `mi_heap_destroy` which should
+// not be combined with concurrent remote frees in that heap).
+// ------------------------------------------------------
+
+// push a list of blocks `head` to `tail` (linked using the `page` keys) on the page thread free list
+static void mi_remote_free_flush_slot(mi_remote_free_slot_t* slot)
+{
+  mi_page_t* const page = slot->page;
+  mi_block_t* head = slot->head;
+  mi_block_t* const tail = slot->tail;
+  size_t count = slot->count;
+  slot->page = NULL;
+  slot->head = slot->tail = NULL;
+  slot->count = 0;
+  if (page == NULL || head == NULL) return;
+
+  mi_thread_free_t tfree = mi_atomic_load_relaxed(&page->xthread_free);
+  while (true) {
+    if mi_unlikely(mi_tf_delayed(tfree) == MI_USE_DELAYED_FREE) {
+      // unlikely: the page is in the full list and the first block needs to go through the heap delayed free list
+      mi_block_t* const next = (head == tail ? NULL : mi_block_next(page, head));
+      mi_free_block_delayed_mt(page, head);
+      if (next == NULL) return;
+      head = next;
+      count--;
+      tfree = mi_atomic_load_relaxed(&page->xthread_free);
+    }
+    else {
+      // usual: append the whole batch at once
+      mi_block_set_next(page, tail, mi_tf_block(page, tfree));
+      const mi_thread_free_t tfreex = mi_tf_push(page, tfree, head, tail, count);
+      if (mi_atomic_cas_weak_release(&page->xthread_free, &tfree, tfreex)) return;
+    }
+  }
+}
+
+// add a block to the magazine of the current thread; returns `false` if the thread has no magazine
+static bool mi_remote_free_push(mi_page_t* page, mi_block_t* block)
+{
+  mi_heap_t* const heap = mi_prim_get_default_heap();
+  if mi_unlikely(!mi_heap_is_initialized(heap)) return false;  // thread is not initialized or already terminated
+  mi_remote_free_t* const rf = &heap->tld->remote_free;
+
+  // find the slot of this page (or an empty one)
+  mi_remote_free_slot_t* slot = NULL;
+  mi_remote_free_slot_t* empty = NULL;
+  for (size_t i = 0; i < MI_REMOTE_FREE_SLOTS; i++) {
+    mi_remote_free_slot_t* const s = &rf->slots[i];
+    if (s->page == page) { slot = s; break; }
+    if (s->page == NULL && empty == NULL) { empty = s; }
+  }
+  if (slot == NULL) {
+    if (empty == NULL) {
+      // all slots are in use: flush one in round-robin order
+      empty = &rf->slots[rf->evict];
+      rf->evict = (rf->evict + 1) % MI_REMOTE_FREE_SLOTS;
+      mi_remote_free_flush_slot(empty);
+    }
+    slot = empty;
+    slot->page = page;
+  }
+
+  // and push the block in the batch
+  mi_block_set_next(page, block, slot->head);
+  slot->head = block;
+  if (slot->tail == NULL) { slot->tail = block; }
+  slot->count++;
+  if (slot->count >= (size_t)_mi_option_get_fast(mi_option_remote_free_batch)) {
+    mi_remote_free_flush_slot(slot);
+  }
+  return true;
+}
+
+// flush all pending frees of a thread (called on collection and thread termination)
+void _mi_free_remote_flush(mi_tld_t* tld) {
+  if (tld == NULL) return;
+  for (size_t i = 0; i < MI_REMOTE_FREE_SLOTS; i++) {
+    mi_remote_free_flush_slot(&tld->remote_free.slots[i]);
+  }
+}
+
+
 // ------------------------------------------------------
 // Usable size
 // ------------------------------------------------------
@@ -346,16 +546,56 @@ mi_decl_nodiscard size_t mi_usable_size(const void* p) mi_attr_noexcept {
 // Free variants
 // ------------------------------------------------------
 
+// Free a block of which the allocation size is known (as with C++ sized delete).
+// If the allocation was guaranteed to be satisfied at the start of a block, we can skip
+// unaligning the pointer even if the page contains other (inner) aligned blocks;
+// otherwise the pointer may be inside its block and pages with aligned blocks take the generic path.
+static inline void mi_free_sized(void* p, size_t size, bool is_block_start, const char* msg) mi_attr_noexcept
+{
+  mi_segment_t* const segment = mi_checked_ptr_segment(p,msg);
+  if mi_unlikely(segment==NULL) return;
+
+  const bool is_local = (_mi_prim_thread_id() == mi_atomic_load_relaxed(&segment->thread_id));
+  mi_page_t* const page = _mi_segment_page_of(segment, p);
+  mi_assert(size <= mi_page_usable_block_size(page));
+  MI_UNUSED_RELEASE(size);
+
+  if mi_likely(is_local) {
+    const bool is_fast = (is_block_start ? !mi_page_is_in_full(page) && !mi_page_has_sampled(page) : page->flags.full_aligned == 0);
+    if mi_likely(is_fast) {
+      mi_assert(_mi_page_ptr_unalign(page, p) == p);  // the size hint was used for a pointer from an aligned allocation?
+      mi_free_block_local(page, (mi_block_t*)p, true /* track stats */, false /* no need to check if the page is full */);
+    }
+    else {
+      mi_free_generic_local(page, segment, p);
+    }
+  }
+  else {
+    mi_free_generic_mt(page, segment, p);
+  }
+}
+
+// Free a block of at most `size` bytes (which can be an aligned allocation, as with `mi_malloc_aligned_at`)
 void mi_free_size(void* p, size_t size) mi_attr_noexcept {
+  #if MI_GUARDED
+  // guarded blocks do not start at the block boundary
   MI_UNUSED_RELEASE(size);
   mi_assert(p == NULL || size <= _mi_usable_size(p,"mi_free_size"));
   mi_free(p);
+  #else
+  mi_free_sized(p, size, false, "mi_free_size");
+  #endif
 }
 
 void mi_free_size_aligned(void* p, size_t size, size_t alignment) mi_attr_noexcept {
-  MI_UNUSED_RELEASE(alignment);
   mi_assert(((uintptr_t)p % alignment) == 0);
-  mi_free_size(p,size);
+  #if MI_GUARDED
+  MI_UNUSED_RELEASE(size); MI_UNUSED_RELEASE(alignment);
+  mi_assert(p == NULL || size <= _mi_usable_size(p,"mi_free_size_aligned"));
+  mi_free(p);
+  #else
+  mi_free_sized(p, size, _mi_is_power_of_two(alignment) && _mi_malloc_is_naturally_aligned(size, alignment), "mi_free_size_aligned");
+  #endif
 }
 
 void mi_free_aligned(void* p, size_t alignment) mi_attr_noexcept {
@@ -533,6 +773,7 @@ static void mi_stat_free(const mi_page_t* page, const mi_block_t* block) {
   #endif
   if (bsize <= MI_MEDIUM_OBJ_SIZE_MAX) {
     mi_heap_stat_decrease(heap, normal, bsize);
+    mi_heap_stat_decrease(heap, tag_normal[page->heap_tag % MI_TAG_STATS_MAX], bsize);
     #if (MI_STAT > 1)
     mi_heap_stat_decrease(heap, normal_bins[_mi_bin(bsize)], 1);
     #endif
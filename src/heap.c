@@ -128,8 +128,18 @@ static void mi_heap_collect_ex(mi_heap_t* heap, mi_collect_t collect)
   const bool force = (collect >= MI_FORCE);
   _mi_deferred_free(heap, force);
 
+  // free the blocks in the free cache so their pages can be collected
+  _mi_heap_tcache_flush(heap);
+
   // python/cpython#112532: we may be called from a thread that is not the owner of the heap
-  const bool is_main_thread = (_mi_is_main_thread() && heap->thread_id == _mi_thread_id());
+  // (and heaps with their own thread data, like parked or fiber heaps, are never the main thread heaps
+  //  even if the main thread owns them, see `init.c:mi_heap_pool_collect`)
+  const bool is_main_thread = (_mi_is_main_thread() && heap->thread_id == _mi_thread_id() && heap->tld == _mi_heap_main_get()->tld);
+
+  // push out the pending cross-thread frees of this thread
+  if (heap->thread_id == _mi_thread_id()) {
+    _mi_free_remote_flush(heap->tld);
+  }
 
   // note: never reclaim on collect but leave it to threads that need storage to reclaim
   const bool force_main =
@@ -161,7 +171,7 @@ static void mi_heap_collect_ex(mi_heap_t* heap, mi_collect_t collect)
 
   // collect all pages owned by this thread
   mi_heap_visit_pages(heap, &mi_heap_page_collect, &collect, NULL);
-  mi_assert_internal( collect != MI_ABANDON || mi_atomic_load_ptr_acquire(mi_block_t,&heap->thread_delayed_free) == NULL );
+  mi_assert_internal( collect != MI_ABANDON || _mi_heap_delayed_free_is_empty(heap) );
 
   // collect abandoned segments (in particular, purge expired parts of segments in the abandoned segment list)
   // note: forced purge can be quite expensive if many threads are created/destroyed so we do not force on abandonment
@@ -173,7 +183,10 @@ static void mi_heap_collect_ex(mi_heap_t* heap, mi_collect_t collect)
   }
 
   // collect arenas (this is program wide so don't force purges on abandonment of threads)
-  _mi_arenas_collect(collect == MI_FORCE /* force purge? */);
+  // (when a segment batch is installed the arenas are purged after it is released, see `mi_heap_collect_parallel`)
+  if (heap->tld->segments.batch == NULL) {
+    _mi_arenas_collect(collect == MI_FORCE /* force purge? */);
+  }
 }
 
 void _mi_heap_collect_abandon(mi_heap_t* heap) {
@@ -185,7 +198,75 @@ void mi_heap_collect(mi_heap_t* heap, bool force) mi_attr_noexcept {
 }
 
 void mi_collect(bool force) mi_attr_noexcept {
-  mi_heap_collect(mi_prim_get_default_heap(), force);
+  mi_heap_t* const heap = mi_prim_get_default_heap();
+  mi_heap_t* const host = _mi_heap_cpu_host(heap);
+  if (heap != host) {
+    // collect and release the leased per-CPU heap as well (see `init.c`)
+    mi_heap_collect(heap, force);
+    _mi_heap_cpu_release(host);
+  }
+  mi_heap_collect(host, force);
+}
+
+
+/* -----------------------------------------------------------
+  Heap tag policies
+----------------------------------------------------------- */
+
+static mi_heap_tag_policy_t mi_heap_tag_policies[256];
+static bool                 mi_heap_tag_has_policy[256];
+
+static void mi_heap_tag_policy_init(mi_heap_tag_policy_t* policy) {
+  policy->bin_granularity = 0;
+  policy->page_kind = mi_heap_tag_page_default;
+  policy->eager_commit = -1;
+  policy->purge_delay = -2;
+  policy->populate = -1;
+}
+
+// Returns `NULL` if no policy was set for the tag
+const mi_heap_tag_policy_t* _mi_heap_tag_policy(uint8_t tag) {
+  return (mi_heap_tag_has_policy[tag] ? &mi_heap_tag_policies[tag] : NULL);
+}
+
+bool mi_heap_tag_get_policy(int heap_tag, mi_heap_tag_policy_t* policy) mi_attr_noexcept {
+  if (policy == NULL || heap_tag < 0 || heap_tag >= 256) return false;
+  const mi_heap_tag_policy_t* const current = _mi_heap_tag_policy((uint8_t)heap_tag);
+  if (current == NULL) {
+    mi_heap_tag_policy_init(policy);
+  }
+  else {
+    *policy = *current;
+  }
+  return true;
+}
+
+// Set the policy of a tag, or reset it to the defaults when `policy` is `NULL`.
+// This should be done before heaps with this tag are created.
+bool mi_heap_tag_set_policy(int heap_tag, const mi_heap_tag_policy_t* policy) mi_attr_noexcept {
+  if (heap_tag < 0 || heap_tag >= 256) return false;
+  if (policy == NULL) {
+    mi_heap_tag_has_policy[heap_tag] = false;
+    return true;
+  }
+  if (policy->bin_granularity > MI_MEDIUM_OBJ_SIZE_MAX ||
+      (policy->bin_granularity > 0 && !_mi_is_power_of_two(policy->bin_granularity)) ||
+      policy->page_kind < mi_heap_tag_page_default || policy->page_kind > mi_heap_tag_page_medium ||
+      policy->eager_commit < -1 || policy->eager_commit > 1 || policy->purge_delay < -2 ||
+      policy->populate < -1 || policy->populate > 1)
+  {
+    return false;  // invalid policy
+  }
+  mi_heap_tag_policies[heap_tag] = *policy;
+  mi_heap_tag_has_policy[heap_tag] = true;
+  return true;
+}
+
+static void mi_heap_tag_policy_apply(mi_heap_t* heap) {
+  const mi_heap_tag_policy_t* const policy = _mi_heap_tag_policy(heap->tag);
+  if (policy == NULL) return;
+  heap->page_kind  = (uint8_t)policy->page_kind;
+  heap->size_round = (policy->bin_granularity > MI_INTPTR_SIZE ? policy->bin_granularity - 1 : 0);
 }
 
 
@@ -195,7 +276,7 @@ void mi_collect(bool force) mi_attr_noexcept {
 
 mi_heap_t* mi_heap_get_default(void) {
   mi_thread_init();
-  return mi_prim_get_default_heap();
+  return _mi_heap_cpu_host(mi_prim_get_default_heap());
 }
 
 static bool mi_heap_is_default(const mi_heap_t* heap) {
@@ -219,10 +300,12 @@ void _mi_heap_init(mi_heap_t* heap, mi_tld_t* tld, mi_arena_id_t arena_id, bool
   heap->arena_id   = arena_id;
   heap->no_reclaim = noreclaim;
   heap->tag        = tag;
+  mi_heap_tag_policy_apply(heap);
   if (heap == tld->heap_backing) {
     _mi_random_init(&heap->random);
   }
   else {
+    if (!_mi_preloading()) { _mi_random_reinit_if_weak(&tld->heap_backing->random); }  // the main heap is weakly seeded in fast start mode
     _mi_random_split(&tld->heap_backing->random, &heap->random);
   }
   heap->cookie  = _mi_heap_random_next(heap) | 1;
@@ -267,8 +350,12 @@ static void mi_heap_reset_pages(mi_heap_t* heap) {
   // TODO: copy full empty heap instead?
   memset(&heap->pages_free_direct, 0, sizeof(heap->pages_free_direct));
   _mi_memcpy_aligned(&heap->pages, &_mi_heap_empty.pages, sizeof(heap->pages));
-  heap->thread_delayed_free = NULL;
+  _mi_memzero(&heap->tcache_count, sizeof(heap->tcache_count));
+  _mi_memzero(&heap->tcache, sizeof(heap->tcache));
+  _mi_memzero(&heap->thread_delayed_free, sizeof(heap->thread_delayed_free));
+  mi_atomic_store_release(&heap->thread_delayed_mask, (uintptr_t)0);
   heap->page_count = 0;
+  heap->pages_size = 0;
 }
 
 // called from `mi_heap_destroy` and `mi_heap_delete` to free the internal heap resources.
@@ -278,10 +365,8 @@ static void mi_heap_free(mi_heap_t* heap) {
   if (heap==NULL || !mi_heap_is_initialized(heap)) return;
   if (mi_heap_is_backing(heap)) return; // dont free the backing heap
 
-  // reset default
-  if (mi_heap_is_default(heap)) {
-    _mi_heap_set_default_direct(heap->tld->heap_backing);
-  }
+  // reset default (and associate the thread again in case `mi_heap_switch` switched away from this heap)
+  _mi_heap_set_default_direct(mi_heap_is_default(heap) ? heap->tld->heap_backing : mi_prim_get_default_heap());
 
   // remove ourselves from the thread local heaps list
   // linear search but we expect the number of heaps to be relatively small
@@ -315,6 +400,196 @@ mi_heap_t* _mi_heap_by_tag(mi_heap_t* heap, uint8_t tag) {
   return NULL;
 }
 
+
+/* -----------------------------------------------------------
+  Heap limits
+----------------------------------------------------------- */
+
+// Set the soft and hard limit (in bytes) on the pages owned by the heap (see `page.c:mi_heap_check_pressure`)
+void mi_heap_set_limits(mi_heap_t* heap, size_t soft_limit, size_t hard_limit) mi_attr_noexcept {
+  if (heap==NULL || !mi_heap_is_initialized(heap)) return;
+  heap->limit_soft = soft_limit;
+  heap->limit_hard = hard_limit;
+  heap->limit_pressure = false;
+}
+
+void mi_heap_register_pressure(mi_heap_t* heap, mi_heap_pressure_fun* fun, void* arg) mi_attr_noexcept {
+  if (heap==NULL || !mi_heap_is_initialized(heap)) return;
+  heap->pressure_fun = fun;
+  heap->pressure_arg = arg;
+}
+
+// Return the total size of the pages owned by the heap
+size_t mi_heap_get_size(const mi_heap_t* heap) mi_attr_noexcept {
+  if (heap==NULL) return 0;
+  return heap->pages_size;
+}
+
+/* -----------------------------------------------------------
+  Heap sampling
+
+  1 out of `mi_option_heap_sample_rate` allocations (on average) is
+  recorded in a global side table keyed by the block address. The table
+  uses open addressing with a bounded number of probes and only atomic
+  operations, so it can be read from any thread at any time without
+  allocating or taking locks. Pages that contain sampled blocks have the
+  `has_sampled` flag set which diverts their frees from the fast path in
+  `mi_free` such that the record can be removed.
+----------------------------------------------------------- */
+
+#define MI_HEAP_SAMPLE_SLOTS    (16*1024)  // power of 2
+#define MI_HEAP_SAMPLE_PROBES   (64)       // maximal probes before a sample is dropped
+
+#define MI_HEAP_SAMPLE_EMPTY    (0)        // never used (so lookups can stop here)
+#define MI_HEAP_SAMPLE_DELETED  (1)        // was used
+#define MI_HEAP_SAMPLE_BUSY     (2)        // claimed, but still being written
+
+typedef struct mi_heap_sample_slot_s {
+  _Atomic(uintptr_t)  block;               // key, or EMPTY, DELETED, or BUSY
+  _Atomic(size_t)     size;
+  _Atomic(size_t)     tag;
+  _Atomic(size_t)     thread_id;
+} mi_heap_sample_slot_t;
+
+static _Atomic(mi_heap_sample_slot_t*) mi_heap_samples;  // = NULL, allocated on the first sample
+static mi_heap_sample_tag_fun* volatile mi_heap_sample_tag = NULL;
+static _Atomic(void*) mi_heap_sample_tag_arg;  // = NULL
+
+void mi_register_heap_sample_tag(mi_heap_sample_tag_fun* fun, void* arg) mi_attr_noexcept {
+  mi_heap_sample_tag = fun;
+  mi_atomic_store_ptr_release(void, &mi_heap_sample_tag_arg, arg);
+}
+
+static mi_heap_sample_slot_t* mi_heap_samples_get(bool create) {
+  mi_heap_sample_slot_t* slots = mi_atomic_load_ptr_acquire(mi_heap_sample_slot_t, &mi_heap_samples);
+  if mi_likely(slots != NULL || !create) return slots;
+  const size_t size = MI_HEAP_SAMPLE_SLOTS * sizeof(mi_heap_sample_slot_t);
+  mi_memid_t memid;
+  slots = (mi_heap_sample_slot_t*)_mi_os_alloc(size, &memid);
+  if (slots == NULL) return NULL;
+  if (!memid.initially_zero) { _mi_memzero_aligned(slots, size); }
+  mi_heap_sample_slot_t* expected = NULL;
+  if (!mi_atomic_cas_ptr_strong_release(mi_heap_sample_slot_t, &mi_heap_samples, &expected, slots)) {
+    // another thread was first
+    _mi_os_free(slots, size, memid);
+    slots = mi_atomic_load_ptr_acquire(mi_heap_sample_slot_t, &mi_heap_samples);
+  }
+  return slots;
+}
+
+static inline size_t mi_heap_sample_hash(uintptr_t block) {
+  return (size_t)_mi_random_shuffle(block >> MI_INTPTR_SHIFT);
+}
+
+// Called from `alloc.c:_mi_page_malloc_zero` when the heap sample count reaches zero
+void _mi_heap_sample_alloc(mi_heap_t* heap, mi_page_t* page, mi_block_t* block, size_t size, void* return_address) {
+  // count down to the next sample; randomized around the rate to avoid aliasing with allocation patterns
+  const long rate = _mi_option_get_fast(mi_option_heap_sample_rate);
+  if (rate <= 0) {
+    heap->sample_count = 0;  // disabled; checked again in `page.c:mi_malloc_generic`
+    return;
+  }
+  heap->sample_count = (rate == 1 ? 1 : 1 + (_mi_heap_random_next(heap) % (2*(size_t)rate - 1)));
+
+  mi_heap_sample_slot_t* const slots = mi_heap_samples_get(true);
+  if (slots == NULL) return;
+  const size_t req_size = size - MI_PADDING_SIZE;
+  mi_heap_sample_tag_fun* const tagfun = mi_heap_sample_tag;
+  const size_t tag = (tagfun != NULL ? tagfun(block, req_size, return_address, mi_atomic_load_ptr_relaxed(void, &mi_heap_sample_tag_arg))
+                                     : (size_t)return_address);
+
+  // claim a free slot
+  const size_t hash = mi_heap_sample_hash((uintptr_t)block);
+  for (size_t i = 0; i < MI_HEAP_SAMPLE_PROBES; i++) {
+    mi_heap_sample_slot_t* const slot = &slots[(hash + i) & (MI_HEAP_SAMPLE_SLOTS - 1)];
+    uintptr_t key = mi_atomic_load_relaxed(&slot->block);
+    if (key <= MI_HEAP_SAMPLE_DELETED && mi_atomic_cas_strong_acq_rel(&slot->block, &key, (uintptr_t)MI_HEAP_SAMPLE_BUSY)) {
+      mi_atomic_store_relaxed(&slot->size, req_size);
+      mi_atomic_store_relaxed(&slot->tag, tag);
+      mi_atomic_store_relaxed(&slot->thread_id, heap->thread_id);
+      mi_atomic_store_release(&slot->block, (uintptr_t)block);
+      mi_page_set_has_sampled(page, true);
+      return;
+    }
+  }
+  // no free slot near this block: drop the sample
+}
+
+// Called on a free of a block in a page that has sampled blocks
+void _mi_heap_sample_free(mi_page_t* page, mi_block_t* block) {
+  MI_UNUSED(page);
+  mi_heap_sample_slot_t* const slots = mi_heap_samples_get(false);
+  if (slots == NULL) return;
+  const size_t hash = mi_heap_sample_hash((uintptr_t)block);
+  for (size_t i = 0; i < MI_HEAP_SAMPLE_PROBES; i++) {
+    mi_heap_sample_slot_t* const slot = &slots[(hash + i) & (MI_HEAP_SAMPLE_SLOTS - 1)];
+    uintptr_t key = mi_atomic_load_relaxed(&slot->block);
+    if (key == MI_HEAP_SAMPLE_EMPTY) return;  // not sampled
+    if (key == (uintptr_t)block) {
+      mi_atomic_cas_strong_acq_rel(&slot->block, &key, (uintptr_t)MI_HEAP_SAMPLE_DELETED);
+      return;
+    }
+  }
+}
+
+// Called when a page is freed without freeing its blocks (as in `mi_heap_destroy`)
+void _mi_heap_sample_page_free(mi_page_t* page) {
+  if (!mi_page_has_sampled(page)) return;
+  mi_page_set_has_sampled(page, false);
+  mi_heap_sample_slot_t* const slots = mi_heap_samples_get(false);
+  if (slots == NULL) return;
+  size_t psize;
+  const uintptr_t start = (uintptr_t)_mi_segment_page_start(_mi_page_segment(page), page, &psize);
+  for (size_t i = 0; i < MI_HEAP_SAMPLE_SLOTS; i++) {
+    uintptr_t key = mi_atomic_load_relaxed(&slots[i].block);
+    if (key > MI_HEAP_SAMPLE_BUSY && key >= start && key < start + psize) {
+      mi_atomic_cas_strong_acq_rel(&slots[i].block, &key, (uintptr_t)MI_HEAP_SAMPLE_DELETED);
+    }
+  }
+}
+
+// Visit all sampled live allocations (from any thread)
+bool mi_heap_sample_visit(mi_heap_sample_visit_fun* visitor, void* arg) mi_attr_noexcept {
+  if (visitor == NULL) return false;
+  mi_heap_sample_slot_t* const slots = mi_heap_samples_get(false);
+  if (slots == NULL) return true;
+  for (size_t i = 0; i < MI_HEAP_SAMPLE_SLOTS; i++) {
+    mi_heap_sample_slot_t* const slot = &slots[i];
+    const uintptr_t key = mi_atomic_load_acquire(&slot->block);
+    if (key <= MI_HEAP_SAMPLE_BUSY) continue;
+    mi_heap_sample_t sample;
+    sample.block = (void*)key;
+    sample.size = mi_atomic_load_relaxed(&slot->size);
+    sample.tag = mi_atomic_load_relaxed(&slot->tag);
+    sample.thread_id = mi_atomic_load_relaxed(&slot->thread_id);
+    mi_atomic(thread_fence)(mi_memory_order(acquire));
+    if (mi_atomic_load_relaxed(&slot->block) != key) continue;  // freed (or re-used) while reading
+    if (!visitor(&sample, arg)) return false;
+  }
+  return true;
+}
+
+typedef struct mi_heap_sample_snapshot_s {
+  mi_heap_sample_t* samples;
+  size_t            count;
+  size_t            max;
+} mi_heap_sample_snapshot_t;
+
+static bool mi_cdecl mi_heap_sample_snapshot_visit(const mi_heap_sample_t* sample, void* arg) {
+  mi_heap_sample_snapshot_t* const snap = (mi_heap_sample_snapshot_t*)arg;
+  if (snap->count >= snap->max) return false;
+  snap->samples[snap->count++] = *sample;
+  return true;
+}
+
+// Copy at most `count` sampled live allocations into `samples`; returns the number copied
+size_t mi_heap_sample_snapshot(mi_heap_sample_t* samples, size_t count) mi_attr_noexcept {
+  if (samples == NULL || count == 0) return 0;
+  mi_heap_sample_snapshot_t snap = { samples, 0, count };
+  mi_heap_sample_visit(&mi_heap_sample_snapshot_visit, &snap);
+  return snap.count;
+}
+
 /* -----------------------------------------------------------
   Heap destroy
 ----------------------------------------------------------- */
@@ -343,6 +618,7 @@ static bool _mi_heap_page_destroy(mi_heap_t* heap, mi_page_queue_t* pq, mi_page_
   const size_t inuse = page->used;
   if (bsize <= MI_LARGE_OBJ_SIZE_MAX) {
     mi_heap_stat_decrease(heap, normal, bsize * inuse);
+    mi_heap_stat_decrease(heap, tag_normal[page->heap_tag % MI_TAG_STATS_MAX], bsize * inuse);
 #if (MI_STAT>1)
     mi_heap_stat_decrease(heap, normal_bins[_mi_bin(bsize)], inuse);
 #endif
@@ -353,6 +629,7 @@ static bool _mi_heap_page_destroy(mi_heap_t* heap, mi_page_queue_t* pq, mi_page_
   /// pretend it is all free now
   mi_assert_internal(mi_page_thread_free(page) == NULL);
   page->used = 0;
+  _mi_heap_sample_page_free(page);
 
   // and free the page
   // mi_page_free(page,false);
@@ -364,6 +641,7 @@ static bool _mi_heap_page_destroy(mi_heap_t* heap, mi_page_queue_t* pq, mi_page_
 }
 
 void _mi_heap_destroy_pages(mi_heap_t* heap) {
+  _mi_heap_tcache_flush(heap);  // keep the statistics right
   mi_heap_visit_pages(heap, &_mi_heap_page_destroy, NULL, NULL);
   mi_heap_reset_pages(heap);
 }
@@ -393,11 +671,20 @@ void mi_heap_destroy(mi_heap_t* heap) {
     mi_heap_delete(heap);
   }
   else {
+    const bool is_fiber = _mi_heap_fiber_claim(heap);  // (attaching a detached fiber heap first)
+    // push out the pending cross-thread frees of this thread as these may be in pages of the heap (if it was
+    // owned by another thread when they were freed); the pending frees of other threads cannot be drained
+    // here and these threads should flush them first (see `mi_option_remote_free_batch`)
+    _mi_free_remote_flush(mi_prim_get_default_heap()->tld);
     // track all blocks as freed
     #if MI_TRACK_HEAP_DESTROY
     mi_heap_visit_blocks(heap, true, mi_heap_track_block_free, NULL);
     #endif
     // free all pages
+    if (is_fiber) {
+      _mi_heap_fiber_free(heap, true /* destroy */);
+      return;
+    }
     _mi_heap_destroy_pages(heap);
     mi_heap_free(heap);
   }
@@ -421,6 +708,227 @@ void _mi_heap_unsafe_destroy_all(mi_heap_t* heap) {
   }
 }
 
+/* -----------------------------------------------------------
+  Parallel destroy and collect
+
+  Pages are freed by the calling thread as they update thread local
+  segment state, but the segments that become free are collected in a
+  batch (see `segment.c:mi_segment_os_free`). The batch is released to
+  the arenas and the OS (decommit or unmap) by parallel tasks, and on a
+  collect the arenas are then purged in parallel as well.
+----------------------------------------------------------- */
+
+size_t mi_arena_get_count(void);  // in `arena.c`
+
+typedef struct mi_parallel_run_s {
+  mi_parallel_task_fun* task;
+  void*                 task_arg;
+  size_t                count;
+  _Atomic(size_t)       next;    // next task index
+  _Atomic(size_t)       active;  // running helper threads
+} mi_parallel_run_t;
+
+static void mi_parallel_run_tasks(mi_parallel_run_t* run) {
+  size_t i;
+  while ((i = mi_atomic_increment_relaxed(&run->next)) < run->count) {
+    run->task(i, run->task_arg);
+  }
+}
+
+static void mi_parallel_helper(void* arg) {
+  mi_parallel_run_t* const run = (mi_parallel_run_t*)arg;
+  mi_parallel_run_tasks(run);
+  mi_atomic_decrement_acq_rel(&run->active);  // last access to `run`
+}
+
+// The default executor starts `count-1` helper threads and runs tasks on the calling thread as well
+static void mi_cdecl mi_parallel_execute_default(mi_parallel_task_fun* task, void* task_arg, size_t count, void* arg) {
+  MI_UNUSED(arg);
+  mi_parallel_run_t run;
+  run.task = task;
+  run.task_arg = task_arg;
+  run.count = count;
+  mi_atomic_store_relaxed(&run.next, (size_t)0);
+  mi_atomic_store_relaxed(&run.active, (size_t)0);
+  for (size_t i = 1; i < count; i++) {
+    mi_atomic_increment_acq_rel(&run.active);
+    if (!_mi_prim_thread_start(&mi_parallel_helper, &run)) {
+      mi_atomic_decrement_acq_rel(&run.active);
+      break;
+    }
+  }
+  mi_parallel_run_tasks(&run);
+  // wait for the helpers as they still access `run`
+  while (mi_atomic_load_acquire(&run.active) > 0) {
+    mi_atomic_yield();
+  }
+}
+
+static void mi_parallel_execute(mi_executor_fun* executor, void* arg, mi_parallel_task_fun* task, void* task_arg, size_t count) {
+  if (count <= 1) {
+    for (size_t i = 0; i < count; i++) { task(i, task_arg); }
+  }
+  else if (executor != NULL) {
+    executor(task, task_arg, count, arg);
+  }
+  else {
+    mi_parallel_execute_default(task, task_arg, count, NULL);
+  }
+}
+
+static void mi_cdecl mi_parallel_batch_release(size_t part, void* task_arg) {
+  _mi_segment_batch_release((mi_segment_batch_t*)task_arg, part);
+}
+
+static void mi_cdecl mi_parallel_arenas_collect(size_t part, void* task_arg) {
+  _mi_arenas_collect_part(part, *(size_t*)task_arg);
+}
+
+static void mi_segment_batch_start(mi_segment_batch_t* batch, mi_segments_tld_t* tld, size_t workers) {
+  _mi_memzero(batch, sizeof(*batch));
+  batch->parts = (workers == 0 ? 1 : (workers > MI_SEGMENT_BATCH_PARTS_MAX ? MI_SEGMENT_BATCH_PARTS_MAX : workers));
+  mi_assert_internal(tld->batch == NULL);
+  tld->batch = batch;
+}
+
+static void mi_segment_batch_end(mi_segment_batch_t* batch, mi_segments_tld_t* tld, mi_executor_fun* executor, void* arg) {
+  mi_assert_internal(tld->batch == batch);
+  tld->batch = NULL;
+  const size_t parts = (batch->count < batch->parts ? batch->count : batch->parts);
+  mi_parallel_execute(executor, arg, &mi_parallel_batch_release, batch, parts);
+}
+
+void mi_heap_destroy_parallel(mi_heap_t* heap, size_t workers, mi_executor_fun* executor, void* arg) mi_attr_noexcept {
+  if (heap==NULL || !mi_heap_is_initialized(heap)) return;
+  #if !MI_GUARDED
+  if (heap->no_reclaim && heap->tld->segments.batch == NULL) {
+    mi_segments_tld_t* const tld = &heap->tld->segments;
+    mi_segment_batch_t batch;
+    mi_segment_batch_start(&batch, tld, workers);
+    mi_heap_destroy(heap);  // note: `heap` is freed now
+    mi_segment_batch_end(&batch, tld, executor, arg);
+    return;
+  }
+  #endif
+  MI_UNUSED(workers); MI_UNUSED(executor); MI_UNUSED(arg);
+  mi_heap_destroy(heap);
+}
+
+void mi_heap_collect_parallel(mi_heap_t* heap, size_t workers, mi_executor_fun* executor, void* arg) mi_attr_noexcept {
+  if (heap==NULL || !mi_heap_is_initialized(heap)) return;
+  mi_segments_tld_t* const tld = &heap->tld->segments;
+  if (tld->batch != NULL) {  // recursive call (from a deferred free callback)
+    mi_heap_collect(heap, true);
+    return;
+  }
+  mi_segment_batch_t batch;
+  mi_segment_batch_start(&batch, tld, workers);
+  mi_heap_collect_ex(heap, MI_FORCE);  // this skips the arena purge while the batch is installed
+  mi_segment_batch_end(&batch, tld, executor, arg);
+  // and purge the arenas (after the segments are released to them)
+  size_t parts = batch.parts;
+  const size_t arena_count = mi_arena_get_count();
+  if (parts > arena_count) { parts = arena_count; }
+  mi_parallel_execute(executor, arg, &mi_parallel_arenas_collect, &parts, parts);
+}
+
+/* -----------------------------------------------------------
+  Heap reset: free all blocks at once but keep the pages
+  (committed and owned by the heap) for the next "epoch".
+----------------------------------------------------------- */
+
+static bool _mi_heap_page_reset(mi_heap_t* heap, mi_page_queue_t* pq, mi_page_t* page, void* arg1, void* arg2) {
+  MI_UNUSED(arg1);
+  MI_UNUSED(arg2);
+  MI_UNUSED(heap);
+
+  // stats
+  const size_t bsize = mi_page_block_size(page);
+  if (bsize > MI_MEDIUM_OBJ_SIZE_MAX) {
+    if (bsize <= MI_LARGE_OBJ_SIZE_MAX) {
+      mi_heap_stat_decrease(heap, large, bsize);
+    }
+    else {
+      mi_heap_stat_decrease(heap, huge, bsize);
+    }
+  }
+#if (MI_STAT)
+  _mi_page_free_collect(page, false);  // update used count
+  const size_t inuse = page->used;
+  if (bsize <= MI_LARGE_OBJ_SIZE_MAX) {
+    mi_heap_stat_decrease(heap, normal, bsize * inuse);
+    mi_heap_stat_decrease(heap, tag_normal[page->heap_tag % MI_TAG_STATS_MAX], bsize * inuse);
+#if (MI_STAT>1)
+    mi_heap_stat_decrease(heap, normal_bins[_mi_bin(bsize)], inuse);
+#endif
+  }
+  mi_heap_stat_decrease(heap, malloc, bsize * inuse);  // todo: off for aligned blocks...
+#endif
+  mi_heap_stat_decrease(heap, page_committed, bsize * page->capacity);
+
+  // make the page empty: all blocks (including pending thread frees) are dropped
+  mi_track_mem_noaccess(page->page_start, bsize * page->capacity);
+  mi_thread_free_t tfree = mi_atomic_load_relaxed(&page->xthread_free);
+  mi_atomic_store_release(&page->xthread_free, mi_tf_clear(tfree));
+  page->free = NULL;
+  page->local_free = NULL;
+  page->used = 0;
+  page->capacity = 0;        // the free list is rebuilt (or bump allocated) on demand
+  page->free_is_zero = false;
+  page->retire_expire = 0;
+  mi_page_set_has_aligned(page, false);
+  _mi_heap_sample_page_free(page);
+
+  if (mi_page_is_huge(page)) {
+    // huge pages contain a single block of a specific size; return those to the OS
+    _mi_page_free(page, pq, false);
+  }
+  else if (mi_page_is_in_full(page)) {
+    // make it available for allocation again
+    _mi_page_unfull(page);
+  }
+  return true; // keep going
+}
+
+void mi_heap_reset(mi_heap_t* heap) {
+  mi_assert(heap != NULL);
+  mi_assert(mi_heap_is_initialized(heap));
+  mi_assert(heap->no_reclaim);
+  if (heap==NULL || !mi_heap_is_initialized(heap)) return;
+  #if MI_GUARDED
+  // guarded blocks need to be freed explicitly to remove their guard pages
+  _mi_warning_message("'mi_heap_reset' called but ignored as MI_GUARDED is enabled (heap at %p)\n", heap);
+  return;
+  #else
+  if (!heap->no_reclaim) {
+    // the heap may contain reclaimed pages with blocks that are still in use elsewhere
+    _mi_warning_message("'mi_heap_reset' called but ignored as the heap was not created with 'allow_destroy' (heap at %p)\n", heap);
+    return;
+  }
+  const bool was_attached = (heap->fiber_host != NULL);
+  const bool is_fiber = _mi_heap_fiber_claim(heap);  // (attaching a detached fiber heap first)
+  mi_assert_expensive(mi_heap_is_valid(heap));
+  // push out the pending cross-thread frees of this thread as these may be in pages of the heap
+  // (just like in `mi_heap_destroy`) and would otherwise be pushed into a reset page later on
+  _mi_free_remote_flush(mi_prim_get_default_heap()->tld);
+  // track all blocks as freed
+  #if MI_TRACK_HEAP_DESTROY
+  mi_heap_visit_blocks(heap, true, mi_heap_track_block_free, NULL);
+  #endif
+  // drop any delayed frees, and reset all pages (after freeing the cached blocks to keep the statistics right)
+  for (size_t i = 0; i < MI_DELAYED_SHARDS; i++) {
+    mi_atomic_store_ptr_release(mi_block_t, &heap->thread_delayed_free[i].list, NULL);
+  }
+  mi_atomic_store_release(&heap->thread_delayed_mask, (uintptr_t)0);
+  _mi_heap_tcache_flush(heap);
+  mi_heap_visit_pages(heap, &_mi_heap_page_reset, NULL, NULL);
+  mi_assert_expensive(mi_heap_is_valid(heap));
+  if (is_fiber && !was_attached) {
+    mi_heap_fiber_detach(heap);  // and detach it again
+  }
+  #endif
+}
+
 /* -----------------------------------------------------------
   Safe Heap delete
 ----------------------------------------------------------- */
@@ -445,6 +953,8 @@ static void mi_heap_absorb(mi_heap_t* heap, mi_heap_t* from) {
     from->page_count -= pcount;
   }
   mi_assert_internal(from->page_count == 0);
+  heap->pages_size += from->pages_size;
+  from->pages_size = 0;
 
   // and do outstanding delayed frees in the `from` heap
   // note: be careful here as the `heap` field in all those pages no longer point to `from`,
@@ -452,7 +962,7 @@ static void mi_heap_absorb(mi_heap_t* heap, mi_heap_t* from) {
   // the regular `_mi_free_delayed_block` which is safe.
   _mi_heap_delayed_free_all(from);
   #if !defined(_MSC_VER) || (_MSC_VER > 1900) // somehow the following line gives an error in VS2015, issue #353
-  mi_assert_internal(mi_atomic_load_ptr_relaxed(mi_block_t,&from->thread_delayed_free) == NULL);
+  mi_assert_internal(_mi_heap_delayed_free_is_empty(from));
   #endif
 
   // and reset the `from` heap
@@ -472,7 +982,12 @@ void mi_heap_delete(mi_heap_t* heap)
   mi_assert(mi_heap_is_initialized(heap));
   mi_assert_expensive(mi_heap_is_valid(heap));
   if (heap==NULL || !mi_heap_is_initialized(heap)) return;
+  if (_mi_heap_fiber_claim(heap)) {  // (attaching a detached fiber heap first)
+    _mi_heap_fiber_free(heap, false /* delete */);
+    return;
+  }
 
+  _mi_heap_tcache_flush(heap);
   mi_heap_t* bheap = heap->tld->heap_backing;
   if (bheap != heap && mi_heaps_are_compatible(bheap,heap)) {
     // transfer still used pages to the backing heap
@@ -491,7 +1006,7 @@ mi_heap_t* mi_heap_set_default(mi_heap_t* heap) {
   mi_assert(mi_heap_is_initialized(heap));
   if (heap==NULL || !mi_heap_is_initialized(heap)) return NULL;
   mi_assert_expensive(mi_heap_is_valid(heap));
-  mi_heap_t* old = mi_prim_get_default_heap();
+  mi_heap_t* old = _mi_heap_cpu_host(mi_prim_get_default_heap());
   _mi_heap_set_default_direct(heap);
   return old;
 }
@@ -727,3 +1242,246 @@ bool mi_heap_visit_blocks(const mi_heap_t* heap, bool visit_blocks, mi_block_vis
   mi_visit_blocks_args_t args = { visit_blocks, visitor, arg };
   return mi_heap_visit_areas(heap, &mi_heap_area_visitor, &args);
 }
+
+
+/* -----------------------------------------------------------
+  Fragmentation report
+----------------------------------------------------------- */
+
+static bool mi_heap_frag_bin_page(mi_heap_t* heap, mi_page_queue_t* pq, mi_page_t* page, void* vbins, void* arg2) {
+  MI_UNUSED(heap); MI_UNUSED(pq); MI_UNUSED(arg2);
+  mi_frag_bin_t* const bins = (mi_frag_bin_t*)vbins;
+  const size_t bsize = mi_page_block_size(page);
+  mi_frag_bin_t* const bin = &bins[_mi_bin(bsize)];   // note: full pages are counted in their original bin
+  if (bsize > bin->block_size) { bin->block_size = bsize; }
+  bin->pages++;
+  bin->used     += page->used;
+  bin->capacity += page->capacity;
+  bin->reserved += page->reserved;
+  return true;
+}
+
+// Collect the pages of a heap per bin in `all`
+static void mi_heap_frag_bins_all(const mi_heap_t* heap, mi_frag_bin_t all[MI_BIN_HUGE+1]) {
+  _mi_memzero(all, (MI_BIN_HUGE+1) * sizeof(mi_frag_bin_t));
+  mi_heap_visit_pages((mi_heap_t*)heap, &mi_heap_frag_bin_page, all, NULL);
+}
+
+// Report the non-empty bins of a heap
+size_t mi_heap_frag_bins(const mi_heap_t* heap, mi_frag_bin_t* bins, size_t max_count) mi_attr_noexcept {
+  if (heap == NULL) { heap = mi_prim_get_default_heap(); }
+  mi_frag_bin_t all[MI_BIN_HUGE+1];
+  mi_heap_frag_bins_all(heap, all);
+  size_t count = 0;
+  for (size_t i = 0; i <= MI_BIN_HUGE; i++) {
+    if (all[i].pages == 0) continue;
+    if (bins != NULL && count < max_count) { bins[count] = all[i]; }
+    count++;
+  }
+  return count;
+}
+
+// Get all segments of this thread in an OS allocated array (released with `mi_frag_segments_free`)
+static mi_frag_segment_t* mi_frag_segments_alloc(size_t* count, size_t* size, mi_memid_t* memid) {
+  *count = 0;
+  *size = 0;
+  const size_t n = mi_thread_frag_segments(NULL, 0);
+  if (n == 0) return NULL;
+  *size = n * sizeof(mi_frag_segment_t);
+  mi_frag_segment_t* const segments = (mi_frag_segment_t*)_mi_os_alloc(*size, memid);
+  if (segments == NULL) return NULL;
+  const size_t m = mi_thread_frag_segments(segments, n);
+  *count = (m < n ? m : n);
+  return segments;
+}
+
+static void mi_frag_segments_free(mi_frag_segment_t* segments, size_t size, mi_memid_t memid) {
+  if (segments != NULL) { _mi_os_free(segments, size, memid); }
+}
+
+static void mi_frag_summary_of(const mi_frag_segment_t* segments, size_t count, mi_frag_summary_t* summary) {
+  _mi_memzero(summary, sizeof(*summary));
+  mi_heap_t* const heap = mi_prim_get_default_heap();
+  if (mi_heap_is_initialized(heap)) {
+    for (mi_heap_t* h = heap->tld->heaps; h != NULL; h = h->next) {
+      mi_frag_bin_t all[MI_BIN_HUGE+1];
+      mi_heap_frag_bins_all(h, all);
+      for (size_t i = 0; i <= MI_BIN_HUGE; i++) {
+        summary->live           += all[i].used * all[i].block_size;
+        summary->page_committed += all[i].capacity * all[i].block_size;
+        summary->page_reserved  += all[i].reserved * all[i].block_size;
+      }
+    }
+  }
+  for (size_t i = 0; i < count; i++) {
+    summary->segment_committed += segments[i].committed;
+    summary->free_committed    += segments[i].free_committed;
+  }
+  summary->ratio = (summary->live == 0 ? 0.0 : (double)summary->segment_committed / (double)summary->live);
+}
+
+void mi_thread_frag_summary(mi_frag_summary_t* summary) mi_attr_noexcept {
+  if (summary == NULL) return;
+  size_t count;
+  size_t size;
+  mi_memid_t memid;
+  mi_frag_segment_t* const segments = mi_frag_segments_alloc(&count, &size, &memid);
+  mi_frag_summary_of(segments, count, summary);
+  mi_frag_segments_free(segments, size, memid);
+}
+
+void mi_thread_frag_print_out(mi_output_fun* out, void* arg) mi_attr_noexcept {
+  mi_heap_t* const heap = mi_prim_get_default_heap();
+  if (!mi_heap_is_initialized(heap)) return;
+  // pages per bin of each heap
+  for (mi_heap_t* h = heap->tld->heaps; h != NULL; h = h->next) {
+    _mi_fprintf(out, arg, "heap %p (tag %d): %zu pages\n", (void*)h, (int)h->tag, h->page_count);
+    if (h->page_count == 0) continue;
+    _mi_fprintf(out, arg, "%12s %8s %10s %10s %10s %8s\n", "block size", "pages", "used", "capacity", "reserved", "used %");
+    mi_frag_bin_t all[MI_BIN_HUGE+1];
+    mi_heap_frag_bins_all(h, all);
+    for (size_t i = 0; i <= MI_BIN_HUGE; i++) {
+      const mi_frag_bin_t* const bin = &all[i];
+      if (bin->pages == 0) continue;
+      const size_t perc = (bin->reserved == 0 ? 0 : (1000 * bin->used) / bin->reserved);
+      _mi_fprintf(out, arg, "%12zu %8zu %10zu %10zu %10zu %6zu.%zu\n", bin->block_size, bin->pages, bin->used, bin->capacity, bin->reserved, perc / 10, perc % 10);
+    }
+  }
+  // the segments of this thread
+  size_t count;
+  size_t size;
+  mi_memid_t memid;
+  mi_frag_segment_t* const segments = mi_frag_segments_alloc(&count, &size, &memid);
+  _mi_fprintf(out, arg, "segments: %zu (slices of %zu KiB)\n", count, (size_t)(MI_SEGMENT_SLICE_SIZE / MI_KiB));
+  if (count > 0) {
+    _mi_fprintf(out, arg, "%18s %10s %14s %8s %10s %10s %8s %18s\n", "segment", "size KiB", "committed KiB", "pages", "free spans", "free", "largest", "free committed KiB");
+  }
+  for (size_t i = 0; i < count; i++) {
+    const mi_frag_segment_t* const fs = &segments[i];
+    _mi_fprintf(out, arg, "%18p %10zu %14zu %8zu %10zu %10zu %8zu %18zu\n", fs->segment, fs->size / MI_KiB, fs->committed / MI_KiB,
+                fs->page_slices, fs->free_spans, fs->free_slices, fs->free_largest, fs->free_committed / MI_KiB);
+  }
+  // and the summary
+  mi_frag_summary_t summary;
+  mi_frag_summary_of(segments, count, &summary);
+  mi_frag_segments_free(segments, size, memid);
+  const size_t ratio = (size_t)(summary.ratio * 100.0);
+  _mi_fprintf(out, arg, "live %zu KiB, page committed %zu KiB, page reserved %zu KiB, segment committed %zu KiB (%zu KiB in free spans), fragmentation %zu.%02zux\n",
+              summary.live / MI_KiB, summary.page_committed / MI_KiB, summary.page_reserved / MI_KiB,
+              summary.segment_committed / MI_KiB, summary.free_committed / MI_KiB, ratio / 100, ratio % 100);
+}
+
+
+/* -----------------------------------------------------------
+  Relocate blocks out of sparsely used pages
+----------------------------------------------------------- */
+
+static bool mi_page_is_sparse(const mi_page_t* page, size_t max_used_percent) {
+  return (page->used > 0 && !mi_page_has_aligned(page) && 100*page->used < max_used_percent*page->reserved);
+}
+
+// Find the sparse pages of a heap and return their count; if `pages` is not NULL, the first `max_count`
+// pages are stored and moved to the full queue so no blocks are allocated from them anymore.
+static size_t mi_heap_sparse_pages(mi_heap_t* heap, size_t max_used_percent, mi_page_t** pages, size_t max_count) {
+  size_t count = 0;
+  for (size_t bin = 0; bin < MI_BIN_HUGE; bin++) {
+    mi_page_queue_t* const pq = &heap->pages[bin];
+    // if all pages are sparse, keep the fullest one to relocate into
+    mi_page_t* target = NULL;
+    for (mi_page_t* page = pq->first; page != NULL; page = page->next) {
+      _mi_page_free_collect(page, false);
+      if (!mi_page_is_sparse(page, max_used_percent)) { target = NULL; break; }
+      if (target == NULL || page->used > target->used) { target = page; }
+    }
+    for (mi_page_t* page = pq->first; page != NULL; page = page->next) {
+      if (page == target || !mi_page_is_sparse(page, max_used_percent)) continue;
+      if (pages != NULL && count < max_count) { pages[count] = page; }
+      count++;
+    }
+  }
+  if (pages != NULL) {
+    for (size_t i = 0; i < count && i < max_count; i++) { _mi_page_exclude(pages[i]); }
+  }
+  return count;
+}
+
+typedef struct mi_relocate_args_s {
+  mi_block_relocate_fun* relocate;
+  void*       arg;
+  void*       moved;    // relocated blocks that are freed after visiting the page (linked through their first word)
+  size_t      count;
+  bool        failed;   // out of memory
+} mi_relocate_args_t;
+
+static bool mi_heap_relocate_block(const mi_heap_t* heap, const mi_heap_area_t* area, void* block, size_t block_size, void* vargs) {
+  MI_UNUSED(area); MI_UNUSED(block_size);
+  mi_relocate_args_t* const args = (mi_relocate_args_t*)vargs;
+  const size_t size = mi_usable_size(block);
+  void* const new_block = mi_heap_malloc((mi_heap_t*)heap, size);
+  if (new_block == NULL) {
+    args->failed = true;
+    return false;
+  }
+  _mi_memcpy(new_block, block, size);
+  if (!args->relocate(heap, block, new_block, size, args->arg)) {
+    mi_free(new_block);
+    return true;
+  }
+  // don't free yet as that would change the free lists of the page we are visiting
+  *((void**)block) = args->moved;
+  args->moved = block;
+  args->count++;
+  return true;
+}
+
+size_t mi_heap_relocate_candidates(mi_heap_t* heap, size_t max_used_percent, mi_block_relocate_fun* relocate, void* arg) {
+  if (heap == NULL) { heap = mi_prim_get_default_heap(); }
+  if (!mi_heap_is_initialized(heap) || relocate == NULL) return 0;
+  if (heap->thread_id != _mi_thread_id()) {
+    _mi_error_message(EINVAL, "can only relocate blocks in a heap owned by the current thread (heap %p)\n", (void*)heap);
+    return 0;
+  }
+  if (max_used_percent == 0) { max_used_percent = 5; }
+
+  // make the used counts accurate, and while relocating don't cache freed blocks (which could come from a sparse page)
+  _mi_heap_delayed_free_all(heap);
+  _mi_heap_tcache_flush(heap);
+  const uint8_t tcache_max = heap->tcache_max;
+  heap->tcache_max = 0;
+
+  mi_relocate_args_t args = { relocate, arg, NULL, 0, false };
+  const size_t count = mi_heap_sparse_pages(heap, max_used_percent, NULL, 0);
+  if (count > 0) {
+    mi_memid_t memid;
+    const size_t size = count * sizeof(mi_page_t*);
+    mi_page_t** const pages = (mi_page_t**)_mi_os_alloc(size, &memid);
+    if (pages != NULL) {
+      const size_t n = mi_heap_sparse_pages(heap, max_used_percent, pages, count);
+      for (size_t i = 0; i < n && i < count; i++) {
+        mi_page_t* const page = pages[i];
+        if (!args.failed) {
+          mi_heap_area_t area;
+          _mi_heap_area_init(&area, page);
+          args.moved = NULL;
+          _mi_heap_area_visit_blocks(&area, page, &mi_heap_relocate_block, &args);
+        }
+        if (args.moved == NULL) {
+          // nothing relocated: allow allocation from this page again
+          _mi_page_unfull(page);
+          continue;
+        }
+        // free the relocated blocks; the first free moves the page back to its queue, and the last one frees it
+        void* block = args.moved;
+        args.moved = NULL;
+        while (block != NULL) {
+          void* const next = *((void**)block);
+          mi_free(block);
+          block = next;
+        }
+      }
+      _mi_os_free(pages, size, memid);
+    }
+  }
+  heap->tcache_max = tcache_max;
+  return args.count;
+}
@@ -53,6 +53,14 @@ const mi_page_t _mi_page_empty = {
 
 // Empty page queues for every bin
 #define QNULL(sz)  { NULL, NULL, (sz)*sizeof(uintptr_t) }
+#if MI_BIN_TABLE
+#include "mimalloc/bin-table.h"   // generated size classes (see `page-queue.c`)
+#define MI_PAGE_QUEUES_EMPTY \
+  { QNULL(1), \
+    MI_BIN_TABLE_WSIZES(QNULL), \
+    QNULL(MI_MEDIUM_OBJ_WSIZE_MAX + 1  /* Huge queue */), \
+    QNULL(MI_MEDIUM_OBJ_WSIZE_MAX + 2) /* Full queue */ }
+#else
 #define MI_PAGE_QUEUES_EMPTY \
   { QNULL(1), \
     QNULL(     1), QNULL(     2), QNULL(     3), QNULL(     4), QNULL(     5), QNULL(     6), QNULL(     7), QNULL(     8), /* 8 */ \
@@ -66,6 +74,7 @@ const mi_page_t _mi_page_empty = {
     QNULL(163840), QNULL(196608), QNULL(229376), QNULL(262144), QNULL(327680), QNULL(393216), QNULL(458752), QNULL(524288), /* 72 */ \
     QNULL(MI_MEDIUM_OBJ_WSIZE_MAX + 1  /* 655360, Huge queue */), \
     QNULL(MI_MEDIUM_OBJ_WSIZE_MAX + 2) /* Full queue */ }
+#endif
 
 #define MI_STAT_COUNT_NULL()  {0,0,0,0}
 
@@ -88,7 +97,11 @@ const mi_page_t _mi_page_empty = {
   { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, \
   { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, \
   { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, \
-  { 0, 0 }, { 0, 0 } \
+  { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, \
+  { 0, 0 }, { 0, 0 }, { 0, 0 }, \
+  { MI_STAT_COUNT_NULL() }, { { 0, 0 } }, { { 0, 0 } }, \
+  { MI_STAT_COUNT_NULL() }, { MI_STAT_COUNT_NULL() }, \
+  { { 0, 0 } }, { { 0, 0 } } \
   MI_STAT_COUNT_END_NULL()
 
 
@@ -114,22 +127,30 @@ const mi_page_t _mi_page_empty = {
 
 mi_decl_cache_align const mi_heap_t _mi_heap_empty = {
   NULL,
-  MI_ATOMIC_VAR_INIT(NULL),
+  MI_ATOMIC_VAR_INIT(0),  // thread delayed mask
   0,                // tid
   0,                // cookie
   0,                // arena id
   { 0, 0 },         // keys
   { {0}, {0}, 0, true }, // random
   0,                // page count
+  0, 0, 0, false,   // pages size, soft and hard limit, pressure
+  NULL, NULL,       // pressure callback and argument
   MI_BIN_FULL, 0,   // page retired min/max
   NULL,             // next
   false,            // can reclaim
   0,                // tag
+  0, 0,             // tag page kind and size round
+  false,            // page bump
+  NULL, NULL,       // fiber host and next
+  0,                // sample count
+  0, { 0 }, { NULL }, // free cache
   #if MI_GUARDED
   0, 0, 0, 0, 1,    // count is 1 so we never write to it (see `internal.h:mi_heap_malloc_use_guarded`)
   #endif
   MI_SMALL_PAGES_EMPTY,
-  MI_PAGE_QUEUES_EMPTY
+  MI_PAGE_QUEUES_EMPTY,
+  { { MI_ATOMIC_VAR_INIT(NULL), { 0 } } }  // thread delayed free
 };
 
 static mi_decl_cache_align mi_subproc_t mi_subproc_default;
@@ -139,9 +160,11 @@ static mi_decl_cache_align mi_subproc_t mi_subproc_default;
 mi_decl_cache_align static const mi_tld_t tld_empty = {
   0,
   false,
-  NULL, NULL,
-  { MI_SEGMENT_SPAN_QUEUES_EMPTY, 0, 0, 0, 0, 0, &mi_subproc_default, tld_empty_stats }, // segments
-  { MI_STATS_NULL }       // stats
+  NULL, NULL, NULL, NULL, 0,
+  { MI_SEGMENT_SPAN_QUEUES_EMPTY, 0, 0, 0, 0, 0, &mi_subproc_default, tld_empty_stats, 0, NULL }, // segments
+  { MI_STATS_NULL },      // stats
+  { 0, {{NULL, NULL, NULL, 0}} }, // remote frees
+  0                       // alloc sample count
 };
 
 mi_threadid_t _mi_thread_id(void) mi_attr_noexcept {
@@ -155,29 +178,39 @@ extern mi_heap_t _mi_heap_main;
 
 static mi_decl_cache_align mi_tld_t tld_main = {
   0, false,
-  &_mi_heap_main, & _mi_heap_main,
-  { MI_SEGMENT_SPAN_QUEUES_EMPTY, 0, 0, 0, 0, 0, &mi_subproc_default, &tld_main.stats }, // segments
-  { MI_STATS_NULL }       // stats
+  &_mi_heap_main, & _mi_heap_main, NULL, NULL, 0,
+  { MI_SEGMENT_SPAN_QUEUES_EMPTY, 0, 0, 0, 0, 0, &mi_subproc_default, &tld_main.stats, 0, NULL }, // segments
+  { MI_STATS_NULL },      // stats
+  { 0, {{NULL, NULL, NULL, 0}} }, // remote frees
+  0                       // alloc sample count
 };
 
 mi_decl_cache_align mi_heap_t _mi_heap_main = {
   &tld_main,
-  MI_ATOMIC_VAR_INIT(NULL),
+  MI_ATOMIC_VAR_INIT(0),  // thread delayed mask
   0,                // thread id
   0,                // initial cookie
   0,                // arena id
   { 0, 0 },         // the key of the main heap can be fixed (unlike page keys that need to be secure!)
   { {0x846ca68b}, {0}, 0, true },  // random
   0,                // page count
+  0, 0, 0, false,   // pages size, soft and hard limit, pressure
+  NULL, NULL,       // pressure callback and argument
   MI_BIN_FULL, 0,   // page retired min/max
   NULL,             // next heap
   false,            // can reclaim
   0,                // tag
+  0, 0,             // tag page kind and size round
+  false,            // page bump
+  NULL, NULL,       // fiber host and next
+  0,                // sample count
+  0, { 0 }, { NULL }, // free cache
   #if MI_GUARDED
   0, 0, 0, 0, 0,
   #endif
   MI_SMALL_PAGES_EMPTY,
-  MI_PAGE_QUEUES_EMPTY
+  MI_PAGE_QUEUES_EMPTY,
+  { { MI_ATOMIC_VAR_INIT(NULL), { 0 } } }  // thread delayed free
 };
 
 bool _mi_process_is_initialized = false;  // set to `true` in `mi_process_init`.
@@ -231,13 +264,17 @@ static void mi_heap_main_init(void) {
     #if defined(_WIN32) && !defined(MI_SHARED_LIB)
       _mi_random_init_weak(&_mi_heap_main.random);    // prevent allocation failure during bcrypt dll initialization with static linking
     #else
+    if (MI_SECURE == 0 && _mi_option_get_fast(mi_option_fast_start) != 0) {
+      _mi_random_init_weak(&_mi_heap_main.random);    // fast start: reseeded once another heap is split off (see `_mi_heap_init`)
+    }
+    else {
       _mi_random_init(&_mi_heap_main.random);
+    }
     #endif
     _mi_heap_main.cookie  = _mi_heap_random_next(&_mi_heap_main);
     _mi_heap_main.keys[0] = _mi_heap_random_next(&_mi_heap_main);
     _mi_heap_main.keys[1] = _mi_heap_random_next(&_mi_heap_main);
-    mi_lock_init(&mi_subproc_default.abandoned_os_lock);
-    mi_lock_init(&mi_subproc_default.abandoned_os_visit_lock);
+    _mi_subproc_init(&mi_subproc_default);
     _mi_heap_guarded_init(&_mi_heap_main);
   }
 }
@@ -261,9 +298,7 @@ mi_subproc_id_t mi_subproc_new(void) {
   mi_subproc_t* subproc = (mi_subproc_t*)_mi_arena_meta_zalloc(sizeof(mi_subproc_t), &memid);
   if (subproc == NULL) return NULL;
   subproc->memid = memid;
-  subproc->abandoned_os_list = NULL;
-  mi_lock_init(&subproc->abandoned_os_lock);
-  mi_lock_init(&subproc->abandoned_os_visit_lock);
+  _mi_subproc_init(subproc);
   return subproc;
 }
 
@@ -275,17 +310,22 @@ void mi_subproc_delete(mi_subproc_id_t subproc_id) {
   if (subproc_id == NULL) return;
   mi_subproc_t* subproc = _mi_subproc_from_id(subproc_id);
   // check if there are no abandoned segments still..
-  bool safe_to_delete = false;
-  mi_lock(&subproc->abandoned_os_lock) {
-    if (subproc->abandoned_os_list == NULL) {
-      safe_to_delete = true;
+  bool safe_to_delete = true;
+  for (size_t i = 0; i < MI_ABANDONED_OS_SHARDS; i++) {
+    mi_abandoned_os_shard_t* const shard = &subproc->abandoned_os[i];
+    mi_lock(&shard->lock) {
+      if (shard->list != NULL) {
+        safe_to_delete = false;
+      }
     }
   }
   if (!safe_to_delete) return;
   // safe to release
   // todo: should we refcount subprocesses?
-  mi_lock_done(&subproc->abandoned_os_lock);
-  mi_lock_done(&subproc->abandoned_os_visit_lock);
+  for (size_t i = 0; i < MI_ABANDONED_OS_SHARDS; i++) {
+    mi_lock_done(&subproc->abandoned_os[i].lock);
+    mi_lock_done(&subproc->abandoned_os[i].visit_lock);
+  }
   _mi_arena_meta_free(subproc, subproc->memid, sizeof(mi_subproc_t));
 }
 
@@ -386,6 +426,378 @@ void _mi_thread_data_collect(void) {
   }
 }
 
+
+/* -----------------------------------------------------------
+  Heap pool
+
+  With `mi_option_heap_pool` set, a terminating thread parks its
+  backing heap (together with its pages, segments, and span queues)
+  in the pool instead of abandoning it, and a new thread adopts a parked
+  heap wholesale. This avoids the abandon/reclaim churn of thread pools
+  that frequently start and stop threads.
+  A parked heap is owned by a pool id (the address of its thread data)
+  which never equals a thread id, so frees into it use the
+  multi-threaded path just like for any other thread.
+----------------------------------------------------------- */
+
+#define MI_HEAP_POOL_SIZE (64)
+static _Atomic(mi_thread_data_t*) mi_heap_pool[MI_HEAP_POOL_SIZE];
+
+// Set the owning thread of the heaps of a thread data and of the segments of all their pages
+static void mi_tld_set_owner(mi_tld_t* tld, mi_threadid_t tid) {
+  for (mi_heap_t* heap = tld->heaps; heap != NULL; heap = heap->next) {
+    heap->thread_id = tid;
+    for (size_t i = 0; i <= MI_BIN_FULL; i++) {
+      for (mi_page_t* page = heap->pages[i].first; page != NULL; page = page->next) {
+        mi_segment_t* const segment = _mi_page_segment(page);
+        if (mi_atomic_load_relaxed(&segment->thread_id) != tid) {
+          mi_atomic_store_release(&segment->thread_id, tid);
+        }
+      }
+    }
+  }
+}
+
+// Try to park the backing heap of a terminating thread in the pool
+static bool mi_heap_pool_park(mi_heap_t* heap) {
+  mi_assert_internal(mi_heap_is_backing(heap) && heap != &_mi_heap_main);
+  mi_assert_internal(heap->tld->heaps == heap && heap->next == NULL);
+  const size_t max = (size_t)mi_option_get_clamp(mi_option_heap_pool, 0, MI_HEAP_POOL_SIZE);
+  if (max == 0) return false;
+  if (heap->tld->segments.subproc != &mi_subproc_default) return false;  // only adopted by threads in the default sub-process
+  mi_heap_collect(heap, false);
+  _mi_stats_done(&heap->tld->stats);
+
+  // hand over ownership to the pool before publishing the heap
+  mi_thread_data_t* const td = (mi_thread_data_t*)heap;
+  mi_tld_set_owner(heap->tld, (mi_threadid_t)td);
+  for (size_t i = 0; i < max; i++) {
+    mi_thread_data_t* expected = NULL;
+    if (mi_atomic_load_ptr_relaxed(mi_thread_data_t, &mi_heap_pool[i]) == NULL &&
+        mi_atomic_cas_ptr_strong_release(mi_thread_data_t, &mi_heap_pool[i], &expected, td)) {
+      return true;
+    }
+  }
+  // the pool is full: take back ownership (so the heap can be abandoned as usual)
+  mi_tld_set_owner(heap->tld, _mi_thread_id());
+  return false;
+}
+
+// Try to adopt a parked heap for the current thread
+static mi_thread_data_t* mi_heap_pool_adopt(void) {
+  for (size_t i = 0; i < MI_HEAP_POOL_SIZE; i++) {
+    if (mi_atomic_load_ptr_relaxed(mi_thread_data_t, &mi_heap_pool[i]) != NULL) {
+      mi_thread_data_t* const td = mi_atomic_exchange_ptr_acq_rel(mi_thread_data_t, &mi_heap_pool[i], NULL);
+      if (td != NULL) {
+        mi_tld_set_owner(&td->tld, _mi_thread_id());
+        return td;
+      }
+    }
+  }
+  return NULL;
+}
+
+// Abandon all parked heaps (so that other threads can reclaim their memory); returns the number of heaps abandoned
+size_t mi_heap_pool_collect(void) mi_attr_noexcept {
+  size_t count = 0;
+  for (size_t i = 0; i < MI_HEAP_POOL_SIZE; i++) {
+    if (mi_atomic_load_ptr_relaxed(mi_thread_data_t, &mi_heap_pool[i]) == NULL) continue;
+    mi_thread_data_t* const td = mi_atomic_exchange_ptr_acq_rel(mi_thread_data_t, &mi_heap_pool[i], NULL);
+    if (td == NULL) continue;
+    // temporarily own the heap in this thread to abandon it
+    mi_tld_set_owner(&td->tld, _mi_thread_id());
+    _mi_heap_collect_abandon(&td->heap);
+    _mi_stats_done(&td->tld.stats);
+    mi_thread_data_free(td);
+    count++;
+  }
+  return count;
+}
+
+
+/* -----------------------------------------------------------
+  Fiber heaps
+
+  A fiber heap has its own thread data (just like a parked heap) so
+  its segments only contain pages of the fiber heap (and of heaps created
+  while it is the default heap). Moving it to another thread together with
+  its fiber is then a matter of rewriting the owning thread id of these
+  heaps and segments: `mi_heap_fiber_detach` hands the ownership to a
+  pseudo id (the address of its thread data) and `mi_heap_fiber_attach`
+  takes it in the new thread, without abandoning and reclaiming its pages.
+  The pages keep pointing to the same heap.
+  The attached fiber heaps of a thread are linked from its backing thread
+  data: when the thread terminates they are detached (and can be attached
+  by another thread later). A detached fiber heap can also be deleted or
+  destroyed from any thread, which first attaches it.
+
+  `mi_heap_switch` sets the default heap in constant time: it only writes
+  the thread local and leaves the heap that is associated with the thread
+  (for `_mi_thread_done`) as is. This is why deleting or detaching a heap
+  associates the thread with its current default heap again.
+----------------------------------------------------------- */
+
+// The backing heap of the current thread (even if the default heap belongs to a fiber heap)
+static mi_heap_t* mi_heap_get_host(void) {
+  mi_heap_t* const heap = mi_heap_get_backing();
+  return (heap->fiber_host != NULL ? heap->fiber_host : heap);
+}
+
+// Attach a fiber heap to a host (the backing heap of a thread)
+static void mi_heap_fiber_link(mi_heap_t* heap, mi_heap_t* host) {
+  mi_assert_internal(heap->fiber_host == NULL && heap->fiber_next == NULL);
+  heap->fiber_host = host;
+  heap->fiber_next = host->tld->fibers;
+  host->tld->fibers = heap;
+}
+
+static void mi_heap_fiber_unlink(mi_heap_t* heap) {
+  mi_heap_t* const host = heap->fiber_host;
+  mi_assert_internal(host != NULL);
+  mi_heap_t** link = &host->tld->fibers;
+  while (*link != heap) {
+    mi_assert_internal(*link != NULL);
+    link = &(*link)->fiber_next;
+  }
+  *link = heap->fiber_next;
+  heap->fiber_next = NULL;
+  heap->fiber_host = NULL;
+}
+
+mi_heap_t* mi_heap_new_fiber(void) {
+  mi_heap_t* const host = mi_heap_get_host();
+  mi_thread_data_t* const td = mi_thread_data_zalloc();
+  if (td == NULL) return NULL;
+  _mi_tld_init(&td->tld, &td->heap);
+  td->tld.segments.subproc = host->tld->segments.subproc;
+  _mi_heap_init(&td->heap, &td->tld, _mi_arena_id_none(), true /* no reclaim */, 0 /* default tag */);
+  mi_heap_fiber_link(&td->heap, host);
+  return &td->heap;
+}
+
+mi_heap_t* mi_heap_switch(mi_heap_t* heap) mi_attr_noexcept {
+  mi_heap_t* const old = _mi_heap_cpu_host(mi_prim_get_default_heap());
+  mi_assert(mi_heap_is_initialized(heap) && heap->thread_id == _mi_thread_id());
+  #if defined(MI_TLS_SLOT)
+  mi_prim_tls_slot_set(MI_TLS_SLOT,heap);
+  #elif defined(MI_TLS_PTHREAD_SLOT_OFS)
+  *mi_prim_tls_pthread_heap_slot() = heap;
+  #elif defined(MI_TLS_PTHREAD)
+  _mi_heap_set_default_direct(heap);  // the thread local is the association
+  #else
+  _mi_heap_default = heap;
+  #endif
+  return old;
+}
+
+// Ensure neither the default heap, nor the heap associated with the thread, are among the heaps of `tld`
+static void mi_heap_fiber_leave(mi_tld_t* tld, mi_heap_t* host) {
+  mi_heap_t* const heap = mi_prim_get_default_heap();
+  _mi_heap_set_default_direct(heap->tld == tld ? host : heap);
+}
+
+void mi_heap_fiber_detach(mi_heap_t* heap) mi_attr_noexcept {
+  mi_assert(heap != NULL && heap->fiber_host != NULL && heap->thread_id == _mi_thread_id());
+  if (heap == NULL || heap->fiber_host == NULL || heap->thread_id != _mi_thread_id()) return;
+  mi_heap_fiber_leave(heap->tld, heap->fiber_host);
+  _mi_free_remote_flush(heap->tld);
+  mi_heap_fiber_unlink(heap);
+  mi_tld_set_owner(heap->tld, (mi_threadid_t)heap);  // the heap is at the start of its thread data
+}
+
+bool mi_heap_fiber_attach(mi_heap_t* heap) mi_attr_noexcept {
+  if (heap == NULL || heap->fiber_host != NULL || heap->thread_id != (mi_threadid_t)heap) return false;  // not a detached fiber heap
+  mi_heap_t* const host = mi_heap_get_host();
+  if (host->tld->segments.subproc != heap->tld->segments.subproc) return false;
+  mi_tld_set_owner(heap->tld, _mi_thread_id());
+  mi_heap_fiber_link(heap, host);
+  return true;
+}
+
+// Take ownership of a detached fiber heap so it can be deleted or destroyed by the current thread;
+// returns `true` if `heap` is an attached fiber heap (called from `mi_heap_delete` and `mi_heap_destroy`)
+bool _mi_heap_fiber_claim(mi_heap_t* heap) {
+  if (heap->fiber_host != NULL) return true;
+  if (heap->thread_id != (mi_threadid_t)heap) return false;  // not a fiber heap
+  if (!mi_heap_fiber_attach(heap)) {
+    _mi_error_message(EINVAL, "a detached fiber heap can only be deleted by a thread in the same sub-process (heap %p)\n", (void*)heap);
+    return false;
+  }
+  return true;
+}
+
+// Delete or destroy an attached fiber heap and the other heaps in its thread data
+// (called from `mi_heap_delete` and `mi_heap_destroy`)
+void _mi_heap_fiber_free(mi_heap_t* heap, bool destroy) {
+  mi_assert_internal(mi_heap_is_backing(heap) && heap->fiber_host != NULL);
+  mi_assert_internal(heap->thread_id == _mi_thread_id());
+  mi_heap_fiber_leave(heap->tld, heap->fiber_host);
+  mi_heap_fiber_unlink(heap);
+
+  // the other heaps transfer their pages to the fiber heap
+  mi_heap_t* curr = heap->tld->heaps;
+  while (curr != NULL) {
+    mi_heap_t* const next = curr->next;
+    if (curr != heap) { mi_heap_delete(curr); }
+    curr = next;
+  }
+  mi_assert_internal(heap->tld->heaps == heap && heap->next == NULL);
+  if (destroy) {
+    _mi_heap_destroy_pages(heap);
+  }
+  else {
+    _mi_heap_collect_abandon(heap);
+  }
+  _mi_stats_done(&heap->tld->stats);
+  mi_thread_data_free((mi_thread_data_t*)heap);
+}
+
+/* -----------------------------------------------------------
+  Per-CPU heaps
+
+  With `mi_option_cpu_heaps` set, the default heap of a thread allocates
+  small objects from a heap per CPU, so memory scales with the number of cores
+  instead of the number of (mostly idle) threads. The cpu id is read from the
+  restartable sequences (rseq) area without a system call.
+  On its generic allocation path a thread leases the heap of its CPU and makes
+  it its default heap: the fast path then allocates from it directly, and
+  frees of its blocks by the thread are local. The lease moves the heap between
+  threads just like a fiber heap (by rewriting the owning thread id of its pages
+  and segments), as the allocation fast path is not a restartable sequence.
+  The lease is released at the next generic allocation when the thread migrated
+  to another CPU or when another thread on the same CPU wants the heap, by
+  `mi_collect`, or when the thread terminates. If the heap is leased by another
+  thread, the thread allocates from its own (backing) heap, as it also does for
+  large objects. A leased heap is never exposed through the API
+  (see `_mi_heap_cpu_host`) so `mi_heap_get_default` returns the thread's own heap.
+----------------------------------------------------------- */
+
+#if defined(__linux__)
+#define MI_CPU_HEAPS  1
+#else
+#define MI_CPU_HEAPS  0
+#endif
+
+#if MI_CPU_HEAPS
+
+#define MI_CPU_HEAPS_MAX    (256)
+#define MI_CPU_SLOT_FREE    (0)
+#define MI_CPU_SLOT_LEASED  (1)
+#define MI_CPU_SLOT_WANTED  (2)   // leased, and another thread on the same CPU waits for it
+
+typedef struct mi_cpu_slot_s {
+  _Atomic(uintptr_t) state;    // free, leased, or wanted
+  mi_thread_data_t*  td;       // heap and tld, created by the first lease (and published by releasing it)
+  uint8_t            padding[64 - sizeof(uintptr_t) - sizeof(void*)];  // avoid false sharing between CPUs
+} mi_cpu_slot_t;
+
+static mi_cpu_slot_t mi_cpu_slots[MI_CPU_HEAPS_MAX];
+static mi_decl_thread size_t mi_cpu_heap_depth;  // > 0 while allocating from the leased heap (so a nested allocation cannot release it)
+
+// Lease the heap of a CPU slot for the current thread
+static mi_heap_t* mi_heap_cpu_lease(mi_heap_t* host, size_t idx) {
+  mi_cpu_slot_t* const slot = &mi_cpu_slots[idx];
+  uintptr_t expected = MI_CPU_SLOT_FREE;
+  if (mi_atomic_load_relaxed(&slot->state) != MI_CPU_SLOT_FREE ||
+      !mi_atomic_cas_strong_acq_rel(&slot->state, &expected, (uintptr_t)MI_CPU_SLOT_LEASED)) {
+    // ask the current holder to release it at its next generic allocation
+    expected = MI_CPU_SLOT_LEASED;
+    mi_atomic_cas_strong_acq_rel(&slot->state, &expected, (uintptr_t)MI_CPU_SLOT_WANTED);
+    return NULL;
+  }
+  mi_thread_data_t* td = slot->td;
+  if (td == NULL) {
+    td = mi_thread_data_zalloc();
+    if (td == NULL) {
+      mi_atomic_store_release(&slot->state, (uintptr_t)MI_CPU_SLOT_FREE);
+      return NULL;
+    }
+    _mi_tld_init(&td->tld, &td->heap);
+    _mi_heap_init(&td->heap, &td->tld, _mi_arena_id_none(), false /* can reclaim */, 0 /* default tag */);
+    slot->td = td;
+  }
+  else {
+    mi_tld_set_owner(&td->tld, _mi_thread_id());
+  }
+  mi_heap_fiber_link(&td->heap, host);
+  host->tld->cpu_heap = &td->heap;
+  host->tld->cpu_slot = idx;
+  return &td->heap;
+}
+
+// Release the heap leased by the thread of `host` (unless the thread is allocating from it)
+void _mi_heap_cpu_release(mi_heap_t* host) {
+  mi_heap_t* const heap = host->tld->cpu_heap;
+  if (heap == NULL || mi_cpu_heap_depth > 0) return;
+  mi_assert_internal(heap->fiber_host == host && heap->thread_id == _mi_thread_id());
+  _mi_stats_done(&heap->tld->stats);
+  host->tld->cpu_heap = NULL;
+  mi_heap_fiber_detach(heap);  // this also makes the host the default heap again
+  mi_atomic_store_release(&mi_cpu_slots[host->tld->cpu_slot].state, (uintptr_t)MI_CPU_SLOT_FREE);
+}
+
+// Keep, switch, or lease the heap of the current CPU for the thread of `host`
+static mi_heap_t* mi_heap_cpu_select(mi_heap_t* host) {
+  mi_tld_t* const tld = host->tld;
+  const size_t cpu = (mi_option_is_enabled(mi_option_cpu_heaps) && tld->segments.subproc == &mi_subproc_default ? _mi_prim_cpu_id() : SIZE_MAX);
+  mi_heap_t* heap = tld->cpu_heap;
+  if (heap != NULL) {
+    const bool wanted = (mi_atomic_load_relaxed(&mi_cpu_slots[tld->cpu_slot].state) == MI_CPU_SLOT_WANTED);
+    if (!wanted && cpu != SIZE_MAX && (cpu % MI_CPU_HEAPS_MAX) == tld->cpu_slot) {
+      if (heap != mi_prim_get_default_heap()) { mi_heap_switch(heap); }  // after the host was set as the default heap
+      return heap;
+    }
+    _mi_heap_cpu_release(host);
+    if (wanted) return host;  // give the waiting thread a chance to lease it first
+  }
+  if (cpu == SIZE_MAX) return host;
+  heap = mi_heap_cpu_lease(host, cpu % MI_CPU_HEAPS_MAX);
+  if (heap == NULL) return host;
+  mi_heap_switch(heap);
+  return heap;
+}
+
+// Return the heap to allocate `size` bytes from on the generic path: `heap`, the leased per-CPU heap,
+// or the host; must be followed by `_mi_heap_cpu_leave` with the returned heap.
+mi_heap_t* _mi_heap_cpu_enter(mi_heap_t* heap, size_t size, size_t huge_alignment) {
+  mi_heap_t* const host = _mi_heap_cpu_host(heap);
+  if (host->tld->cpu_heap == NULL && !mi_option_is_enabled(mi_option_cpu_heaps)) return heap;
+  if (heap == mi_prim_get_default_heap() && mi_heap_is_backing(host) && host->fiber_host == NULL) {
+    if (huge_alignment != 0 || size > MI_MEDIUM_OBJ_SIZE_MAX + MI_PADDING_SIZE) {
+      heap = host;  // large objects are allocated from the own heap of the thread
+    }
+    else if (mi_cpu_heap_depth == 0) {
+      heap = mi_heap_cpu_select(host);
+    }
+  }
+  if (_mi_heap_cpu_host(heap) != heap) { mi_cpu_heap_depth++; }
+  return heap;
+}
+
+void _mi_heap_cpu_leave(mi_heap_t* heap) {
+  if (_mi_heap_cpu_host(heap) != heap) {
+    mi_assert_internal(mi_cpu_heap_depth > 0);
+    mi_cpu_heap_depth--;
+  }
+}
+
+#else
+
+mi_heap_t* _mi_heap_cpu_enter(mi_heap_t* heap, size_t size, size_t huge_alignment) {
+  MI_UNUSED(size); MI_UNUSED(huge_alignment);
+  return heap;
+}
+
+void _mi_heap_cpu_leave(mi_heap_t* heap) {
+  MI_UNUSED(heap);
+}
+
+void _mi_heap_cpu_release(mi_heap_t* host) {
+  MI_UNUSED(host);
+}
+
+#endif
+
 // Initialize the thread local default heap, called from `mi_thread_init`
 static bool _mi_thread_heap_init(void) {
   if (mi_heap_is_initialized(mi_prim_get_default_heap())) return true;
@@ -397,8 +809,15 @@ static bool _mi_thread_heap_init(void) {
     //mi_assert_internal(_mi_heap_default->tld->heap_backing == mi_prim_get_default_heap());
   }
   else {
+    // adopt a parked heap from a terminated thread if possible
+    mi_thread_data_t* td = mi_heap_pool_adopt();
+    if (td != NULL) {
+      _mi_heap_set_default_direct(&td->heap);
+      return false;
+    }
+
     // use `_mi_os_alloc` to allocate directly from the OS
-    mi_thread_data_t* td = mi_thread_data_zalloc();
+    td = mi_thread_data_zalloc();
     if (td == NULL) return false;
 
     mi_tld_t*  tld = &td->tld;
@@ -423,13 +842,28 @@ void _mi_tld_init(mi_tld_t* tld, mi_heap_t* bheap) {
 static bool _mi_thread_heap_done(mi_heap_t* heap) {
   if (!mi_heap_is_initialized(heap)) return true;
 
+  // push out any pending cross-thread frees
+  _mi_free_remote_flush(heap->tld);
+
   // reset default heap
   _mi_heap_set_default_direct(_mi_is_main_thread() ? &_mi_heap_main : (mi_heap_t*)&_mi_heap_empty);
 
-  // switch to backing heap
+  // switch to backing heap (of the thread if the default heap belongs to a fiber heap)
   heap = heap->tld->heap_backing;
+  if (heap->fiber_host != NULL) {
+    heap = heap->fiber_host;
+    _mi_free_remote_flush(heap->tld);
+  }
   if (!mi_heap_is_initialized(heap)) return false;
 
+  // release the leased per-CPU heap (so another thread on the CPU can lease it)
+  _mi_heap_cpu_release(heap);
+
+  // detach the fiber heaps that are still attached (so another thread can attach them)
+  while (heap->tld->fibers != NULL) {
+    mi_heap_fiber_detach(heap->tld->fibers);
+  }
+
   // delete all non-backing heaps in this thread
   mi_heap_t* curr = heap->tld->heaps;
   while (curr != NULL) {
@@ -443,6 +877,11 @@ static bool _mi_thread_heap_done(mi_heap_t* heap) {
   mi_assert_internal(heap->tld->heaps == heap && heap->next == NULL);
   mi_assert_internal(mi_heap_is_backing(heap));
 
+  // park the heap for adoption by a new thread if possible
+  if (heap != &_mi_heap_main && mi_heap_pool_park(heap)) {
+    return false;
+  }
+
   // collect if not the main thread
   if (heap != &_mi_heap_main) {
     _mi_heap_collect_abandon(heap);
@@ -548,6 +987,9 @@ void _mi_thread_done(mi_heap_t* heap)
   // check thread-id as on Windows shutdown with FLS the main (exit) thread may call this on thread-local heaps...
   if (heap->thread_id != _mi_thread_id()) return;
 
+  // flush any tracked information of this thread
+  mi_track_thread_done();
+
   // abandon the thread local heap
   if (_mi_thread_heap_done(heap)) return;  // returns true if already ran
 }
@@ -601,8 +1043,10 @@ void _mi_process_load(void) {
     _mi_fputs(NULL,NULL,NULL,msg);
   }
 
-  // reseed random
-  _mi_random_reinit_if_weak(&_mi_heap_main.random);
+  // reseed random (in fast start mode only once needed)
+  if (MI_SECURE > 0 || !mi_option_is_enabled(mi_option_fast_start)) {
+    _mi_random_reinit_if_weak(&_mi_heap_main.random);
+  }
 }
 
 #if defined(_WIN32) && (defined(_M_IX86) || defined(_M_X64))
@@ -637,7 +1081,8 @@ void mi_process_init(void) mi_attr_noexcept {
   mi_process_setup_auto_thread_done();
 
   mi_detect_cpu_features();
-  _mi_os_init();
+  const bool fast_start = mi_option_is_enabled(mi_option_fast_start);
+  if (!fast_start) { _mi_os_init(); }  // otherwise on first use
   mi_heap_main_init();
   #if MI_DEBUG
   _mi_verbose_message("debug level : %d\n", MI_DEBUG);
@@ -659,21 +1104,7 @@ void mi_process_init(void) mi_attr_noexcept {
   mi_stats_reset();  // only call stat reset *after* thread init (or the heap tld == NULL)
   mi_track_init();
 
-  if (mi_option_is_enabled(mi_option_reserve_huge_os_pages)) {
-    size_t pages = mi_option_get_clamp(mi_option_reserve_huge_os_pages, 0, 128*1024);
-    long reserve_at = mi_option_get(mi_option_reserve_huge_os_pages_at);
-    if (reserve_at != -1) {
-      mi_reserve_huge_os_pages_at(pages, reserve_at, pages*500);
-    } else {
-      mi_reserve_huge_os_pages_interleave(pages, 0, pages*500);
-    }
-  }
-  if (mi_option_is_enabled(mi_option_reserve_os_memory)) {
-    long ksize = mi_option_get(mi_option_reserve_os_memory);
-    if (ksize > 0) {
-      mi_reserve_os_memory((size_t)ksize*MI_KiB, true /* commit? */, true /* allow large pages? */);
-    }
-  }
+  _mi_arenas_reserve_startup(fast_start /* defer to the first arena allocation? */);
 }
 
 // Called when the process is done (through `at_exit`)
@@ -692,6 +1123,10 @@ void mi_cdecl _mi_process_done(void) {
   // release any thread specific resources and ensure _mi_thread_done is called on all but the main thread
   _mi_prim_thread_done_auto_done();
 
+  // stop the background purger and background reservations (if they were started)
+  _mi_arenas_purger_done();
+  _mi_arenas_reserve_done();
+
 
   #ifndef MI_SKIP_COLLECT_ON_EXIT
     #if (MI_DEBUG || !defined(MI_SHARED_LIB))
@@ -715,6 +1150,7 @@ void mi_cdecl _mi_process_done(void) {
   if (mi_option_is_enabled(mi_option_show_stats) || mi_option_is_enabled(mi_option_verbose)) {
     mi_stats_print(NULL);
   }
+  mi_track_done();
   _mi_allocator_done();
   _mi_verbose_message("process done: 0x%zx\n", _mi_heap_main.thread_id);
   os_preloading = true; // don't call the C runtime anymore
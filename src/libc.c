@@ -15,6 +15,7 @@ terms of the MIT license. A copy of the license can be found in the file
 #include "mimalloc.h"
 #include "mimalloc/internal.h"
 #include "mimalloc/prim.h"      // mi_prim_getenv
+#include "mimalloc/atomic.h"
 
 char _mi_toupper(char c) {
   if (c >= 'a' && c <= 'z') return (c - 'a' + 'A');
@@ -273,3 +274,213 @@ void _mi_snprintf(char* buf, size_t buflen, const char* fmt, ...) {
   _mi_vsnprintf(buf, buflen, fmt, args);
   va_end(args);
 }
+
+
+// --------------------------------------------------------
+// Copy and zero large blocks with non-temporal stores
+// that bypass the cache, so a multi-MiB `realloc` or
+// `calloc` does not evict the working set of the program.
+// This is used for blocks of at least `mi_option_nontemporal_min`.
+// The kernel (AVX-512, AVX2, SSE2, or NEON) is selected at
+// runtime on first use.
+// --------------------------------------------------------
+
+#define MI_NT_CHUNK   (64)    // bytes per kernel iteration (and the alignment of the destination)
+
+typedef void (mi_nt_copy_fun)(uint8_t* dst, const uint8_t* src, size_t n);
+typedef void (mi_nt_zero_fun)(uint8_t* dst, size_t n);
+
+#if !MI_TRACK_ENABLED && (defined(__x86_64__) || defined(_M_X64)) && (defined(__GNUC__) || defined(__clang__) || defined(_MSC_VER))
+#include <immintrin.h>
+#define MI_HAS_NT_STORE  1
+
+#if defined(__GNUC__) || defined(__clang__)
+#define mi_decl_target(t)  __attribute__((target(t)))
+#else
+#define mi_decl_target(t)
+#endif
+
+// note: the kernels are called with `n` a multiple of `MI_NT_CHUNK`, and `dst` aligned to it
+static void mi_nt_copy_sse2(uint8_t* dst, const uint8_t* src, size_t n) {
+  for (; n > 0; n -= MI_NT_CHUNK, dst += MI_NT_CHUNK, src += MI_NT_CHUNK) {
+    const __m128i a = _mm_loadu_si128((const __m128i*)src);
+    const __m128i b = _mm_loadu_si128((const __m128i*)(src + 16));
+    const __m128i c = _mm_loadu_si128((const __m128i*)(src + 32));
+    const __m128i d = _mm_loadu_si128((const __m128i*)(src + 48));
+    _mm_stream_si128((__m128i*)dst, a);
+    _mm_stream_si128((__m128i*)(dst + 16), b);
+    _mm_stream_si128((__m128i*)(dst + 32), c);
+    _mm_stream_si128((__m128i*)(dst + 48), d);
+  }
+}
+
+static void mi_nt_zero_sse2(uint8_t* dst, size_t n) {
+  const __m128i z = _mm_setzero_si128();
+  for (; n > 0; n -= MI_NT_CHUNK, dst += MI_NT_CHUNK) {
+    _mm_stream_si128((__m128i*)dst, z);
+    _mm_stream_si128((__m128i*)(dst + 16), z);
+    _mm_stream_si128((__m128i*)(dst + 32), z);
+    _mm_stream_si128((__m128i*)(dst + 48), z);
+  }
+}
+
+mi_decl_target("avx2") static void mi_nt_copy_avx2(uint8_t* dst, const uint8_t* src, size_t n) {
+  for (; n > 0; n -= MI_NT_CHUNK, dst += MI_NT_CHUNK, src += MI_NT_CHUNK) {
+    const __m256i a = _mm256_loadu_si256((const __m256i*)src);
+    const __m256i b = _mm256_loadu_si256((const __m256i*)(src + 32));
+    _mm256_stream_si256((__m256i*)dst, a);
+    _mm256_stream_si256((__m256i*)(dst + 32), b);
+  }
+}
+
+mi_decl_target("avx2") static void mi_nt_zero_avx2(uint8_t* dst, size_t n) {
+  const __m256i z = _mm256_setzero_si256();
+  for (; n > 0; n -= MI_NT_CHUNK, dst += MI_NT_CHUNK) {
+    _mm256_stream_si256((__m256i*)dst, z);
+    _mm256_stream_si256((__m256i*)(dst + 32), z);
+  }
+}
+
+mi_decl_target("avx512f") static void mi_nt_copy_avx512(uint8_t* dst, const uint8_t* src, size_t n) {
+  for (; n > 0; n -= MI_NT_CHUNK, dst += MI_NT_CHUNK, src += MI_NT_CHUNK) {
+    _mm512_stream_si512((void*)dst, _mm512_loadu_si512((const void*)src));
+  }
+}
+
+mi_decl_target("avx512f") static void mi_nt_zero_avx512(uint8_t* dst, size_t n) {
+  const __m512i z = _mm512_setzero_si512();
+  for (; n > 0; n -= MI_NT_CHUNK, dst += MI_NT_CHUNK) {
+    _mm512_stream_si512((void*)dst, z);
+  }
+}
+
+static void mi_nt_fence(void) {
+  _mm_sfence();  // non-temporal stores are weakly ordered
+}
+
+#if defined(_MSC_VER) && !defined(__clang__)
+static bool mi_cpu_has_avx(int leaf7_ebx_bit) {
+  int info[4];
+  __cpuid(info, 1);
+  const bool osxsave = ((info[2] & (1 << 27)) != 0);
+  if (!osxsave) return false;
+  const unsigned long long xcr0 = _xgetbv(0);
+  const unsigned long long xmask = (leaf7_ebx_bit == 16 ? 0xE6 : 0x06);  // AVX-512 also needs the opmask and upper ZMM state
+  if ((xcr0 & xmask) != xmask) return false;
+  __cpuidex(info, 7, 0);
+  return ((info[1] & (1 << leaf7_ebx_bit)) != 0);
+}
+#define mi_cpu_has_avx2()    mi_cpu_has_avx(5)    // bit 5 of EBX
+#define mi_cpu_has_avx512()  mi_cpu_has_avx(16)   // bit 16 of EBX (AVX-512F)
+#else
+#define mi_cpu_has_avx2()    (__builtin_cpu_init(), __builtin_cpu_supports("avx2"))
+#define mi_cpu_has_avx512()  (__builtin_cpu_init(), __builtin_cpu_supports("avx512f"))
+#endif
+
+static mi_nt_copy_fun* const mi_nt_copy_kernels[3] = { &mi_nt_copy_sse2, &mi_nt_copy_avx2, &mi_nt_copy_avx512 };
+static mi_nt_zero_fun* const mi_nt_zero_kernels[3] = { &mi_nt_zero_sse2, &mi_nt_zero_avx2, &mi_nt_zero_avx512 };
+
+static size_t mi_nt_select(void) {
+  return (mi_cpu_has_avx512() ? 2 : (mi_cpu_has_avx2() ? 1 : 0));
+}
+
+#elif !MI_TRACK_ENABLED && defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__))
+#define MI_HAS_NT_STORE  1
+
+// NEON loads with `stnp` (store pair, non-temporal) stores
+static void mi_nt_copy_neon(uint8_t* dst, const uint8_t* src, size_t n) {
+  for (; n > 0; n -= MI_NT_CHUNK, dst += MI_NT_CHUNK, src += MI_NT_CHUNK) {
+    __asm__ volatile(
+      "ldp  q0, q1, [%1]\n\t"
+      "ldp  q2, q3, [%1, #32]\n\t"
+      "stnp q0, q1, [%0]\n\t"
+      "stnp q2, q3, [%0, #32]"
+      : : "r"(dst), "r"(src) : "v0", "v1", "v2", "v3", "memory");
+  }
+}
+
+static void mi_nt_zero_neon(uint8_t* dst, size_t n) {
+  for (; n > 0; n -= MI_NT_CHUNK, dst += MI_NT_CHUNK) {
+    __asm__ volatile(
+      "stnp xzr, xzr, [%0]\n\t"
+      "stnp xzr, xzr, [%0, #16]\n\t"
+      "stnp xzr, xzr, [%0, #32]\n\t"
+      "stnp xzr, xzr, [%0, #48]"
+      : : "r"(dst) : "memory");
+  }
+}
+
+static void mi_nt_fence(void) {
+  __asm__ volatile("dmb ishst" : : : "memory");
+}
+
+static mi_nt_copy_fun* const mi_nt_copy_kernels[1] = { &mi_nt_copy_neon };
+static mi_nt_zero_fun* const mi_nt_zero_kernels[1] = { &mi_nt_zero_neon };
+
+static size_t mi_nt_select(void) {
+  return 0;  // NEON is always available on arm64
+}
+
+#else
+#define MI_HAS_NT_STORE  0
+#endif
+
+#if MI_HAS_NT_STORE
+static _Atomic(size_t) mi_nt_kernel;  // index of the selected kernels + 1 (or 0 if not yet selected)
+
+// Use non-temporal stores for a block of `block_size`? Returns the kernel index + 1, or 0 if not.
+static size_t mi_use_nt(size_t block_size, size_t n) {
+  if (n < 4*MI_NT_CHUNK) return 0;
+  const size_t min_size = mi_option_get_size(mi_option_nontemporal_min);
+  if (min_size == 0 || block_size < min_size) return 0;
+  size_t kernel = mi_atomic_load_relaxed(&mi_nt_kernel);
+  if mi_unlikely(kernel == 0) {
+    kernel = mi_nt_select() + 1;
+    mi_atomic_store_relaxed(&mi_nt_kernel, kernel);
+  }
+  return kernel;
+}
+
+// the number of bytes before `dst` is aligned to `MI_NT_CHUNK`
+static size_t mi_nt_head(const void* dst) {
+  return ((MI_NT_CHUNK - ((uintptr_t)dst % MI_NT_CHUNK)) % MI_NT_CHUNK);
+}
+#endif
+
+// Copy `n` bytes to a block of `block_size` bytes
+void _mi_memcpy_large(void* dst, const void* src, size_t n, size_t block_size) {
+  #if MI_HAS_NT_STORE
+  const size_t kernel = mi_use_nt(block_size, n);
+  if (kernel > 0) {
+    const size_t head = mi_nt_head(dst);
+    const size_t body = (n - head) & ~((size_t)MI_NT_CHUNK - 1);
+    _mi_memcpy(dst, src, head);
+    (*mi_nt_copy_kernels[kernel-1])((uint8_t*)dst + head, (const uint8_t*)src + head, body);
+    mi_nt_fence();
+    _mi_memcpy((uint8_t*)dst + head + body, (const uint8_t*)src + head + body, n - head - body);
+    return;
+  }
+  #else
+  MI_UNUSED(block_size);
+  #endif
+  _mi_memcpy(dst, src, n);
+}
+
+// Zero `n` bytes in a block of `block_size` bytes
+void _mi_memzero_large(void* dst, size_t n, size_t block_size) {
+  #if MI_HAS_NT_STORE
+  const size_t kernel = mi_use_nt(block_size, n);
+  if (kernel > 0) {
+    const size_t head = mi_nt_head(dst);
+    const size_t body = (n - head) & ~((size_t)MI_NT_CHUNK - 1);
+    _mi_memzero(dst, head);
+    (*mi_nt_zero_kernels[kernel-1])((uint8_t*)dst + head, body);
+    mi_nt_fence();
+    _mi_memzero((uint8_t*)dst + head + body, n - head - body);
+    return;
+  }
+  #else
+  MI_UNUSED(block_size);
+  #endif
+  _mi_memzero(dst, n);
+}
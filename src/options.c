@@ -13,10 +13,6 @@ terms of the MIT license. A copy of the license can be found in the file
 #include <stdlib.h>     // abort
 
 
-
-static long mi_max_error_count   = 16; // stop outputting errors after this (use < 0 for no limit)
-static long mi_max_warning_count = 16; // stop outputting warnings after this (use < 0 for no limit)
-
 static void mi_add_stderr_output(void);
 
 int mi_version(void) mi_attr_noexcept {
@@ -27,8 +23,8 @@ int mi_version(void) mi_attr_noexcept {
 // --------------------------------------------------------
 // Options
 // These can be accessed by multiple threads and may be
-// concurrently initialized, but an initializing data race
-// is ok since they resolve to the same value.
+// concurrently initialized (which is serialized by a lock,
+// see `mi_option_init_locked`).
 // --------------------------------------------------------
 typedef enum mi_init_e {
   UNINIT,       // not yet initialized
@@ -102,6 +98,10 @@ typedef struct mi_option_desc_s {
 #endif
 #endif
 
+#ifndef MI_DEFAULT_FAST_START
+#define MI_DEFAULT_FAST_START 0
+#endif
+
 
 static mi_option_desc_t options[_mi_option_last] =
 {
@@ -162,28 +162,64 @@ static mi_option_desc_t options[_mi_option_last] =
          UNINIT, MI_OPTION(guarded_sample_rate)},       // 1 out of N allocations in the min/max range will be guarded (=4000)
   { 0,   UNINIT, MI_OPTION(guarded_sample_seed)},
   { 0,   UNINIT, MI_OPTION(target_segments_per_thread) }, // abandon segments beyond this point, or 0 to disable.
+  { 0,   UNINIT, MI_OPTION(remote_free_batch) },        // batch cross-thread frees per page (up to N blocks), or 0 to disable.
+  { 0,   UNINIT, MI_OPTION(purge_background_interval) }, // wake interval of the background purge thread (in milli-seconds), or 0 to disable.
+  { 0,   UNINIT, MI_OPTION(thp_aware) },                // commit and purge in (2MiB) huge OS page units to play well with transparent huge pages
+  { 0,   UNINIT, MI_OPTION(alloc_sample_rate) },        // sample 1 out of N slow path allocations (for statistics), or 0 to disable.
+  { 0,   UNINIT, MI_OPTION(heap_sample_rate) },         // record 1 out of N allocations for live heap profiling, or 0 to disable.
+  { 0,   UNINIT, MI_OPTION(heap_pool) },                // park up to N heaps of terminated threads for adoption by new threads (at most 64), or 0 to disable.
+  { 0,   UNINIT, MI_OPTION(page_bump) },                // bump allocate the fresh capacity of pages (instead of extending the free list first)
+  { 0,   UNINIT, MI_OPTION(free_cache) },               // cache up to N recently freed small blocks per size class (at most 255), or 0 to disable.
+  { 0,   UNINIT, MI_OPTION(reserve_huge_os_pages_async) }, // reserve all but the first huge OS page at startup on a background thread
+  { 0,   UNINIT, MI_OPTION(commit_ahead) },             // maximal size to commit ahead in segments that commit frequently (in KiB), or 0 to disable.
+  { 0,   UNINIT, MI_OPTION(populate) },                 // prefault segment memory (and memory reserved at startup) when it is allocated
+  { 0,   UNINIT, MI_OPTION(purge_adaptive) },           // maximal factor to scale the purge delay when purged memory is soon reused, or 0 to disable.
+  { 0,   UNINIT, MI_OPTION(purge_adaptive_ceiling) },   // committed memory (in KiB) above which the purge delay is not scaled, or 0 for no ceiling.
+  { 1024L*1024L, UNINIT, MI_OPTION(trace_max_size) },   // maximal size of an allocation trace file (in KiB), 1GiB
+  { 0,   UNINIT, MI_OPTION(calloc_decommit_min) },      // zero large blocks (in KiB) by decommitting and recommitting them (instead of a memset), or 0 to disable.
+  { MI_DEFAULT_FAST_START,
+         UNINIT, MI_OPTION(fast_start) },               // defer option parsing, secure seeding, OS queries, and startup reservations until first needed
+  { 0,   UNINIT, MI_OPTION(nontemporal_min) },          // copy and zero blocks of at least N KiB with non-temporal stores, or 0 to disable.
+  { 0,   UNINIT, MI_OPTION(pressure_interval) },        // poll the cgroup memory pressure every N milli-seconds, or 0 to disable.
+  { 0,   UNINIT, MI_OPTION(cpu_heaps) },                // allocate small objects from a heap leased per CPU (instead of the heap of the thread)
 };
 
 static void mi_option_init(mi_option_desc_t* desc);
 
 static bool mi_option_has_size_in_kib(mi_option_t option) {
-  return (option == mi_option_reserve_os_memory || option == mi_option_arena_reserve);
-}
+  return (option == mi_option_reserve_os_memory || option == mi_option_arena_reserve ||
+          option == mi_option_commit_ahead || option == mi_option_purge_adaptive_ceiling ||
+          option == mi_option_trace_max_size || option == mi_option_calloc_decommit_min ||
+          option == mi_option_nontemporal_min);
+}
+
+// Options that are read on hot paths through `_mi_option_get_fast`; these are
+// always initialized at process load, also in fast start mode.
+static const mi_option_t mi_options_read_fast[] = {
+  mi_option_free_cache, mi_option_remote_free_batch, mi_option_page_bump,
+  mi_option_alloc_sample_rate, mi_option_heap_sample_rate,
+  mi_option_target_segments_per_thread, mi_option_abandoned_reclaim_on_free,
+  mi_option_guarded_min, mi_option_guarded_max
+};
 
 void _mi_options_init(void) {
   // called on process load
   mi_add_stderr_output(); // now it safe to use stderr for output
-  for(int i = 0; i < _mi_option_last; i++ ) {
-    mi_option_t option = (mi_option_t)i;
-    long l = mi_option_get(option); MI_UNUSED(l); // initialize
-    // if (option != mi_option_verbose)
-    {
+  // in fast start mode each option is only parsed on its first read (unless verbose)
+  if (!mi_option_is_enabled(mi_option_fast_start) || mi_option_is_enabled(mi_option_verbose)) {
+    for(int i = 0; i < _mi_option_last; i++ ) {
+      mi_option_t option = (mi_option_t)i;
+      long l = mi_option_get(option); MI_UNUSED(l); // initialize
       mi_option_desc_t* desc = &options[option];
       _mi_verbose_message("option '%s': %ld %s\n", desc->name, desc->value, (mi_option_has_size_in_kib(option) ? "KiB" : ""));
     }
   }
-  mi_max_error_count = mi_option_get(mi_option_max_errors);
-  mi_max_warning_count = mi_option_get(mi_option_max_warnings);
+  else {
+    // except for the options that are read through `_mi_option_get_fast` (which never initializes)
+    for (size_t i = 0; i < sizeof(mi_options_read_fast)/sizeof(mi_options_read_fast[0]); i++) {
+      long l = mi_option_get(mi_options_read_fast[i]); MI_UNUSED(l);
+    }
+  }
   #if MI_GUARDED
   if (mi_option_get(mi_option_guarded_sample_rate) > 0) {
     if (mi_option_is_enabled(mi_option_allow_large_os_pages)) {
@@ -204,13 +240,36 @@ long _mi_option_get_fast(mi_option_t option) {
 }
 
 
+// In fast start mode options are initialized lazily, possibly by multiple threads at the
+// same time. Serialize the initialization with a lock that is re-entrant as initializing
+// an option can read other options (through `_mi_warning_message` for example).
+static _Atomic(mi_threadid_t) mi_option_init_owner;  // = 0
+
+static mi_decl_noinline void mi_option_init_locked(mi_option_desc_t* desc) {
+  const mi_threadid_t tid = _mi_prim_thread_id();
+  const bool nested = (mi_atomic_load_relaxed(&mi_option_init_owner) == tid);
+  if (!nested) {
+    mi_threadid_t expected = 0;
+    while (!mi_atomic_cas_weak_acq_rel(&mi_option_init_owner, &expected, tid)) {
+      expected = 0;
+      mi_atomic_yield();
+    }
+  }
+  if (desc->init == UNINIT) {  // another thread may have initialized it in the meantime
+    mi_option_init(desc);
+  }
+  if (!nested) {
+    mi_atomic_store_release(&mi_option_init_owner, (mi_threadid_t)0);
+  }
+}
+
 mi_decl_nodiscard long mi_option_get(mi_option_t option) {
   mi_assert(option >= 0 && option < _mi_option_last);
   if (option < 0 || option >= _mi_option_last) return 0;
   mi_option_desc_t* desc = &options[option];
   mi_assert(desc->option == option);  // index should match the option
   if mi_unlikely(desc->init == UNINIT) {
-    mi_option_init(desc);
+    mi_option_init_locked(desc);
   }
   return desc->value;
 }
@@ -461,7 +520,8 @@ void _mi_verbose_message(const char* fmt, ...) {
 static void mi_show_error_message(const char* fmt, va_list args) {
   if (!mi_option_is_enabled(mi_option_verbose)) {
     if (!mi_option_is_enabled(mi_option_show_errors)) return;
-    if (mi_max_error_count >= 0 && (long)mi_atomic_increment_acq_rel(&error_count) > mi_max_error_count) return;
+    const long max_errors = mi_option_get(mi_option_max_errors);  // stop outputting errors after this (use < 0 for no limit)
+    if (max_errors >= 0 && (long)mi_atomic_increment_acq_rel(&error_count) > max_errors) return;
   }
   mi_vfprintf_thread(NULL, NULL, "mimalloc: error: ", fmt, args);
 }
@@ -469,7 +529,8 @@ static void mi_show_error_message(const char* fmt, va_list args) {
 void _mi_warning_message(const char* fmt, ...) {
   if (!mi_option_is_enabled(mi_option_verbose)) {
     if (!mi_option_is_enabled(mi_option_show_errors)) return;
-    if (mi_max_warning_count >= 0 && (long)mi_atomic_increment_acq_rel(&warning_count) > mi_max_warning_count) return;
+    const long max_warnings = mi_option_get(mi_option_max_warnings);
+    if (max_warnings >= 0 && (long)mi_atomic_increment_acq_rel(&warning_count) > max_warnings) return;
   }
   va_list args;
   va_start(args,fmt);
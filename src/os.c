@@ -40,32 +40,50 @@ static mi_os_mem_config_t mi_os_mem_config = {
   MI_DEFAULT_VIRTUAL_ADDRESS_BITS,
   true,     // has overcommit?  (if true we use MAP_NORESERVE on mmap systems)
   false,    // can we partially free allocated blocks? (on mmap systems we can free anywhere in a mapped range, but on Windows we must free the entire span)
-  true      // has virtual reserve? (if true we can reserve virtual address space without using commit or physical memory)
+  true,     // has virtual reserve? (if true we can reserve virtual address space without using commit or physical memory)
+  false     // has zero decommit? (if true decommitted memory reads as zero once it is used again)
 };
 
+static mi_decl_cache_align _Atomic(uintptr_t) mi_os_initialized;  // set once `mi_os_mem_config` is initialized
+
+// the OS memory configuration; in fast start mode it is initialized on first use
+static inline const mi_os_mem_config_t* mi_os_config(void) {
+  if mi_unlikely(mi_atomic_load_acquire(&mi_os_initialized) == 0) { _mi_os_init(); }
+  return &mi_os_mem_config;
+}
+
 bool _mi_os_has_overcommit(void) {
-  return mi_os_mem_config.has_overcommit;
+  return mi_os_config()->has_overcommit;
 }
 
 bool _mi_os_has_virtual_reserve(void) {
-  return mi_os_mem_config.has_virtual_reserve;
+  return mi_os_config()->has_virtual_reserve;
 }
 
 
 // OS (small) page size
 size_t _mi_os_page_size(void) {
-  return mi_os_mem_config.page_size;
+  return mi_os_config()->page_size;
 }
 
 // if large OS pages are supported (2 or 4MiB), then return the size, otherwise return the small page size (4KiB)
 size_t _mi_os_large_page_size(void) {
-  return (mi_os_mem_config.large_page_size != 0 ? mi_os_mem_config.large_page_size : _mi_os_page_size());
+  const size_t large_page_size = mi_os_config()->large_page_size;
+  return (large_page_size != 0 ? large_page_size : _mi_os_page_size());
+}
+
+// if transparent huge page aware mode is enabled, return the (2MiB) huge OS page size, otherwise return 0
+size_t _mi_os_thp_size(void) {
+  const size_t large_page_size = mi_os_config()->large_page_size;
+  if (large_page_size == 0 || !mi_option_is_enabled(mi_option_thp_aware)) return 0;
+  return large_page_size;
 }
 
 bool _mi_os_use_large_page(size_t size, size_t alignment) {
   // if we have access, check the size and alignment requirements
-  if (mi_os_mem_config.large_page_size == 0 || !mi_option_is_enabled(mi_option_allow_large_os_pages)) return false;
-  return ((size % mi_os_mem_config.large_page_size) == 0 && (alignment % mi_os_mem_config.large_page_size) == 0);
+  const size_t large_page_size = mi_os_config()->large_page_size;
+  if (large_page_size == 0 || !mi_option_is_enabled(mi_option_allow_large_os_pages)) return false;
+  return ((size % large_page_size) == 0 && (alignment % large_page_size) == 0);
 }
 
 // round to a good OS allocation size (bounded by max 12.5% waste)
@@ -81,7 +99,9 @@ size_t _mi_os_good_alloc_size(size_t size) {
 }
 
 void _mi_os_init(void) {
+  if (mi_atomic_load_acquire(&mi_os_initialized) != 0) return;
   _mi_prim_mem_init(&mi_os_mem_config);
+  mi_atomic_store_release(&mi_os_initialized, (uintptr_t)1);
 }
 
 
@@ -116,7 +136,7 @@ static mi_decl_cache_align _Atomic(uintptr_t)aligned_base;
 void* _mi_os_get_aligned_hint(size_t try_alignment, size_t size)
 {
   if (try_alignment <= 1 || try_alignment > MI_SEGMENT_SIZE) return NULL;
-  if (mi_os_mem_config.virtual_address_bits < 46) return NULL;  // < 64TiB virtual address space
+  if (mi_os_config()->virtual_address_bits < 46) return NULL;  // < 64TiB virtual address space
   size = _mi_align_up(size, MI_SEGMENT_SIZE);
   if (size > 1*MI_GiB) return NULL;  // guarantee the chance of fixed valid address is at most 1/(MI_HINT_AREA / 1<<30) = 1/4096.
   #if (MI_SECURE>0)
@@ -212,6 +232,7 @@ static void* mi_os_prim_alloc_at(void* hint_addr, size_t size, size_t try_alignm
   mi_assert_internal(is_zero != NULL);
   mi_assert_internal(is_large != NULL);
   if (size == 0) return NULL;
+  _mi_os_init();  // the primitives may depend on it (in fast start mode)
   if (!commit) { allow_large = false; }
   if (try_alignment == 0) { try_alignment = 1; } // avoid 0 to ensure there will be no divide by zero when aligning
   *is_zero = false;
@@ -272,7 +293,7 @@ static void* mi_os_prim_alloc_aligned(size_t size, size_t alignment, bool commit
     if (size >= (SIZE_MAX - alignment)) return NULL; // overflow
     const size_t over_size = size + alignment;
 
-    if (!mi_os_mem_config.has_partial_free) {  // win32 virtualAlloc cannot free parts of an allocated block
+    if (!mi_os_config()->has_partial_free) {  // win32 virtualAlloc cannot free parts of an allocated block
       // over-allocate uncommitted (virtual) memory
       p = mi_os_prim_alloc(over_size, 1 /*alignment*/, false /* commit? */, false /* allow_large */, is_large, is_zero);
       if (p == NULL) return NULL;
@@ -350,6 +371,36 @@ void* _mi_os_alloc_aligned(size_t size, size_t alignment, bool commit, bool allo
   return p;
 }
 
+/* -----------------------------------------------------------
+  OS API: remap
+----------------------------------------------------------- */
+
+// Grow committed OS memory at `addr` from `size` to `newsize` bytes without copying (using `mremap` on Linux).
+// The memory may move to a new `alignment` aligned address which is returned (and `memid` is updated).
+// Returns NULL if the memory could not be remapped in which case the original memory is unchanged.
+void* _mi_os_remap(void* addr, size_t size, size_t newsize, size_t alignment, mi_memid_t* memid) {
+  if (addr == NULL || newsize <= size) return NULL;
+  if (memid->memkind != MI_MEM_OS || memid->is_pinned || !memid->initially_committed) return NULL;
+  if (memid->mem.os.base != addr || memid->mem.os.size != 0) return NULL;  // only for memory allocated at an aligned base
+  size    = _mi_os_good_alloc_size(size);
+  newsize = _mi_os_good_alloc_size(newsize);
+  alignment = _mi_align_up(alignment, _mi_os_page_size());
+  if (newsize <= size || ((uintptr_t)addr % alignment) != 0) return NULL;
+  void* p = NULL;
+  int err = _mi_prim_remap(addr, size, newsize, alignment, &p);
+  if (err != 0 || p == NULL) {
+    if (err != ENOTSUP && err != 0) { _mi_verbose_message("unable to remap OS memory (error: %d (0x%x), size: 0x%zx bytes, new size: 0x%zx bytes, address: %p)\n", err, err, size, newsize, addr); }
+    return NULL;
+  }
+  mi_assert_internal(((uintptr_t)p % alignment) == 0);
+  mi_os_stat_counter_increase(mmap_calls, 1);
+  mi_os_stat_increase(reserved, newsize - size);
+  mi_os_stat_increase(committed, newsize - size);
+  memid->mem.os.base = p;
+  memid->initially_zero = false;
+  return p;
+}
+
 /* -----------------------------------------------------------
   OS aligned allocation with an offset. This is used
   for large alignments > MI_BLOCK_ALIGNMENT_MAX. We use a large mimalloc
@@ -495,12 +546,28 @@ bool _mi_os_reset(void* addr, size_t size) {
 }
 
 
+// Populate (prefault) committed memory that is not yet in use so the first access
+// does not page fault. If the OS cannot do this in one call, we touch each OS page.
+void _mi_os_populate(void* addr, size_t size) {
+  size_t csize;
+  uint8_t* const start = (uint8_t*)mi_os_page_align_area_conservative(addr, size, &csize);
+  if (csize == 0) return;
+  if (_mi_prim_populate(start, csize) != 0) {
+    const size_t psize = _mi_os_page_size();
+    for (size_t ofs = 0; ofs < csize; ofs += psize) {
+      volatile uint8_t* const b = start + ofs;
+      *b = *b;   // write the same value to fault the page in writable
+    }
+  }
+}
+
 // either resets or decommits memory, returns true if the memory needs
 // to be recommitted if it is to be re-used later on.
 bool _mi_os_purge_ex(void* p, size_t size, bool allow_reset, size_t stat_size)
 {
   if (mi_option_get(mi_option_purge_delay) < 0) return false;  // is purging allowed?
   mi_os_stat_counter_increase(purge_calls, 1);
+  mi_os_stat_counter_increase(purge_ranges, 1);
   mi_os_stat_increase(purged, size);
 
   if (mi_option_is_enabled(mi_option_purge_decommits) &&   // should decommit?
@@ -524,6 +591,118 @@ bool _mi_os_purge(void* p, size_t size) {
   return _mi_os_purge_ex(p, size, true, size);
 }
 
+// Does a purge (currently) decommit such that anonymous OS memory reads as zero once it is used again?
+bool _mi_os_purge_is_zero(void) {
+  return (mi_os_config()->has_zero_decommit &&
+          mi_option_get(mi_option_purge_delay) >= 0 &&        // is purging allowed?
+          mi_option_is_enabled(mi_option_purge_decommits) &&   // and does it decommit?
+          !_mi_preloading());
+}
+
+// Zero committed anonymous OS memory by decommitting and recommitting the OS pages inside the range instead
+// of writing them (see `mi_option_calloc_decommit_min`); the unaligned ends are cleared as usual.
+// Returns `false` if this is not supported (and the range is not zeroed).
+bool _mi_os_zero_decommit(void* p, size_t size) {
+  if (!mi_os_config()->has_zero_decommit || _mi_preloading()) return false;
+  size_t csize;
+  uint8_t* const start = (uint8_t*)mi_os_page_align_area_conservative(p, size, &csize);
+  if (csize == 0) return false;
+  bool needs_recommit = true;
+  if (!mi_os_decommit_ex(start, csize, &needs_recommit, csize)) return false;
+  if (needs_recommit) {
+    if (!_mi_os_commit(start, csize, NULL)) {
+      _mi_error_message(ENOMEM, "unable to recommit zeroed memory (%zu bytes at %p)\n", csize, start);
+      return false;
+    }
+  }
+  else {
+    mi_os_stat_increase(committed, csize);  // undo the decrease in `mi_os_decommit_ex`
+  }
+  mi_os_stat_counter_increase(zero_decommit, 1);
+  _mi_memzero(p, (size_t)(start - (uint8_t*)p));
+  _mi_memzero(start + csize, (size_t)((uint8_t*)p + size - (start + csize)));
+  return true;
+}
+
+
+/* -----------------------------------------------------------
+  Purge batches: adjacent ranges are coalesced, and on a flush
+  all ranges are decommitted with a single system call if the OS
+  supports it (like `process_madvise` on Linux). The ranges must
+  be fully committed (as for `_mi_os_purge`).
+----------------------------------------------------------- */
+
+void _mi_os_purge_batch_init(mi_os_purge_batch_t* batch) {
+  batch->count = 0;
+  batch->requests = 0;
+}
+
+// Add a range to the batch; returns `false` if the batch is full
+// (and nothing was added) in which case it should be flushed first.
+bool _mi_os_purge_batch_add(mi_os_purge_batch_t* batch, void* p, size_t size) {
+  size_t csize;
+  void* start = mi_os_page_align_area_conservative(p, size, &csize);
+  if (csize == 0) {
+    batch->requests++;
+    return true;
+  }
+  if (batch->count > 0) {
+    mi_os_range_t* const last = &batch->ranges[batch->count - 1];
+    if ((uint8_t*)last->start + last->size == (uint8_t*)start) {
+      last->size += csize;  // coalesce
+      batch->requests++;
+      return true;
+    }
+  }
+  if (batch->count >= MI_OS_PURGE_BATCH_MAX) return false;
+  batch->ranges[batch->count].start = start;
+  batch->ranges[batch->count].size = csize;
+  batch->count++;
+  batch->requests++;
+  return true;
+}
+
+// Purge all ranges in the batch and empty it. Returns `true` if the memory
+// needs to be recommitted if it is to be re-used later on. Sets `is_zero` if the ranges
+// were decommitted such that anonymous OS memory reads as zero again (see `_mi_os_purge_is_zero`).
+bool _mi_os_purge_batch_flush(mi_os_purge_batch_t* batch, bool* is_zero) {
+  const size_t count = batch->count;
+  const size_t requests = batch->requests;
+  _mi_os_purge_batch_init(batch);
+  if (is_zero != NULL) { *is_zero = false; }
+  if (count == 0) return false;
+  if (mi_option_get(mi_option_purge_delay) < 0) return false;  // is purging allowed?
+  mi_os_stat_counter_increase(purge_ranges, requests);
+  size_t total = 0;
+  for (size_t i = 0; i < count; i++) { total += batch->ranges[i].size; }
+  mi_os_stat_increase(purged, total);
+
+  if (mi_option_is_enabled(mi_option_purge_decommits) &&   // should decommit?
+      !_mi_preloading())                                   // don't decommit during preloading (unsafe)
+  {
+    if (is_zero != NULL) { *is_zero = mi_os_config()->has_zero_decommit; }
+    bool needs_recommit = true;
+    if (count > 1 && _mi_prim_purge_vec(batch->ranges, count, true, &needs_recommit) == 0) {
+      mi_os_stat_counter_increase(purge_calls, 1);
+      mi_os_stat_decrease(committed, total);
+      return needs_recommit;
+    }
+    // purge one by one
+    for (size_t i = 0; i < count; i++) {
+      mi_os_stat_counter_increase(purge_calls, 1);
+      mi_os_decommit_ex(batch->ranges[i].start, batch->ranges[i].size, &needs_recommit, batch->ranges[i].size);
+    }
+    return needs_recommit;
+  }
+  else {
+    for (size_t i = 0; i < count; i++) {
+      mi_os_stat_counter_increase(purge_calls, 1);
+      _mi_os_reset(batch->ranges[i].start, batch->ranges[i].size);
+    }
+    return false;  // needs no recommit
+  }
+}
+
 // Protect a region in memory to be not accessible.
 static  bool mi_os_protectx(void* addr, size_t size, bool protect) {
   // page align conservatively within the range
@@ -601,6 +780,7 @@ void* _mi_os_alloc_huge_os_pages(size_t pages, int numa_node, mi_msecs_t max_mse
   *memid = _mi_memid_none();
   if (psize != NULL) *psize = 0;
   if (pages_reserved != NULL) *pages_reserved = 0;
+  _mi_os_init();
   size_t size = 0;
   uint8_t* start = mi_os_claim_huge_pages(pages, &size);
   if (start == NULL) return NULL; // or 32-bit systems
@@ -689,6 +869,7 @@ _Atomic(size_t)  _mi_numa_node_count; // = 0   // cache the node count
 size_t _mi_os_numa_node_count_get(void) {
   size_t count = mi_atomic_load_acquire(&_mi_numa_node_count);
   if (count <= 0) {
+    _mi_os_init();
     long ncount = mi_option_get(mi_option_use_numa_nodes); // given explicitly?
     if (ncount > 0) {
       count = (size_t)ncount;
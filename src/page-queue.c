@@ -53,6 +53,46 @@ static inline bool mi_page_queue_is_special(const mi_page_queue_t* pq) {
   Bins
 ----------------------------------------------------------- */
 
+#if MI_BIN_TABLE
+// Size classes generated from an allocation profile (see `MI_BIN_PROFILE` in `CMakeLists.txt`)
+#include "mimalloc/bin-table.h"
+
+#if (MI_BIN_TABLE_INTPTR_SIZE != MI_INTPTR_SIZE) || (MI_BIN_TABLE_MAX_ALIGN_SIZE != MI_MAX_ALIGN_SIZE) || \
+    (MI_BIN_TABLE_SMALL_WSIZE_MAX != MI_SMALL_WSIZE_MAX) || (MI_BIN_TABLE_WSIZE_MAX != MI_MEDIUM_OBJ_WSIZE_MAX)
+#error "the generated bin table does not match this configuration (regenerate it with mimalloc-gen-bins)"
+#endif
+
+#define MI_BIN_TABLE_WSIZE(sz)  (sz)
+static const uint8_t  mi_bin_table_small[MI_SMALL_WSIZE_MAX+1] = MI_BIN_TABLE_SMALL;
+static const uint32_t mi_bin_table_wsize[MI_BIN_HUGE] = { 0, MI_BIN_TABLE_WSIZES(MI_BIN_TABLE_WSIZE) };
+
+// Return the bin for a given field size using the generated table:
+// a direct lookup for small sizes and a binary search over the classes otherwise.
+static inline uint8_t mi_bin(size_t size) {
+  const size_t wsize = _mi_wsize_from_size(size);
+  uint8_t bin;
+  if (wsize <= MI_SMALL_WSIZE_MAX) {
+    bin = mi_bin_table_small[wsize];
+  }
+  else if (wsize > MI_MEDIUM_OBJ_WSIZE_MAX) {
+    bin = MI_BIN_HUGE;
+  }
+  else {
+    size_t lo = mi_bin_table_small[MI_SMALL_WSIZE_MAX] + 1;  // first class above the small sizes
+    size_t hi = MI_BIN_TABLE_COUNT;                            // the last class is `MI_MEDIUM_OBJ_WSIZE_MAX`
+    while (lo < hi) {
+      const size_t mid = (lo + hi) / 2;
+      if (mi_bin_table_wsize[mid] < wsize) { lo = mid + 1; } else { hi = mid; }
+    }
+    bin = (uint8_t)lo;
+  }
+  mi_assert_internal(bin > 0 && bin <= MI_BIN_HUGE);
+  mi_assert_internal(bin == MI_BIN_HUGE || mi_bin_table_wsize[bin] >= wsize);
+  return bin;
+}
+
+#else
+
 // Return the bin for a given field size.
 // Returns MI_BIN_HUGE if the size is too large.
 // We use `wsize` for the size in "machine word sizes",
@@ -95,6 +135,7 @@ static inline uint8_t mi_bin(size_t size) {
   mi_assert_internal(bin > 0 && bin <= MI_BIN_HUGE);
   return bin;
 }
+#endif
 
 
 
@@ -120,6 +161,14 @@ size_t mi_good_size(size_t size) mi_attr_noexcept {
   }
 }
 
+// Round the (padded) size up to the bin granularity of the heap tag policy (see `heap.c:mi_heap_tag_set_policy`).
+// This is only done in the slow path (`page.c:mi_malloc_generic`) when finding a page; the direct pages are
+// set up such that the fast path allocates from a page for the rounded size as well (see `mi_heap_queue_first_update`).
+static inline size_t mi_heap_size_round(const mi_heap_t* heap, size_t size) {
+  if (size - MI_PADDING_SIZE > MI_MEDIUM_OBJ_SIZE_MAX) return size;  // also if `size` overflowed
+  return ((size - MI_PADDING_SIZE + heap->size_round) & ~heap->size_round) + MI_PADDING_SIZE;
+}
+
 #if (MI_DEBUG>1)
 static bool mi_page_queue_contains(mi_page_queue_t* queue, const mi_page_t* page) {
   mi_assert_internal(page != NULL);
@@ -141,6 +190,11 @@ static bool mi_heap_contains_queue(const mi_heap_t* heap, const mi_page_queue_t*
 }
 #endif
 
+// size of the memory area of a page (as accounted in `heap->pages_size`)
+static inline size_t mi_page_size(const mi_page_t* page) {
+  return ((size_t)page->slice_count * MI_SEGMENT_SLICE_SIZE);
+}
+
 static inline bool mi_page_is_large_or_huge(const mi_page_t* page) {
   return (mi_page_block_size(page) > MI_MEDIUM_OBJ_SIZE_MAX || mi_page_is_huge(page));
 }
@@ -181,10 +235,21 @@ static inline void mi_heap_queue_first_update(mi_heap_t* heap, const mi_page_que
   size_t idx = _mi_wsize_from_size(size);
   mi_page_t** pages_free = heap->pages_free_direct;
 
-  if (pages_free[idx] == page) return;  // already set
-
+  if mi_unlikely(heap->size_round != 0) {
+    // with a bin granularity the sizes that round up into this bin can start in lower bins (and
+    // the largest sizes of this bin may round up into the next one)
+    const uint8_t bin = mi_bin(size);
+    while (idx > 0 && mi_bin(mi_heap_size_round(heap, idx*MI_INTPTR_SIZE)) != bin) { idx--; }
+    if (mi_bin(mi_heap_size_round(heap, idx*MI_INTPTR_SIZE)) != bin) return;  // no size rounds up into this bin
+    if (pages_free[idx] == page) return;  // already set
+    start = idx;
+    while (start > 0 && mi_bin(mi_heap_size_round(heap, (start-1)*MI_INTPTR_SIZE)) == bin) { start--; }
+  }
+  else if (pages_free[idx] == page) {
+    return;  // already set
+  }
   // find start slot
-  if (idx<=1) {
+  else if (idx<=1) {
     start = 0;
   }
   else {
@@ -229,6 +294,7 @@ static void mi_page_queue_remove(mi_page_queue_t* queue, mi_page_t* page) {
     mi_heap_queue_first_update(heap,queue);
   }
   heap->page_count--;
+  heap->pages_size -= mi_page_size(page);
   page->next = NULL;
   page->prev = NULL;
   // mi_atomic_store_ptr_release(mi_atomic_cast(void*, &page->heap), NULL);
@@ -262,6 +328,7 @@ static void mi_page_queue_push(mi_heap_t* heap, mi_page_queue_t* queue, mi_page_
   // update direct
   mi_heap_queue_first_update(heap, queue);
   heap->page_count++;
+  heap->pages_size += mi_page_size(page);
 }
 
 static void mi_page_queue_move_to_front(mi_heap_t* heap, mi_page_queue_t* queue, mi_page_t* page) {
@@ -364,6 +431,7 @@ size_t _mi_page_queue_append(mi_heap_t* heap, mi_page_queue_t* pq, mi_page_queue
     // inline `mi_page_set_heap` to avoid wrong assertion during absorption;
     // in this case it is ok to be delayed freeing since both "to" and "from" heap are still alive.
     mi_atomic_store_release(&page->xheap, (uintptr_t)heap);
+    mi_page_set_has_free_cache(page, heap);
     // set the flag to delayed free (not overriding NEVER_DELAYED_FREE) which has as a
     // side effect that it spins until any DELAYED_FREEING is finished. This ensures
     // that after appending only the new heap will be used for delayed free operations.
@@ -14,6 +14,7 @@ terms of the MIT license. A copy of the license can be found in the file
 #include "mimalloc.h"
 #include "mimalloc/internal.h"
 #include "mimalloc/atomic.h"
+#include "mimalloc/prim.h"   // _mi_prim_clock_nsecs
 
 /* -----------------------------------------------------------
   Definition of page queues for each block size
@@ -180,19 +181,34 @@ bool _mi_page_try_use_delayed_free(mi_page_t* page, mi_delayed_t delay, bool ove
 // ensure that there was no race where the page became unfull just before the move.
 static void _mi_page_thread_free_collect(mi_page_t* page)
 {
-  mi_block_t* head;
   mi_thread_free_t tfreex;
   mi_thread_free_t tfree = mi_atomic_load_relaxed(&page->xthread_free);
   do {
-    head = mi_tf_block(tfree);
-    tfreex = mi_tf_set_block(tfree,NULL);
+    tfreex = mi_tf_clear(tfree);
   } while (!mi_atomic_cas_weak_acq_rel(&page->xthread_free, &tfree, tfreex));
 
   // return if the list is empty
+  mi_block_t* const head = mi_tf_block(page, tfree);
   if (head == NULL) return;
 
+  // the blocks are allocated from soon (and the head was written last by another thread)
+  mi_prefetch(head);
+
+  const size_t max_count = page->capacity; // cannot collect more than capacity
+  #if MI_TF_SPLICE
+  // the list carries its tail and count so we can splice it in constant time
+  size_t count = mi_tf_count(tfree);
+  mi_block_t* const tail = mi_tf_tail(page, tfree);
+  #if (MI_DEBUG>0)
+  // in debug mode we still walk the list to detect a cycle (due to a double multi-threaded free)
+  size_t walked = 1;
+  for (mi_block_t* block = head; block != tail && block != NULL && walked <= max_count; block = mi_block_next(page,block)) {
+    walked++;
+  }
+  if (walked != count) { count = max_count + 1; }
+  #endif
+  #else
   // find the tail -- also to get a proper count (without data races)
-  size_t max_count = page->capacity; // cannot collect more than capacity
   size_t count = 1;
   mi_block_t* tail = head;
   mi_block_t* next;
@@ -200,11 +216,13 @@ static void _mi_page_thread_free_collect(mi_page_t* page)
     count++;
     tail = next;
   }
+  #endif
   // if `count > max_count` there was a memory corruption (possibly infinite list due to double multi-threaded free)
   if (count > max_count) {
     _mi_error_message(EFAULT, "corrupted thread-free list\n");
     return; // the thread-free items cannot be freed
   }
+  mi_assert_internal(mi_block_next(page,tail) == NULL);
 
   // and append the current local free list
   mi_block_set_next(page,tail, page->local_free);
@@ -269,6 +287,17 @@ void _mi_page_reclaim(mi_heap_t* heap, mi_page_t* page) {
   mi_assert_expensive(_mi_page_is_valid(page));
 }
 
+// Would a page of `size` bytes stay within the hard limit of the heap?
+static bool mi_heap_within_limit(const mi_heap_t* heap, size_t size) {
+  return (heap->limit_hard == 0 || heap->pages_size + size <= heap->limit_hard);
+}
+
+// The size of a fresh page for blocks of `block_size` (see `segment.c:_mi_segment_page_alloc`)
+static size_t mi_page_fresh_size(size_t block_size, size_t page_alignment) {
+  if (page_alignment > 0 || block_size > MI_MEDIUM_OBJ_SIZE_MAX) return _mi_align_up(block_size, MI_SEGMENT_SLICE_SIZE);
+  return (block_size <= MI_SMALL_OBJ_SIZE_MAX ? MI_SMALL_PAGE_SIZE : MI_MEDIUM_PAGE_SIZE);
+}
+
 // allocate a fresh page from a segment
 static mi_page_t* mi_page_fresh_alloc(mi_heap_t* heap, mi_page_queue_t* pq, size_t block_size, size_t page_alignment) {
   #if !MI_HUGE_PAGE_ABANDON
@@ -276,6 +305,10 @@ static mi_page_t* mi_page_fresh_alloc(mi_heap_t* heap, mi_page_queue_t* pq, size
   mi_assert_internal(mi_heap_contains_queue(heap, pq));
   mi_assert_internal(page_alignment > 0 || block_size > MI_MEDIUM_OBJ_SIZE_MAX || block_size == pq->block_size);
   #endif
+  if mi_unlikely(!mi_heap_within_limit(heap, mi_page_fresh_size(block_size, page_alignment))) {
+    // over the hard limit of this heap
+    return NULL;
+  }
   mi_page_t* page = _mi_segment_page_alloc(heap, block_size, page_alignment, &heap->tld->segments);
   if (page == NULL) {
     // this may be out-of-memory, or an abandoned page was reclaimed (and in our queue)
@@ -291,6 +324,7 @@ static mi_page_t* mi_page_fresh_alloc(mi_heap_t* heap, mi_page_queue_t* pq, size
   mi_assert_internal(full_block_size >= block_size);
   mi_page_init(heap, page, full_block_size, heap->tld);
   mi_heap_stat_increase(heap, pages, 1);
+  _mi_stat_increase(&_mi_stats_main.tag_pages[heap->tag % MI_TAG_STATS_MAX], 1);
   if (pq != NULL) { mi_page_queue_push(heap, pq, page); }
   mi_assert_expensive(_mi_page_is_valid(page));
   return page;
@@ -311,16 +345,31 @@ static mi_page_t* mi_page_fresh(mi_heap_t* heap, mi_page_queue_t* pq) {
    (put there by other threads if they deallocated in a full page)
 ----------------------------------------------------------- */
 void _mi_heap_delayed_free_all(mi_heap_t* heap) {
-  while (!_mi_heap_delayed_free_partial(heap)) {
+  // (also wait for blocks that are pushed but whose shard is not yet flagged)
+  while (!_mi_heap_delayed_free_partial(heap) || !_mi_heap_delayed_free_is_empty(heap)) {
     mi_atomic_yield();
   }
 }
 
-// returns true if all delayed frees were processed
-bool _mi_heap_delayed_free_partial(mi_heap_t* heap) {
+// Push a block on a shard of the delayed free list of a heap, and flag the shard in the
+// summary mask if it was empty. (called by other threads while `MI_DELAYED_FREEING` keeps the heap valid)
+void _mi_heap_delayed_free_push(mi_heap_t* heap, size_t shard, mi_block_t* block) {
+  _Atomic(mi_block_t*)* const list = &heap->thread_delayed_free[shard].list;
+  mi_block_t* dfree = mi_atomic_load_ptr_relaxed(mi_block_t, list);
+  do {
+    mi_block_set_nextx(heap, block, dfree, heap->keys);
+  } while (!mi_atomic_cas_ptr_weak_release(mi_block_t, list, &dfree, block));
+  if (dfree == NULL) {
+    mi_atomic_or_acq_rel(&heap->thread_delayed_mask, (uintptr_t)1 << shard);
+  }
+}
+
+// returns true if all delayed frees in the shard were processed
+static bool mi_heap_delayed_free_shard(mi_heap_t* heap, size_t shard) {
   // take over the list (note: no atomic exchange since it is often NULL)
-  mi_block_t* block = mi_atomic_load_ptr_relaxed(mi_block_t, &heap->thread_delayed_free);
-  while (block != NULL && !mi_atomic_cas_ptr_weak_acq_rel(mi_block_t, &heap->thread_delayed_free, &block, NULL)) { /* nothing */ };
+  _Atomic(mi_block_t*)* const list = &heap->thread_delayed_free[shard].list;
+  mi_block_t* block = mi_atomic_load_ptr_relaxed(mi_block_t, list);
+  while (block != NULL && !mi_atomic_cas_ptr_weak_acq_rel(mi_block_t, list, &block, NULL)) { /* nothing */ };
   bool all_freed = true;
 
   // and free them all
@@ -332,16 +381,37 @@ bool _mi_heap_delayed_free_partial(mi_heap_t* heap) {
       // reset the delayed_freeing flag; in that case delay it further by reinserting the current block
       // into the delayed free list
       all_freed = false;
-      mi_block_t* dfree = mi_atomic_load_ptr_relaxed(mi_block_t, &heap->thread_delayed_free);
-      do {
-        mi_block_set_nextx(heap, block, dfree, heap->keys);
-      } while (!mi_atomic_cas_ptr_weak_release(mi_block_t,&heap->thread_delayed_free, &dfree, block));
+      _mi_heap_delayed_free_push(heap, shard, block);
     }
     block = next;
   }
   return all_freed;
 }
 
+// returns true if all delayed frees were processed
+bool _mi_heap_delayed_free_partial(mi_heap_t* heap) {
+  bool all_freed = true;
+  // only visit the shards that were flagged (a shard is flagged after its first block is pushed)
+  if (mi_atomic_load_relaxed(&heap->thread_delayed_mask) == 0) return true;
+  uintptr_t mask = mi_atomic_exchange_acq_rel(&heap->thread_delayed_mask, (uintptr_t)0);
+  while (mask != 0) {
+    const size_t shard = mi_ctz(mask);
+    mask &= mask - 1;
+    if (!mi_heap_delayed_free_shard(heap, shard)) {
+      all_freed = false;
+    }
+  }
+  return all_freed;
+}
+
+// returns true if no delayed frees are pending
+bool _mi_heap_delayed_free_is_empty(mi_heap_t* heap) {
+  for (size_t i = 0; i < MI_DELAYED_SHARDS; i++) {
+    if (mi_atomic_load_ptr_acquire(mi_block_t, &heap->thread_delayed_free[i].list) != NULL) return false;
+  }
+  return true;
+}
+
 /* -----------------------------------------------------------
   Unfull, abandon, free and retire
 ----------------------------------------------------------- */
@@ -361,6 +431,14 @@ void _mi_page_unfull(mi_page_t* page) {
   mi_page_queue_enqueue_from_full(pq, pqfull, page);
 }
 
+// Move a page that may still have free blocks to the full list so no blocks are allocated
+// from it anymore; the first local free moves it back (used when relocating blocks, see `heap.c`)
+void _mi_page_exclude(mi_page_t* page) {
+  mi_assert_internal(page != NULL);
+  if (mi_page_is_in_full(page)) return;
+  mi_page_queue_enqueue_from(&mi_page_heap(page)->pages[MI_BIN_FULL], mi_page_queue_of(page), page);
+}
+
 static void mi_page_to_full(mi_page_t* page, mi_page_queue_t* pq) {
   mi_assert_internal(pq == mi_page_queue_of(page));
   mi_assert_internal(!mi_page_immediate_available(page));
@@ -374,7 +452,7 @@ static void mi_page_to_full(mi_page_t* page, mi_page_queue_t* pq) {
 
 // Abandon a page with used blocks at the end of a thread.
 // Note: only call if it is ensured that no references exist from
-// the `page->heap->thread_delayed_free` into this page.
+// the `page->heap->thread_delayed_free` lists into this page.
 // Currently only called through `mi_heap_collect_ex` which ensures this.
 void _mi_page_abandon(mi_page_t* page, mi_page_queue_t* pq) {
   mi_assert_internal(page != NULL);
@@ -394,7 +472,7 @@ void _mi_page_abandon(mi_page_t* page, mi_page_queue_t* pq) {
 
 #if (MI_DEBUG>1) && !MI_TRACK_ENABLED
   // check there are no references left..
-  for (mi_block_t* block = (mi_block_t*)pheap->thread_delayed_free; block != NULL; block = mi_block_nextx(pheap, block, pheap->keys)) {
+  for (mi_block_t* block = (mi_block_t*)pheap->thread_delayed_free[mi_page_delayed_shard(page)].list; block != NULL; block = mi_block_nextx(pheap, block, pheap->keys)) {
     mi_assert_internal(_mi_ptr_page(block) != page);
   }
 #endif
@@ -435,8 +513,9 @@ void _mi_page_free(mi_page_t* page, mi_page_queue_t* pq, bool force) {
   mi_assert_internal(mi_page_all_free(page));
   mi_assert_internal(mi_page_thread_free_flag(page)!=MI_DELAYED_FREEING);
 
-  // no more aligned blocks in here
+  // no more aligned or sampled blocks in here
   mi_page_set_has_aligned(page, false);
+  mi_page_set_has_sampled(page, false);
 
   mi_heap_t* heap = mi_page_heap(page);
 
@@ -465,6 +544,7 @@ void _mi_page_retire(mi_page_t* page) mi_attr_noexcept {
   mi_assert_internal(mi_page_all_free(page));
 
   mi_page_set_has_aligned(page, false);
+  mi_page_set_has_sampled(page, false);
 
   // don't retire too often..
   // (or we end up retiring and re-allocating most of the time)
@@ -590,6 +670,105 @@ static void mi_page_free_list_extend_secure(mi_heap_t* const heap, mi_page_t* co
   page->free = free_start;
 }
 
+// Link `count` consecutive blocks of `bsize` bytes from `block` onwards where each block links to the
+// following one; returns the first block that was not linked (at most `MI_LINKV_LANES-1` blocks are left
+// over). Uses SIMD to link (and encode) two blocks at a time (or four with AVX2), which on 64-bit also writes
+// the links of 8-byte blocks with a single 16-byte (or 32-byte) store.
+// The AVX2 path is only selected at compile time (e.g. with `-march=haswell`) as a runtime dispatch (as for
+// the non-temporal kernels in `libc.c`) would add an indirect call to every extension of a page.
+// (not with memory tracking (valgrind etc.) as that needs to track each block separately)
+#if (MI_INTPTR_SIZE==8) && !MI_TRACK_ENABLED && (defined(__SSE2__) || defined(_M_X64) || defined(__aarch64__) || defined(_M_ARM64))
+#if defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define MI_LINKV_LANES  2
+typedef uint64x2_t mi_linkv_t;
+#define mi_linkv_init(p,b)        vcombine_u64(vcreate_u64((uint64_t)((p) + (b))), vcreate_u64((uint64_t)((p) + 2*(b))))
+#define mi_linkv_add(x,n)         vaddq_u64(x, vdupq_n_u64((uint64_t)(n)))
+#define mi_linkv_store(p,x)       vst1q_u64((uint64_t*)(p), x)
+#define mi_linkv_xor(x,k)         veorq_u64(x, vdupq_n_u64((uint64_t)(k)))
+#define mi_linkv_rotl(x,r)        vorrq_u64(vshlq_u64(x, vdupq_n_s64((int64_t)(r))), vshlq_u64(x, vdupq_n_s64((int64_t)(r) - 64)))
+static inline void mi_linkv_store_lanes(uint8_t* p, size_t bsize, mi_linkv_t x) {
+  vst1q_lane_u64((uint64_t*)p, x, 0);
+  vst1q_lane_u64((uint64_t*)(p + bsize), x, 1);
+}
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define MI_LINKV_LANES  4
+typedef __m256i mi_linkv_t;
+#define mi_linkv_init(p,b)        _mm256_set_epi64x((long long)((p) + 4*(b)), (long long)((p) + 3*(b)), (long long)((p) + 2*(b)), (long long)((p) + (b)))
+#define mi_linkv_add(x,n)         _mm256_add_epi64(x, _mm256_set1_epi64x((long long)(n)))
+#define mi_linkv_store(p,x)       _mm256_storeu_si256((__m256i*)(p), x)
+#define mi_linkv_xor(x,k)         _mm256_xor_si256(x, _mm256_set1_epi64x((long long)(k)))
+#define mi_linkv_rotl(x,r)        _mm256_or_si256(_mm256_sll_epi64(x, _mm_cvtsi32_si128((int)(r))), _mm256_srl_epi64(x, _mm_cvtsi32_si128(64 - (int)(r))))
+static inline void mi_linkv_store_lanes(uint8_t* p, size_t bsize, mi_linkv_t x) {
+  const __m128i lo = _mm256_castsi256_si128(x);
+  const __m128i hi = _mm256_extracti128_si256(x, 1);
+  _mm_storel_epi64((__m128i*)p, lo);
+  _mm_storel_epi64((__m128i*)(p + bsize), _mm_unpackhi_epi64(lo, lo));
+  _mm_storel_epi64((__m128i*)(p + 2*bsize), hi);
+  _mm_storel_epi64((__m128i*)(p + 3*bsize), _mm_unpackhi_epi64(hi, hi));
+}
+#else
+#include <emmintrin.h>
+#define MI_LINKV_LANES  2
+typedef __m128i mi_linkv_t;
+#define mi_linkv_init(p,b)        _mm_set_epi64x((long long)((p) + 2*(b)), (long long)((p) + (b)))
+#define mi_linkv_add(x,n)         _mm_add_epi64(x, _mm_set1_epi64x((long long)(n)))
+#define mi_linkv_store(p,x)       _mm_storeu_si128((__m128i*)(p), x)
+#define mi_linkv_xor(x,k)         _mm_xor_si128(x, _mm_set1_epi64x((long long)(k)))
+#define mi_linkv_rotl(x,r)        _mm_or_si128(_mm_sll_epi64(x, _mm_cvtsi32_si128((int)(r))), _mm_srl_epi64(x, _mm_cvtsi32_si128(64 - (int)(r))))
+static inline void mi_linkv_store_lanes(uint8_t* p, size_t bsize, mi_linkv_t x) {
+  _mm_storel_epi64((__m128i*)p, x);
+  _mm_storel_epi64((__m128i*)(p + bsize), _mm_unpackhi_epi64(x, x));
+}
+#endif
+
+static mi_block_t* mi_page_free_list_link(const mi_page_t* page, mi_block_t* block, size_t bsize, size_t count) {
+  MI_UNUSED(page);
+  uint8_t* p = (uint8_t*)block;
+  const size_t stride = MI_LINKV_LANES*bsize;
+  mi_linkv_t next = mi_linkv_init(p, bsize);  // the links of the current `MI_LINKV_LANES` blocks
+  #ifdef MI_ENCODE_FREELIST
+  // see `internal.h:mi_ptr_encode` (where shift counts of 64 result in 0 for the SIMD shifts)
+  const uintptr_t k0 = page->keys[0];
+  const uintptr_t k1 = page->keys[1];
+  const uintptr_t rot = k0 % MI_INTPTR_BITS;
+  for (size_t n = count/MI_LINKV_LANES; n > 0; n--) {
+    mi_linkv_store_lanes(p, bsize, mi_linkv_add(mi_linkv_rotl(mi_linkv_xor(next, k1), rot), k0));
+    next = mi_linkv_add(next, stride);
+    p += stride;
+  }
+  #else
+  if (bsize == MI_INTPTR_SIZE) {
+    for (size_t n = count/MI_LINKV_LANES; n > 0; n--) {
+      mi_linkv_store(p, next);  // consecutive links in one store
+      next = mi_linkv_add(next, stride);
+      p += stride;
+    }
+  }
+  else {
+    // plain stores are as fast for larger blocks
+    for (size_t n = count/2; n > 0; n--) {
+      ((mi_block_t*)p)->next = (mi_encoded_t)(p + bsize);
+      ((mi_block_t*)(p + bsize))->next = (mi_encoded_t)(p + 2*bsize);
+      p += 2*bsize;
+    }
+    MI_UNUSED(next);
+  }
+  #endif
+  return (mi_block_t*)p;
+}
+#else
+static mi_block_t* mi_page_free_list_link(const mi_page_t* page, mi_block_t* block, size_t bsize, size_t count) {
+  for (size_t n = count; n > 0; n--) {
+    mi_block_t* const next = (mi_block_t*)((uint8_t*)block + bsize);
+    mi_block_set_next(page, block, next);
+    block = next;
+  }
+  return block;
+}
+#endif
+
 static mi_decl_noinline void mi_page_free_list_extend( mi_page_t* const page, const size_t bsize, const size_t extend, mi_stats_t* const stats)
 {
   MI_UNUSED(stats);
@@ -605,8 +784,8 @@ static mi_decl_noinline void mi_page_free_list_extend( mi_page_t* const page, co
 
   // initialize a sequential free list
   mi_block_t* const last = mi_page_block_at(page, page_area, bsize, page->capacity + extend - 1);
-  mi_block_t* block = start;
-  while(block <= last) {
+  mi_block_t* block = mi_page_free_list_link(page, start, bsize, extend - 1);
+  while(block < last) {
     mi_block_t* next = (mi_block_t*)((uint8_t*)block + bsize);
     mi_block_set_next(page,block,next);
     block = next;
@@ -631,7 +810,10 @@ static mi_decl_noinline void mi_page_free_list_extend( mi_page_t* const page, co
 // We do at most `MI_MAX_EXTEND` to avoid touching too much memory
 // Note: we also experimented with "bump" allocation on the first
 // allocations but this did not speed up any benchmark (due to an
-// extra test in malloc? or cache effects?)
+// extra test in malloc? or cache effects?). It is available with
+// `mi_option_page_bump` though as it avoids the warm-up cost of fresh
+// pages, and the dependent `next` load per allocation (in that case
+// we do not extend at all until the bump region is used up).
 static void mi_page_extend_free(mi_heap_t* heap, mi_page_t* page, mi_tld_t* tld) {
   MI_UNUSED(tld);
   mi_assert_expensive(mi_page_is_valid_init(page));
@@ -641,6 +823,9 @@ static void mi_page_extend_free(mi_heap_t* heap, mi_page_t* page, mi_tld_t* tld)
   if (page->free != NULL) return;
   #endif
   if (page->capacity >= page->reserved) return;
+  #if (MI_SECURE==0)
+  if (heap->page_bump) return;  // the fresh capacity is handed out by bumping instead (see `alloc.c:_mi_page_malloc_zero`)
+  #endif
 
   mi_stat_counter_increase(tld->stats.pages_extended, 1);
 
@@ -684,6 +869,7 @@ static void mi_page_init(mi_heap_t* heap, mi_page_t* page, size_t block_size, mi
   // set fields
   mi_page_set_heap(page, heap);
   page->block_size = block_size;
+  mi_page_set_has_free_cache(page, heap);
   size_t page_size;
   page->page_start = _mi_segment_page_start(segment, page, &page_size);
   mi_track_mem_noaccess(page->page_start,page_size);
@@ -726,9 +912,9 @@ static void mi_page_init(mi_heap_t* heap, mi_page_t* page, size_t block_size, mi
   mi_assert_internal(page->block_size_shift == 0 || (block_size == ((size_t)1 << page->block_size_shift)));
   mi_assert_expensive(mi_page_is_valid_init(page));
 
-  // initialize an initial free list
+  // initialize an initial free list (unless the blocks are bump allocated)
   mi_page_extend_free(heap,page,tld);
-  mi_assert(mi_page_immediate_available(page));
+  mi_assert(mi_page_immediate_available(page) || mi_page_bump_available(heap,page));
 }
 
 
@@ -821,6 +1007,7 @@ static mi_page_t* mi_page_queue_find_free_ex(mi_heap_t* heap, mi_page_queue_t* p
     page = page_candidate;
   }
   if (page != NULL && !mi_page_immediate_available(page)) {
+    // extend the free list (or, with bump allocation, leave the rest of the capacity to the bump region)
     mi_assert_internal(mi_page_is_expandable(page));
     mi_page_extend_free(heap, page, heap->tld);
   }
@@ -839,7 +1026,7 @@ static mi_page_t* mi_page_queue_find_free_ex(mi_heap_t* heap, mi_page_queue_t* p
     page->retire_expire = 0;
     // _mi_heap_collect_retired(heap, false); // update retire counts; note: increases rss on MemoryLoad bench so don't do this
   }
-  mi_assert_internal(page == NULL || mi_page_immediate_available(page));
+  mi_assert_internal(page == NULL || mi_page_immediate_available(page) || mi_page_bump_available(heap,page));
 
 
   return page;
@@ -865,7 +1052,7 @@ static inline mi_page_t* mi_find_free_page(mi_heap_t* heap, size_t size) {
       _mi_page_free_collect(page,false);
     }
 
-    if (mi_page_immediate_available(page)) {
+    if (mi_page_immediate_available(page) || mi_page_bump_available(heap,page)) {
       page->retire_expire = 0;
       return page; // fast path
     }
@@ -887,6 +1074,8 @@ static _Atomic(void*) deferred_arg; // = NULL
 
 void _mi_deferred_free(mi_heap_t* heap, bool force) {
   heap->tld->heartbeat++;
+  // check the memory pressure every so often (see `arena.c:_mi_mem_pressure_poll`)
+  if ((heap->tld->heartbeat % 64) == 0 && _mi_mem_pressure_poll()) { force = true; }
   if (deferred_free != NULL && !heap->tld->recurse) {
     heap->tld->recurse = true;
     deferred_free(force, heap->tld->heartbeat, mi_atomic_load_ptr_relaxed(void,&deferred_arg));
@@ -920,7 +1109,7 @@ static mi_page_t* mi_large_huge_page_alloc(mi_heap_t* heap, size_t size, size_t
   #endif
   mi_page_t* page = mi_page_fresh_alloc(heap, pq, block_size, page_alignment);
   if (page != NULL) {
-    mi_assert_internal(mi_page_immediate_available(page));
+    mi_assert_internal(mi_page_immediate_available(page) || mi_page_bump_available(heap,page));
 
     if (is_huge) {
       mi_assert_internal(mi_page_is_huge(page));
@@ -949,6 +1138,52 @@ static mi_page_t* mi_large_huge_page_alloc(mi_heap_t* heap, size_t size, size_t
 }
 
 
+// Try to grow the single block of a large or huge page in place to hold `size` bytes (including padding).
+// Returns the page (which can have moved for huge pages) or NULL on failure. Used by `mi_realloc`.
+mi_page_t* _mi_page_try_grow(mi_page_t* page, size_t size) {
+  mi_assert_internal(mi_page_is_large_or_huge(page) && page->used == 1);
+  mi_heap_t* const heap = mi_page_heap(page);
+  if (heap == NULL || page->reserved != 1 || page->capacity != 1 || size <= mi_page_block_size(page)) return NULL;
+  mi_assert_internal(heap->thread_id == _mi_thread_id());
+  const size_t old_bsize = mi_page_usable_block_size(page);
+  const size_t old_psize = mi_page_size(page);
+  if (!mi_page_is_huge(page)) {
+    const size_t block_size = _mi_os_good_alloc_size(size);
+    if (block_size > MI_LARGE_OBJ_SIZE_MAX) return NULL;  // cannot become a huge page
+    if (!mi_heap_within_limit(heap, _mi_align_up(block_size, MI_SEGMENT_SLICE_SIZE) - old_psize)) return NULL;
+    if (!_mi_segment_large_page_try_extend(page, block_size, &heap->tld->segments)) return NULL;
+    heap->pages_size += mi_page_size(page) - old_psize;  // the page stays in its queue
+  }
+  else {
+    #if MI_HUGE_PAGE_ABANDON
+    return NULL;
+    #else
+    if (!mi_heap_within_limit(heap, _mi_align_up(size, MI_SEGMENT_SLICE_SIZE) - old_psize)) return NULL;
+    // the page can move so unlink it from its queue first
+    mi_page_queue_t* const pq = mi_page_queue_of(page);
+    mi_page_queue_remove(pq, page);
+    mi_page_t* const newpage = _mi_segment_huge_page_try_remap(page, size, &heap->tld->segments);
+    if (newpage != NULL) { page = newpage; }
+    mi_page_queue_push(heap, pq, page);
+    if (newpage == NULL) return NULL;
+    #endif
+  }
+  const size_t block_size = mi_page_block_size(page);
+  page->block_size_shift = (_mi_is_power_of_two(block_size) ? (uint8_t)mi_ctz((uintptr_t)block_size) : 0);
+  #if (MI_STAT>0)
+  const size_t bsize = mi_page_usable_block_size(page);
+  if (bsize <= MI_LARGE_OBJ_SIZE_MAX) {
+    mi_heap_stat_increase(heap, large, bsize - old_bsize);
+  }
+  else {
+    mi_heap_stat_increase(heap, huge, bsize - old_bsize);
+  }
+  #else
+  MI_UNUSED(old_bsize);
+  #endif
+  return page;
+}
+
 // Allocate a page
 // Note: in debug mode the size includes MI_PADDING_SIZE and might have overflowed.
 static mi_page_t* mi_find_page(mi_heap_t* heap, size_t size, size_t huge_alignment) mi_attr_noexcept {
@@ -972,32 +1207,73 @@ static mi_page_t* mi_find_page(mi_heap_t* heap, size_t size, size_t huge_alignme
   }
 }
 
-// Generic allocation routine if the fast path (`alloc.c:mi_page_malloc`) does not succeed.
-// Note: in debug mode the size includes MI_PADDING_SIZE and might have overflowed.
-// The `huge_alignment` is normally 0 but is set to a multiple of MI_SEGMENT_SIZE for
-// very large requested alignments in which case we use a huge segment.
-void* _mi_malloc_generic(mi_heap_t* heap, size_t size, bool zero, size_t huge_alignment) mi_attr_noexcept
-{
-  mi_assert_internal(heap != NULL);
+// Collect the heap once it reaches its soft limit and call the registered pressure
+// callback (at most once until the heap is below the soft limit again).
+static mi_decl_noinline void mi_heap_check_pressure(mi_heap_t* heap) {
+  if (heap->pages_size < heap->limit_soft) {
+    heap->limit_pressure = false;
+  }
+  else if (!heap->limit_pressure) {
+    heap->limit_pressure = true;  // set first as the callback may allocate
+    mi_heap_collect(heap, true /* force */);
+    if (heap->pressure_fun != NULL) {
+      (*heap->pressure_fun)(heap, heap->pages_size, heap->limit_soft, heap->pressure_arg);
+    }
+  }
+}
 
-  // initialize if necessary
-  if mi_unlikely(!mi_heap_is_initialized(heap)) {
-    heap = mi_heap_get_default(); // calls mi_thread_init
-    if mi_unlikely(!mi_heap_is_initialized(heap)) { return NULL; }
+// Keep the count down to the next allocation recorded for heap profiling within range of the sample rate.
+// (The count is randomized up to `2*rate - 1` in `heap.c:_mi_heap_sample_alloc`)
+static inline void mi_heap_sample_count_check(mi_heap_t* heap) {
+  const long rate = _mi_option_get_fast(mi_option_heap_sample_rate);
+  if mi_unlikely(rate > 0 && (heap->sample_count == 0 || heap->sample_count >= 2*(size_t)rate)) {
+    heap->sample_count = (size_t)rate;
   }
+}
+
+// Zero the blocks of a page by decommitting them? (see `mi_option_calloc_decommit_min`)
+static bool mi_page_zero_decommit(const mi_page_t* page) {
+  const size_t decommit_min = mi_option_get_size(mi_option_calloc_decommit_min);
+  return (decommit_min > 0 && mi_page_usable_block_size(page) >= decommit_min);
+}
+
+// The generic allocation routine on an initialized heap (see `_mi_malloc_generic`)
+static void* mi_malloc_generic(mi_heap_t* heap, size_t size, bool zero, size_t huge_alignment) mi_attr_noexcept
+{
   mi_assert_internal(mi_heap_is_initialized(heap));
 
   // call potential deferred free routines
   _mi_deferred_free(heap, false);
 
+  // purge our segments if this was requested by `mi_collect_target`
+  _mi_segments_purge_requested(heap);
+
   // free delayed frees from other threads (but skip contended ones)
   _mi_heap_delayed_free_partial(heap);
 
-  // find (or allocate) a page of the right size
-  mi_page_t* page = mi_find_page(heap, size, huge_alignment);
+  // collect and notify when the heap reaches its soft limit
+  if mi_unlikely(heap->limit_soft > 0) {
+    mi_heap_check_pressure(heap);
+  }
+
+  // start counting down to the next sampled allocation if the heap sample rate was enabled (or lowered)
+  mi_heap_sample_count_check(heap);
+
+  // bump allocate fresh page capacity?
+  heap->page_bump = (_mi_option_get_fast(mi_option_page_bump) != 0);
+
+  // keep recently freed small blocks in a cache? (see `free.c:mi_heap_tcache_push`)
+  #if (MI_SECURE==0)
+  const long tcache_max = _mi_option_get_fast(mi_option_free_cache);
+  heap->tcache_max = (uint8_t)(tcache_max <= 0 ? 0 : (tcache_max > 255 ? 255 : tcache_max));
+  #endif
+
+  // find (or allocate) a page of the right size (rounded up to the bin granularity of the heap tag policy)
+  const size_t page_size = (heap->size_round == 0 ? size : mi_heap_size_round(heap, size));
+  mi_page_t* page = mi_find_page(heap, page_size, huge_alignment);
   if mi_unlikely(page == NULL) { // first time out of memory, try to collect and retry the allocation once more
     mi_heap_collect(heap, true /* force */);
-    page = mi_find_page(heap, size, huge_alignment);
+    page = mi_find_page(heap, page_size, huge_alignment);
   }
 
   if mi_unlikely(page == NULL) { // out of memory
@@ -1006,18 +1282,77 @@ void* _mi_malloc_generic(mi_heap_t* heap, size_t size, bool zero, size_t huge_al
     return NULL;
   }
 
-  mi_assert_internal(mi_page_immediate_available(page));
+  mi_assert_internal(mi_page_immediate_available(page) || mi_page_bump_available(heap,page));
   mi_assert_internal(mi_page_block_size(page) >= size);
 
   // and try again, this time succeeding! (i.e. this should never recurse through _mi_page_malloc)
-  if mi_unlikely(zero && mi_page_is_huge(page)) {
+  if mi_unlikely(zero && (mi_page_is_huge(page) || (!page->free_is_zero && mi_page_zero_decommit(page)))) {
     // note: we cannot call _mi_page_malloc with zeroing for huge blocks; we zero it afterwards in that case.
+    // Large blocks may also be zeroed by decommitting and recommitting their memory (see `mi_option_calloc_decommit_min`).
+    const bool is_zero = page->free_is_zero;  // only for huge pages
     void* p = _mi_page_malloc(heap, page, size);
     mi_assert_internal(p != NULL);
-    _mi_memzero_aligned(p, mi_page_usable_block_size(page));
+    size_t usize = mi_page_usable_block_size(page);
+    #if MI_PADDING_CHECK
+    if (!mi_page_is_huge(page)) { usize = size - MI_PADDING_SIZE; }  // keep the padding fill after the block intact
+    #endif
+    if (is_zero) {
+      ((mi_block_t*)p)->next = 0;
+      mi_track_mem_defined(p, usize);
+      mi_assert_expensive(mi_mem_is_zero(p, usize));
+    }
+    else if (!mi_page_zero_decommit(page) || !_mi_segment_page_zero_decommit(page, p, usize)) {
+      _mi_memzero_large(p, usize, mi_page_block_size(page));
+    }
     return p;
   }
   else {
     return _mi_page_malloc_zero(heap, page, size, zero);
   }
 }
+
+// Should this slow path allocation be sampled? (1 out of `mi_option_alloc_sample_rate`)
+static bool mi_malloc_sample_next(mi_tld_t* tld) {
+  if mi_likely(tld->alloc_sample_count > 1) {
+    tld->alloc_sample_count--;
+    return false;
+  }
+  const long rate = _mi_option_get_fast(mi_option_alloc_sample_rate);
+  const bool sample = (rate > 0 && tld->alloc_sample_count == 1);
+  tld->alloc_sample_count = (rate > 0 ? (size_t)rate : 1024);  // if disabled, check the option again after a while
+  return sample;
+}
+
+// Generic allocation routine if the fast path (`alloc.c:mi_page_malloc`) does not succeed.
+// Note: in debug mode the size includes MI_PADDING_SIZE and might have overflowed.
+// The `huge_alignment` is normally 0 but is set to a multiple of MI_SEGMENT_SIZE for
+// very large requested alignments in which case we use a huge segment.
+void* _mi_malloc_generic(mi_heap_t* heap, size_t size, bool zero, size_t huge_alignment) mi_attr_noexcept
+{
+  mi_assert_internal(heap != NULL);
+
+  // initialize if necessary
+  if mi_unlikely(!mi_heap_is_initialized(heap)) {
+    heap = mi_heap_get_default(); // calls mi_thread_init
+    if mi_unlikely(!mi_heap_is_initialized(heap)) { return NULL; }
+  }
+  mi_assert_internal(mi_heap_is_initialized(heap));
+
+  // allocate small objects of the default heap from the per-CPU heap leased by the thread (see `init.c`)
+  heap = _mi_heap_cpu_enter(heap, size, huge_alignment);
+
+  // sample the size class and latency of 1 out of N slow path allocations (also in release builds)
+  void* p;
+  if mi_unlikely(mi_malloc_sample_next(heap->tld)) {
+    const int64_t start = _mi_prim_clock_nsecs();
+    p = mi_malloc_generic(heap, size, zero, huge_alignment);
+    if (p != NULL) {
+      _mi_stat_sample_alloc(&heap->tld->stats, _mi_bin(size), size - MI_PADDING_SIZE, _mi_prim_clock_nsecs() - start);
+    }
+  }
+  else {
+    p = mi_malloc_generic(heap, size, zero, huge_alignment);
+  }
+  _mi_heap_cpu_leave(heap);
+  return p;
+}
@@ -53,6 +53,7 @@ void _mi_prim_mem_init( mi_os_mem_config_t* config) {
   config->has_overcommit = false;
   config->has_partial_free = false;
   config->has_virtual_reserve = false;
+  config->has_zero_decommit = false;
 }
 
 extern void emmalloc_free(void*);
@@ -119,6 +120,53 @@ int _mi_prim_protect(void* addr, size_t size, bool protect) {
   return 0;
 }
 
+int _mi_prim_purge_vec(const mi_os_range_t* ranges, size_t count, bool decommit, bool* needs_recommit) {
+  MI_UNUSED(ranges); MI_UNUSED(count); MI_UNUSED(decommit); MI_UNUSED(needs_recommit);
+  return ENOTSUP;
+}
+
+int _mi_prim_populate(void* addr, size_t size) {
+  MI_UNUSED(addr); MI_UNUSED(size);
+  return 0;  // linear memory is always backed
+}
+
+int _mi_prim_remap(void* addr, size_t size, size_t newsize, size_t alignment, void** newaddr) {
+  MI_UNUSED(addr); MI_UNUSED(size); MI_UNUSED(newsize); MI_UNUSED(alignment);
+  *newaddr = NULL;
+  return ENOTSUP;
+}
+
+//---------------------------------------------
+// File mapping
+//---------------------------------------------
+
+int _mi_prim_file_open(const char* path, int* fd) {
+  MI_UNUSED(path);
+  *fd = -1;
+  return ENOTSUP;
+}
+
+void _mi_prim_file_close(int fd) {
+  MI_UNUSED(fd);
+}
+
+int _mi_prim_file_size(int fd, size_t* size) {
+  MI_UNUSED(fd);
+  *size = 0;
+  return ENOTSUP;
+}
+
+int _mi_prim_file_read(int fd, size_t offset, void* buf, size_t size) {
+  MI_UNUSED(fd); MI_UNUSED(offset); MI_UNUSED(buf); MI_UNUSED(size);
+  return ENOTSUP;
+}
+
+int _mi_prim_file_map(int fd, size_t size, void* addr, size_t alignment, void** mapped) {
+  MI_UNUSED(fd); MI_UNUSED(size); MI_UNUSED(addr); MI_UNUSED(alignment);
+  *mapped = NULL;
+  return ENOTSUP;
+}
+
 
 //---------------------------------------------
 // Huge pages and NUMA nodes
@@ -145,11 +193,16 @@ size_t _mi_prim_numa_node_count(void) {
 //----------------------------------------------------------------
 
 #include <emscripten/html5.h>
+#include <emscripten/emscripten.h>  // emscripten_get_now
 
 mi_msecs_t _mi_prim_clock_now(void) {
   return emscripten_date_now();
 }
 
+int64_t _mi_prim_clock_nsecs(void) {
+  return (int64_t)(emscripten_get_now() * 1000000.0);  // high resolution milli-seconds
+}
+
 
 //----------------------------------------------------------------
 // Process info
@@ -242,3 +295,34 @@ void _mi_prim_thread_associate_default_heap(mi_heap_t* heap) {
 
 }
 #endif
+
+
+//----------------------------------------------------------------
+// Background threads
+//----------------------------------------------------------------
+
+bool _mi_prim_thread_start(void (*fun)(void* arg), void* arg) {
+  // not supported (as the main thread may not block)
+  MI_UNUSED(fun); MI_UNUSED(arg);
+  return false;
+}
+
+void _mi_prim_thread_sleep(mi_msecs_t msecs) {
+  MI_UNUSED(msecs);
+}
+
+void _mi_prim_thread_atfork_child(void (*fun)(void)) {
+  MI_UNUSED(fun);  // no fork
+}
+
+bool _mi_prim_mem_pressure_init(void) {
+  return false;
+}
+
+bool _mi_prim_mem_pressure_poll(void) {
+  return false;
+}
+
+size_t _mi_prim_cpu_id(void) {
+  return SIZE_MAX;
+}
@@ -27,6 +27,7 @@ terms of the MIT license. A copy of the license can be found in the file
 #include <sys/mman.h>  // mmap
 #include <unistd.h>    // sysconf
 #include <fcntl.h>     // open, close, read, access
+#include <sys/stat.h>  // stat, fstat
 #include <stdlib.h>    // getenv, arc4random_buf
 
 #if defined(__linux__)
@@ -151,13 +152,16 @@ void _mi_prim_mem_init( mi_os_mem_config_t* config )
   config->has_overcommit = unix_detect_overcommit();
   config->has_partial_free = true;    // mmap can free in parts
   config->has_virtual_reserve = true; // todo: check if this true for NetBSD?  (for anonymous mmap with PROT_NONE)
+  #if defined(__linux__)
+  config->has_zero_decommit = true;   // `MADV_DONTNEED` on private anonymous memory zero-fills on the next access
+  #endif
 
   // disable transparent huge pages for this process?
   #if (defined(__linux__) || defined(__ANDROID__)) && defined(PR_GET_THP_DISABLE)
   #if defined(MI_NO_THP)
   if (true)
   #else
-  if (!mi_option_is_enabled(mi_option_allow_large_os_pages)) // disable THP also if large OS pages are not allowed in the options
+  if (!mi_option_is_enabled(mi_option_allow_large_os_pages) && !mi_option_is_enabled(mi_option_thp_aware)) // disable THP also if large OS pages are not allowed in the options (unless in THP aware mode)
   #endif
   {
     int val = 0;
@@ -338,8 +342,10 @@ static void* unix_mmap(void* addr, size_t size, size_t try_alignment, int protec
       // though since properly aligned allocations will already use large pages if available
       // in that case -- in particular for our large regions (in `memory.c`).
       // However, some systems only allow THP if called with explicit `madvise`, so
-      // when large OS pages are enabled for mimalloc, we call `madvise` anyways.
-      if (allow_large && _mi_os_use_large_page(size, try_alignment)) {
+      // when large OS pages are enabled for mimalloc (or in THP aware mode), we call `madvise` anyways.
+      const size_t thp_size = _mi_os_thp_size();
+      if ((allow_large && _mi_os_use_large_page(size, try_alignment)) ||
+          (thp_size > 0 && (size % thp_size) == 0 && (try_alignment % thp_size) == 0)) {
         if (unix_madvise(p, size, MADV_HUGEPAGE) == 0) {
           // *is_large = true; // possibly
         };
@@ -451,6 +457,203 @@ int _mi_prim_protect(void* start, size_t size, bool protect) {
   return err;
 }
 
+#if defined(__linux__) && defined(MI_HAS_SYSCALL_H) && defined(SYS_process_madvise) && defined(SYS_pidfd_open) && !MI_DEBUG && !MI_SECURE
+#include <sys/uio.h>   // struct iovec
+
+// A pid file descriptor for our own process (used by `process_madvise`)
+static int unix_pidfd_self(void) {
+  static _Atomic(size_t) pidfd_plus1;  // = 0 (not yet opened)
+  static _Atomic(size_t) pidfd_pid;    // process of the descriptor (as it is inherited by a `fork`)
+  const size_t pid = (size_t)getpid();
+  const size_t fd1 = mi_atomic_load_acquire(&pidfd_plus1);
+  if mi_likely(fd1 != 0 && mi_atomic_load_acquire(&pidfd_pid) == pid) return (int)fd1 - 1;
+  const int fd = (int)syscall(SYS_pidfd_open, (pid_t)pid, 0);
+  if (fd < 0) return -1;
+  size_t expected = fd1;
+  if (!mi_atomic_cas_strong_acq_rel(&pidfd_plus1, &expected, (size_t)fd + 1)) {
+    close(fd);  // another thread was first
+    return (int)expected - 1;
+  }
+  mi_atomic_store_release(&pidfd_pid, pid);
+  if (fd1 != 0) { close((int)fd1 - 1); }  // inherited from the parent process
+  return fd;
+}
+
+int _mi_prim_purge_vec(const mi_os_range_t* ranges, size_t count, bool decommit, bool* needs_recommit) {
+  // only decommit (`MADV_DONTNEED`) is done in one call; `process_madvise` on our own process
+  // supports this since Linux 6.13, and older kernels return `EINVAL`.
+  static _Atomic(size_t) purge_vec_unsupported; // = 0
+  if (!decommit || count > MI_OS_PURGE_BATCH_MAX || mi_atomic_load_relaxed(&purge_vec_unsupported) != 0) return ENOTSUP;
+  const int pidfd = unix_pidfd_self();
+  if (pidfd < 0) {
+    mi_atomic_store_release(&purge_vec_unsupported, (size_t)1);
+    return ENOTSUP;
+  }
+  struct iovec iov[MI_OS_PURGE_BATCH_MAX];
+  size_t total = 0;
+  for (size_t i = 0; i < count; i++) {
+    iov[i].iov_base = ranges[i].start;
+    iov[i].iov_len  = ranges[i].size;
+    total += ranges[i].size;
+  }
+  long res;
+  while ((res = syscall(SYS_process_madvise, pidfd, iov, count, MADV_DONTNEED, 0)) < 0 && errno == EINTR) { errno = 0; }
+  if (res < 0) {
+    const int err = errno;
+    if (err == EINVAL || err == ENOSYS || err == EPERM) {  // older kernel (or not allowed)
+      mi_atomic_store_release(&purge_vec_unsupported, (size_t)1);
+    }
+    return err;
+  }
+  if ((size_t)res != total) return EAGAIN;  // partially advised; the caller purges each range again
+  *needs_recommit = false;  // as in `_mi_prim_decommit`
+  return 0;
+}
+#else
+int _mi_prim_purge_vec(const mi_os_range_t* ranges, size_t count, bool decommit, bool* needs_recommit) {
+  MI_UNUSED(ranges); MI_UNUSED(count); MI_UNUSED(decommit); MI_UNUSED(needs_recommit);
+  return ENOTSUP;
+}
+#endif
+
+#if defined(__linux__) && !defined(MADV_POPULATE_WRITE)
+#define MADV_POPULATE_WRITE  23   // since Linux 5.14
+#endif
+
+int _mi_prim_populate(void* start, size_t size) {
+  #if defined(MADV_POPULATE_WRITE)
+  // fault in all pages writable in one call (instead of a page fault on each first touch)
+  static _Atomic(size_t) populate_unsupported; // = 0
+  if (mi_atomic_load_relaxed(&populate_unsupported) != 0) return ENOTSUP;
+  int err;
+  while ((err = unix_madvise(start, size, MADV_POPULATE_WRITE)) != 0 && errno == EINTR) { errno = 0; }
+  if (err != 0) {
+    err = errno;
+    if (err == EINVAL) {  // older kernel
+      mi_atomic_store_release(&populate_unsupported, (size_t)1);
+      err = ENOTSUP;
+    }
+  }
+  return err;
+  #else
+  MI_UNUSED(start); MI_UNUSED(size);
+  return ENOTSUP;
+  #endif
+}
+
+#if defined(__linux__) && defined(MI_HAS_SYSCALL_H) && defined(SYS_mremap)
+#ifndef MREMAP_MAYMOVE
+#define MREMAP_MAYMOVE  1
+#endif
+#ifndef MREMAP_FIXED
+#define MREMAP_FIXED    2
+#endif
+
+// use the system call directly as `mremap` is only declared with `_GNU_SOURCE`
+static void* unix_mremap(void* addr, size_t size, size_t newsize, int flags, void* newaddr) {
+  return (void*)syscall(SYS_mremap, addr, size, newsize, flags, newaddr);
+}
+
+int _mi_prim_remap(void* addr, size_t size, size_t newsize, size_t alignment, void** newaddr) {
+  // first try to grow in place
+  void* p = unix_mremap(addr, size, newsize, 0, NULL);
+  if (p != MAP_FAILED) { *newaddr = p; return 0; }
+
+  // otherwise reserve an aligned range and move the mapping there (which only moves the page table entries)
+  const size_t over_size = newsize + alignment;
+  uint8_t* base = (uint8_t*)mmap(NULL, over_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (base == MAP_FAILED) return errno;
+  uint8_t* aligned = (uint8_t*)_mi_align_up((uintptr_t)base, alignment);
+  const size_t pre_size  = (size_t)(aligned - base);
+  const size_t post_size = over_size - pre_size - newsize;
+  if (pre_size > 0)  { munmap(base, pre_size); }
+  if (post_size > 0) { munmap(aligned + newsize, post_size); }
+  p = unix_mremap(addr, size, newsize, MREMAP_MAYMOVE | MREMAP_FIXED, aligned);
+  if (p == MAP_FAILED) {
+    const int err = errno;
+    munmap(aligned, newsize);
+    return err;
+  }
+  mi_assert_internal(p == aligned);
+  *newaddr = p;
+  return 0;
+}
+#else
+int _mi_prim_remap(void* addr, size_t size, size_t newsize, size_t alignment, void** newaddr) {
+  MI_UNUSED(addr); MI_UNUSED(size); MI_UNUSED(newsize); MI_UNUSED(alignment);
+  *newaddr = NULL;
+  return ENOTSUP;
+}
+#endif
+
+
+//---------------------------------------------
+// File mapping
+//---------------------------------------------
+
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
+int _mi_prim_file_open(const char* path, int* fd) {
+  *fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  return (*fd < 0 ? errno : 0);
+}
+
+void _mi_prim_file_close(int fd) {
+  close(fd);
+}
+
+int _mi_prim_file_size(int fd, size_t* size) {
+  *size = 0;
+  struct stat st;
+  if (fstat(fd, &st) != 0) return errno;
+  *size = (size_t)st.st_size;
+  return 0;
+}
+
+int _mi_prim_file_read(int fd, size_t offset, void* buf, size_t size) {
+  const ssize_t n = pread(fd, buf, size, (off_t)offset);
+  if (n < 0) return errno;
+  return ((size_t)n == size ? 0 : EIO);
+}
+
+int _mi_prim_file_map(int fd, size_t size, void* addr, size_t alignment, void** mapped) {
+  *mapped = NULL;
+  struct stat st;
+  if (fstat(fd, &st) != 0) return errno;
+  if ((size_t)st.st_size < size && ftruncate(fd, (off_t)size) != 0) return errno;
+  if (addr != NULL) {
+    // map at exactly the given address without replacing an existing mapping
+    int flags = MAP_SHARED;
+    #if defined(MAP_FIXED_NOREPLACE)
+    flags |= MAP_FIXED_NOREPLACE;
+    #endif
+    void* p = mmap(addr, size, PROT_READ | PROT_WRITE, flags, fd, 0);
+    if (p == MAP_FAILED) return errno;
+    if (p != addr) { munmap(p, size); return EEXIST; }  // the address was treated as a hint only
+    *mapped = p;
+    return 0;
+  }
+  // otherwise reserve an aligned range first and map the file over it
+  const size_t over_size = size + alignment;
+  uint8_t* base = (uint8_t*)mmap(NULL, over_size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (base == MAP_FAILED) return errno;
+  uint8_t* aligned = (uint8_t*)_mi_align_up((uintptr_t)base, alignment);
+  const size_t pre_size  = (size_t)(aligned - base);
+  const size_t post_size = over_size - pre_size - size;
+  if (pre_size > 0)  { munmap(base, pre_size); }
+  if (post_size > 0) { munmap(aligned + size, post_size); }
+  void* p = mmap(aligned, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+  if (p == MAP_FAILED) {
+    const int err = errno;
+    munmap(aligned, size);
+    return err;
+  }
+  *mapped = p;
+  return 0;
+}
+
 
 
 //---------------------------------------------
@@ -597,6 +800,16 @@ mi_msecs_t _mi_prim_clock_now(void) {
   return ((mi_msecs_t)t.tv_sec * 1000) + ((mi_msecs_t)t.tv_nsec / 1000000);
 }
 
+int64_t _mi_prim_clock_nsecs(void) {
+  struct timespec t;
+  #ifdef CLOCK_MONOTONIC
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  #else
+  clock_gettime(CLOCK_REALTIME, &t);
+  #endif
+  return ((int64_t)t.tv_sec * 1000000000) + (int64_t)t.tv_nsec;
+}
+
 #else
 
 // low resolution timer
@@ -610,6 +823,10 @@ mi_msecs_t _mi_prim_clock_now(void) {
   #endif
 }
 
+int64_t _mi_prim_clock_nsecs(void) {
+  return (int64_t)_mi_prim_clock_now() * 1000000;
+}
+
 #endif
 
 
@@ -884,3 +1101,225 @@ void _mi_prim_thread_associate_default_heap(mi_heap_t* heap) {
 }
 
 #endif
+
+
+//----------------------------------------------------------------
+// Background threads
+//----------------------------------------------------------------
+
+#if defined(MI_USE_PTHREADS)
+
+typedef struct mi_thread_start_s {
+  void (*fun)(void*);
+  void* arg;
+} mi_thread_start_t;
+
+static void* mi_pthread_start(void* p) {
+  const mi_thread_start_t start = *(mi_thread_start_t*)p;
+  _mi_prim_free(p, _mi_os_page_size());
+  start.fun(start.arg);
+  return NULL;
+}
+
+bool _mi_prim_thread_start(void (*fun)(void* arg), void* arg) {
+  // allocate the start info from the OS to avoid recursion into malloc
+  bool is_large = false;
+  bool is_zero = false;
+  void* p = NULL;
+  if (_mi_prim_alloc(NULL, _mi_os_page_size(), 1, true, false, &is_large, &is_zero, &p) != 0 || p == NULL) return false;
+  mi_thread_start_t* const start = (mi_thread_start_t*)p;
+  start->fun = fun;
+  start->arg = arg;
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, &mi_pthread_start, start) != 0) {
+    _mi_prim_free(p, _mi_os_page_size());
+    return false;
+  }
+  pthread_detach(thread);
+  return true;
+}
+
+void _mi_prim_thread_atfork_child(void (*fun)(void)) {
+  pthread_atfork(NULL, NULL, fun);
+}
+
+#else
+
+bool _mi_prim_thread_start(void (*fun)(void* arg), void* arg) {
+  MI_UNUSED(fun); MI_UNUSED(arg);
+  return false;
+}
+
+void _mi_prim_thread_atfork_child(void (*fun)(void)) {
+  MI_UNUSED(fun);
+}
+
+#endif
+
+void _mi_prim_thread_sleep(mi_msecs_t msecs) {
+  if (msecs <= 0) return;
+  struct timespec t;
+  t.tv_sec  = (time_t)(msecs / 1000);
+  t.tv_nsec = (long)((msecs % 1000) * 1000000L);
+  while (nanosleep(&t, &t) != 0 && errno == EINTR) { /* continue sleeping */ }
+}
+
+
+//----------------------------------------------------------------
+// Memory pressure
+//----------------------------------------------------------------
+
+#if defined(__linux__)
+
+#include <poll.h>
+
+// A PSI trigger fires when tasks in the cgroup stalled on memory for at least 100ms in
+// a 2s window (unprivileged processes can only use windows that are a multiple of 2s).
+#define MI_PSI_TRIGGER  "some 100000 2000000"
+
+static int      mi_pressure_fd = -1;   // `memory.pressure` with a trigger, or `memory.events`
+static bool     mi_pressure_psi;       // using a PSI trigger?
+static uint64_t mi_pressure_events;    // sum of the `high`, `max`, and `oom` events at the previous poll
+
+// Find the cgroup (v2) directory of the process (without allocating)
+static bool mi_cgroup_dir(char* dir, size_t dir_size) {
+  char buf[1024];
+  const int fd = mi_prim_open("/proc/self/cgroup", O_RDONLY);
+  if (fd < 0) return false;
+  const ssize_t n = mi_prim_read(fd, buf, sizeof(buf) - 1);
+  mi_prim_close(fd);
+  if (n <= 0) return false;
+  buf[n] = 0;
+  // the unified hierarchy is the line `0::<path>`
+  for (char* line = buf; *line != 0; ) {
+    char* end = line;
+    while (*end != 0 && *end != '\n') { end++; }
+    const bool more = (*end != 0);
+    *end = 0;
+    if (line[0] == '0' && line[1] == ':' && line[2] == ':') {
+      const char* path = line + 3;
+      _mi_snprintf(dir, dir_size, "/sys/fs/cgroup%s", (path[0] == '/' && path[1] == 0 ? "" : path));
+      return true;
+    }
+    line = (more ? end + 1 : end);
+  }
+  return false;
+}
+
+// Read the sum of the `high`, `max`, and `oom` counts of `memory.events`
+static bool mi_pressure_read_events(uint64_t* events) {
+  char buf[256];
+  const ssize_t n = pread(mi_pressure_fd, buf, sizeof(buf) - 1, 0);
+  if (n <= 0) return false;
+  buf[n] = 0;
+  uint64_t total = 0;
+  for (const char* s = buf; *s != 0; ) {
+    // each line is `<name> <count>`
+    const bool is_pressure = (_mi_strnicmp(s, "high ", 5) == 0 || _mi_strnicmp(s, "max ", 4) == 0 || _mi_strnicmp(s, "oom ", 4) == 0);
+    while (*s != 0 && *s != ' ' && *s != '\n') { s++; }
+    while (*s == ' ') { s++; }
+    uint64_t count = 0;
+    while (*s >= '0' && *s <= '9') { count = 10*count + (uint64_t)(*s - '0'); s++; }
+    if (is_pressure) { total += count; }
+    while (*s != 0 && *s != '\n') { s++; }
+    if (*s == '\n') { s++; }
+  }
+  *events = total;
+  return true;
+}
+
+bool _mi_prim_mem_pressure_init(void) {
+  char dir[256];
+  char fname[320];
+  if (!mi_cgroup_dir(dir, sizeof(dir))) return false;
+  // prefer a PSI trigger (Linux 5.2+) as it signals stalls before the limits are reached
+  _mi_snprintf(fname, sizeof(fname), "%s/memory.pressure", dir);
+  int fd = mi_prim_open(fname, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+  if (fd >= 0) {
+    if (write(fd, MI_PSI_TRIGGER, sizeof(MI_PSI_TRIGGER)) > 0) {  // including the terminating zero
+      mi_pressure_fd  = fd;
+      mi_pressure_psi = true;
+      return true;
+    }
+    mi_prim_close(fd);  // no PSI support, or no permission to create a trigger
+  }
+  // otherwise poll the event counters of the `memory.high` and `memory.max` limits
+  _mi_snprintf(fname, sizeof(fname), "%s/memory.events", dir);
+  fd = mi_prim_open(fname, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return false;
+  mi_pressure_fd  = fd;
+  mi_pressure_psi = false;
+  if (!mi_pressure_read_events(&mi_pressure_events)) {
+    mi_prim_close(fd);
+    mi_pressure_fd = -1;
+    return false;
+  }
+  return true;
+}
+
+bool _mi_prim_mem_pressure_poll(void) {
+  if (mi_pressure_fd < 0) return false;
+  if (mi_pressure_psi) {
+    struct pollfd pfd;
+    pfd.fd = mi_pressure_fd;
+    pfd.events = POLLPRI;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, 0) <= 0) return false;
+    if ((pfd.revents & POLLERR) != 0) {  // the cgroup was removed
+      mi_prim_close(mi_pressure_fd);
+      mi_pressure_fd = -1;
+      return false;
+    }
+    return ((pfd.revents & POLLPRI) != 0);
+  }
+  else {
+    uint64_t events = 0;
+    if (!mi_pressure_read_events(&events)) return false;
+    const bool pressure = (events > mi_pressure_events);
+    mi_pressure_events = events;
+    return pressure;
+  }
+}
+
+#else
+
+bool _mi_prim_mem_pressure_init(void) {
+  return false;
+}
+
+bool _mi_prim_mem_pressure_poll(void) {
+  return false;
+}
+
+#endif
+
+
+//----------------------------------------------------------------
+// Current CPU
+//----------------------------------------------------------------
+
+#if defined(__linux__) && defined(__GLIBC__) && defined(__has_include)
+#if __has_include(<sys/rseq.h>) && defined(__has_builtin)
+#if __has_builtin(__builtin_thread_pointer)
+#include <sys/rseq.h>  // __rseq_offset, __rseq_size (glibc 2.35+)
+#define MI_HAS_RSEQ
+#endif
+#endif
+#endif
+
+size_t _mi_prim_cpu_id(void) {
+  #if defined(MI_HAS_RSEQ)
+  // glibc registers a restartable sequences (rseq) area for each thread in which the
+  // kernel keeps the current cpu id up-to-date, so we can read it without a system call.
+  if (__rseq_size > 0) {
+    const struct rseq* const rs = (const struct rseq*)((uint8_t*)__builtin_thread_pointer() + __rseq_offset);
+    const int32_t cpu = (int32_t)(*(const volatile uint32_t*)&rs->cpu_id);
+    if (cpu >= 0) return (size_t)cpu;  // otherwise uninitialized (-1) or registration failed (-2)
+  }
+  #endif
+  #if defined(__linux__) && defined(MI_HAS_SYSCALL_H) && defined(SYS_getcpu)
+  unsigned int cpu = 0;
+  if (syscall(SYS_getcpu, &cpu, NULL, NULL) == 0) return (size_t)cpu;
+  #endif
+  return SIZE_MAX;
+}
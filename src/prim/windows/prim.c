@@ -62,6 +62,11 @@ static PGetNumaProcessorNodeEx      pGetNumaProcessorNodeEx = NULL;
 static PGetNumaNodeProcessorMaskEx  pGetNumaNodeProcessorMaskEx = NULL;
 static PGetNumaProcessorNode        pGetNumaProcessorNode = NULL;
 
+// PrefetchVirtualMemory is only supported since Windows 8
+typedef struct MI_WIN32_MEMORY_RANGE_ENTRY_S { PVOID VirtualAddress; SIZE_T NumberOfBytes; } MI_WIN32_MEMORY_RANGE_ENTRY;
+typedef BOOL (__stdcall *PPrefetchVirtualMemory)(HANDLE hProcess, ULONG_PTR NumberOfEntries, MI_WIN32_MEMORY_RANGE_ENTRY* VirtualAddresses, ULONG Flags);
+static PPrefetchVirtualMemory pPrefetchVirtualMemory = NULL;
+
 //---------------------------------------------
 // Enable large page support dynamically (if possible)
 //---------------------------------------------
@@ -113,6 +118,7 @@ void _mi_prim_mem_init( mi_os_mem_config_t* config )
   config->has_overcommit = false;
   config->has_partial_free = false;
   config->has_virtual_reserve = true;
+  config->has_zero_decommit = true;  // `MEM_COMMIT` of decommitted pages zero-fills them
   // get the page size
   SYSTEM_INFO si;
   GetSystemInfo(&si);
@@ -152,6 +158,7 @@ void _mi_prim_mem_init( mi_os_mem_config_t* config )
     pGetNumaProcessorNodeEx = (PGetNumaProcessorNodeEx)(void (*)(void))GetProcAddress(hDll, "GetNumaProcessorNodeEx");
     pGetNumaNodeProcessorMaskEx = (PGetNumaNodeProcessorMaskEx)(void (*)(void))GetProcAddress(hDll, "GetNumaNodeProcessorMaskEx");
     pGetNumaProcessorNode = (PGetNumaProcessorNode)(void (*)(void))GetProcAddress(hDll, "GetNumaProcessorNode");
+    pPrefetchVirtualMemory = (PPrefetchVirtualMemory)(void (*)(void))GetProcAddress(hDll, "PrefetchVirtualMemory");
     FreeLibrary(hDll);
   }
   if (mi_option_is_enabled(mi_option_allow_large_os_pages) || mi_option_is_enabled(mi_option_reserve_huge_os_pages)) {
@@ -350,6 +357,58 @@ int _mi_prim_protect(void* addr, size_t size, bool protect) {
   return (ok ? 0 : (int)GetLastError());
 }
 
+int _mi_prim_purge_vec(const mi_os_range_t* ranges, size_t count, bool decommit, bool* needs_recommit) {
+  MI_UNUSED(ranges); MI_UNUSED(count); MI_UNUSED(decommit); MI_UNUSED(needs_recommit);
+  return ENOTSUP;
+}
+
+int _mi_prim_populate(void* addr, size_t size) {
+  // bring the range into the working set with a single call (Windows 8+)
+  if (pPrefetchVirtualMemory == NULL) return ENOTSUP;
+  MI_WIN32_MEMORY_RANGE_ENTRY range;
+  range.VirtualAddress = addr;
+  range.NumberOfBytes = size;
+  BOOL ok = (*pPrefetchVirtualMemory)(GetCurrentProcess(), 1, &range, 0);
+  return (ok ? 0 : (int)GetLastError());
+}
+
+int _mi_prim_remap(void* addr, size_t size, size_t newsize, size_t alignment, void** newaddr) {
+  MI_UNUSED(addr); MI_UNUSED(size); MI_UNUSED(newsize); MI_UNUSED(alignment);
+  *newaddr = NULL;
+  return ENOTSUP;
+}
+
+//---------------------------------------------
+// File mapping
+//---------------------------------------------
+
+int _mi_prim_file_open(const char* path, int* fd) {
+  MI_UNUSED(path);
+  *fd = -1;
+  return ENOTSUP;
+}
+
+void _mi_prim_file_close(int fd) {
+  MI_UNUSED(fd);
+}
+
+int _mi_prim_file_size(int fd, size_t* size) {
+  MI_UNUSED(fd);
+  *size = 0;
+  return ENOTSUP;
+}
+
+int _mi_prim_file_read(int fd, size_t offset, void* buf, size_t size) {
+  MI_UNUSED(fd); MI_UNUSED(offset); MI_UNUSED(buf); MI_UNUSED(size);
+  return ENOTSUP;
+}
+
+int _mi_prim_file_map(int fd, size_t size, void* addr, size_t alignment, void** mapped) {
+  MI_UNUSED(fd); MI_UNUSED(size); MI_UNUSED(addr); MI_UNUSED(alignment);
+  *mapped = NULL;
+  return ENOTSUP;
+}
+
 
 //---------------------------------------------
 // Huge page allocation
@@ -474,6 +533,17 @@ mi_msecs_t _mi_prim_clock_now(void) {
   return mi_to_msecs(t);
 }
 
+int64_t _mi_prim_clock_nsecs(void) {
+  static LARGE_INTEGER freq; // = 0
+  if (freq.QuadPart == 0LL) {
+    QueryPerformanceFrequency(&freq);
+    if (freq.QuadPart == 0) freq.QuadPart = 1;
+  }
+  LARGE_INTEGER t;
+  QueryPerformanceCounter(&t);
+  return ((t.QuadPart / freq.QuadPart) * 1000000000LL) + (((t.QuadPart % freq.QuadPart) * 1000000000LL) / freq.QuadPart);
+}
+
 
 //----------------------------------------------------------------
 // Process Info
@@ -771,6 +841,57 @@ static void NTAPI mi_win_main(PVOID module, DWORD reason, LPVOID reserved) {
   }
 #endif
 
+//----------------------------------------------------------------
+// Background threads
+//----------------------------------------------------------------
+
+typedef struct mi_thread_start_s {
+  void (*fun)(void*);
+  void* arg;
+} mi_thread_start_t;
+
+static DWORD WINAPI mi_win_thread_start(LPVOID p) {
+  const mi_thread_start_t start = *(mi_thread_start_t*)p;
+  VirtualFree(p, 0, MEM_RELEASE);
+  start.fun(start.arg);
+  return 0;
+}
+
+bool _mi_prim_thread_start(void (*fun)(void* arg), void* arg) {
+  // allocate the start info from the OS to avoid recursion into malloc
+  mi_thread_start_t* const start = (mi_thread_start_t*)VirtualAlloc(NULL, sizeof(mi_thread_start_t), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+  if (start == NULL) return false;
+  start->fun = fun;
+  start->arg = arg;
+  HANDLE thread = CreateThread(NULL, 0, &mi_win_thread_start, start, 0, NULL);
+  if (thread == NULL) {
+    VirtualFree(start, 0, MEM_RELEASE);
+    return false;
+  }
+  CloseHandle(thread);
+  return true;
+}
+
+void _mi_prim_thread_sleep(mi_msecs_t msecs) {
+  if (msecs > 0) { Sleep((DWORD)msecs); }
+}
+
+void _mi_prim_thread_atfork_child(void (*fun)(void)) {
+  MI_UNUSED(fun);  // no fork
+}
+
+bool _mi_prim_mem_pressure_init(void) {
+  return false;
+}
+
+bool _mi_prim_mem_pressure_poll(void) {
+  return false;
+}
+
+size_t _mi_prim_cpu_id(void) {
+  return SIZE_MAX;
+}
+
 // ----------------------------------------------------
 // Communicate with the redirection module on Windows
 // ----------------------------------------------------
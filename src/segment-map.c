@@ -9,108 +9,152 @@ terms of the MIT license. A copy of the license can be found in the file
   The following functions are to reliably find the segment or
   block that encompasses any pointer p (or NULL if it is not
   in any of our segments).
-  We maintain a bitmap of all memory with 1 bit per MI_SEGMENT_SIZE (64MiB)
-  set to 1 if it contains the segment meta data.
+  We maintain a bitmap of all memory with 1 bit per MI_SEGMENT_SIZE (32MiB)
+  set to 1 if it contains the segment meta data. The bitmap is
+  stored in a radix tree over the full address range where the
+  interior nodes and leaves are allocated on demand.
 ----------------------------------------------------------- */
 #include "mimalloc.h"
 #include "mimalloc/internal.h"
 #include "mimalloc/atomic.h"
 
-// Reduce total address space to reduce .bss  (due to the `mi_segment_map`)
-#if (MI_INTPTR_SIZE > 4) && MI_TRACK_ASAN
-#define MI_SEGMENT_MAP_MAX_ADDRESS    (128*1024ULL*MI_GiB)  // 128 TiB  (see issue #881)
-#elif (MI_INTPTR_SIZE > 4)
-#define MI_SEGMENT_MAP_MAX_ADDRESS    (48*1024ULL*MI_GiB)   // 48 TiB
+// A leaf is a bitmap of 2^15 segments (1TiB address span, or 128GiB on 32-bit)
+#define MI_SEGMAP_LEAF_BITS           (15)
+#define MI_SEGMAP_LEAF_SHIFT          (MI_SEGMENT_SHIFT + MI_SEGMAP_LEAF_BITS)
+#define MI_SEGMAP_LEAF_ENTRIES        ((MI_ZU(1) << MI_SEGMAP_LEAF_BITS) / MI_INTPTR_BITS)
+
+// The remaining upper address bits index the root (in .bss) and the interior nodes
+#if (MI_INTPTR_BITS > MI_SEGMAP_LEAF_SHIFT + 10)
+#define MI_SEGMAP_ROOT_BITS           (10)                                                      // 8KiB .bss
+#define MI_SEGMAP_NODE_BITS           (MI_INTPTR_BITS - MI_SEGMAP_LEAF_SHIFT - MI_SEGMAP_ROOT_BITS)  // 128KiB per node on 64-bit
+#elif (MI_INTPTR_BITS <= MI_SEGMAP_LEAF_SHIFT)
+#define MI_SEGMAP_ROOT_BITS           (0)                                                       // a single leaf covers the address space
+#define MI_SEGMAP_NODE_BITS           (0)
 #else
-#define MI_SEGMENT_MAP_MAX_ADDRESS    (UINT32_MAX)
+#error "define the segment map radix tree levels for this platform"
 #endif
 
-#define MI_SEGMENT_MAP_PART_SIZE      (MI_INTPTR_SIZE*MI_KiB - 128)      // 128 > sizeof(mi_memid_t) ! 
-#define MI_SEGMENT_MAP_PART_BITS      (8*MI_SEGMENT_MAP_PART_SIZE)
-#define MI_SEGMENT_MAP_PART_ENTRIES   (MI_SEGMENT_MAP_PART_SIZE / MI_INTPTR_SIZE)
-#define MI_SEGMENT_MAP_PART_BIT_SPAN  (MI_SEGMENT_ALIGN)
-#define MI_SEGMENT_MAP_PART_SPAN      (MI_SEGMENT_MAP_PART_BITS * MI_SEGMENT_MAP_PART_BIT_SPAN)
-#define MI_SEGMENT_MAP_MAX_PARTS      ((MI_SEGMENT_MAP_MAX_ADDRESS / MI_SEGMENT_MAP_PART_SPAN) + 1)
+#define MI_SEGMAP_ROOT_ENTRIES        (MI_ZU(1) << MI_SEGMAP_ROOT_BITS)
+#define MI_SEGMAP_NODE_ENTRIES        (MI_ZU(1) << MI_SEGMAP_NODE_BITS)
+
+// A leaf of the segment map.
+typedef struct mi_segmap_leaf_s {
+  mi_memid_t memid;
+  _Atomic(uintptr_t) map[MI_SEGMAP_LEAF_ENTRIES];
+} mi_segmap_leaf_t;
 
-// A part of the segment map.
-typedef struct mi_segmap_part_s {
+// An interior node of the segment map.
+typedef struct mi_segmap_node_s {
   mi_memid_t memid;
-  _Atomic(uintptr_t) map[MI_SEGMENT_MAP_PART_ENTRIES];
-} mi_segmap_part_t;
+  _Atomic(mi_segmap_leaf_t*) leaves[MI_SEGMAP_NODE_ENTRIES];
+} mi_segmap_node_t;
+
+// Allocate nodes and leaves on-demand to reduce .bss footprint
+static _Atomic(mi_segmap_node_t*) mi_segment_map[MI_SEGMAP_ROOT_ENTRIES]; // = { NULL, .. }
 
-// Allocate parts on-demand to reduce .bss footprint
-static _Atomic(mi_segmap_part_t*) mi_segment_map[MI_SEGMENT_MAP_MAX_PARTS]; // = { NULL, .. }
+// Each lookup thread caches the last found segment; the cache is valid as long as no segment was freed since then.
+static _Atomic(size_t) mi_segment_map_freed_count;  // = 0
+static mi_decl_thread const mi_segment_t* mi_segment_map_last;  // = NULL
+static mi_decl_thread size_t mi_segment_map_last_freed_count;
+
+static mi_segmap_node_t* mi_segment_map_node_of(size_t rootidx, bool create_on_demand) {
+  mi_segmap_node_t* node = mi_atomic_load_ptr_acquire(mi_segmap_node_t, &mi_segment_map[rootidx]);
+  if mi_likely(node != NULL || !create_on_demand) return node;
+  mi_memid_t memid;
+  node = (mi_segmap_node_t*)_mi_os_alloc(sizeof(mi_segmap_node_t), &memid);
+  if (node == NULL) return NULL;
+  node->memid = memid;
+  mi_segmap_node_t* expected = NULL;
+  if (!mi_atomic_cas_ptr_strong_release(mi_segmap_node_t, &mi_segment_map[rootidx], &expected, node)) {
+    _mi_os_free(node, sizeof(mi_segmap_node_t), memid);
+    node = expected;
+  }
+  return node;
+}
 
-static mi_segmap_part_t* mi_segment_map_index_of(const mi_segment_t* segment, bool create_on_demand, size_t* idx, size_t* bitidx) {
+static mi_segmap_leaf_t* mi_segment_map_leaf_of(mi_segmap_node_t* node, size_t nodeidx, bool create_on_demand) {
+  mi_segmap_leaf_t* leaf = mi_atomic_load_ptr_acquire(mi_segmap_leaf_t, &node->leaves[nodeidx]);
+  if mi_likely(leaf != NULL || !create_on_demand) return leaf;
+  mi_memid_t memid;
+  leaf = (mi_segmap_leaf_t*)_mi_os_alloc(sizeof(mi_segmap_leaf_t), &memid);
+  if (leaf == NULL) return NULL;
+  leaf->memid = memid;
+  mi_segmap_leaf_t* expected = NULL;
+  if (!mi_atomic_cas_ptr_strong_release(mi_segmap_leaf_t, &node->leaves[nodeidx], &expected, leaf)) {
+    _mi_os_free(leaf, sizeof(mi_segmap_leaf_t), memid);
+    leaf = expected;
+  }
+  return leaf;
+}
+
+static mi_segmap_leaf_t* mi_segment_map_index_of(const mi_segment_t* segment, bool create_on_demand, size_t* idx, size_t* bitidx) {
   // note: segment can be invalid or NULL.
   mi_assert_internal(_mi_ptr_segment(segment + 1) == segment); // is it aligned on MI_SEGMENT_SIZE?
   *idx = 0;
-  *bitidx = 0;  
-  if ((uintptr_t)segment >= MI_SEGMENT_MAP_MAX_ADDRESS) return NULL;
-  const uintptr_t segindex = ((uintptr_t)segment) / MI_SEGMENT_MAP_PART_SPAN;
-  if (segindex >= MI_SEGMENT_MAP_MAX_PARTS) return NULL;
-  mi_segmap_part_t* part = mi_atomic_load_ptr_relaxed(mi_segmap_part_t, &mi_segment_map[segindex]);
-
-  // allocate on demand to reduce .bss footprint
-  if (part == NULL) {
-    if (!create_on_demand) return NULL;
-    mi_memid_t memid;
-    part = (mi_segmap_part_t*)_mi_os_alloc(sizeof(mi_segmap_part_t), &memid);
-    if (part == NULL) return NULL;
-    part->memid = memid;
-    mi_segmap_part_t* expected = NULL;
-    if (!mi_atomic_cas_ptr_strong_release(mi_segmap_part_t, &mi_segment_map[segindex], &expected, part)) {
-      _mi_os_free(part, sizeof(mi_segmap_part_t), memid);
-      part = expected;
-      if (part == NULL) return NULL;
-    }
-  }
-  mi_assert(part != NULL);
-  const uintptr_t offset = ((uintptr_t)segment) % MI_SEGMENT_MAP_PART_SPAN;
-  const uintptr_t bitofs = offset / MI_SEGMENT_MAP_PART_BIT_SPAN;
+  *bitidx = 0;
+  const uintptr_t addr = (uintptr_t)segment;
+  #if (MI_SEGMAP_ROOT_BITS > 0)
+  const size_t rootidx = (size_t)(addr >> (MI_SEGMAP_LEAF_SHIFT + MI_SEGMAP_NODE_BITS));
+  const size_t nodeidx = (size_t)((addr >> MI_SEGMAP_LEAF_SHIFT) % MI_SEGMAP_NODE_ENTRIES);
+  #else
+  const size_t rootidx = 0;
+  const size_t nodeidx = 0;
+  #endif
+  mi_segmap_node_t* const node = mi_segment_map_node_of(rootidx, create_on_demand);
+  if (node == NULL) return NULL;
+  mi_segmap_leaf_t* const leaf = mi_segment_map_leaf_of(node, nodeidx, create_on_demand);
+  if (leaf == NULL) return NULL;
+  const size_t bitofs = (size_t)((addr >> MI_SEGMENT_SHIFT) % (MI_ZU(1) << MI_SEGMAP_LEAF_BITS));
   *idx = bitofs / MI_INTPTR_BITS;
   *bitidx = bitofs % MI_INTPTR_BITS;
-  return part;
+  return leaf;
 }
 
 void _mi_segment_map_allocated_at(const mi_segment_t* segment) {
   if (segment->memid.memkind == MI_MEM_ARENA) return; // we lookup segments first in the arena's and don't need the segment map
   size_t index;
   size_t bitidx;
-  mi_segmap_part_t* part = mi_segment_map_index_of(segment, true /* alloc map if needed */, &index, &bitidx);
-  if (part == NULL) return; // outside our address range..
-  uintptr_t mask = mi_atomic_load_relaxed(&part->map[index]);
+  mi_segmap_leaf_t* leaf = mi_segment_map_index_of(segment, true /* alloc map if needed */, &index, &bitidx);
+  if (leaf == NULL) return; // out of memory..
+  uintptr_t mask = mi_atomic_load_relaxed(&leaf->map[index]);
   uintptr_t newmask;
   do {
     newmask = (mask | ((uintptr_t)1 << bitidx));
-  } while (!mi_atomic_cas_weak_release(&part->map[index], &mask, newmask));
+  } while (!mi_atomic_cas_weak_release(&leaf->map[index], &mask, newmask));
 }
 
 void _mi_segment_map_freed_at(const mi_segment_t* segment) {
   if (segment->memid.memkind == MI_MEM_ARENA) return;
   size_t index;
   size_t bitidx;
-  mi_segmap_part_t* part = mi_segment_map_index_of(segment, false /* don't alloc if not present */, &index, &bitidx);
-  if (part == NULL) return; // outside our address range..
-  uintptr_t mask = mi_atomic_load_relaxed(&part->map[index]);
+  mi_segmap_leaf_t* leaf = mi_segment_map_index_of(segment, false /* don't alloc if not present */, &index, &bitidx);
+  if (leaf == NULL) return; // not in the map
+  uintptr_t mask = mi_atomic_load_relaxed(&leaf->map[index]);
   uintptr_t newmask;
   do {
     newmask = (mask & ~((uintptr_t)1 << bitidx));
-  } while (!mi_atomic_cas_weak_release(&part->map[index], &mask, newmask));
+  } while (!mi_atomic_cas_weak_release(&leaf->map[index], &mask, newmask));
+  mi_atomic_increment_acq_rel(&mi_segment_map_freed_count);  // invalidate the per-thread lookup caches
 }
 
 // Determine the segment belonging to a pointer or NULL if it is not in a valid segment.
 static mi_segment_t* _mi_segment_of(const void* p) {
   if (p == NULL) return NULL;
-  mi_segment_t* segment = _mi_ptr_segment(p);  // segment can be NULL  
+  mi_segment_t* segment = _mi_ptr_segment(p);  // segment can be NULL
+  const size_t freed_count = mi_atomic_load_acquire(&mi_segment_map_freed_count);
+  if (segment == mi_segment_map_last && freed_count == mi_segment_map_last_freed_count) {
+    return segment;  // same as the last lookup
+  }
   size_t index;
   size_t bitidx;
-  mi_segmap_part_t* part = mi_segment_map_index_of(segment, false /* dont alloc if not present */, &index, &bitidx);
-  if (part == NULL) return NULL;  
-  const uintptr_t mask = mi_atomic_load_relaxed(&part->map[index]);
+  mi_segmap_leaf_t* leaf = mi_segment_map_index_of(segment, false /* dont alloc if not present */, &index, &bitidx);
+  if (leaf == NULL) return NULL;
+  const uintptr_t mask = mi_atomic_load_relaxed(&leaf->map[index]);
   if mi_likely((mask & ((uintptr_t)1 << bitidx)) != 0) {
     bool cookie_ok = (_mi_ptr_cookie(segment) == segment->cookie);
     mi_assert_internal(cookie_ok); MI_UNUSED(cookie_ok);
+    mi_segment_map_last = segment;
+    mi_segment_map_last_freed_count = freed_count;
     return segment; // yes, allocated by us
   }
   return NULL;
@@ -127,10 +171,16 @@ mi_decl_nodiscard mi_decl_export bool mi_is_in_heap_region(const void* p) mi_att
 }
 
 void _mi_segment_map_unsafe_destroy(void) {
-  for (size_t i = 0; i < MI_SEGMENT_MAP_MAX_PARTS; i++) {
-    mi_segmap_part_t* part = mi_atomic_exchange_ptr_relaxed(mi_segmap_part_t, &mi_segment_map[i], NULL);
-    if (part != NULL) {
-      _mi_os_free(part, sizeof(mi_segmap_part_t), part->memid);
+  for (size_t i = 0; i < MI_SEGMAP_ROOT_ENTRIES; i++) {
+    mi_segmap_node_t* node = mi_atomic_exchange_ptr_relaxed(mi_segmap_node_t, &mi_segment_map[i], NULL);
+    if (node == NULL) continue;
+    for (size_t j = 0; j < MI_SEGMAP_NODE_ENTRIES; j++) {
+      mi_segmap_leaf_t* leaf = mi_atomic_exchange_ptr_relaxed(mi_segmap_leaf_t, &node->leaves[j], NULL);
+      if (leaf != NULL) {
+        _mi_os_free(leaf, sizeof(mi_segmap_leaf_t), leaf->memid);
+      }
     }
+    _mi_os_free(node, sizeof(mi_segmap_node_t), node->memid);
   }
+  mi_atomic_increment_acq_rel(&mi_segment_map_freed_count);
 }
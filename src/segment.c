@@ -7,6 +7,7 @@ terms of the MIT license. A copy of the license can be found in the file
 #include "mimalloc.h"
 #include "mimalloc/internal.h"
 #include "mimalloc/atomic.h"
+#include "mimalloc/prim.h"  // mi_prim_get_default_heap
 
 #include <string.h>  // memset
 #include <stdio.h>
@@ -395,6 +396,11 @@ We keep a small segment cache per thread to increase local
 reuse and avoid setting/clearing guard pages in secure mode.
 ------------------------------------------------------------------------------- */
 
+// per numa node statistics are kept in the main statistics
+static size_t mi_segment_numa_stat_index(int numa_node) {
+  return (numa_node <= 0 ? 0 : (size_t)numa_node % MI_NUMA_STATS_MAX);
+}
+
 static void mi_segments_track_size(long segment_size, mi_segments_tld_t* tld) {
   if (segment_size>=0) _mi_stat_increase(&tld->stats->segments,1);
                   else _mi_stat_decrease(&tld->stats->segments,1);
@@ -408,6 +414,7 @@ static void mi_segment_os_free(mi_segment_t* segment, mi_segments_tld_t* tld) {
   segment->thread_id = 0;
   _mi_segment_map_freed_at(segment);
   mi_segments_track_size(-((long)mi_segment_size(segment)),tld);
+  _mi_stat_decrease(&_mi_stats_main.numa_segments[mi_segment_numa_stat_index(segment->numa_node)], 1);
   if (segment->was_reclaimed) {
     tld->reclaim_count--;
     segment->was_reclaimed = false;
@@ -424,16 +431,48 @@ static void mi_segment_os_free(mi_segment_t* segment, mi_segments_tld_t* tld) {
   // purge delayed decommits now? (no, leave it to the arena)
   // mi_segment_try_purge(segment,true,tld->stats);
 
+  // release it later if a batch is installed (see `heap.c:mi_heap_destroy_parallel`)
+  mi_segment_batch_t* const batch = tld->batch;
+  if (batch != NULL) {
+    const size_t part = (batch->count++) % batch->parts;
+    segment->next = batch->segments[part];
+    batch->segments[part] = segment;
+    return;
+  }
+
   const size_t size = mi_segment_size(segment);
   const size_t csize = _mi_commit_mask_committed_size(&segment->commit_mask, size);
 
   _mi_arena_free(segment, mi_segment_size(segment), csize, segment->memid);
 }
 
+// Release the segments in one part of a batch to the arenas and the OS.
+// Different parts can be released concurrently by different threads.
+void _mi_segment_batch_release(mi_segment_batch_t* batch, size_t part) {
+  mi_assert_internal(part < batch->parts);
+  mi_segment_t* segment = batch->segments[part];
+  batch->segments[part] = NULL;
+  while (segment != NULL) {
+    mi_segment_t* const next = segment->next;  // read before the segment memory is released
+    const size_t size = mi_segment_size(segment);
+    const size_t csize = _mi_commit_mask_committed_size(&segment->commit_mask, size);
+    _mi_arena_free(segment, size, csize, segment->memid);
+    segment = next;
+  }
+}
+
 /* -----------------------------------------------------------
    Commit/Decommit ranges
 ----------------------------------------------------------- */
 
+// In THP aware mode we commit and purge in whole (2MiB) huge OS pages so transparent huge pages are not split.
+// Returns 0 if not in THP aware mode (or if the huge OS page size is not a suitable multiple of the commit size)
+static size_t mi_segment_thp_size(void) {
+  const size_t thp_size = _mi_os_thp_size();
+  if (thp_size <= MI_COMMIT_SIZE || thp_size > MI_SEGMENT_SIZE || (thp_size % MI_COMMIT_SIZE) != 0) return 0;
+  return thp_size;
+}
+
 static void mi_segment_commit_mask(mi_segment_t* segment, bool conservative, uint8_t* p, size_t size, uint8_t** start_p, size_t* full_size, mi_commit_mask_t* cm) {
   mi_assert_internal(_mi_ptr_segment(p + 1) == segment);
   mi_assert_internal(segment->kind != MI_SEGMENT_HUGE);
@@ -448,17 +487,21 @@ static void mi_segment_commit_mask(mi_segment_t* segment, bool conservative, uin
 
   size_t start;
   size_t end;
+  const size_t thp_size = mi_segment_thp_size();
   if (conservative) {
-    // decommit conservative
-    start = _mi_align_up(pstart, MI_COMMIT_SIZE);
-    end   = _mi_align_down(pstart + size, MI_COMMIT_SIZE);
+    // decommit conservative (and in THP aware mode only whole huge OS pages)
+    const size_t purge_size = (thp_size > 0 ? thp_size : MI_COMMIT_SIZE);
+    start = _mi_align_up(pstart, purge_size);
+    end   = _mi_align_down(pstart + size, purge_size);
+    if (end < start) { end = start; }
     mi_assert_internal(start >= segstart);
     mi_assert_internal(end <= segsize);
   }
   else {
-    // commit liberal
-    start = _mi_align_down(pstart, MI_MINIMAL_COMMIT_SIZE);
-    end   = _mi_align_up(pstart + size, MI_MINIMAL_COMMIT_SIZE);
+    // commit liberal (and in THP aware mode whole huge OS pages)
+    const size_t commit_size = (thp_size > 0 ? thp_size : MI_MINIMAL_COMMIT_SIZE);
+    start = _mi_align_down(pstart, commit_size);
+    end   = _mi_align_up(pstart + size, commit_size);
   }
   if (pstart >= segstart && start < segstart) {  // note: the mask is also calculated for an initial commit of the info area
     start = segstart;
@@ -467,7 +510,7 @@ static void mi_segment_commit_mask(mi_segment_t* segment, bool conservative, uin
     end = segsize;
   }
 
-  mi_assert_internal(start <= pstart && (pstart + size) <= end);
+  mi_assert_internal(conservative ? (start >= pstart && end <= pstart + size) || end == start : (start <= pstart && (pstart + size) <= end));
   mi_assert_internal(start % MI_COMMIT_SIZE==0 && end % MI_COMMIT_SIZE == 0);
   *start_p   = (uint8_t*)segment + start;
   *full_size = (end > start ? end - start : 0);
@@ -484,6 +527,68 @@ static void mi_segment_commit_mask(mi_segment_t* segment, bool conservative, uin
   mi_commit_mask_create(bitidx, bitcount, cm);
 }
 
+// The purge delay of a segment (from the heap tag policy, or `mi_option_purge_delay`)
+static long mi_segment_purge_delay_base(const mi_segment_t* segment) {
+  return (segment->purge_delay >= -1 ? segment->purge_delay : mi_option_get(mi_option_purge_delay));
+}
+
+// The adapted purge delay (see `arena.c:_mi_purge_delay_adapt`)
+static long mi_segment_purge_delay(const mi_segment_t* segment) {
+  return _mi_purge_delay_adapt(mi_segment_purge_delay_base(segment));
+}
+
+// Report if a range that is about to be used was purged recently (so the purge delay can adapt)
+static void mi_segment_purged_reuse(mi_segment_t* segment, uint8_t* p, size_t size) {
+  uint8_t* start = NULL;
+  size_t   full_size = 0;
+  mi_commit_mask_t mask;
+  mi_segment_commit_mask(segment, false /* conservative? */, p, size, &start, &full_size, &mask);
+  if (!mi_commit_mask_any_set(&segment->purged_mask, &mask)) return;
+  mi_commit_mask_clear(&segment->purged_mask, &mask);
+  _mi_purge_adapt_reused(segment->purged_at, mi_segment_purge_delay_base(segment));
+}
+
+// Claim a range that is about to be used: returns `true` if it reads as zero (and clears it from the zero mask
+// as it will be written). This is tracked per commit chunk so the whole chunks spanned by the range must be zero.
+static bool mi_segment_zero_claim(mi_segment_t* segment, uint8_t* p, size_t size) {
+  if (segment->kind == MI_SEGMENT_HUGE || mi_commit_mask_is_empty(&segment->zero_mask)) return false;
+  uint8_t* start = NULL;
+  size_t   full_size = 0;
+  mi_commit_mask_t mask;
+  mi_segment_commit_mask(segment, false /* conservative? */, p, size, &start, &full_size, &mask);
+  const bool is_zero = (!mi_commit_mask_is_empty(&mask) && mi_commit_mask_all_set(&segment->zero_mask, &mask));
+  mi_commit_mask_clear(&segment->zero_mask, &mask);
+  return is_zero;
+}
+
+// Record that a purged range reads as zero again (if purging decommits anonymous OS memory)
+static void mi_segment_zero_purged(mi_segment_t* segment, const mi_commit_mask_t* mask, bool purge_is_zero) {
+  if (purge_is_zero && segment->os_backed) {
+    mi_commit_mask_set(&segment->zero_mask, mask);
+  }
+}
+
+// When a segment commits often (as during warm-up), commit ahead in growing chunks to reduce the number
+// of commit calls (see `mi_option_commit_ahead`). The commit ahead size doubles (up to the maximum) on each
+// commit that follows the previous one within `MI_COMMIT_AHEAD_WINDOW`, and halves otherwise. A segment
+// is owned by a single thread so this adapts to the commit rate of that thread.
+#define MI_COMMIT_AHEAD_WINDOW  (10)   // in milli-seconds
+
+static size_t mi_segment_commit_ahead(mi_segment_t* segment) {
+  const size_t ahead_max = mi_option_get_size(mi_option_commit_ahead);
+  if (ahead_max == 0 || !segment->allow_purge || mi_segment_purge_delay(segment) == 0) return 0;
+  const mi_msecs_t now = _mi_clock_now();
+  if (now - segment->commit_last <= MI_COMMIT_AHEAD_WINDOW) {
+    segment->commit_ahead = (segment->commit_ahead == 0 ? MI_MINIMAL_COMMIT_SIZE : 2*segment->commit_ahead);
+    if (segment->commit_ahead > ahead_max) { segment->commit_ahead = ahead_max; }
+  }
+  else {
+    segment->commit_ahead /= 2;
+  }
+  segment->commit_last = now;
+  return segment->commit_ahead;
+}
+
 static bool mi_segment_commit(mi_segment_t* segment, uint8_t* p, size_t size) {
   mi_assert_internal(mi_commit_mask_all_set(&segment->commit_mask, &segment->purge_mask));
 
@@ -494,23 +599,53 @@ static bool mi_segment_commit(mi_segment_t* segment, uint8_t* p, size_t size) {
   mi_segment_commit_mask(segment, false /* conservative? */, p, size, &start, &full_size, &mask);
   if (mi_commit_mask_is_empty(&mask) || full_size == 0) return true;
 
+  mi_commit_mask_t amask;  // committed ahead
+  mi_commit_mask_create_empty(&amask);
   if (!mi_commit_mask_all_set(&segment->commit_mask, &mask)) {
+    // commit ahead as well?
+    const size_t ahead = mi_segment_commit_ahead(segment);
+    const size_t available = mi_segment_size(segment) - (size_t)(start + full_size - (uint8_t*)segment);
+    if (ahead > 0 && available > 0) {
+      mi_commit_mask_t xmask;
+      mi_segment_commit_mask(segment, false, start, full_size + (ahead < available ? ahead : available), &start, &full_size, &xmask);
+      // only the slices that are not yet committed are committed ahead (and thus free)
+      amask = xmask;
+      mi_commit_mask_clear(&amask, &segment->commit_mask);
+      mi_commit_mask_clear(&amask, &mask);
+      mask = xmask;
+    }
+
     // committing
     bool is_zero = false;
     mi_commit_mask_t cmask;
     mi_commit_mask_create_intersect(&segment->commit_mask, &mask, &cmask);
     _mi_stat_decrease(&_mi_stats_main.committed, _mi_commit_mask_committed_size(&cmask, MI_SEGMENT_SIZE)); // adjust for overlap
     if (!_mi_os_commit(start, full_size, &is_zero)) return false;
+    if (is_zero) {
+      // the newly committed slices read as zero
+      mi_commit_mask_t zmask = mask;
+      mi_commit_mask_clear(&zmask, &segment->commit_mask);
+      mi_commit_mask_set(&segment->zero_mask, &zmask);
+    }
     mi_commit_mask_set(&segment->commit_mask, &mask);
+    if (segment->populate) { _mi_os_populate(start, full_size); }
   }
 
   // increase purge expiration when using part of delayed purges -- we assume more allocations are coming soon.
   if (mi_commit_mask_any_set(&segment->purge_mask, &mask)) {
-    segment->purge_expire = _mi_clock_now() + mi_option_get(mi_option_purge_delay);
+    segment->purge_expire = _mi_clock_now() + mi_segment_purge_delay(segment);
   }
 
   // always clear any delayed purges in our range (as they are either committed now)
   mi_commit_mask_clear(&segment->purge_mask, &mask);
+
+  // and schedule the memory that was committed ahead for purging in case it stays unused
+  if (!mi_commit_mask_is_empty(&amask)) {
+    mi_commit_mask_set(&segment->purge_mask, &amask);
+    if (segment->purge_expire == 0) {
+      segment->purge_expire = _mi_clock_now() + mi_segment_purge_delay(segment);
+    }
+  }
   return true;
 }
 
@@ -537,7 +672,9 @@ static bool mi_segment_purge(mi_segment_t* segment, uint8_t* p, size_t size) {
     // purging
     mi_assert_internal((void*)start != (void*)segment);
     mi_assert_internal(segment->allow_decommit);
+    const bool purge_is_zero = _mi_os_purge_is_zero();
     const bool decommitted = _mi_os_purge(start, full_size);  // reset or decommit
+    mi_segment_zero_purged(segment, &mask, purge_is_zero);
     if (decommitted) {
       mi_commit_mask_t cmask;
       mi_commit_mask_create_intersect(&segment->commit_mask, &mask, &cmask);
@@ -548,13 +685,58 @@ static bool mi_segment_purge(mi_segment_t* segment, uint8_t* p, size_t size) {
 
   // always clear any scheduled purges in our range
   mi_commit_mask_clear(&segment->purge_mask, &mask);
+  mi_commit_mask_set(&segment->purged_mask, &mask);
+  segment->purged_at = _mi_clock_now();
   return true;
 }
 
+// Purge the ranges in the batch and update the commit mask for the `pending` ranges
+static void mi_segment_purge_batch_flush(mi_segment_t* segment, mi_os_purge_batch_t* batch, mi_commit_mask_t* pending) {
+  if (mi_commit_mask_is_empty(pending)) return;
+  bool purge_is_zero = false;
+  const bool decommitted = _mi_os_purge_batch_flush(batch, &purge_is_zero);  // reset or decommit
+  mi_segment_zero_purged(segment, pending, purge_is_zero);
+  if (decommitted) {
+    mi_commit_mask_t cmask;
+    mi_commit_mask_create_intersect(&segment->commit_mask, pending, &cmask);
+    const size_t psize = _mi_commit_mask_committed_size(pending, MI_SEGMENT_SIZE);
+    _mi_stat_increase(&_mi_stats_main.committed, psize - _mi_commit_mask_committed_size(&cmask, MI_SEGMENT_SIZE)); // adjust for double counting
+    mi_commit_mask_clear(&segment->commit_mask, pending);
+  }
+  mi_commit_mask_create_empty(pending);
+}
+
+// As `mi_segment_purge` but adds the range to a batch (see `mi_segment_try_purge`)
+static void mi_segment_purge_batched(mi_segment_t* segment, mi_os_purge_batch_t* batch, mi_commit_mask_t* pending, uint8_t* p, size_t size) {
+  mi_assert_internal(mi_commit_mask_all_set(&segment->commit_mask, &segment->purge_mask));
+  if (!segment->allow_purge) return;
+
+  // purge conservative
+  uint8_t* start = NULL;
+  size_t   full_size = 0;
+  mi_commit_mask_t mask;
+  mi_segment_commit_mask(segment, true /* conservative? */, p, size, &start, &full_size, &mask);
+  if (mi_commit_mask_is_empty(&mask) || full_size==0) return;
+
+  if (mi_commit_mask_any_set(&segment->commit_mask, &mask)) {
+    mi_assert_internal((void*)start != (void*)segment);
+    mi_assert_internal(segment->allow_decommit);
+    if (!_mi_os_purge_batch_add(batch, start, full_size)) {
+      mi_segment_purge_batch_flush(segment, batch, pending);
+      _mi_os_purge_batch_add(batch, start, full_size);
+    }
+    mi_commit_mask_set(pending, &mask);
+  }
+
+  // always clear any scheduled purges in our range
+  mi_commit_mask_clear(&segment->purge_mask, &mask);
+  mi_commit_mask_set(&segment->purged_mask, &mask);
+}
+
 static void mi_segment_schedule_purge(mi_segment_t* segment, uint8_t* p, size_t size) {
   if (!segment->allow_purge) return;
 
-  if (mi_option_get(mi_option_purge_delay) == 0) {
+  if (mi_segment_purge_delay(segment) == 0) {
     mi_segment_purge(segment, p, size);
   }
   else {
@@ -573,7 +755,7 @@ static void mi_segment_schedule_purge(mi_segment_t* segment, uint8_t* p, size_t
     mi_msecs_t now = _mi_clock_now();
     if (segment->purge_expire == 0) {
       // no previous purgess, initialize now
-      segment->purge_expire = now + mi_option_get(mi_option_purge_delay);
+      segment->purge_expire = now + mi_segment_purge_delay(segment);
     }
     else if (segment->purge_expire <= now) {
       // previous purge mask already expired
@@ -598,8 +780,14 @@ static void mi_segment_try_purge(mi_segment_t* segment, bool force) {
 
   mi_commit_mask_t mask = segment->purge_mask;
   segment->purge_expire = 0;
+  segment->purged_at = now;
   mi_commit_mask_create_empty(&segment->purge_mask);
 
+  // purge all sequences with a single call where possible
+  mi_os_purge_batch_t batch;
+  _mi_os_purge_batch_init(&batch);
+  mi_commit_mask_t pending;  // commit mask of the ranges in the batch
+  mi_commit_mask_create_empty(&pending);
   size_t idx;
   size_t count;
   mi_commit_mask_foreach(&mask, idx, count) {
@@ -607,10 +795,11 @@ static void mi_segment_try_purge(mi_segment_t* segment, bool force) {
     if (count > 0) {
       uint8_t* p = (uint8_t*)segment + (idx*MI_COMMIT_SIZE);
       size_t size = count * MI_COMMIT_SIZE;
-      mi_segment_purge(segment, p, size);
+      mi_segment_purge_batched(segment, &batch, &pending, p, size);
     }
   }
   mi_commit_mask_foreach_end()
+  mi_segment_purge_batch_flush(segment, &batch, &pending);
   mi_assert_internal(mi_commit_mask_is_empty(&segment->purge_mask));
 }
 
@@ -728,26 +917,8 @@ static mi_slice_t* mi_segment_span_free_coalesce(mi_slice_t* slice, mi_segments_
    Page allocation
 ----------------------------------------------------------- */
 
-// Note: may still return NULL if committing the memory failed
-static mi_page_t* mi_segment_span_allocate(mi_segment_t* segment, size_t slice_index, size_t slice_count) {
-  mi_assert_internal(slice_index < segment->slice_entries);
-  mi_slice_t* const slice = &segment->slices[slice_index];
-  mi_assert_internal(slice->block_size==0 || slice->block_size==1);
-
-  // commit before changing the slice data
-  if (!mi_segment_ensure_committed(segment, _mi_segment_page_start_from_slice(segment, slice, 0, NULL), slice_count * MI_SEGMENT_SLICE_SIZE)) {
-    return NULL;  // commit failed!
-  }
-
-  // convert the slices to a page
-  slice->slice_offset = 0;
-  slice->slice_count = (uint32_t)slice_count;
-  mi_assert_internal(slice->slice_count == slice_count);
-  const size_t bsize = slice_count * MI_SEGMENT_SLICE_SIZE;
-  slice->block_size = bsize;
-  mi_page_t*  page = mi_slice_to_page(slice);
-  mi_assert_internal(mi_page_block_size(page) == bsize);
-
+// set slice back pointers of a span (the first slice must be initialized already)
+static void mi_segment_span_set_back_offsets(mi_segment_t* segment, mi_slice_t* slice, size_t slice_index, size_t slice_count) {
   // set slice back pointers for the first MI_MAX_SLICE_OFFSET_COUNT entries
   size_t extra = slice_count-1;
   if (extra > MI_MAX_SLICE_OFFSET_COUNT) extra = MI_MAX_SLICE_OFFSET_COUNT;
@@ -770,9 +941,36 @@ static mi_page_t* mi_segment_span_allocate(mi_segment_t* segment, size_t slice_i
     last->slice_count = 0;
     last->block_size = 1;
   }
+}
+
+// Note: may still return NULL if committing the memory failed
+static mi_page_t* mi_segment_span_allocate(mi_segment_t* segment, size_t slice_index, size_t slice_count) {
+  mi_assert_internal(slice_index < segment->slice_entries);
+  mi_slice_t* const slice = &segment->slices[slice_index];
+  mi_assert_internal(slice->block_size==0 || slice->block_size==1);
+
+  // commit before changing the slice data
+  uint8_t* const start = _mi_segment_page_start_from_slice(segment, slice, 0, NULL);
+  if mi_unlikely(!mi_commit_mask_is_empty(&segment->purged_mask)) {
+    mi_segment_purged_reuse(segment, start, slice_count * MI_SEGMENT_SLICE_SIZE);
+  }
+  if (!mi_segment_ensure_committed(segment, start, slice_count * MI_SEGMENT_SLICE_SIZE)) {
+    return NULL;  // commit failed!
+  }
+
+  // convert the slices to a page
+  slice->slice_offset = 0;
+  slice->slice_count = (uint32_t)slice_count;
+  mi_assert_internal(slice->slice_count == slice_count);
+  const size_t bsize = slice_count * MI_SEGMENT_SLICE_SIZE;
+  slice->block_size = bsize;
+  mi_page_t*  page = mi_slice_to_page(slice);
+  mi_assert_internal(mi_page_block_size(page) == bsize);
+  mi_segment_span_set_back_offsets(segment, slice, slice_index, slice_count);
 
   // and initialize the page
   page->is_committed = true;
+  page->is_zero_init = mi_segment_zero_claim(segment, start, bsize);
   page->is_huge = (segment->kind == MI_SEGMENT_HUGE);
   segment->used++;
   return page;
@@ -790,34 +988,51 @@ static void mi_segment_slice_split(mi_segment_t* segment, mi_slice_t* slice, siz
   slice->slice_count = (uint32_t)slice_count;
 }
 
+#define MI_SEGMENT_THP_PACK_CANDIDATES  (8)   // max. spans to consider per span queue for packing into committed huge OS pages
+
+// is the start of a span (of `slice_count` slices) fully committed?
+static bool mi_segment_span_is_committed(mi_segment_t* segment, mi_slice_t* slice, size_t slice_count) {
+  uint8_t* start = NULL;
+  size_t   full_size = 0;
+  mi_commit_mask_t mask;
+  mi_segment_commit_mask(segment, false /* conservative? */, mi_slice_start(slice), slice_count * MI_SEGMENT_SLICE_SIZE, &start, &full_size, &mask);
+  return (!mi_commit_mask_is_empty(&mask) && mi_commit_mask_all_set(&segment->commit_mask, &mask));
+}
+
 static mi_page_t* mi_segments_page_find_and_allocate(size_t slice_count, mi_arena_id_t req_arena_id, mi_segments_tld_t* tld) {
   mi_assert_internal(slice_count*MI_SEGMENT_SLICE_SIZE <= MI_LARGE_OBJ_SIZE_MAX);
   // search from best fit up
   mi_span_queue_t* sq = mi_span_queue_for(slice_count, tld);
   if (slice_count == 0) slice_count = 1;
+  const bool thp_pack = (mi_segment_thp_size() > 0);
   while (sq <= &tld->spans[MI_SEGMENT_BIN_MAX]) {
-    for (mi_slice_t* slice = sq->first; slice != NULL; slice = slice->next) {
-      if (slice->slice_count >= slice_count) {
-        // found one
-        mi_segment_t* segment = _mi_ptr_segment(slice);
-        if (_mi_arena_memid_is_suitable(segment->memid, req_arena_id)) {
-          // found a suitable page span
-          mi_span_queue_delete(sq, slice);
-
-          if (slice->slice_count > slice_count) {
-            mi_segment_slice_split(segment, slice, slice_count, tld);
-          }
-          mi_assert_internal(slice != NULL && slice->slice_count == slice_count && slice->block_size > 0);
-          mi_page_t* page = mi_segment_span_allocate(segment, mi_slice_index(slice), slice->slice_count);
-          if (page == NULL) {
-            // commit failed; return NULL but first restore the slice
-            mi_segment_span_free_coalesce(slice, tld);
-            return NULL;
-          }
-          return page;
-        }
+    mi_slice_t* slice = NULL;
+    size_t candidates = 0;
+    for (mi_slice_t* s = sq->first; s != NULL; s = s->next) {
+      if (s->slice_count >= slice_count && _mi_arena_memid_is_suitable(_mi_ptr_segment(s)->memid, req_arena_id)) {
+        // found a suitable page span; in THP aware mode we prefer one that is already committed
+        // to pack pages inside the (resident) huge OS pages.
+        if (slice == NULL) { slice = s; }
+        if (!thp_pack || mi_segment_span_is_committed(_mi_ptr_segment(s), s, slice_count)) { slice = s; break; }
+        if (++candidates >= MI_SEGMENT_THP_PACK_CANDIDATES) break;
       }
     }
+    if (slice != NULL) {
+      mi_segment_t* segment = _mi_ptr_segment(slice);
+      mi_span_queue_delete(sq, slice);
+
+      if (slice->slice_count > slice_count) {
+        mi_segment_slice_split(segment, slice, slice_count, tld);
+      }
+      mi_assert_internal(slice != NULL && slice->slice_count == slice_count && slice->block_size > 0);
+      mi_page_t* page = mi_segment_span_allocate(segment, mi_slice_index(slice), slice->slice_count);
+      if (page == NULL) {
+        // commit failed; return NULL but first restore the slice
+        mi_segment_span_free_coalesce(slice, tld);
+        return NULL;
+      }
+      return page;
+    }
     sq++;
   }
   // could not find a page..
@@ -878,20 +1093,33 @@ static mi_segment_t* mi_segment_os_alloc( size_t required, size_t page_alignment
   segment->memid = memid;
   segment->allow_decommit = !memid.is_pinned;
   segment->allow_purge = segment->allow_decommit && (mi_option_get(mi_option_purge_delay) >= 0);
+  segment->purge_delay = -2;  // use `mi_option_purge_delay`
+  segment->populate = false;
+  segment->commit_last = 0;
+  segment->commit_ahead = 0;
   segment->segment_size = segment_size;
   segment->subproc = tld->subproc;
   segment->commit_mask = commit_mask;
   segment->purge_expire = 0;
   mi_commit_mask_create_empty(&segment->purge_mask);
+  mi_commit_mask_create_empty(&segment->purged_mask);
+  segment->purged_at = 0;
+  segment->os_backed = _mi_arena_memid_is_os_backed(memid);
+  if (memid.initially_zero && required == 0) { mi_commit_mask_create_full(&segment->zero_mask); }  // (huge pages are set directly)
+                                        else { mi_commit_mask_create_empty(&segment->zero_mask); }
+  // the memory is on the numa node of the arena, or otherwise (usually) on the node of the thread that first touches it
+  segment->numa_node = _mi_arena_memid_numa_node(memid);
+  if (segment->numa_node < 0) { segment->numa_node = _mi_os_numa_node(); }
 
   mi_segments_track_size((long)(segment_size), tld);
+  _mi_stat_increase(&_mi_stats_main.numa_segments[mi_segment_numa_stat_index(segment->numa_node)], 1);
   _mi_segment_map_allocated_at(segment);
   return segment;
 }
 
 
 // Allocate a segment from the OS aligned to `MI_SEGMENT_SIZE` .
-static mi_segment_t* mi_segment_alloc(size_t required, size_t page_alignment, mi_arena_id_t req_arena_id, mi_segments_tld_t* tld, mi_page_t** huge_page)
+static mi_segment_t* mi_segment_alloc(size_t required, size_t page_alignment, mi_arena_id_t req_arena_id, uint8_t heap_tag, mi_segments_tld_t* tld, mi_page_t** huge_page)
 {
   mi_assert_internal((required==0 && huge_page==NULL) || (required>0 && huge_page != NULL));
 
@@ -904,14 +1132,33 @@ static mi_segment_t* mi_segment_alloc(size_t required, size_t page_alignment, mi
   const bool eager_delay = (// !_mi_os_has_overcommit() &&             // never delay on overcommit systems
                             _mi_current_thread_count() > 1 &&       // do not delay for the first N threads
                             tld->peak_count < (size_t)mi_option_get(mi_option_eager_commit_delay));
-  const bool eager = !eager_delay && mi_option_is_enabled(mi_option_eager_commit);
-  bool commit = eager || (required > 0);
+  bool eager = !eager_delay && mi_option_is_enabled(mi_option_eager_commit);
+  const mi_heap_tag_policy_t* const policy = _mi_heap_tag_policy(heap_tag);
+  if (policy != NULL && policy->eager_commit >= 0) { eager = (policy->eager_commit != 0); }
+  const bool populate = (required == 0 &&  // huge pages are used directly
+                         (policy != NULL && policy->populate >= 0 ? policy->populate != 0 : mi_option_is_enabled(mi_option_populate)));
+  bool commit = eager || populate || (required > 0);
 
   // Allocate the segment from the OS
   mi_segment_t* segment = mi_segment_os_alloc(required, page_alignment, eager_delay, req_arena_id,
                                               &segment_slices, &info_slices, commit, tld);
   if (segment == NULL) return NULL;
 
+  // use the purge delay of the tag policy?
+  if (policy != NULL && policy->purge_delay >= -1) {
+    segment->purge_delay = policy->purge_delay;
+    segment->allow_purge = segment->allow_decommit && (policy->purge_delay >= 0) && (mi_option_get(mi_option_purge_delay) >= 0);
+  }
+
+  // back the whole segment before any page is handed out? (the info slices are initialized below)
+  if (populate) {
+    segment->populate = true;
+    const size_t info_size = info_slices * MI_SEGMENT_SLICE_SIZE;
+    if (!segment->memid.is_pinned) {  // large or huge OS pages are always backed
+      _mi_os_populate((uint8_t*)segment + info_size, mi_segment_size(segment) - info_size);
+    }
+  }
+
   // zero the segment info? -- not always needed as it may be zero initialized from the OS
   if (!segment->memid.initially_zero) {
     ptrdiff_t ofs    = offsetof(mi_segment_t, next);
@@ -963,6 +1210,7 @@ static mi_segment_t* mi_segment_alloc(size_t required, size_t page_alignment, mi
     mi_assert_internal(mi_commit_mask_is_full(&segment->commit_mask));
     *huge_page = mi_segment_span_allocate(segment, info_slices, segment_slices - info_slices - guard_slices);
     mi_assert_internal(*huge_page != NULL); // cannot fail as we commit in advance
+    (*huge_page)->is_zero_init = segment->memid.initially_zero;
   }
 
   mi_assert_expensive(mi_segment_is_valid(segment,tld));
@@ -1023,6 +1271,7 @@ static mi_slice_t* mi_segment_page_clear(mi_page_t* page, mi_segments_tld_t* tld
   size_t inuse = page->capacity * mi_page_block_size(page);
   _mi_stat_decrease(&tld->stats->page_committed, inuse);
   _mi_stat_decrease(&tld->stats->pages, 1);
+  _mi_stat_decrease(&_mi_stats_main.tag_pages[page->heap_tag % MI_TAG_STATS_MAX], 1);
 
   // reset the page memory to reduce memory pressure?
   if (segment->allow_decommit && mi_option_is_enabled(mi_option_deprecated_page_reset)) {
@@ -1094,24 +1343,44 @@ by scanning the arena memory
    Abandon segment/page
 ----------------------------------------------------------- */
 
+static mi_slice_t* mi_slices_start_iterate(mi_segment_t* segment, const mi_slice_t** end) {
+  mi_slice_t* slice = &segment->slices[0];
+  *end = mi_segment_slices_end(segment);
+  mi_assert_internal(slice->slice_count>0 && slice->block_size>0); // segment allocated page
+  slice = slice + slice->slice_count; // skip the first segment allocated page
+  return slice;
+}
+
+// add a used page to the free space summary of an abandoned segment
+static size_t mi_segment_page_fit(size_t fit, const mi_page_t* page) {
+  if (!mi_page_has_any_available(page)) return fit;
+  return (fit | mi_abandoned_fit_bin(_mi_bin(mi_page_block_size(page))));
+}
+
 static void mi_segment_abandon(mi_segment_t* segment, mi_segments_tld_t* tld) {
   mi_assert_internal(segment->used == segment->abandoned);
   mi_assert_internal(segment->used > 0);
   mi_assert_internal(segment->abandoned_visits == 0);
   mi_assert_expensive(mi_segment_is_valid(segment,tld));
 
-  // remove the free pages from the free page queues
-  mi_slice_t* slice = &segment->slices[0];
-  const mi_slice_t* end = mi_segment_slices_end(segment);
+  // remove the free pages from the free page queues (and summarize the free space for reclamation)
+  size_t fit = 0;
+  const mi_slice_t* end;
+  mi_slice_t* slice = mi_slices_start_iterate(segment, &end);
   while (slice < end) {
     mi_assert_internal(slice->slice_count > 0);
     mi_assert_internal(slice->slice_offset == 0);
     if (slice->block_size == 0) { // a free page
       mi_segment_span_remove_from_queue(slice,tld);
       slice->block_size = 0; // but keep it free
+      fit = mi_abandoned_fit_span(fit, slice->slice_count);
+    }
+    else {
+      fit = mi_segment_page_fit(fit, mi_slice_to_page(slice));
     }
     slice = slice + slice->slice_count;
   }
+  segment->abandoned_fit = fit;
 
   // perform delayed decommits (forcing is much slower on mstress)
   // Only abandoned segments in arena memory can be reclaimed without a free
@@ -1152,19 +1421,12 @@ void _mi_segment_page_abandon(mi_page_t* page, mi_segments_tld_t* tld) {
   Reclaim abandoned pages
 ----------------------------------------------------------- */
 
-static mi_slice_t* mi_slices_start_iterate(mi_segment_t* segment, const mi_slice_t** end) {
-  mi_slice_t* slice = &segment->slices[0];
-  *end = mi_segment_slices_end(segment);
-  mi_assert_internal(slice->slice_count>0 && slice->block_size>0); // segment allocated page
-  slice = slice + slice->slice_count; // skip the first segment allocated page
-  return slice;
-}
-
-// Possibly free pages and check if free space is available
+// Possibly free pages and check if free space is available (and update the free space summary)
 static bool mi_segment_check_free(mi_segment_t* segment, size_t slices_needed, size_t block_size, mi_segments_tld_t* tld)
 {
   mi_assert_internal(mi_segment_is_abandoned(segment));
   bool has_page = false;
+  size_t fit = 0;
 
   // for all slices
   const mi_slice_t* end;
@@ -1187,9 +1449,12 @@ static bool mi_segment_check_free(mi_segment_t* segment, size_t slices_needed, s
           has_page = true;
         }
       }
-      else if (mi_page_block_size(page) == block_size && mi_page_has_any_available(page)) {
-        // a page has available free blocks of the right size
-        has_page = true;
+      else {
+        if (mi_page_block_size(page) == block_size && mi_page_has_any_available(page)) {
+          // a page has available free blocks of the right size
+          has_page = true;
+        }
+        fit = mi_segment_page_fit(fit, page);
       }
     }
     else {
@@ -1198,8 +1463,10 @@ static bool mi_segment_check_free(mi_segment_t* segment, size_t slices_needed, s
         has_page = true;
       }
     }
+    if (!mi_slice_is_used(slice)) { fit = mi_abandoned_fit_span(fit, slice->slice_count); }
     slice = slice + slice->slice_count;
   }
+  segment->abandoned_fit = fit;
   return has_page;
 }
 
@@ -1217,6 +1484,11 @@ static mi_segment_t* mi_segment_reclaim(mi_segment_t* segment, mi_heap_t* heap,
   mi_segments_track_size((long)mi_segment_size(segment), tld);
   mi_assert_internal(segment->next == NULL);
   _mi_stat_decrease(&tld->stats->segments_abandoned, 1);
+  const int numa_node = _mi_os_numa_node();
+  _mi_stat_counter_increase(&_mi_stats_main.numa_reclaim[mi_segment_numa_stat_index(numa_node)], 1);
+  if (segment->numa_node != numa_node) {
+    _mi_stat_counter_increase(&_mi_stats_main.numa_reclaim_remote[mi_segment_numa_stat_index(numa_node)], 1);
+  }
 
   // for all slices
   const mi_slice_t* end;
@@ -1241,6 +1513,7 @@ static mi_segment_t* mi_segment_reclaim(mi_segment_t* segment, mi_heap_t* heap,
       }
       // associate the heap with this page, and allow heap thread delayed free again.
       mi_page_set_heap(page, target_heap);
+      mi_page_set_has_free_cache(page, target_heap);
       _mi_page_use_delayed_free(page, MI_USE_DELAYED_FREE, true); // override never (after heap is set)
       _mi_page_free_collect(page, false); // ensure used count is up to date
       if (mi_page_all_free(page)) {
@@ -1298,6 +1571,63 @@ bool _mi_segment_attempt_reclaim(mi_heap_t* heap, mi_segment_t* segment) {
   return false;
 }
 
+// Re-attach a segment in a persistent (file backed) arena after the arena is mapped again by a new process.
+// The segment still has the state of the previous process: its memory id is updated, and all its pages
+// are made abandoned so they can be reclaimed (or freed) by this process. The caller marks it abandoned
+// in the arena afterwards. Returns false if the memory does not look like a segment with used pages.
+bool _mi_segment_reattach(mi_segment_t* segment, size_t block_index, mi_arena_id_t arena_id, bool is_exclusive, mi_subproc_t* subproc) {
+  if (segment->memid.memkind != MI_MEM_ARENA || segment->memid.mem.arena.block_index != block_index) return false;
+  if (segment->segment_slices == 0 || segment->slice_entries == 0 || segment->slice_entries > MI_SLICES_PER_SEGMENT) return false;
+  if (segment->kind != MI_SEGMENT_NORMAL && segment->kind != MI_SEGMENT_HUGE) return false;
+  segment->memid.mem.arena.id = arena_id;
+  segment->memid.mem.arena.is_exclusive = is_exclusive;
+  segment->subproc = subproc;
+  segment->cookie = _mi_ptr_cookie(segment);
+  segment->next = NULL;
+  segment->abandoned_os_next = NULL;
+  segment->abandoned_os_prev = NULL;
+  segment->was_reclaimed = false;
+  segment->dont_free = false;
+  mi_atomic_store_release(&segment->thread_id, (uintptr_t)0);
+
+  // detach all pages from the heaps (and free spans from the span queues) of the previous process
+  size_t used = 0;
+  size_t fit = 0;
+  const mi_slice_t* end;
+  mi_slice_t* slice = mi_slices_start_iterate(segment, &end);
+  while (slice < end) {
+    if (slice->slice_count == 0 || slice->slice_offset != 0) return false;
+    if (mi_slice_is_used(slice)) {
+      mi_page_t* const page = mi_slice_to_page(slice);
+      mi_atomic_store_release(&page->xthread_free, mi_tf_set_delayed(mi_atomic_load_relaxed(&page->xthread_free), MI_NEVER_DELAYED_FREE));
+      mi_page_set_heap(page, NULL);
+      mi_page_set_in_full(page, false);
+      page->next = NULL;
+      page->prev = NULL;
+      page->retire_expire = 0;
+      fit = mi_segment_page_fit(fit, page);
+      used++;
+    }
+    else {
+      slice->next = NULL;
+      slice->prev = NULL;
+      fit = mi_abandoned_fit_span(fit, slice->slice_count);
+    }
+    slice = slice + slice->slice_count;
+  }
+  if (used == 0 || used != segment->used) return false;
+  segment->abandoned = used;
+  segment->abandoned_visits = 1;
+  segment->abandoned_fit = fit;
+  segment->numa_node = _mi_arena_memid_numa_node(segment->memid);
+  if (segment->numa_node < 0) { segment->numa_node = _mi_os_numa_node(); }
+  _mi_stat_increase(&_mi_stats_main.numa_segments[mi_segment_numa_stat_index(segment->numa_node)], 1);
+  _mi_stat_increase(&_mi_stats_main.segments_abandoned, 1);
+  _mi_stat_increase(&_mi_stats_main.pages_abandoned, used);
+  _mi_segment_map_allocated_at(segment);
+  return true;
+}
+
 void _mi_abandoned_reclaim_all(mi_heap_t* heap, mi_segments_tld_t* tld) {
   mi_segment_t* segment;
   mi_arena_field_cursor_t current;
@@ -1335,43 +1665,58 @@ static mi_segment_t* mi_segment_try_reclaim(mi_heap_t* heap, size_t needed_slice
 
   mi_segment_t* result = NULL;
   mi_segment_t* segment = NULL;
-  mi_arena_field_cursor_t current;
-  _mi_arena_field_cursor_init(heap, tld->subproc, false /* non-blocking */, &current);
-  while (segment_count_is_within_target(tld,NULL) && (max_tries-- > 0) && ((segment = _mi_arena_segment_clear_abandoned_next(&current)) != NULL))
-  {
-    mi_assert(segment->subproc == heap->tld->segments.subproc); // cursor only visits segments in our sub-process
-    segment->abandoned_visits++;
-    // todo: should we respect numa affinity for abandoned reclaim? perhaps only for the first visit?
-    // todo: an arena exclusive heap will potentially visit many abandoned unsuitable segments and use many tries
-    // Perhaps we can skip non-suitable ones in a better way?
-    bool is_suitable = _mi_heap_memid_is_suitable(heap, segment->memid);
-    bool has_page = mi_segment_check_free(segment,needed_slices,block_size,tld); // try to free up pages (due to concurrent frees)
-    if (segment->used == 0) {
-      // free the segment (by forced reclaim) to make it available to other threads.
-      // note1: we prefer to free a segment as that might lead to reclaiming another
-      // segment that is still partially used.
-      // note2: we could in principle optimize this by skipping reclaim and directly
-      // freeing but that would violate some invariants temporarily)
-      mi_segment_reclaim(segment, heap, 0, NULL, tld);
+  bool found = false;
+  const int numa_node = (_mi_os_numa_node_count() > 1 ? _mi_os_numa_node() : -1);
+  // In the first pass we only visit segments whose free space summary shows they can satisfy the request.
+  // This way we find a fitting segment directly (instead of using up our tries on unsuitable ones), and if
+  // there is none we fall back to the regular visit which also frees empty segments and forces reclaims.
+  for (int pass = 0; pass < 2 && !found && max_tries > 0; pass++) {
+    mi_arena_field_cursor_t current;
+    _mi_arena_field_cursor_init(heap, tld->subproc, false /* non-blocking */, &current);
+    if (pass == 0) {
+      current.fit_slices = needed_slices;
+      current.fit_bins = (block_size == 0 ? 0 : mi_abandoned_fit_bin(_mi_bin(block_size)));
     }
-    else if (has_page && is_suitable) {
-      // found a large enough free span, or a page of the right block_size with free space
-      // we return the result of reclaim (which is usually `segment`) as it might free
-      // the segment due to concurrent frees (in which case `NULL` is returned).
-      result = mi_segment_reclaim(segment, heap, block_size, reclaimed, tld);
-      break;
-    }
-    else if (segment->abandoned_visits > 3 && is_suitable) {
-      // always reclaim on 3rd visit to limit the abandoned segment count.
-      mi_segment_reclaim(segment, heap, 0, NULL, tld);
-    }
-    else {
-      // otherwise, push on the visited list so it gets not looked at too quickly again
-      mi_segment_try_purge(segment, false /* true force? */); // force purge if needed as we may not visit soon again
-      _mi_arena_segment_mark_abandoned(segment);
+    while (segment_count_is_within_target(tld,NULL) && (max_tries-- > 0) && ((segment = _mi_arena_segment_clear_abandoned_next(&current)) != NULL))
+    {
+      mi_assert(segment->subproc == heap->tld->segments.subproc); // cursor only visits segments in our sub-process
+      segment->abandoned_visits++;
+      // todo: an arena exclusive heap will potentially visit many abandoned unsuitable segments and use many tries
+      // Perhaps we can skip non-suitable ones in a better way?
+      bool is_suitable = _mi_heap_memid_is_suitable(heap, segment->memid);
+      // prefer numa local segments: a segment on another numa node is only reclaimed from its second visit onward
+      if (numa_node >= 0 && segment->numa_node != numa_node && segment->abandoned_visits <= 1) {
+        is_suitable = false;
+      }
+      bool has_page = mi_segment_check_free(segment,needed_slices,block_size,tld); // try to free up pages (due to concurrent frees)
+      if (segment->used == 0) {
+        // free the segment (by forced reclaim) to make it available to other threads.
+        // note1: we prefer to free a segment as that might lead to reclaiming another
+        // segment that is still partially used.
+        // note2: we could in principle optimize this by skipping reclaim and directly
+        // freeing but that would violate some invariants temporarily)
+        mi_segment_reclaim(segment, heap, 0, NULL, tld);
+      }
+      else if (has_page && is_suitable) {
+        // found a large enough free span, or a page of the right block_size with free space
+        // we return the result of reclaim (which is usually `segment`) as it might free
+        // the segment due to concurrent frees (in which case `NULL` is returned).
+        result = mi_segment_reclaim(segment, heap, block_size, reclaimed, tld);
+        found = true;
+        break;
+      }
+      else if (segment->abandoned_visits > 3 && is_suitable) {
+        // always reclaim on 3rd visit to limit the abandoned segment count.
+        mi_segment_reclaim(segment, heap, 0, NULL, tld);
+      }
+      else {
+        // otherwise, push on the visited list so it gets not looked at too quickly again
+        mi_segment_try_purge(segment, false /* true force? */); // force purge if needed as we may not visit soon again
+        _mi_arena_segment_mark_abandoned(segment);
+      }
     }
+    _mi_arena_field_cursor_done(&current);
   }
-  _mi_arena_field_cursor_done(&current);
   return result;
 }
 
@@ -1399,6 +1744,20 @@ void _mi_abandoned_collect(mi_heap_t* heap, bool force, mi_segments_tld_t* tld)
   _mi_arena_field_cursor_done(&current);
 }
 
+// purge the expired parts of abandoned segments (used by the background purger),
+// or all parts that are scheduled for purging if `force` is set (see `mi_collect_target`)
+void _mi_abandoned_purge(mi_subproc_t* subproc, bool force)
+{
+  mi_segment_t* segment;
+  mi_arena_field_cursor_t current; _mi_arena_field_cursor_init(NULL, subproc, false /* non-blocking */, &current);
+  long max_tries = (long)mi_atomic_load_relaxed(&subproc->abandoned_count);
+  while ((max_tries-- > 0) && ((segment = _mi_arena_segment_clear_abandoned_next(&current)) != NULL)) {
+    mi_segment_try_purge(segment, force);
+    _mi_arena_segment_mark_abandoned(segment);
+  }
+  _mi_arena_field_cursor_done(&current);
+}
+
 /* -----------------------------------------------------------
    Force abandon a segment that is in use by our thread
 ----------------------------------------------------------- */
@@ -1496,6 +1855,74 @@ void mi_collect_reduce(size_t target_size) mi_attr_noexcept {
   mi_segments_try_abandon_to_target(heap, target, tld);
 }
 
+
+/* -----------------------------------------------------------
+   Reduce the committed memory of the process to a target size.
+   We purge the cheapest memory first: the parts of arenas and of
+   abandoned segments that are already scheduled for purging, then
+   the free pages and spans of the segments of the calling thread.
+   As only the owning thread can purge its segments, other threads
+   are asked to do the same on their next (slow path) allocation.
+----------------------------------------------------------- */
+
+static _Atomic(size_t) mi_purge_request_epoch; // = 0, incremented to ask all threads to purge their segments
+
+static size_t mi_committed_current(void) {
+  const int64_t committed = _mi_stats_main.committed.current;
+  return (committed <= 0 ? 0 : (size_t)committed);
+}
+
+static bool mi_committed_within(size_t target) {
+  return (mi_committed_current() <= target);
+}
+
+// purge all the free spans in the segments of this thread (and not only the ones that were scheduled)
+static void mi_segments_purge_free_spans(mi_segments_tld_t* tld) {
+  for (mi_span_queue_t* sq = &tld->spans[0]; sq <= &tld->spans[MI_SEGMENT_BIN_MAX]; sq++) {
+    for (mi_slice_t* slice = sq->first; slice != NULL; slice = slice->next) {
+      mi_segment_t* const segment = _mi_ptr_segment(slice);
+      if (mi_commit_mask_is_empty(&segment->commit_mask)) continue;
+      mi_segment_purge(segment, mi_slice_start(slice), slice->slice_count * MI_SEGMENT_SLICE_SIZE);
+    }
+  }
+}
+
+// purge as much as possible of the memory owned by this thread
+static void mi_segments_purge_owned(mi_heap_t* heap) {
+  mi_heap_collect(heap, true /* force */);  // free empty pages and purge what was scheduled
+  mi_segments_purge_free_spans(&heap->tld->segments);
+  _mi_arenas_collect(true /* force purge */);  // as segments may have been freed
+}
+
+// Called on the allocation slow path: handle a pending purge request (from `mi_collect_target`)
+void _mi_segments_purge_requested(mi_heap_t* heap) {
+  const size_t epoch = mi_atomic_load_relaxed(&mi_purge_request_epoch);
+  mi_segments_tld_t* const tld = &heap->tld->segments;
+  if mi_likely(tld->purge_epoch == epoch) return;
+  tld->purge_epoch = epoch;
+  mi_segments_purge_owned(heap);
+}
+
+size_t mi_collect_target(size_t target_committed) mi_attr_noexcept {
+  mi_heap_t* const heap = mi_heap_get_default();
+  // 1. scheduled purges in arenas and abandoned segments
+  if (!mi_committed_within(target_committed)) {
+    _mi_arenas_collect(true /* force purge */);
+  }
+  if (!mi_committed_within(target_committed)) {
+    _mi_abandoned_purge(heap->tld->segments.subproc, true /* force */);
+  }
+  // 2. memory owned by this thread
+  if (!mi_committed_within(target_committed)) {
+    mi_segments_purge_owned(heap);
+  }
+  // 3. and ask the other threads
+  if (!mi_committed_within(target_committed)) {
+    heap->tld->segments.purge_epoch = mi_atomic_increment_acq_rel(&mi_purge_request_epoch) + 1;
+  }
+  return mi_committed_current();
+}
+
 /* -----------------------------------------------------------
    Reclaim or allocate
 ----------------------------------------------------------- */
@@ -1520,7 +1947,7 @@ static mi_segment_t* mi_segment_reclaim_or_alloc(mi_heap_t* heap, size_t needed_
     return segment;
   }
   // 2. otherwise allocate a fresh segment
-  return mi_segment_alloc(0, 0, heap->arena_id, tld, NULL);
+  return mi_segment_alloc(0, 0, heap->arena_id, heap->tag, tld, NULL);
 }
 
 
@@ -1560,10 +1987,10 @@ static mi_page_t* mi_segments_page_alloc(mi_heap_t* heap, mi_page_kind_t page_ki
    Huge page allocation
 ----------------------------------------------------------- */
 
-static mi_page_t* mi_segment_huge_page_alloc(size_t size, size_t page_alignment, mi_arena_id_t req_arena_id, mi_segments_tld_t* tld)
+static mi_page_t* mi_segment_huge_page_alloc(size_t size, size_t page_alignment, mi_arena_id_t req_arena_id, uint8_t heap_tag, mi_segments_tld_t* tld)
 {
   mi_page_t* page = NULL;
-  mi_segment_t* segment = mi_segment_alloc(size,page_alignment,req_arena_id,tld,&page);
+  mi_segment_t* segment = mi_segment_alloc(size,page_alignment,req_arena_id,heap_tag,tld,&page);
   if (segment == NULL || page==NULL) return NULL;
   mi_assert_internal(segment->used==1);
   mi_assert_internal(mi_page_block_size(page) >= size);
@@ -1638,18 +2065,129 @@ void _mi_segment_huge_page_reset(mi_segment_t* segment, mi_page_t* page, mi_bloc
 }
 #endif
 
+// Zero a block in a large or huge page by decommitting and recommitting its memory instead of writing it
+// (see `mi_option_calloc_decommit_min`). Returns `false` if the block was not zeroed.
+bool _mi_segment_page_zero_decommit(mi_page_t* page, void* p, size_t size) {
+  mi_segment_t* const segment = _mi_page_segment(page);
+  if (!segment->allow_decommit || !segment->os_backed) return false;
+  return _mi_os_zero_decommit(p, size);
+}
+
+/* -----------------------------------------------------------
+   Grow the block of a large or huge page in place (used by `mi_realloc`).
+   These pages contain a single block and are owned by the current thread.
+----------------------------------------------------------- */
+
+// Try to grow a large page to `block_size` by extending it into the free span that directly follows it.
+bool _mi_segment_large_page_try_extend(mi_page_t* page, size_t block_size, mi_segments_tld_t* tld) {
+  mi_segment_t* const segment = _mi_page_segment(page);
+  mi_assert_internal(segment->kind == MI_SEGMENT_NORMAL);
+  mi_assert_internal(mi_atomic_load_relaxed(&segment->thread_id) == _mi_thread_id());
+  mi_assert_internal(page->reserved == 1 && block_size > mi_page_block_size(page) && block_size <= MI_LARGE_OBJ_SIZE_MAX);
+  mi_slice_t* const slice = mi_page_to_slice(page);
+  mi_assert_internal(_mi_segment_page_start(segment, page, NULL) == mi_slice_start(slice)); // large pages have no start offset
+  const size_t slices_needed = _mi_divide_up(block_size, MI_SEGMENT_SLICE_SIZE);
+  if (slices_needed > slice->slice_count) {
+    // is the next span free and large enough?
+    mi_slice_t* const next = slice + slice->slice_count;
+    const size_t extra = slices_needed - slice->slice_count;
+    if (next >= mi_segment_slices_end(segment) || next->block_size != 0 || next->slice_count < extra) return false;
+    mi_assert_internal(next->slice_offset == 0);
+
+    // claim it and commit the part we need
+    const size_t next_index = mi_slice_index(next);
+    const size_t next_count = next->slice_count;
+    mi_segment_span_remove_from_queue(next, tld);
+    if (!mi_segment_ensure_committed(segment, mi_slice_start(next), extra * MI_SEGMENT_SLICE_SIZE)) {
+      mi_segment_span_free(segment, next_index, next_count, false /* don't purge */, tld);
+      return false;
+    }
+    // claim the zero bits only after the commit (which may set them for newly committed chunks)
+    mi_segment_zero_claim(segment, mi_slice_start(next), extra * MI_SEGMENT_SLICE_SIZE);
+    if (next_count > extra) {
+      mi_segment_span_free(segment, next_index + extra, next_count - extra, false /* don't purge left-over part */, tld);
+    }
+    slice->slice_count = (uint32_t)slices_needed;
+    mi_segment_span_set_back_offsets(segment, slice, mi_slice_index(slice), slices_needed);
+  }
+  _mi_stat_increase(&tld->stats->page_committed, block_size - mi_page_block_size(page));
+  page->block_size = block_size;
+  mi_assert_expensive(mi_segment_is_valid(segment, tld));
+  return true;
+}
+
+#if !MI_HUGE_PAGE_ABANDON
+// Try to grow a huge page to hold `required` bytes by remapping the OS memory of its segment (using `mremap` on Linux).
+// This never copies the contents but the segment may move in which case the new page is returned.
+// The page must have been removed from its page queue. Returns NULL on failure (and leaves the page as is).
+mi_page_t* _mi_segment_huge_page_try_remap(mi_page_t* page, size_t required, mi_segments_tld_t* tld) {
+  mi_segment_t* const segment = _mi_page_segment(page);
+  mi_assert_internal(segment->kind == MI_SEGMENT_HUGE && segment->used == 1);
+  mi_assert_internal(mi_atomic_load_relaxed(&segment->thread_id) == _mi_thread_id());
+  if (MI_SECURE > 0 || mi_page_has_aligned(page)) return NULL;  // guard pages at the end, or a large alignment offset
+  if (segment->memid.memkind != MI_MEM_OS) return NULL;         // can only remap memory allocated directly from the OS
+  size_t info_slices;
+  const size_t segment_slices = mi_segment_calculate_slices(required, &info_slices);
+  if (info_slices != segment->segment_info_slices || segment_slices <= segment->segment_slices) return NULL;
+  const size_t segment_size = segment_slices * MI_SEGMENT_SLICE_SIZE;
+  const size_t old_size = mi_segment_size(segment);
+
+  // remap; the segment map only contains the segment start, so unregister first in case the segment moves
+  mi_memid_t memid = segment->memid;
+  _mi_segment_map_freed_at(segment);
+  mi_segment_t* const newseg = (mi_segment_t*)_mi_os_remap(segment, old_size, segment_size, MI_SEGMENT_ALIGN, &memid);
+  if (newseg == NULL) {
+    _mi_segment_map_allocated_at(segment);
+    return NULL;
+  }
+  mi_assert_internal((uintptr_t)newseg % MI_SEGMENT_ALIGN == 0);
+
+  // update the segment and its page (which are at the same offset from the segment start)
+  mi_page_t* const newpage = (mi_page_t*)((uint8_t*)newseg + ((uint8_t*)page - (uint8_t*)segment));
+  newseg->memid = memid;
+  newseg->cookie = _mi_ptr_cookie(newseg);
+  newseg->segment_size = segment_size;
+  newseg->segment_slices = segment_slices;
+  newseg->slice_entries = (segment_slices > MI_SLICES_PER_SEGMENT ? MI_SLICES_PER_SEGMENT : segment_slices);
+  mi_slice_t* const slice = mi_page_to_slice(newpage);
+  slice->slice_count = (uint32_t)(segment_slices - info_slices);
+  mi_segment_span_set_back_offsets(newseg, slice, info_slices, slice->slice_count);
+  _mi_segment_map_allocated_at(newseg);
+
+  const size_t old_bsize = mi_page_block_size(newpage);
+  size_t psize;
+  newpage->page_start = _mi_segment_page_start(newseg, newpage, &psize);
+  newpage->block_size = psize;
+  mi_assert_internal(psize >= required && psize > old_bsize);
+  _mi_stat_increase(&tld->stats->page_committed, psize - old_bsize);
+  tld->current_size += (segment_size - old_size);
+  if (tld->current_size > tld->peak_size) tld->peak_size = tld->current_size;
+  mi_assert_expensive(mi_segment_is_valid(newseg, tld));
+  return newpage;
+}
+#endif
+
 /* -----------------------------------------------------------
    Page allocation and free
 ----------------------------------------------------------- */
+// Use a medium page for small blocks? (if the heap tag policy prefers it, and the block count fits in the page fields)
+static bool mi_segment_use_medium_page(const mi_heap_t* heap, size_t block_size) {
+  return (heap->page_kind == mi_heap_tag_page_medium && block_size > MI_MEDIUM_PAGE_SIZE / UINT16_MAX);
+}
+
 mi_page_t* _mi_segment_page_alloc(mi_heap_t* heap, size_t block_size, size_t page_alignment, mi_segments_tld_t* tld) {
   mi_page_t* page;
   if mi_unlikely(page_alignment > MI_BLOCK_ALIGNMENT_MAX) {
     mi_assert_internal(_mi_is_power_of_two(page_alignment));
     mi_assert_internal(page_alignment >= MI_SEGMENT_SIZE);
     if (page_alignment < MI_SEGMENT_SIZE) { page_alignment = MI_SEGMENT_SIZE; }
-    page = mi_segment_huge_page_alloc(block_size,page_alignment,heap->arena_id,tld);
+    page = mi_segment_huge_page_alloc(block_size,page_alignment,heap->arena_id,heap->tag,tld);
   }
-  else if (block_size <= MI_SMALL_OBJ_SIZE_MAX) {
+  else if (block_size <= MI_SMALL_OBJ_SIZE_MAX && !mi_segment_use_medium_page(heap, block_size)) {
+    page = mi_segments_page_alloc(heap,MI_PAGE_SMALL,block_size,block_size,tld);
+  }
+  else if (block_size <= MI_MEDIUM_OBJ_SIZE_MAX && heap->page_kind == mi_heap_tag_page_small) {
+    // use the smallest page that fits the block (see `mi_heap_tag_set_policy`)
     page = mi_segments_page_alloc(heap,MI_PAGE_SMALL,block_size,block_size,tld);
   }
   else if (block_size <= MI_MEDIUM_OBJ_SIZE_MAX) {
@@ -1659,7 +2197,7 @@ mi_page_t* _mi_segment_page_alloc(mi_heap_t* heap, size_t block_size, size_t pag
     page = mi_segments_page_alloc(heap,MI_PAGE_LARGE,block_size,block_size,tld);
   }
   else {
-    page = mi_segment_huge_page_alloc(block_size,page_alignment,heap->arena_id,tld);
+    page = mi_segment_huge_page_alloc(block_size,page_alignment,heap->arena_id,heap->tag,tld);
   }
   mi_assert_internal(page == NULL || _mi_heap_memid_is_suitable(heap, _mi_page_segment(page)->memid));
   mi_assert_expensive(page == NULL || mi_segment_is_valid(_mi_page_segment(page),tld));
@@ -1698,3 +2236,87 @@ bool _mi_segment_visit_blocks(mi_segment_t* segment, int heap_tag, bool visit_bl
   }
   return true;
 }
+
+
+/* -----------------------------------------------------------
+   Fragmentation report of the segments owned by this thread
+----------------------------------------------------------- */
+
+static void mi_segment_frag(mi_segment_t* segment, mi_frag_segment_t* fs) {
+  _mi_memzero(fs, sizeof(*fs));
+  fs->segment   = segment;
+  fs->size      = mi_segment_size(segment);
+  fs->committed = _mi_commit_mask_committed_size(&segment->commit_mask, fs->size);
+  const mi_slice_t* end;
+  mi_slice_t* slice = mi_slices_start_iterate(segment, &end);
+  while (slice < end) {
+    if (mi_slice_is_used(slice)) {
+      fs->page_slices += slice->slice_count;
+    }
+    else {
+      fs->free_spans++;
+      fs->free_slices += slice->slice_count;
+      if (slice->slice_count > fs->free_largest) { fs->free_largest = slice->slice_count; }
+      if (segment->kind != MI_SEGMENT_HUGE) {  // huge segments are always fully committed
+        uint8_t* start = NULL;
+        size_t full_size = 0;
+        mi_commit_mask_t mask;
+        mi_commit_mask_t cmask;
+        mi_segment_commit_mask(segment, false /* conservative? */, mi_slice_start(slice), slice->slice_count * MI_SEGMENT_SLICE_SIZE, &start, &full_size, &mask);
+        mi_commit_mask_create_intersect(&segment->commit_mask, &mask, &cmask);
+        fs->free_committed += _mi_commit_mask_committed_size(&cmask, MI_SEGMENT_SIZE);
+      }
+    }
+    slice = slice + slice->slice_count;
+  }
+}
+
+static bool mi_segments_contains(mi_segment_t** segments, size_t count, mi_segment_t* segment) {
+  for (size_t i = 0; i < count; i++) {
+    if (segments[i] == segment) return true;
+  }
+  return false;
+}
+
+// Report every segment of this thread: these are the segments that contain a page of one of
+// the heaps of the thread, or a free span in the span queues.
+size_t mi_thread_frag_segments(mi_frag_segment_t* segments, size_t max_count) mi_attr_noexcept {
+  mi_heap_t* const heap = mi_prim_get_default_heap();
+  if (!mi_heap_is_initialized(heap)) return 0;
+  mi_tld_t* const tld = heap->tld;
+  // upper bound on the number of segments
+  size_t max_segments = 0;
+  for (mi_span_queue_t* sq = &tld->segments.spans[0]; sq <= &tld->segments.spans[MI_SEGMENT_BIN_MAX]; sq++) {
+    for (mi_slice_t* slice = sq->first; slice != NULL; slice = slice->next) { max_segments++; }
+  }
+  for (mi_heap_t* h = tld->heaps; h != NULL; h = h->next) { max_segments += h->page_count; }
+  if (max_segments == 0) return 0;
+  // collect the unique segments
+  mi_memid_t memid;
+  const size_t fsize = max_segments * sizeof(mi_segment_t*);
+  mi_segment_t** const found = (mi_segment_t**)_mi_os_alloc(fsize, &memid);
+  if (found == NULL) return 0;
+  size_t count = 0;
+  for (mi_span_queue_t* sq = &tld->segments.spans[0]; sq <= &tld->segments.spans[MI_SEGMENT_BIN_MAX]; sq++) {
+    for (mi_slice_t* slice = sq->first; slice != NULL; slice = slice->next) {
+      mi_segment_t* const segment = _mi_ptr_segment(slice);
+      if (!mi_segments_contains(found, count, segment)) { found[count++] = segment; }
+    }
+  }
+  for (mi_heap_t* h = tld->heaps; h != NULL; h = h->next) {
+    for (size_t i = 0; i <= MI_BIN_FULL; i++) {
+      for (mi_page_t* page = h->pages[i].first; page != NULL; page = page->next) {
+        mi_segment_t* const segment = _mi_page_segment(page);
+        if (!mi_segments_contains(found, count, segment)) { found[count++] = segment; }
+      }
+    }
+  }
+  // and report them
+  if (segments != NULL) {
+    for (size_t i = 0; i < count && i < max_count; i++) {
+      mi_segment_frag(found[i], &segments[i]);
+    }
+  }
+  _mi_os_free(found, fsize, memid);
+  return count;
+}
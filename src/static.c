@@ -35,6 +35,7 @@ terms of the MIT license. A copy of the license can be found in the file
 #include "segment.c"
 #include "segment-map.c"
 #include "stats.c"
+#include "trace.c"
 #include "prim/prim.c"
 #if MI_OSX_ZONE
 #include "prim/osx/alloc-override-zone.c"
@@ -83,6 +83,12 @@ void _mi_stat_counter_increase(mi_stat_counter_t* stat, size_t amount) {
   }
 }
 
+void _mi_stat_sample_alloc(mi_stats_t* stats, size_t bin, size_t size, int64_t latency_ns) {
+  mi_assert_internal(bin <= MI_BIN_HUGE);
+  _mi_stat_counter_increase(&stats->sample_bins[bin], size);
+  _mi_stat_counter_increase(&stats->sample_bins_latency[bin], (size_t)(latency_ns < 0 ? 0 : latency_ns));
+}
+
 void _mi_stat_increase(mi_stat_count_t* stat, size_t amount) {
   mi_stat_update(stat, (int64_t)amount);
 }
@@ -142,6 +148,8 @@ static void mi_stats_add(mi_stats_t* stats, const mi_stats_t* src) {
   mi_stat_counter_add(&stats->commit_calls, &src->commit_calls, 1);
   mi_stat_counter_add(&stats->reset_calls, &src->reset_calls, 1);
   mi_stat_counter_add(&stats->purge_calls, &src->purge_calls, 1);
+  mi_stat_counter_add(&stats->purge_ranges, &src->purge_ranges, 1);
+  mi_stat_counter_add(&stats->zero_decommit, &src->zero_decommit, 1);
 
   mi_stat_counter_add(&stats->page_no_retire, &src->page_no_retire, 1);
   mi_stat_counter_add(&stats->searches, &src->searches, 1);
@@ -149,6 +157,17 @@ static void mi_stats_add(mi_stats_t* stats, const mi_stats_t* src) {
   mi_stat_counter_add(&stats->huge_count, &src->huge_count, 1);
   mi_stat_counter_add(&stats->large_count, &src->large_count, 1);
   mi_stat_counter_add(&stats->guarded_alloc_count, &src->guarded_alloc_count, 1);
+  for (size_t i = 0; i <= MI_BIN_HUGE; i++) {
+    if (src->sample_bins[i].count > 0) {
+      mi_stat_counter_add(&stats->sample_bins[i], &src->sample_bins[i], 1);
+      mi_stat_counter_add(&stats->sample_bins_latency[i], &src->sample_bins_latency[i], 1);
+    }
+  }
+  for (size_t i = 0; i < MI_TAG_STATS_MAX; i++) {
+    if (src->tag_normal[i].allocated > 0 || src->tag_normal[i].freed > 0) {
+      mi_stat_add(&stats->tag_normal[i], &src->tag_normal[i], 1);
+    }
+  }
 #if MI_STAT>1
   for (size_t i = 0; i <= MI_BIN_HUGE; i++) {
     if (src->normal_bins[i].allocated > 0 || src->normal_bins[i].freed > 0) {
@@ -294,6 +313,29 @@ static void mi_stats_print_bins(const mi_stat_count_t* bins, size_t max, const c
 #endif
 
 
+static void mi_stats_print_samples(const mi_stats_t* stats, mi_output_fun* out, void* arg) {
+  bool found = false;
+  for (size_t i = 0; i <= MI_BIN_HUGE; i++) {
+    const int64_t count = stats->sample_bins[i].count;
+    if (count <= 0) continue;
+    if (!found) {
+      found = true;
+      _mi_fprintf(out, arg, "%10s: %11s %11s %11s %11s\n", "sampled", "block   ", "count   ", "avg size   ", "avg ns   ");
+    }
+    char buf[64];
+    _mi_snprintf(buf, 64, "%s %3lu", "bin", (long)i);
+    _mi_fprintf(out, arg, "%10s:", buf);
+    if (i < MI_BIN_HUGE) { mi_printf_amount((int64_t)_mi_bin_size((uint8_t)i), 1, out, arg, NULL); }
+                    else { _mi_fprintf(out, arg, "%12s", "huge"); }
+    mi_printf_amount(count, 0, out, arg, NULL);
+    mi_printf_amount(stats->sample_bins[i].total / count, 1, out, arg, NULL);
+    mi_printf_amount(stats->sample_bins_latency[i].total / count, 0, out, arg, NULL);
+    _mi_fprintf(out, arg, "\n");
+  }
+  if (found) {
+    _mi_fprintf(out, arg, "\n");
+  }
+}
 
 //------------------------------------------------------------
 // Use an output wrapper for line-buffered output
@@ -375,10 +417,35 @@ static void _mi_stats_print(mi_stats_t* stats, mi_output_fun* out0, void* arg0)
   mi_stat_counter_print(&stats->commit_calls, "commits", out, arg);
   mi_stat_counter_print(&stats->reset_calls, "resets", out, arg);
   mi_stat_counter_print(&stats->purge_calls, "purges", out, arg);
+  mi_stat_counter_print(&stats->purge_ranges, "-ranges", out, arg);
+  mi_stat_counter_print(&stats->purge_reused, "-reused", out, arg);
+  mi_stat_counter_print(&stats->zero_decommit, "zeroed", out, arg);
   mi_stat_counter_print(&stats->guarded_alloc_count, "guarded", out, arg);
   mi_stat_print(&stats->threads, "threads", -1, out, arg);
   mi_stat_counter_print_avg(&stats->searches, "searches", out, arg);
+  mi_stats_print_samples(stats, out, arg);
+  bool under_pressure;
+  size_t pressure_episodes, pressure_msecs, pressure_collects;
+  if (mi_memory_pressure_stats(&under_pressure, &pressure_episodes, &pressure_msecs, &pressure_collects) || pressure_collects > 0) {
+    _mi_fprintf(out, arg, "%10s: %s, episodes: %zu, duration: %zu.%03zu s, collects: %zu\n", "pressure", (under_pressure ? "active" : "none"),
+                pressure_episodes, pressure_msecs/1000, pressure_msecs%1000, pressure_collects);
+  }
   _mi_fprintf(out, arg, "%10s: %5zu\n", "numa nodes", _mi_os_numa_node_count());
+  if (_mi_os_numa_node_count() > 1) {
+    for (size_t i = 0; i < MI_NUMA_STATS_MAX && i < _mi_os_numa_node_count(); i++) {
+      const mi_stat_count_t* segs = &_mi_stats_main.numa_segments[i];
+      _mi_fprintf(out, arg, "%10s %zu: segments: %lld (peak %lld), reclaimed: %lld (remote %lld)\n", "-node", i,
+                  (long long)segs->current, (long long)segs->peak,
+                  (long long)_mi_stats_main.numa_reclaim[i].count, (long long)_mi_stats_main.numa_reclaim_remote[i].count);
+    }
+  }
+  for (size_t i = 0; i < MI_TAG_STATS_MAX; i++) {
+    const mi_stat_count_t* pages = &_mi_stats_main.tag_pages[i];
+    if (i == 0 || pages->peak == 0) continue;  // only show custom tags that were used
+    _mi_fprintf(out, arg, "%10s %zu: pages: %lld (peak %lld), in use: %lld (peak %lld)\n", "-tag", i,
+                (long long)pages->current, (long long)pages->peak,
+                (long long)stats->tag_normal[i].current, (long long)stats->tag_normal[i].peak);
+  }
 
   size_t elapsed;
   size_t user_time;
@@ -472,6 +539,35 @@ mi_msecs_t _mi_clock_end(mi_msecs_t start) {
 // Basic process statistics
 // --------------------------------------------------------
 
+// Segment statistics for a numa node (these are process wide)
+mi_decl_export void mi_numa_node_stats(int numa_node, size_t* current_segments, size_t* peak_segments, size_t* reclaimed, size_t* reclaimed_remote) mi_attr_noexcept
+{
+  const size_t i = (numa_node <= 0 ? 0 : (size_t)numa_node % MI_NUMA_STATS_MAX);
+  const int64_t current = mi_atomic_loadi64_relaxed((_Atomic(int64_t)*)&_mi_stats_main.numa_segments[i].current);
+  const int64_t peak    = mi_atomic_loadi64_relaxed((_Atomic(int64_t)*)&_mi_stats_main.numa_segments[i].peak);
+  const int64_t count   = mi_atomic_loadi64_relaxed((_Atomic(int64_t)*)&_mi_stats_main.numa_reclaim[i].count);
+  const int64_t remote  = mi_atomic_loadi64_relaxed((_Atomic(int64_t)*)&_mi_stats_main.numa_reclaim_remote[i].count);
+  if (current_segments!=NULL) *current_segments = (current < 0 ? 0 : (size_t)current);
+  if (peak_segments!=NULL)    *peak_segments    = (peak < 0 ? 0 : (size_t)peak);
+  if (reclaimed!=NULL)        *reclaimed        = (count < 0 ? 0 : (size_t)count);
+  if (reclaimed_remote!=NULL) *reclaimed_remote = (remote < 0 ? 0 : (size_t)remote);
+}
+
+// Page and block statistics for a heap tag (the block statistics are only available
+// with `MI_STAT>0` and are per thread until merged into the main statistics)
+mi_decl_export void mi_heap_tag_stats(int heap_tag, size_t* current_pages, size_t* peak_pages, size_t* current_normal, size_t* peak_normal) mi_attr_noexcept
+{
+  const size_t i = (heap_tag <= 0 ? 0 : (size_t)heap_tag % MI_TAG_STATS_MAX);
+  const int64_t pages      = mi_atomic_loadi64_relaxed((_Atomic(int64_t)*)&_mi_stats_main.tag_pages[i].current);
+  const int64_t pages_peak = mi_atomic_loadi64_relaxed((_Atomic(int64_t)*)&_mi_stats_main.tag_pages[i].peak);
+  const int64_t normal     = mi_atomic_loadi64_relaxed((_Atomic(int64_t)*)&_mi_stats_main.tag_normal[i].current);
+  const int64_t normal_peak= mi_atomic_loadi64_relaxed((_Atomic(int64_t)*)&_mi_stats_main.tag_normal[i].peak);
+  if (current_pages!=NULL)  *current_pages  = (pages < 0 ? 0 : (size_t)pages);
+  if (peak_pages!=NULL)     *peak_pages     = (pages_peak < 0 ? 0 : (size_t)pages_peak);
+  if (current_normal!=NULL) *current_normal = (normal < 0 ? 0 : (size_t)normal);
+  if (peak_normal!=NULL)    *peak_normal    = (normal_peak < 0 ? 0 : (size_t)normal_peak);
+}
+
 mi_decl_export void mi_process_info(size_t* elapsed_msecs, size_t* user_msecs, size_t* system_msecs, size_t* current_rss, size_t* peak_rss, size_t* current_commit, size_t* peak_commit, size_t* page_faults) mi_attr_noexcept
 {
   mi_process_info_t pinfo;
@@ -496,3 +592,139 @@ mi_decl_export void mi_process_info(size_t* elapsed_msecs, size_t* user_msecs, s
   if (peak_commit!=NULL)    *peak_commit    = pinfo.peak_commit;
   if (page_faults!=NULL)    *page_faults    = pinfo.page_faults;
 }
+
+
+// --------------------------------------------------------
+// Machine readable statistics in JSON format
+// --------------------------------------------------------
+
+// Append-only writer into a (possibly too small) buffer that keeps track of the needed length
+typedef struct mi_json_out_s {
+  char*  buf;
+  size_t size;
+  size_t len;   // length needed so far (can be larger than `size`)
+} mi_json_out_t;
+
+static void mi_json_printf(mi_json_out_t* js, const char* fmt, ...) {
+  char tmp[128];
+  va_list args;
+  va_start(args, fmt);
+  _mi_vsnprintf(tmp, sizeof(tmp), fmt, args);
+  va_end(args);
+  for (const char* s = tmp; *s != 0; s++, js->len++) {
+    if (js->len + 1 < js->size) { js->buf[js->len] = *s; }
+  }
+}
+
+static void mi_json_stat_count(mi_json_out_t* js, const char* name, const mi_stat_count_t* stat) {
+  mi_json_printf(js, "\"%s\": { \"allocated\": %lld, \"freed\": %lld, \"peak\": %lld, \"current\": %lld },\n", name,
+                 (long long)stat->allocated, (long long)stat->freed, (long long)stat->peak, (long long)stat->current);
+}
+
+static void mi_json_stat_counter(mi_json_out_t* js, const char* name, const mi_stat_counter_t* stat) {
+  mi_json_printf(js, "\"%s\": { \"total\": %lld, \"count\": %lld },\n", name, (long long)stat->total, (long long)stat->count);
+}
+
+// Write the main statistics (and arena usage) as a JSON object into `buf`.
+// Like `snprintf`, this returns the length of the full output (excluding the terminating zero) which
+// is larger or equal to `buf_size` if the output was truncated. Does not take locks or allocate.
+// The statistics of the current thread are added to a snapshot of the main statistics (instead of
+// being merged) so calling this has no side effects.
+size_t mi_stats_get_json(char* buf, size_t buf_size) mi_attr_noexcept {
+  mi_stats_t snapshot;
+  _mi_memcpy(&snapshot, &_mi_stats_main, sizeof(mi_stats_t));
+  mi_stats_add(&snapshot, mi_stats_get_default());
+  const mi_stats_t* stats = &snapshot;
+  mi_json_out_t js = { buf, (buf == NULL ? 0 : buf_size), 0 };
+
+  size_t elapsed, user_time, sys_time, current_rss, peak_rss, current_commit, peak_commit, page_faults;
+  mi_process_info(&elapsed, &user_time, &sys_time, &current_rss, &peak_rss, &current_commit, &peak_commit, &page_faults);
+  mi_json_printf(&js, "{\n\"version\": %d,\n", mi_version());
+  mi_json_printf(&js, "\"process\": { \"elapsed_msecs\": %zu, \"user_msecs\": %zu, \"system_msecs\": %zu, ", elapsed, user_time, sys_time);
+  mi_json_printf(&js, "\"current_rss\": %zu, \"peak_rss\": %zu, ", current_rss, peak_rss);
+  mi_json_printf(&js, "\"current_commit\": %zu, \"peak_commit\": %zu, \"page_faults\": %zu },\n", current_commit, peak_commit, page_faults);
+
+  mi_json_stat_count(&js, "segments", &stats->segments);
+  mi_json_stat_count(&js, "pages", &stats->pages);
+  mi_json_stat_count(&js, "reserved", &stats->reserved);
+  mi_json_stat_count(&js, "committed", &stats->committed);
+  mi_json_stat_count(&js, "reset", &stats->reset);
+  mi_json_stat_count(&js, "purged", &stats->purged);
+  mi_json_stat_count(&js, "page_committed", &stats->page_committed);
+  mi_json_stat_count(&js, "segments_abandoned", &stats->segments_abandoned);
+  mi_json_stat_count(&js, "pages_abandoned", &stats->pages_abandoned);
+  mi_json_stat_count(&js, "threads", &stats->threads);
+  mi_json_stat_count(&js, "normal", &stats->normal);
+  mi_json_stat_count(&js, "huge", &stats->huge);
+  mi_json_stat_count(&js, "large", &stats->large);
+  mi_json_stat_count(&js, "malloc", &stats->malloc);
+  mi_json_stat_count(&js, "segments_cache", &stats->segments_cache);
+  mi_json_stat_counter(&js, "pages_extended", &stats->pages_extended);
+  mi_json_stat_counter(&js, "mmap_calls", &stats->mmap_calls);
+  mi_json_stat_counter(&js, "commit_calls", &stats->commit_calls);
+  mi_json_stat_counter(&js, "reset_calls", &stats->reset_calls);
+  mi_json_stat_counter(&js, "purge_calls", &stats->purge_calls);
+  mi_json_stat_counter(&js, "purge_ranges", &stats->purge_ranges);
+  mi_json_stat_counter(&js, "purge_reused", &stats->purge_reused);
+  mi_json_stat_counter(&js, "zero_decommit", &stats->zero_decommit);
+  mi_json_stat_counter(&js, "page_no_retire", &stats->page_no_retire);
+  mi_json_stat_counter(&js, "searches", &stats->searches);
+  mi_json_stat_counter(&js, "normal_count", &stats->normal_count);
+  mi_json_stat_counter(&js, "huge_count", &stats->huge_count);
+  mi_json_stat_counter(&js, "large_count", &stats->large_count);
+  mi_json_stat_counter(&js, "arena_count", &stats->arena_count);
+  mi_json_stat_counter(&js, "arena_crossover_count", &stats->arena_crossover_count);
+  mi_json_stat_counter(&js, "arena_rollback_count", &stats->arena_rollback_count);
+  mi_json_stat_counter(&js, "guarded_alloc_count", &stats->guarded_alloc_count);
+
+  // memory pressure
+  bool under_pressure;
+  size_t pressure_episodes, pressure_msecs, pressure_collects;
+  const bool pressure_monitored = mi_memory_pressure_stats(&under_pressure, &pressure_episodes, &pressure_msecs, &pressure_collects);
+  mi_json_printf(&js, "\"pressure\": { \"monitored\": %s, \"active\": %s, ", (pressure_monitored ? "true" : "false"), (under_pressure ? "true" : "false"));
+  mi_json_printf(&js, "\"episodes\": %zu, \"msecs\": %zu, \"collects\": %zu },\n", pressure_episodes, pressure_msecs, pressure_collects);
+
+  // per numa node
+  mi_json_printf(&js, "\"numa\": [");
+  for (size_t i = 0; i < MI_NUMA_STATS_MAX; i++) {
+    mi_json_printf(&js, "%s{ \"segments_current\": %lld, \"segments_peak\": %lld, \"reclaim\": %lld, \"reclaim_remote\": %lld }", (i == 0 ? "" : ", "),
+                   (long long)stats->numa_segments[i].current, (long long)stats->numa_segments[i].peak,
+                   (long long)stats->numa_reclaim[i].count, (long long)stats->numa_reclaim_remote[i].count);
+  }
+  mi_json_printf(&js, "],\n");
+
+  // per heap tag
+  mi_json_printf(&js, "\"tags\": [");
+  for (size_t i = 0; i < MI_TAG_STATS_MAX; i++) {
+    mi_json_printf(&js, "%s{ \"pages\": %lld, \"pages_peak\": %lld, \"normal\": %lld, \"normal_peak\": %lld }", (i == 0 ? "" : ", "),
+                   (long long)stats->tag_pages[i].current, (long long)stats->tag_pages[i].peak,
+                   (long long)stats->tag_normal[i].current, (long long)stats->tag_normal[i].peak);
+  }
+  mi_json_printf(&js, "],\n");
+
+  // sampled allocations per size class (only bins with samples)
+  mi_json_printf(&js, "\"samples\": [");
+  bool first = true;
+  for (size_t i = 0; i <= MI_BIN_HUGE; i++) {
+    const int64_t count = stats->sample_bins[i].count;
+    if (count <= 0) continue;
+    mi_json_printf(&js, "%s{ \"bin\": %zu, \"block_size\": %zu, \"count\": %lld, \"size_total\": %lld, \"latency_ns_total\": %lld }", (first ? "" : ", "),
+                   i, (i < MI_BIN_HUGE ? _mi_bin_size((uint8_t)i) : 0), (long long)count,
+                   (long long)stats->sample_bins[i].total, (long long)stats->sample_bins_latency[i].total);
+    first = false;
+  }
+  mi_json_printf(&js, "],\n");
+
+  // per arena usage
+  mi_json_printf(&js, "\"arenas\": [");
+  mi_arena_stats_t ast;
+  for (size_t i = 0; _mi_arena_stats_at(i, &ast); i++) {
+    mi_json_printf(&js, "%s\n  { \"id\": %d, \"size\": %zu, \"inuse\": %zu, \"committed\": %zu, ", (i == 0 ? "" : ","), ast.id, ast.size, ast.inuse, ast.committed);
+    mi_json_printf(&js, "\"purge_pending\": %zu, \"abandoned\": %zu, \"numa_node\": %d, ", ast.purge_pending, ast.abandoned, ast.numa_node);
+    mi_json_printf(&js, "\"exclusive\": %s, \"is_large\": %s, \"is_pinned\": %s }", (ast.exclusive ? "true" : "false"), (ast.is_large ? "true" : "false"), (ast.is_pinned ? "true" : "false"));
+  }
+  mi_json_printf(&js, "]\n}\n");
+
+  if (js.size > 0) { js.buf[(js.len < js.size ? js.len : js.size - 1)] = 0; }
+  return js.len;
+}
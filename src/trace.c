@@ -0,0 +1,209 @@
+/* ----------------------------------------------------------------------------
+Copyright (c) 2018-2025, Microsoft Research, Daan Leijen
+This is free software; you can redistribute it and/or modify it under the
+terms of the MIT license. A copy of the license can be found in the file
+"LICENSE" at the root of this distribution.
+-----------------------------------------------------------------------------*/
+
+/* -----------------------------------------------------------
+  Allocation tracing (with `MI_TRACK_TRACE=1`)
+
+  Each thread appends compact records to its own ring buffer that
+  is flushed into a memory mapped trace file (see `mimalloc/trace.h`
+  for the format). A ring buffer has a single producer (the owning thread)
+  and is consumed by whoever holds its `flushing` flag: the owning thread
+  when the ring is full or when the thread terminates, or `mi_trace_stop`
+  for all rings. Space in the file is reserved with an atomic update of
+  the size in the file header, so flushing threads never block each other.
+
+  Tracing starts at process start if `MIMALLOC_TRACE_FILE` is set, or
+  explicitly with `mi_trace_start`.
+----------------------------------------------------------- */
+#include "mimalloc.h"
+#include "mimalloc/internal.h"
+#include "mimalloc/atomic.h"
+#include "mimalloc/prim.h"
+#include "mimalloc/trace.h"
+
+#if MI_TRACK_TRACE
+
+#define MI_TRACE_RING_SIZE    (1024)   // records per thread (32 KiB)
+
+typedef struct mi_trace_ring_s {
+  struct mi_trace_ring_s* next;        // all rings are in a list (and are reused by new threads)
+  uint32_t                thread;      // small thread id
+  _Atomic(uintptr_t)      in_use;      // owned by a thread
+  _Atomic(uintptr_t)      flushing;    // held by the consumer
+  _Atomic(size_t)         head;        // next record written by the owner
+  _Atomic(size_t)         tail;        // next record to flush
+  mi_trace_record_t       records[MI_TRACE_RING_SIZE];
+} mi_trace_ring_t;
+
+static _Atomic(mi_trace_header_t*) mi_trace_header;   // the mapped trace file, or NULL when not tracing
+static int64_t                     mi_trace_start_nsecs;
+static _Atomic(mi_trace_ring_t*)   mi_trace_rings;    // list of all rings
+static _Atomic(size_t)             mi_trace_ring_count;
+static mi_decl_thread mi_trace_ring_t* mi_trace_ring; // the ring of this thread (or NULL)
+
+
+// Flush the records in a ring to the trace file
+static void mi_trace_ring_flush(mi_trace_ring_t* ring) {
+  uintptr_t expected = 0;
+  while (!mi_atomic_cas_weak_acq_rel(&ring->flushing, &expected, 1)) {
+    expected = 0;
+    mi_atomic_yield();
+  }
+  const size_t tail = mi_atomic_load_relaxed(&ring->tail);
+  const size_t head = mi_atomic_load_acquire(&ring->head);
+  const size_t count = head - tail;
+  mi_trace_header_t* const header = mi_atomic_load_ptr_acquire(mi_trace_header_t, &mi_trace_header);
+  if (count > 0 && header != NULL) {
+    // reserve space in the file
+    _Atomic(int64_t)* const psize = (_Atomic(int64_t)*)&header->size;
+    int64_t ofs = mi_atomic_loadi64_relaxed(psize);
+    size_t n;
+    do {
+      const size_t avail = (size_t)header->capacity - (size_t)ofs;
+      n = (count <= avail / sizeof(mi_trace_record_t) ? count : avail / sizeof(mi_trace_record_t));
+    } while (n > 0 && !mi_atomic_casi64_strong_acq_rel(psize, &ofs, ofs + (int64_t)(n * sizeof(mi_trace_record_t))));
+    // and copy the records
+    mi_trace_record_t* const dest = (mi_trace_record_t*)((uint8_t*)header + sizeof(mi_trace_header_t) + ofs);
+    for (size_t i = 0; i < n; i++) {
+      dest[i] = ring->records[(tail + i) % MI_TRACE_RING_SIZE];
+    }
+    if (n < count) {
+      mi_atomic_addi64_relaxed(&header->dropped, (int64_t)(count - n));
+    }
+  }
+  mi_atomic_store_release(&ring->tail, head);
+  mi_atomic_store_release(&ring->flushing, 0);
+}
+
+// Get the ring buffer of this thread
+static mi_trace_ring_t* mi_trace_ring_get(void) {
+  mi_trace_ring_t* ring = mi_trace_ring;
+  if mi_likely(ring != NULL) return ring;
+  // reuse the ring of a terminated thread
+  for (ring = mi_atomic_load_ptr_acquire(mi_trace_ring_t, &mi_trace_rings); ring != NULL; ring = ring->next) {
+    uintptr_t expected = 0;
+    if (mi_atomic_load_relaxed(&ring->in_use) == 0 && mi_atomic_cas_strong_acq_rel(&ring->in_use, &expected, 1)) {
+      mi_trace_ring = ring;
+      return ring;
+    }
+  }
+  // or allocate a fresh one (never freed)
+  mi_memid_t memid;
+  ring = (mi_trace_ring_t*)_mi_os_alloc(sizeof(mi_trace_ring_t), &memid);
+  if (ring == NULL) return NULL;
+  if (!memid.initially_zero) { _mi_memzero_aligned(ring, sizeof(mi_trace_ring_t)); }
+  ring->thread = (uint32_t)(mi_atomic_increment_relaxed(&mi_trace_ring_count) + 1);
+  mi_atomic_store_relaxed(&ring->in_use, 1);
+  mi_trace_ring_t* next = mi_atomic_load_ptr_relaxed(mi_trace_ring_t, &mi_trace_rings);
+  do {
+    ring->next = next;
+  } while (!mi_atomic_cas_ptr_weak_release(mi_trace_ring_t, &mi_trace_rings, &next, ring));
+  mi_trace_ring = ring;
+  return ring;
+}
+
+static void mi_trace_record(mi_trace_op_t op, const void* p, size_t size) {
+  if mi_likely(mi_atomic_load_ptr_relaxed(mi_trace_header_t, &mi_trace_header) == NULL) return;
+  mi_trace_ring_t* const ring = mi_trace_ring_get();
+  if (ring == NULL) return;
+  const size_t head = mi_atomic_load_relaxed(&ring->head);
+  if (head - mi_atomic_load_acquire(&ring->tail) >= MI_TRACE_RING_SIZE) {
+    mi_trace_ring_flush(ring);  // full
+  }
+  mi_trace_record_t* const rec = &ring->records[head % MI_TRACE_RING_SIZE];
+  rec->nsecs  = (uint64_t)(_mi_prim_clock_nsecs() - mi_trace_start_nsecs);
+  rec->ptr    = (uint64_t)(uintptr_t)p;
+  rec->size   = (uint64_t)size;
+  rec->thread = ring->thread;
+  rec->op     = (uint32_t)op;
+  mi_atomic_store_release(&ring->head, head + 1);
+}
+
+void _mi_trace_malloc(const void* p, size_t size) {
+  mi_trace_record(MI_TRACE_OP_MALLOC, p, size);
+}
+
+void _mi_trace_free(const void* p) {
+  mi_trace_record(MI_TRACE_OP_FREE, p, 0);
+}
+
+// Called on thread termination: flush the ring and make it available to other threads
+void _mi_trace_thread_done(void) {
+  mi_trace_ring_t* const ring = mi_trace_ring;
+  if (ring == NULL) return;
+  mi_trace_ring = NULL;
+  mi_trace_ring_flush(ring);
+  mi_atomic_store_release(&ring->in_use, 0);
+}
+
+int mi_trace_start(const char* path, size_t max_size) mi_attr_noexcept {
+  if (path == NULL) return EINVAL;
+  if (mi_atomic_load_ptr_relaxed(mi_trace_header_t, &mi_trace_header) != NULL) return EBUSY;
+  if (max_size == 0) { max_size = mi_option_get_size(mi_option_trace_max_size); }
+  max_size = _mi_align_up(max_size, _mi_os_page_size());
+  if (max_size <= sizeof(mi_trace_header_t)) return EINVAL;
+  int fd = -1;
+  int err = _mi_prim_file_open(path, &fd);
+  if (err != 0) return err;
+  void* start = NULL;
+  err = _mi_prim_file_map(fd, max_size, NULL, _mi_os_page_size(), &start);
+  _mi_prim_file_close(fd);
+  if (err != 0) {
+    _mi_warning_message("unable to map the trace file (error %d, %s)\n", err, path);
+    return err;
+  }
+  // note: the mapping is never unmapped as other threads may still be flushing
+  mi_trace_header_t* const header = (mi_trace_header_t*)start;
+  _mi_memzero_aligned(header, sizeof(mi_trace_header_t));
+  mi_trace_start_nsecs = _mi_prim_clock_nsecs();
+  header->magic = MI_TRACE_MAGIC;
+  header->version = MI_TRACE_VERSION;
+  header->record_size = (uint32_t)sizeof(mi_trace_record_t);
+  header->capacity = (uint64_t)(max_size - sizeof(mi_trace_header_t));
+  header->start_nsecs = (uint64_t)mi_trace_start_nsecs;
+  mi_trace_header_t* expected = NULL;
+  if (!mi_atomic_cas_ptr_strong_release(mi_trace_header_t, &mi_trace_header, &expected, header)) {
+    return EBUSY;  // started concurrently
+  }
+  _mi_verbose_message("tracing allocations to %s (max %zu KiB)\n", path, max_size / MI_KiB);
+  return 0;
+}
+
+void mi_trace_stop(void) mi_attr_noexcept {
+  mi_trace_header_t* const header = mi_atomic_load_ptr_acquire(mi_trace_header_t, &mi_trace_header);
+  if (header == NULL) return;
+  // flush the rings of all threads (which may still be appending to them)
+  for (mi_trace_ring_t* ring = mi_atomic_load_ptr_acquire(mi_trace_ring_t, &mi_trace_rings); ring != NULL; ring = ring->next) {
+    mi_trace_ring_flush(ring);
+  }
+  mi_atomic_store_ptr_release(mi_trace_header_t, &mi_trace_header, NULL);
+  _mi_verbose_message("trace done: %zu records, %zu dropped\n", (size_t)header->size / sizeof(mi_trace_record_t), (size_t)header->dropped);
+}
+
+// Called at process start: start tracing if `MIMALLOC_TRACE_FILE` is set
+void _mi_trace_init(void) {
+  char path[256];
+  if (_mi_getenv("MIMALLOC_TRACE_FILE", path, sizeof(path)) && path[0] != 0) {
+    mi_trace_start(path, 0);
+  }
+}
+
+void _mi_trace_done(void) {
+  mi_trace_stop();
+}
+
+#else
+
+int mi_trace_start(const char* path, size_t max_size) mi_attr_noexcept {
+  MI_UNUSED(path); MI_UNUSED(max_size);
+  return ENOTSUP;
+}
+
+void mi_trace_stop(void) mi_attr_noexcept {
+}
+
+#endif
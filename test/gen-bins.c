@@ -0,0 +1,288 @@
+/* ----------------------------------------------------------------------------
+Copyright (c) 2018-2025 Microsoft Research, Daan Leijen
+This is free software; you can redistribute it and/or modify it under the
+terms of the MIT license.
+-----------------------------------------------------------------------------*/
+
+/* Generate a size class table from an allocation size profile (see `MI_BIN_PROFILE` in `CMakeLists.txt`).
+
+   > mimalloc-gen-bins <profile> [<output header>]
+
+   The profile is one of:
+   - a binary trace as written by a `MI_TRACK_TRACE=1` build (see `mimalloc/trace.h`),
+   - a text trace as read by `mimalloc-replay` (see `test-replay.c`),
+   - the statistics as written by `mi_stats_get_json` with `MIMALLOC_ALLOC_SAMPLE_RATE=N`;
+     as these only record the average requested size per bin this is less precise,
+   - or a text histogram with a `<size> <count>` pair per line.
+
+   The default size classes (4 per doubling) are kept and the unused bins are used
+   for extra size classes that fit the most frequently requested sizes. The classes
+   are greedily chosen to minimize the internal fragmentation of the profile.
+   Each class stays a multiple of `MI_MAX_ALIGN_SIZE` so blocks keep their alignment
+   (for example, on x64 requests of 40 bytes still need a 48 byte class).
+   The table is for the configuration this tool is compiled with (word size and padding).
+   It writes the header to stdout if no output file is given.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <mimalloc.h>
+#include <mimalloc/types.h>
+#include <mimalloc/trace.h>
+
+#define BINS_MAX        (MI_BIN_HUGE - 1)              // bins 1 up to `MI_BIN_HUGE` (exclusive)
+#define WSIZE_MAX       (MI_MEDIUM_OBJ_WSIZE_MAX)
+#define ALIGN_WSIZE     (MI_MAX_ALIGN_SIZE > MI_INTPTR_SIZE ? MI_MAX_ALIGN_SIZE / MI_INTPTR_SIZE : 1)
+#define MIN_FRACTION    (200)                          // only consider sizes with at least 1/N of the allocations
+
+static uint64_t counts[WSIZE_MAX + 1];  // allocations per needed word size
+static uint64_t total_count;
+
+
+// ---------------------------------------------------------------------------
+// Read the profile
+// ---------------------------------------------------------------------------
+
+// word size of the block needed for a request (rounded up to keep the alignment)
+static size_t needed_wsize(uint64_t size) {
+  size_t wsize = (size_t)((size + MI_PADDING_SIZE + MI_INTPTR_SIZE - 1) / MI_INTPTR_SIZE);
+  if (wsize <= 1) return 1;
+  return ((wsize + ALIGN_WSIZE - 1) / ALIGN_WSIZE) * ALIGN_WSIZE;
+}
+
+static void profile_add(uint64_t size, uint64_t count) {
+  if (count == 0 || size > MI_MEDIUM_OBJ_SIZE_MAX) return;  // larger sizes do not use bins
+  const size_t wsize = needed_wsize(size);
+  if (wsize > WSIZE_MAX) return;
+  counts[wsize] += count;
+  total_count += count;
+}
+
+static bool profile_read_binary(FILE* f, const char* path) {
+  mi_trace_header_t header;
+  if (fread(&header, sizeof(header), 1, f) != 1 || header.version != MI_TRACE_VERSION ||
+      header.record_size != sizeof(mi_trace_record_t) || header.size < 0) {
+    fprintf(stderr, "not a valid trace file: %s\n", path);
+    return false;
+  }
+  const size_t n = (size_t)header.size / sizeof(mi_trace_record_t);
+  mi_trace_record_t rec;
+  for (size_t i = 0; i < n && fread(&rec, sizeof(rec), 1, f) == 1; i++) {
+    if (rec.op == MI_TRACE_OP_MALLOC) { profile_add(rec.size, 1); }
+  }
+  return true;
+}
+
+// the `"samples"` of the JSON statistics: `{ "bin": .., "block_size": .., "count": N, "size_total": T, .. }`
+static bool profile_read_json(FILE* f, const char* path) {
+  fseek(f, 0, SEEK_END);
+  const long len = ftell(f);
+  rewind(f);
+  if (len <= 0) { fprintf(stderr, "empty statistics: %s\n", path); return false; }
+  char* const buf = (char*)malloc((size_t)len + 1);
+  if (buf == NULL) return false;
+  const size_t n = fread(buf, 1, (size_t)len, f);
+  buf[n] = 0;
+  const char* s = strstr(buf, "\"samples\":");
+  const char* const end = (s == NULL ? NULL : strchr(s, ']'));
+  if (s == NULL || end == NULL) {
+    fprintf(stderr, "no sampled allocations in the statistics (use MIMALLOC_ALLOC_SAMPLE_RATE): %s\n", path);
+    free(buf);
+    return false;
+  }
+  while ((s = strstr(s, "\"count\":")) != NULL && s < end) {
+    char* next;
+    const uint64_t count = strtoull(s + strlen("\"count\":"), &next, 10);
+    const char* const total = strstr(next, "\"size_total\":");
+    if (total == NULL || total > end) break;
+    const uint64_t size_total = strtoull(total + strlen("\"size_total\":"), &next, 10);
+    if (count > 0) { profile_add(size_total / count, count); }
+    s = next;
+  }
+  free(buf);
+  return true;
+}
+
+// a text trace (`<thread> m <id> <size>`, `<thread> r <id> <new-id> <size>`, or `<thread> f <id>`) or histogram (`<size> <count>`)
+static bool profile_read_text(FILE* f, const char* path) {
+  char line[256];
+  size_t lineno = 0;
+  while (fgets(line, sizeof(line), f) != NULL) {
+    lineno++;
+    char* s = line;
+    while (*s == ' ' || *s == '\t') { s++; }
+    if (*s == '#' || *s == '\n' || *s == '\r' || *s == 0) continue;
+    char* end;
+    const uint64_t first = strtoull(s, &end, 0);
+    while (*end == ' ' || *end == '\t') { end++; }
+    if (*end == 'm') {
+      strtoull(end + 1, &end, 0);  // id
+      profile_add(strtoull(end, &end, 0), 1);
+    }
+    else if (*end == 'r') {
+      strtoull(end + 1, &end, 0);  // id
+      strtoull(end, &end, 0);      // new id
+      profile_add(strtoull(end, &end, 0), 1);
+    }
+    else if (*end == 'f') {
+      // ignore frees
+    }
+    else if (*end >= '0' && *end <= '9') {
+      profile_add(first, strtoull(end, &end, 0));
+    }
+    else {
+      fprintf(stderr, "%s:%zu: expecting a trace operation or a '<size> <count>' pair\n", path, lineno);
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool profile_read(const char* path) {
+  FILE* f = fopen(path, "rb");
+  if (f == NULL) { fprintf(stderr, "unable to open profile: %s\n", path); return false; }
+  uint64_t magic = 0;
+  const bool is_binary = (fread(&magic, sizeof(magic), 1, f) == 1 && magic == MI_TRACE_MAGIC);
+  rewind(f);
+  int c;
+  while ((c = fgetc(f)) == ' ' || c == '\t' || c == '\n' || c == '\r') {}
+  const bool is_json = (c == '{');
+  rewind(f);
+  const bool ok = (is_binary ? profile_read_binary(f, path) : (is_json ? profile_read_json(f, path) : profile_read_text(f, path)));
+  fclose(f);
+  return ok;
+}
+
+
+// ---------------------------------------------------------------------------
+// Choose the size classes
+// ---------------------------------------------------------------------------
+
+static size_t classes[BINS_MAX + 1];  // word sizes in increasing order
+static size_t class_count;
+
+static bool is_class(size_t wsize) {
+  for (size_t i = 0; i < class_count; i++) {
+    if (classes[i] == wsize) return true;
+  }
+  return false;
+}
+
+static void class_add(size_t wsize) {
+  size_t i = class_count++;
+  while (i > 0 && classes[i-1] > wsize) { classes[i] = classes[i-1]; i--; }
+  classes[i] = wsize;
+}
+
+// the default classes: every aligned word size up to 8, and then 4 classes per doubling (see `page-queue.c:mi_bin`)
+static void classes_init_default(void) {
+  for (size_t wsize = 1; wsize <= 8; wsize++) {
+    if (wsize == 1 || wsize % ALIGN_WSIZE == 0) { class_add(wsize); }
+  }
+  for (size_t b = 3; ((size_t)1 << b) < WSIZE_MAX; b++) {
+    for (size_t j = 1; j <= 4; j++) {
+      const size_t wsize = ((size_t)1 << b) + j*((size_t)1 << (b - 2));
+      if (wsize <= WSIZE_MAX && wsize % ALIGN_WSIZE == 0) { class_add(wsize); }
+    }
+  }
+  if (!is_class(WSIZE_MAX)) { class_add(WSIZE_MAX); }
+}
+
+// the smallest class that fits `wsize`
+static size_t class_of(size_t wsize) {
+  for (size_t i = 0; i < class_count; i++) {
+    if (classes[i] >= wsize) return classes[i];
+  }
+  return WSIZE_MAX;
+}
+
+// the words saved if `wsize` became a class (for the sizes between the previous class and `wsize`)
+static uint64_t class_gain(size_t wsize) {
+  size_t prev = 0;
+  for (size_t i = 0; i < class_count && classes[i] < wsize; i++) { prev = classes[i]; }
+  uint64_t count = 0;
+  for (size_t w = prev + 1; w <= wsize; w++) { count += counts[w]; }
+  return count * (class_of(wsize) - wsize);
+}
+
+static uint64_t waste(void) {
+  uint64_t words = 0;
+  for (size_t w = 1; w <= WSIZE_MAX; w++) { words += counts[w] * (class_of(w) - w); }
+  return words;
+}
+
+static void classes_choose(void) {
+  while (class_count < BINS_MAX) {
+    size_t best = 0;
+    uint64_t best_gain = 0;
+    for (size_t w = 1; w <= WSIZE_MAX; w++) {
+      if (counts[w] == 0 || counts[w] * MIN_FRACTION < total_count || is_class(w)) continue;
+      const uint64_t gain = class_gain(w);
+      if (gain > best_gain) { best = w; best_gain = gain; }
+    }
+    if (best == 0) break;
+    class_add(best);
+  }
+}
+
+
+// ---------------------------------------------------------------------------
+// Write the header
+// ---------------------------------------------------------------------------
+
+static size_t bin_of(size_t wsize) {
+  for (size_t i = 0; i < class_count; i++) {
+    if (classes[i] >= wsize) return i + 1;
+  }
+  return MI_BIN_HUGE;
+}
+
+static void header_write(FILE* out, const char* profile, uint64_t default_waste) {
+  fprintf(out, "// Generated by `mimalloc-gen-bins` from `%s` -- do not edit.\n", profile);
+  fprintf(out, "// %llu sampled allocations; internal fragmentation %llu KiB (%llu KiB with the default classes).\n",
+          (unsigned long long)total_count, (unsigned long long)(waste() * MI_INTPTR_SIZE / 1024),
+          (unsigned long long)(default_waste * MI_INTPTR_SIZE / 1024));
+  fprintf(out, "#pragma once\n#ifndef MIMALLOC_BIN_TABLE_H\n#define MIMALLOC_BIN_TABLE_H\n\n");
+  fprintf(out, "#define MI_BIN_TABLE_INTPTR_SIZE     (%d)\n", (int)MI_INTPTR_SIZE);
+  fprintf(out, "#define MI_BIN_TABLE_MAX_ALIGN_SIZE  (%d)\n", (int)MI_MAX_ALIGN_SIZE);
+  fprintf(out, "#define MI_BIN_TABLE_PADDING_SIZE    (%d)\n", (int)MI_PADDING_SIZE);
+  fprintf(out, "#define MI_BIN_TABLE_SMALL_WSIZE_MAX (%d)\n", (int)MI_SMALL_WSIZE_MAX);
+  fprintf(out, "#define MI_BIN_TABLE_WSIZE_MAX       (%d)\n", (int)WSIZE_MAX);
+  fprintf(out, "#define MI_BIN_TABLE_COUNT           (%d)  // bins in use\n\n", (int)class_count);
+
+  fprintf(out, "// word size of the bins 1 up to `MI_BIN_HUGE` (the bins after `MI_BIN_TABLE_COUNT` are unused)\n");
+  fprintf(out, "#define MI_BIN_TABLE_WSIZES(Q) \\\n ");
+  for (size_t bin = 1; bin < MI_BIN_HUGE; bin++) {
+    const size_t wsize = (bin <= class_count ? classes[bin-1] : 2*WSIZE_MAX*(bin - class_count));
+    fprintf(out, " Q(%zu)%s", wsize, (bin + 1 < MI_BIN_HUGE ? "," : ""));
+    if (bin % 8 == 0 && bin + 1 < MI_BIN_HUGE) { fprintf(out, " \\\n "); }
+  }
+  fprintf(out, "\n\n");
+
+  fprintf(out, "// bin of every word size up to `MI_SMALL_WSIZE_MAX`\n");
+  fprintf(out, "#define MI_BIN_TABLE_SMALL \\\n  {");
+  for (size_t wsize = 0; wsize <= MI_SMALL_WSIZE_MAX; wsize++) {
+    fprintf(out, " %zu%s", bin_of(wsize == 0 ? 1 : wsize), (wsize < MI_SMALL_WSIZE_MAX ? "," : ""));
+    if (wsize % 16 == 15 && wsize < MI_SMALL_WSIZE_MAX) { fprintf(out, " \\\n   "); }
+  }
+  fprintf(out, " }\n\n#endif\n");
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2 || argc > 3) {
+    fprintf(stderr, "usage: mimalloc-gen-bins <profile> [<output header>]\n");
+    return 1;
+  }
+  if (!profile_read(argv[1])) return 1;
+  classes_init_default();
+  const uint64_t default_waste = waste();
+  classes_choose();
+  FILE* out = (argc == 3 ? fopen(argv[2], "w") : stdout);
+  if (out == NULL) { fprintf(stderr, "unable to write: %s\n", argv[2]); return 1; }
+  header_write(out, argv[1], default_waste);
+  if (out != stdout) { fclose(out); }
+  return 0;
+}
@@ -7,6 +7,7 @@
 #include <mimalloc.h>
 #include <new>
 #include <vector>
+#include <list>
 #include <future>
 #include <iostream>
 
@@ -181,9 +182,21 @@ static bool test_stl_allocator6() {
 }
 #endif
 
+static bool test_stl_fixed_allocator() {
+  std::list<some_struct, mi_stl_fixed_allocator<some_struct> > list;
+  for (int i = 0; i < 100; i++) { list.push_back(some_struct()); }
+  void* p = mi_new_fixed<sizeof(some_struct)>();
+  void* q = mi_new_fixed<2*MI_SMALL_SIZE_MAX>();
+  mi_free(p);
+  mi_free(q);
+  list.clear();
+  return (p != NULL && q != NULL && list.size() == 0);
+}
+
 static void test_stl_allocators() {
   test_stl_allocator1();
   test_stl_allocator2();
+  test_stl_fixed_allocator();
 #if MI_HAS_HEAP_STL_ALLOCATOR
   test_stl_allocator3();
   test_stl_allocator4();
@@ -7,6 +7,9 @@ terms of the MIT license. A copy of the license can be found in the file
 #if defined(__GNUC__) && !defined(__clang__)
 #pragma GCC diagnostic ignored "-Walloc-size-larger-than="
 #endif
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE  // sched_setaffinity
+#endif
 
 /*
 Testing allocators is difficult as bugs may only surface after particular
@@ -27,11 +30,21 @@ we therefore test the API over various inputs. Please add more tests :-)
 #include <stdbool.h>
 #include <stdint.h>
 #include <errno.h>
+#include <string.h>
+#include <stdlib.h>  // strtoll
 
 #ifdef __cplusplus
 #include <vector>
 #endif
 
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/mman.h>  // mincore
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 #include "mimalloc.h"
 // #include "mimalloc/internal.h"
 #include "mimalloc/types.h" // for MI_DEBUG and MI_BLOCK_ALIGNMENT_MAX
@@ -59,12 +72,294 @@ bool mem_is_zero(uint8_t* p, size_t size) {
   return true;
 }
 
+static void test_heap_pressure(mi_heap_t* heap, size_t heap_size, size_t soft_limit, void* arg) {
+  (void)(heap); (void)(soft_limit);
+  if (heap_size > 0) { (*(int*)arg)++; }
+}
+
+typedef struct test_heap_samples_s {
+  void** blocks;
+  size_t count;
+  size_t found;
+} test_heap_samples_t;
+
+static bool test_heap_sample_visit(const mi_heap_sample_t* sample, void* arg) {
+  test_heap_samples_t* samples = (test_heap_samples_t*)arg;
+  for (size_t i = 0; i < samples->count; i++) {
+    if (sample->block == samples->blocks[i] && sample->size == 24 + i) { samples->found++; }
+  }
+  return true;
+}
+
+typedef struct test_relocate_s {
+  void*  blocks[4];
+  size_t count;
+} test_relocate_t;
+
+static bool test_relocate(const mi_heap_t* heap, void* block, void* new_block, size_t block_size, void* arg) {
+  (void)(heap); (void)(block_size);
+  test_relocate_t* live = (test_relocate_t*)arg;
+  for (size_t i = 0; i < live->count; i++) {
+    if (live->blocks[i] == block) { live->blocks[i] = new_block; return true; }
+  }
+  return false;
+}
+
+static bool test_heap_area_block_size(const mi_heap_t* heap, const mi_heap_area_t* area, void* block, size_t block_size, void* arg) {
+  // the block size of the areas, or SIZE_MAX if they differ
+  (void)heap; (void)block; (void)block_size;
+  size_t* const bsize = (size_t*)arg;
+  *bsize = (*bsize == 0 || *bsize == area->block_size ? area->block_size : SIZE_MAX);
+  return true;
+}
+
+static void test_executor(mi_parallel_task_fun* task, void* task_arg, size_t count, void* arg) {
+  // run the tasks in reverse order on the calling thread
+  for (size_t i = count; i > 0; i--) { task(i - 1, task_arg); }
+  *((size_t*)arg) += count;
+}
+
+static volatile bool test_deferred_forced;
+
+static void test_deferred_free(bool force, unsigned long long heartbeat, void* arg) {
+  (void)(heartbeat); (void)(arg);
+  if (force) { test_deferred_forced = true; }
+}
+
+static long long test_stats_counter(const char* name) {
+  const size_t len = mi_stats_get_json(NULL, 0) + 1024;
+  char* buf = (char*)mi_malloc(len);
+  mi_stats_get_json(buf, len);
+  char key[64];
+  snprintf(key, sizeof(key), "\"%s\": { \"total\": ", name);
+  const char* const found = strstr(buf, key);
+  const long long total = (found == NULL ? -1 : strtoll(found + strlen(key), NULL, 10));
+  mi_free(buf);
+  return total;
+}
+
+static char test_stats_out[8192];
+
+static void test_stats_output(const char* msg, void* arg) {
+  (void)arg;
+  const size_t len = strlen(test_stats_out);
+  snprintf(test_stats_out + len, sizeof(test_stats_out) - len, "%s", msg);
+}
+
+static bool test_thread_stats_line(const char* name, char* line, size_t line_size) {
+  // the line of a thread local statistic as printed by `mi_thread_stats_print_out`
+  test_stats_out[0] = 0;
+  mi_thread_stats_print_out(&test_stats_output, NULL);
+  const char* const found = strstr(test_stats_out, name);
+  if (found == NULL) return false;
+  const size_t len = strcspn(found, "\n");
+  snprintf(line, line_size, "%.*s", (int)len, found);
+  return true;
+}
+
+#if defined(__linux__)
+static volatile size_t test_reserve_done;
+static volatile size_t test_reserve_pages;
+
+static void test_reserve_progress(size_t pages_reserved, size_t pages_requested, bool done, void* arg) {
+  (void)(pages_requested); (void)(arg);
+  if (done) {
+    test_reserve_pages = pages_reserved;
+    test_reserve_done++;
+  }
+}
+
+#if (MI_DEBUG < 3)
+// count the OS pages of `p` that are resident (i.e. were touched since they were last purged)
+static size_t test_resident_pages(void* p, size_t size) {
+  const size_t psize = (size_t)sysconf(_SC_PAGESIZE);
+  const uintptr_t start = (uintptr_t)p & ~(psize - 1);
+  const size_t count = ((uintptr_t)p + size - start + psize - 1) / psize;
+  unsigned char vec[1024];
+  if (count > sizeof(vec) || mincore((void*)start, count * psize, vec) != 0) return SIZE_MAX;
+  size_t resident = 0;
+  for (size_t i = 0; i < count; i++) { if (vec[i] & 1) resident++; }
+  return resident;
+}
+#endif
+
+#if (MI_DEBUG>0) || (MI_SECURE>0)
+static void test_error_count(int err, void* arg) {
+  if (err == EFAULT) { (*(size_t*)arg)++; }
+}
+
+static void* test_free_twice(void* arg) {
+  // the first free in a page may go to the delayed free list of its heap; the double free is in the thread free list
+  void** p = (void**)arg;
+  mi_free(p[1]);
+  mi_free(p[0]);
+  mi_free(p[0]);
+  return NULL;
+}
+#endif
+
+static void* test_purge_reused(void* arg) {
+  // the free span of a fresh segment is committed but not scheduled for purging, so only `mi_collect_target` purges it
+  void* p = mi_malloc(64);
+  mi_collect_target(0);
+  const long long before = test_stats_counter("purge_reused");
+  void* q = mi_malloc(1024 * 1024);
+  const bool reused = (test_stats_counter("purge_reused") > before);
+  mi_free(q);
+  mi_free(p);
+  return (reused ? arg : NULL);
+}
+
+static void* test_heap_pool_alloc(void* arg) {
+  (void)(arg);
+  return mi_malloc(64);
+}
+
+static void* test_heap_pool_adopt(void* arg) {
+  // the parked heap of the previous thread is adopted and its blocks are local again
+  const bool adopted = mi_heap_contains_block(mi_heap_get_backing(), arg);
+  mi_free(arg);
+  return (adopted ? arg : NULL);
+}
+
+static void* test_heap_fiber_resume(void* arg) {
+  // the fiber heap moves to this thread and allocates (and frees) locally
+  mi_heap_t* heap = (mi_heap_t*)arg;
+  if (!mi_heap_fiber_attach(heap)) return NULL;
+  mi_heap_t* prev = mi_heap_switch(heap);
+  void* p = mi_malloc(32);
+  const bool ok = (p != NULL && mi_heap_contains_block(heap, p) && mi_heap_get_default() == heap);
+  mi_free(p);
+  mi_heap_switch(prev);
+  mi_heap_fiber_detach(heap);
+  return (ok ? heap : NULL);
+}
+
+static void* test_heap_fiber_exit(void* arg) {
+  // the thread terminates while its fiber heap is attached (and even the default heap)
+  void** p = (void**)arg;
+  mi_heap_t* heap = mi_heap_new_fiber();
+  mi_heap_switch(heap);
+  *p = mi_malloc(32);
+  return heap;
+}
+
+// the per-CPU heap tests run their threads on the same CPU
+static int test_cpu = -1;
+static volatile int test_cpu_state;
+
+static bool test_cpu_pin(void) {
+  cpu_set_t set;
+  if (test_cpu < 0) {
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) return false;
+    for (int i = 0; i < CPU_SETSIZE && test_cpu < 0; i++) { if (CPU_ISSET(i, &set)) test_cpu = i; }
+  }
+  CPU_ZERO(&set);
+  CPU_SET(test_cpu, &set);
+  return (sched_setaffinity(0, sizeof(set), &set) == 0);
+}
+
+static void test_cpu_wait(int state) {
+  while (test_cpu_state < state) { sched_yield(); }
+}
+
+static bool test_same_segment(const void* p, const void* q) {
+  return ((uintptr_t)p / MI_SEGMENT_SIZE == (uintptr_t)q / MI_SEGMENT_SIZE);
+}
+
+static void* test_cpu_heap_alloc(void* arg) {
+  (void)(arg);
+  if (!test_cpu_pin()) return NULL;
+  // small blocks come from the per-CPU heap (also on the fast path), large ones from the own heap of the thread
+  void* p = mi_malloc(64);
+  void* q = mi_malloc(64);
+  void* big = mi_malloc(1024 * 1024);
+  mi_heap_t* const heap = mi_heap_get_backing();
+  const bool ok = (p != NULL && q != NULL && !mi_heap_contains_block(heap, p) && !mi_heap_contains_block(heap, q) &&
+                   mi_heap_contains_block(heap, big) && mi_heap_get_default() == heap);
+  mi_free(big);
+  mi_free(q);
+  if (!ok) { mi_free(p); }
+  return (ok ? p : NULL);
+}
+
+static void* test_cpu_heap_reuse(void* arg) {
+  // the heap is released when the previous thread terminated and leased by this thread
+  if (!test_cpu_pin()) return NULL;
+  void* p = mi_malloc(64);
+  const bool ok = (p != NULL && !mi_heap_contains_block(mi_heap_get_backing(), p) && test_same_segment(p, arg));
+  mi_free(arg);  // a local free now
+  mi_free(p);
+  return (ok ? arg : NULL);
+}
+
+static void* test_cpu_heap_holder(void* arg) {
+  void** p = (void**)arg;
+  if (!test_cpu_pin()) return NULL;
+  *p = mi_malloc(64);
+  test_cpu_state = 1;
+  test_cpu_wait(2);
+  // another thread wants the heap: it is released at the next generic allocation
+  void* blocks[4096];
+  size_t n = 0;
+  bool released = false;
+  while (n < 4096 && !released) {
+    blocks[n] = mi_malloc(64);
+    released = mi_heap_contains_block(mi_heap_get_backing(), blocks[n]);
+    n++;
+  }
+  for (size_t i = 0; i < n; i++) { mi_free(blocks[i]); }
+  test_cpu_state = 3;
+  return (released ? arg : NULL);
+}
+
+static void* test_cpu_heap_waiter(void* arg) {
+  void** p = (void**)arg;
+  if (!test_cpu_pin()) return NULL;
+  test_cpu_wait(1);
+  // the heap is leased by the holder: allocate from the own heap (and ask for the heap)
+  void* q = mi_malloc(64);
+  bool ok = mi_heap_contains_block(mi_heap_get_backing(), q);
+  test_cpu_state = 2;
+  test_cpu_wait(3);
+  // and lease it at a later generic allocation
+  void* blocks[4096];
+  size_t n = 0;
+  bool leased = false;
+  while (n < 4096 && !leased) {
+    blocks[n] = mi_malloc(64);
+    leased = !mi_heap_contains_block(mi_heap_get_backing(), blocks[n]);
+    n++;
+  }
+  ok = ok && leased && test_same_segment(blocks[n-1], *p);
+  for (size_t i = 0; i < n; i++) { mi_free(blocks[i]); }
+  mi_free(q);
+  return (ok ? arg : NULL);
+}
+#endif
+
 // ---------------------------------------------------------------------------
 // Main testing
 // ---------------------------------------------------------------------------
 int main(void) {
   mi_option_disable(mi_option_verbose);
 
+  CHECK_BODY("option-env-fast-start") {
+    // the `test-api-fast-start` test sets options that are only read through the hot paths (see CMakeLists.txt);
+    // this check should run before any other check sets these options explicitly
+    const char* s = getenv("MIMALLOC_HEAP_SAMPLE_RATE");
+    if (s != NULL && strcmp(s, "1") == 0) {
+      mi_heap_t* heap = mi_heap_new();
+      void* p = mi_heap_malloc(heap, 24);
+      test_heap_samples_t samples = { &p, 1, 0 };
+      mi_heap_sample_visit(&test_heap_sample_visit, &samples);
+      result = (samples.found == 1 && mi_option_get(mi_option_free_cache) == 7);
+      mi_free(p);
+      mi_heap_delete(heap);
+      mi_option_set(mi_option_heap_sample_rate, 0);
+    }
+  };
+
   CHECK_BODY("malloc-aligned9a") { // test large alignments
     void* p = mi_zalloc_aligned(1024 * 1024, 2);
     mi_free(p);
@@ -263,6 +558,62 @@ int main(void) {
     }
     result = ok;
   }
+  CHECK_BODY("mimalloc-aligned-class") {
+    // common alignments are served from naturally aligned size classes without over-allocation
+    bool ok = true;
+    const size_t aligns[3] = { 64, 128, 4096 };
+    for (int i = 0; i < 3 && ok; i++) {
+      const size_t align = aligns[i];
+      for (size_t size = 1; size <= 3*align && ok; size += 7) {
+        void* p = mi_malloc_aligned(size, align);
+        ok = (p != NULL && ((uintptr_t)p % align) == 0 && mi_usable_size(p) >= size);
+        #if !MI_PADDING
+        const size_t asize = (size + align - 1) & ~(align - 1);
+        ok = ok && (mi_usable_size(p) == mi_good_size(asize));
+        #endif
+        mi_free(p);
+      }
+    }
+    result = ok;
+  };
+  CHECK_BODY("free-size-aligned") {
+    bool ok = true;
+    for (size_t size = 8; size <= 2*MI_SMALL_SIZE_MAX && ok; size += 8) {
+      for (size_t align = 8; align <= 256 && ok; align *= 2) {
+        void* p[10] = { NULL };
+        void* q[10] = { NULL };
+        for (int i = 0; i < 10 && ok; i++) {
+          p[i] = mi_malloc_aligned(size, align);  // pages may now contain inner aligned blocks
+          q[i] = mi_malloc(size);
+          ok = (p[i] != NULL && q[i] != NULL && ((uintptr_t)(p[i]) % align) == 0);
+        }
+        for (int i = 0; i < 10; i++) {
+          mi_free_size_aligned(p[i], size, align);
+          mi_free_size(q[i], size);
+        }
+      }
+    }
+    result = ok;
+  };
+  CHECK_BODY("free-size-aligned-at") {
+    // an aligned allocation with an offset is inside its block and is unaligned on a sized free
+    void* p[16];
+    for (int i = 0; i < 16; i++) {
+      p[i] = mi_malloc_aligned_at(200, 64, 8);
+      result = result && (p[i] != NULL && ((uintptr_t)(p[i]) + 8) % 64 == 0);
+    }
+    for (int i = 0; i < 16; i++) { mi_free_size(p[i], 200); }
+    // the freed blocks are reused whole (and do not overlap)
+    uint8_t* q[32];
+    for (int i = 0; i < 32; i++) {
+      q[i] = (uint8_t*)mi_malloc(200);
+      memset(q[i], i, 200);
+    }
+    for (int i = 0; i < 32; i++) {
+      for (size_t j = 0; j < 200; j++) { result = result && (q[i][j] == (uint8_t)i); }
+      mi_free(q[i]);
+    }
+  };
   CHECK_BODY("malloc-aligned-at1") {
     void* p = mi_malloc_aligned_at(48,32,0); result = (p != NULL && ((uintptr_t)(p) + 0) % 32 == 0); mi_free(p);
   };
@@ -316,20 +667,725 @@ int main(void) {
     mi_free(q);
   };
 
+  CHECK_BODY("realloc-grow-large") {
+    // grow a large block (possibly in place) and check the contents are preserved
+    size_t size = 200*1024;
+    uint8_t* p = (uint8_t*)mi_malloc(size);
+    memset(p, 0x5A, size);
+    bool ok = true;
+    for (; size < 8*1024*1024 && ok; size += size/3 + 4096) {
+      const size_t newsize = size + size/3 + 4096;
+      p = (uint8_t*)mi_realloc(p, newsize);
+      ok = (p != NULL && mi_usable_size(p) >= newsize && p[0] == 0x5A && p[size-1] == 0x5A);
+      if (ok) { memset(p + size, 0x5A, newsize - size); }
+    }
+    mi_free(p);
+    result = ok;
+  };
+  CHECK_BODY("realloc-grow-huge") {
+    size_t size = 20*1024*1024;
+    uint8_t* p = (uint8_t*)mi_zalloc(size);
+    p[0] = 1; p[size-1] = 2;
+    uint8_t* q = (uint8_t*)mi_rezalloc(p, 3*size);
+    result = (q != NULL && mi_usable_size(q) >= 3*size && q[0] == 1 && q[size-1] == 2 && q[size] == 0 && q[3*size-1] == 0);
+    mi_free(q);
+  };
   CHECK_BODY("reallocarray-null-sizezero") {
     void* p = mi_reallocarray(NULL,0,16);  // issue #574
     result = (p != NULL && errno == 0);
     mi_free(p);
   };
 
+  // ---------------------------------------------------
+  // Batched allocation
+  // ---------------------------------------------------
+  CHECK_BODY("malloc-batch") {
+    void* blocks[1000];
+    const size_t n = mi_malloc_batch(48, blocks, 1000);
+    result = (n == 1000);
+    for (size_t i = 0; i < n && result; i++) {
+      result = (blocks[i] != NULL && mi_usable_size(blocks[i]) >= 48);
+      memset(blocks[i], 0, 48);
+    }
+    mi_free_batch(blocks, n);
+  };
+  CHECK_BODY("malloc-batch-large") {
+    void* blocks[8];
+    const size_t n = mi_heap_malloc_batch(mi_heap_get_default(), 2*MI_SMALL_SIZE_MAX, blocks, 8);
+    result = (n == 8);
+    mi_free(blocks[3]);
+    blocks[3] = NULL;   // NULL entries are skipped
+    mi_free_batch(blocks, n);
+  };
+
   // ---------------------------------------------------
   // Heaps
   // ---------------------------------------------------
   CHECK("heap_destroy", test_heap1());
   CHECK("heap_delete", test_heap2());
+  CHECK_BODY("heap-limits") {
+    mi_heap_t* heap = mi_heap_new();
+    int pressure = 0;
+    mi_heap_register_pressure(heap, &test_heap_pressure, &pressure);
+    mi_heap_set_limits(heap, 256*1024, 1024*1024);
+    size_t count = 0;
+    while (count < 64 && mi_heap_malloc(heap, 32*1024) != NULL) { count++; }
+    result = (count > 8 && count < 64 && pressure == 1 && mi_heap_get_size(heap) <= 1024*1024);
+    mi_heap_destroy(heap);
+  };
+  CHECK_BODY("heap-sample") {
+    mi_option_set(mi_option_heap_sample_rate, 1);  // record every allocation
+    mi_heap_t* heap = mi_heap_new();
+    void* p[8];
+    for (size_t i = 0; i < 8; i++) { p[i] = mi_heap_malloc(heap, 24 + i); }
+    test_heap_samples_t samples = { p, 8, 0 };
+    mi_heap_sample_visit(&test_heap_sample_visit, &samples);
+    result = (samples.found == 8);
+    for (size_t i = 0; i < 4; i++) { mi_free(p[i]); }
+    samples.found = 0;
+    mi_heap_sample_visit(&test_heap_sample_visit, &samples);
+    result = result && (samples.found == 4);
+    mi_heap_sample_t snapshot[4];
+    result = result && (mi_heap_sample_snapshot(snapshot, 4) == 4);
+    mi_option_set(mi_option_heap_sample_rate, 0);
+    mi_heap_destroy(heap);   // removes the remaining samples without freeing them
+    samples.found = 0;
+    mi_heap_sample_visit(&test_heap_sample_visit, &samples);
+    result = result && (samples.found == 0);
+  };
+  CHECK_BODY("page-bump") {
+    mi_option_enable(mi_option_page_bump);
+    mi_heap_t* heap = mi_heap_new();
+    void* p[1000];
+    result = true;
+    for (size_t i = 0; i < 1000 && result; i++) {
+      p[i] = mi_heap_zalloc(heap, 48);
+      result = (p[i] != NULL && mem_is_zero((uint8_t*)p[i], 48) && mi_heap_check_owned(heap, p[i]));
+      memset(p[i], 0xAB, 48);
+      if (i % 3 == 0) { mi_free(p[i]); p[i] = NULL; }
+    }
+    for (size_t i = 0; i < 1000 && result; i++) {
+      void* q = mi_heap_zalloc(heap, 48);
+      result = (q != NULL && mem_is_zero((uint8_t*)q, 48));
+      mi_free(q);
+    }
+    // batches are taken from the bump region of a fresh page as well
+    void* bs[100];
+    if (result) {
+      result = (mi_heap_malloc_batch(heap, 200, bs, 100) == 100);
+      for (size_t i = 0; i < 100 && result; i++) {
+        result = (mi_heap_check_owned(heap, bs[i]) && mi_usable_size(bs[i]) >= 200);
+      }
+    }
+    mi_option_disable(mi_option_page_bump);
+    mi_heap_destroy(heap);
+  };
+  CHECK_BODY("heap-reset") {
+    mi_heap_t* heap = mi_heap_new();
+    void* first = NULL;
+    result = true;
+    for (int epoch = 0; epoch < 3 && result; epoch++) {
+      for (size_t i = 0; i < 1000; i++) {
+        void* p = mi_heap_malloc(heap, 16 + (i % 64) * 8);
+        if (i == 0) {
+          // the same page is reused in the next epoch
+          #if (MI_SECURE==0)
+          if (epoch == 0) { first = p; } else { result = result && (p == first); }
+          #else
+          // (in secure mode the free lists are randomized, but the block is in the same small page)
+          if (epoch == 0) { first = p; } else { result = result && ((uintptr_t)p / MI_SEGMENT_SLICE_SIZE == (uintptr_t)first / MI_SEGMENT_SLICE_SIZE); }
+          #endif
+        }
+        memset(p, 0xAB, 16);
+      }
+      void* const huge = mi_heap_malloc(heap, 64*1024*1024);
+      void* const aligned = mi_heap_malloc_aligned(heap, 100, 256);
+      result = result && (huge != NULL && aligned != NULL && mi_heap_check_owned(heap, aligned));
+      mi_heap_reset(heap);
+      void* const z = mi_heap_zalloc(heap, 64);
+      result = result && (z != NULL && mem_is_zero((uint8_t*)z, 64));
+      mi_free(z);
+    }
+    mi_heap_destroy(heap);
+  };
+  CHECK_BODY("heap-tag-policy") {
+    mi_heap_tag_policy_t policy;
+    result = mi_heap_tag_get_policy(5, &policy) && policy.bin_granularity == 0 && policy.purge_delay == -2;
+    policy.bin_granularity = 24;  // not a power of two
+    result = result && !mi_heap_tag_set_policy(5, &policy);
+    policy.bin_granularity = 64;
+    policy.page_kind = mi_heap_tag_page_medium;
+    policy.eager_commit = 1;
+    policy.purge_delay = 0;
+    policy.populate = 2;  // invalid
+    result = result && !mi_heap_tag_set_policy(5, &policy);
+    policy.populate = -1;
+    result = result && mi_heap_tag_set_policy(5, &policy);
+    mi_heap_t* heap = mi_heap_new_ex(5, true, 0 /* any arena */);
+    void* p[2000];
+    for (size_t i = 0; i < 2000; i++) {
+      p[i] = mi_heap_malloc(heap, 16 + (i % 48));
+      result = result && (p[i] != NULL && mi_usable_size(p[i]) >= 16 + (i % 48));
+    }
+    size_t block_size = 0;
+    mi_heap_visit_blocks(heap, false, &test_heap_area_block_size, &block_size);
+    result = result && (block_size >= 64 && block_size != SIZE_MAX);  // all blocks (also from the fast path) have the rounded size
+    #if !MI_PADDING
+    result = result && (mi_usable_size(p[0]) == block_size && mi_usable_size(p[1999]) == block_size);
+    #endif
+    size_t pages = 0;
+    mi_heap_tag_stats(5, &pages, NULL, NULL, NULL);
+    result = result && (pages == 1);  // a single medium page holds all blocks
+    for (size_t i = 0; i < 2000; i++) { mi_free(p[i]); }
+    mi_heap_destroy(heap);
+    result = result && mi_heap_tag_set_policy(5, NULL);
+  };
+  #if (MI_SECURE==0)  // the free cache is not used in secure mode
+  CHECK_BODY("free-cache") {
+    mi_option_set(mi_option_free_cache, 4);
+    mi_heap_t* heap = mi_heap_new();
+    void* p = mi_heap_malloc(heap, 40);  // initializes the cache size through the generic path
+    mi_free(p);
+    void* q = mi_heap_malloc(heap, 40);
+    result = (q == p);                   // LIFO reuse of the cached block
+    memset(q, 0xAB, 40);
+    mi_free(q);
+    q = mi_heap_zalloc(heap, 33);        // same size class
+    result = result && (q == p && mem_is_zero((uint8_t*)q, 33) && mi_usable_size(q) >= 33);
+    void* blocks[16];
+    for (size_t i = 0; i < 16; i++) { blocks[i] = mi_heap_malloc(heap, 40); }
+    for (size_t i = 0; i < 16; i++) { mi_free(blocks[i]); }  // only 4 are cached
+    mi_heap_collect(heap, true);         // flushes the cache
+    mi_free(q);
+    mi_option_set(mi_option_free_cache, 0);
+    mi_heap_delete(heap);
+  };
+  #endif
+  CHECK_BODY("collect-target") {
+    // purging down to zero releases at least the (touched) memory of the freed blocks
+    const long purge_delay = mi_option_get(mi_option_purge_delay);
+    mi_option_set(mi_option_purge_delay, 1000);
+    void* ps[64];
+    for (int i = 0; i < 64; i++) { ps[i] = mi_malloc(64*1024); memset(ps[i], 0, 64*1024); }
+    for (int i = 0; i < 64; i++) { mi_free(ps[i]); }
+    size_t before = mi_collect_target(SIZE_MAX);  // no purging needed
+    size_t after  = mi_collect_target(0);
+    result = (after < before && before - after >= 64*64*1024);
+    mi_option_set(mi_option_purge_delay, purge_delay);
+  };
+  CHECK_BODY("is-in-heap-region-os") {
+    // an over-aligned allocation is in an OS allocated segment (outside the arenas);
+    // the second lookup is served from the per-thread cache
+    int local = 0;
+    void* p = mi_malloc_aligned(1024, 32*1024*1024UL);
+    result = (p != NULL && mi_is_in_heap_region(p) && mi_is_in_heap_region(p) && !mi_is_in_heap_region(&local));
+    mi_free(p);
+  };
+  CHECK_BODY("frag-report") {
+    // a heap with 100 blocks of 48 bytes (plus padding in debug mode) has a bin with (at least) those blocks in use
+    mi_heap_t* heap = mi_heap_new();
+    void* ps[100];
+    for (int i = 0; i < 100; i++) { ps[i] = mi_heap_malloc(heap, 48); }
+    mi_frag_bin_t bins[8];
+    size_t count = mi_heap_frag_bins(heap, bins, 8);
+    result = (count == 1 && bins[0].block_size >= 48 && bins[0].used == 100 && bins[0].capacity >= 100);
+    mi_frag_summary_t summary;
+    mi_thread_frag_summary(&summary);
+    result = result && (summary.live >= 4800 && summary.segment_committed >= summary.live && summary.ratio >= 1.0);
+    result = result && (mi_thread_frag_segments(NULL, 0) >= 1);
+    for (int i = 0; i < 100; i++) { mi_free(ps[i]); }
+    mi_heap_delete(heap);
+  };
+  CHECK_BODY("heap-relocate") {
+    // keep one block of every 1024 so all pages are sparse; all but one page are relocated
+    mi_heap_t* heap = mi_heap_new();
+    void** ps = (void**)mi_malloc(4096 * sizeof(void*));
+    for (int i = 0; i < 4096; i++) { ps[i] = mi_heap_malloc(heap, 64); }
+    test_relocate_t live = { {NULL}, 0 };
+    for (int i = 0; i < 4096; i++) {
+      if (i % 1024 == 0) { *((int*)ps[i]) = i; live.blocks[live.count++] = ps[i]; }
+                    else { mi_free(ps[i]); }
+    }
+    mi_free(ps);
+    mi_frag_bin_t bin_before, bin_after;
+    mi_heap_frag_bins(heap, &bin_before, 1);
+    size_t moved = mi_heap_relocate_candidates(heap, 0, &test_relocate, &live);
+    mi_heap_collect(heap, true);
+    mi_heap_frag_bins(heap, &bin_after, 1);
+    result = (moved == live.count - 1 && bin_before.pages == live.count && bin_after.pages == 1);
+    for (size_t i = 0; i < live.count; i++) {
+      result = result && (*((int*)live.blocks[i]) == (int)(1024*i)) && mi_heap_contains_block(heap, live.blocks[i]);
+      mi_free(live.blocks[i]);
+    }
+    mi_heap_delete(heap);
+  };
+  CHECK_BODY("heap-destroy-parallel") {
+    // huge blocks each have their own segment
+    size_t tasks = 0;
+    mi_heap_t* heap = mi_heap_new();
+    result = true;
+    for (int i = 0; i < 8; i++) { result = result && (mi_heap_malloc(heap, 40*1024*1024) != NULL); }
+    for (int i = 0; i < 1000; i++) { result = result && (mi_heap_malloc(heap, 64 + i) != NULL); }
+    mi_heap_destroy_parallel(heap, 4, &test_executor, &tasks);
+    result = result && (tasks == 4);
+    heap = mi_heap_new();
+    void* live = mi_heap_malloc(heap, 64);
+    for (int i = 0; i < 8; i++) { mi_free(mi_heap_malloc(heap, 40*1024*1024)); }
+    mi_heap_collect_parallel(heap, 4, NULL, NULL);
+    mi_heap_destroy_parallel(heap, 4, NULL, NULL);
+    result = result && (live != NULL);
+  };
+  CHECK_BODY("heap-many-exclusive-arenas") {
+    // more exclusive arenas than fit in the static arena table
+    mi_arena_id_t arena_id = 0;
+    result = true;
+    for (int i = 0; i < 140 && result; i++) {
+      result = (mi_reserve_os_memory_ex(64*1024*1024, false, false, true /* exclusive */, &arena_id) == 0);
+    }
+    if (result) {
+      mi_heap_t* heap = mi_heap_new_in_arena(arena_id);
+      void* p = mi_heap_malloc(heap, 1024);
+      size_t size = 0;
+      void* start = mi_arena_area(arena_id, &size);
+      result = (p != NULL && start != NULL && (uint8_t*)p >= (uint8_t*)start && (uint8_t*)p < (uint8_t*)start + size);
+      mi_free(p);
+      mi_heap_delete(heap);
+    }
+  };
+
+#if defined(__linux__)
+  #if (MI_DEBUG>0) || (MI_SECURE>0)
+  CHECK_BODY("remote-double-free") {
+    // a double free by another thread creates a cycle in the thread free list which is detected in debug and secure mode
+    size_t errors = 0;
+    mi_register_error(&test_error_count, &errors);
+    mi_heap_t* heap = mi_heap_new();
+    void* p[2] = { mi_heap_malloc(heap, 64), mi_heap_malloc(heap, 64) };
+    pthread_t thread;
+    pthread_create(&thread, NULL, &test_free_twice, p);
+    pthread_join(thread, NULL);
+    mi_heap_collect(heap, true);
+    result = (errors == 1);
+    mi_register_error(NULL, NULL);
+    mi_heap_delete(heap);
+  };
+  #endif
+  CHECK_BODY("purge-adaptive-reused") {
+    // memory purged outside of the scheduled purges and needed again soon counts as reused
+    const long eager_delay = mi_option_get(mi_option_eager_commit_delay);
+    const long max_reclaim = mi_option_get(mi_option_max_segment_reclaim);
+    const long purge_delay = mi_option_get(mi_option_purge_delay);
+    mi_option_set(mi_option_eager_commit_delay, 0);
+    mi_option_set(mi_option_max_segment_reclaim, 0);
+    mi_option_set(mi_option_purge_delay, 1000);
+    mi_option_set(mi_option_purge_adaptive, 4);
+    pthread_t thread;
+    int marker = 0;
+    void* reused = NULL;
+    pthread_create(&thread, NULL, &test_purge_reused, &marker);
+    pthread_join(thread, &reused);
+    result = (reused == &marker);
+    mi_option_set(mi_option_purge_adaptive, 0);
+    mi_option_set(mi_option_purge_delay, purge_delay);
+    mi_option_set(mi_option_max_segment_reclaim, max_reclaim);
+    mi_option_set(mi_option_eager_commit_delay, eager_delay);
+  };
+  CHECK_BODY("heap-pool") {
+    mi_option_set(mi_option_heap_pool, 4);
+    pthread_t thread;
+    void* p = NULL;
+    void* q = NULL;
+    pthread_create(&thread, NULL, &test_heap_pool_alloc, NULL);
+    pthread_join(thread, &p);
+    pthread_create(&thread, NULL, &test_heap_pool_adopt, p);
+    pthread_join(thread, &q);
+    result = (p != NULL && q == p && mi_heap_pool_collect() == 1 && mi_heap_pool_collect() == 0);
+    mi_option_set(mi_option_heap_pool, 0);
+  };
+  CHECK_BODY("heap-pool-collect") {
+    // collecting the pool (on the main thread) only abandons the parked heaps and does not reclaim other abandoned segments
+    const long max_reclaim = mi_option_get(mi_option_max_segment_reclaim);
+    mi_option_set(mi_option_max_segment_reclaim, 0);  // do not reclaim on allocation
+    pthread_t thread;
+    void* p = NULL;
+    void* q = NULL;
+    pthread_create(&thread, NULL, &test_heap_pool_alloc, NULL);
+    pthread_join(thread, &q);   // abandoned
+    mi_option_set(mi_option_heap_pool, 1);
+    pthread_create(&thread, NULL, &test_heap_pool_alloc, NULL);
+    pthread_join(thread, &p);   // parked
+    size_t reclaimed = 0;
+    size_t reclaimed_after = 0;
+    mi_numa_node_stats(0, NULL, NULL, &reclaimed, NULL);
+    result = (mi_heap_pool_collect() == 1);
+    mi_numa_node_stats(0, NULL, NULL, &reclaimed_after, NULL);
+    result = result && (reclaimed_after == reclaimed);
+    mi_free(p);
+    mi_free(q);
+    mi_option_set(mi_option_heap_pool, 0);
+    mi_option_set(mi_option_max_segment_reclaim, max_reclaim);
+  };
+#endif
+
+#if defined(__linux__)
+  CHECK_BODY("heap-fiber") {
+    mi_heap_t* heap = mi_heap_new_fiber();
+    mi_heap_t* prev = mi_heap_switch(heap);
+    void* p = mi_malloc(64);
+    result = (p != NULL && mi_heap_switch(prev) == heap && mi_heap_get_default() == prev);
+    mi_heap_fiber_detach(heap);
+    result = result && !mi_heap_fiber_attach(prev);  // not a fiber heap
+    pthread_t thread;
+    void* q = NULL;
+    pthread_create(&thread, NULL, &test_heap_fiber_resume, heap);
+    pthread_join(thread, &q);
+    result = result && (q == heap) && mi_heap_fiber_attach(heap) && mi_heap_contains_block(heap, p);
+    mi_free(p);
+    mi_heap_delete(heap);
+  };
+  CHECK_BODY("heap-fiber-detached-free") {
+    // a detached fiber heap can be deleted or destroyed (by attaching it first)
+    mi_heap_t* prev = mi_heap_get_default();
+    mi_heap_t* heap = mi_heap_new_fiber();
+    void* p = mi_heap_malloc(heap, 64);
+    mi_heap_fiber_detach(heap);
+    mi_heap_delete(heap);
+    result = (p != NULL && mi_usable_size(p) >= 64 && mi_heap_get_default() == prev);
+    mi_free(p);  // still valid after a delete
+    heap = mi_heap_new_fiber();
+    result = result && (mi_heap_malloc(heap, 64) != NULL);
+    mi_heap_fiber_detach(heap);
+    mi_heap_destroy(heap);
+    result = result && (mi_heap_get_default() == prev);
+  };
+  CHECK_BODY("heap-destroy-remote-free") {
+    // a block of a detached fiber heap is freed in the remote free magazine of this thread,
+    // and destroying the heap flushes it first (instead of pushing it in a freed page later)
+    mi_option_set(mi_option_remote_free_batch, 8);
+    mi_heap_t* heap = mi_heap_new_fiber();
+    void* p = mi_heap_malloc(heap, 64);
+    mi_heap_fiber_detach(heap);
+    mi_free(p);
+    mi_heap_destroy(heap);
+    heap = mi_heap_new_fiber();
+    void* q[100];
+    for (size_t i = 0; i < 100; i++) { q[i] = mi_heap_malloc(heap, 64); }
+    mi_collect(false);
+    for (size_t i = 0; i < 100; i++) {
+      void* r = mi_heap_malloc(heap, 64);
+      for (size_t j = 0; j < 100; j++) { result = result && (r != q[j]); }
+    }
+    mi_heap_destroy(heap);
+    mi_option_set(mi_option_remote_free_batch, 0);
+  };
+  CHECK_BODY("heap-reset-remote-free") {
+    // as above, but resetting the (detached) heap flushes the magazine first and leaves the heap detached
+    mi_option_set(mi_option_remote_free_batch, 8);
+    mi_heap_t* heap = mi_heap_new_fiber();
+    void* p = mi_heap_malloc(heap, 64);
+    mi_heap_fiber_detach(heap);
+    mi_free(p);
+    mi_heap_reset(heap);
+    result = mi_heap_fiber_attach(heap);
+    void* q[100];
+    for (size_t i = 0; i < 100; i++) { q[i] = mi_heap_malloc(heap, 64); }
+    mi_collect(false);
+    for (size_t i = 0; i < 100; i++) {
+      void* r = mi_heap_malloc(heap, 64);
+      for (size_t j = 0; j < 100; j++) { result = result && (r != q[j]); }
+    }
+    mi_heap_destroy(heap);
+    mi_option_set(mi_option_remote_free_batch, 0);
+  };
+  CHECK_BODY("heap-fiber-thread-exit") {
+    // a fiber heap that is still attached when its thread terminates is detached
+    pthread_t thread;
+    void* p = NULL;
+    void* heap = NULL;
+    pthread_create(&thread, NULL, &test_heap_fiber_exit, &p);
+    pthread_join(thread, &heap);
+    result = (heap != NULL && p != NULL && mi_heap_fiber_attach((mi_heap_t*)heap) && mi_heap_contains_block((mi_heap_t*)heap, p));
+    mi_free(p);
+    mi_heap_delete((mi_heap_t*)heap);
+  };
+#endif
+
+#if defined(__linux__)
+  CHECK_BODY("cpu-heaps") {
+    mi_option_enable(mi_option_cpu_heaps);
+    pthread_t thread;
+    void* p = NULL;
+    void* q = NULL;
+    pthread_create(&thread, NULL, &test_cpu_heap_alloc, NULL);
+    pthread_join(thread, &p);
+    result = (p != NULL && mi_usable_size(p) >= 64);
+    if (p != NULL) {
+      pthread_create(&thread, NULL, &test_cpu_heap_reuse, p);  // frees `p`
+      pthread_join(thread, &q);
+      result = result && (q == p);
+    }
+    mi_option_disable(mi_option_cpu_heaps);
+  };
+  CHECK_BODY("cpu-heaps-wanted") {
+    // a thread releases the heap of its CPU when another thread on the same CPU wants it
+    mi_option_enable(mi_option_cpu_heaps);
+    test_cpu_state = 0;
+    void* p = NULL;
+    pthread_t holder, waiter;
+    void* r1 = NULL;
+    void* r2 = NULL;
+    pthread_create(&holder, NULL, &test_cpu_heap_holder, &p);
+    pthread_create(&waiter, NULL, &test_cpu_heap_waiter, &p);
+    pthread_join(holder, &r1);
+    pthread_join(waiter, &r2);
+    result = (r1 == &p && r2 == &p);
+    mi_free(p);
+    mi_option_disable(mi_option_cpu_heaps);
+  };
+#endif
+
+#if defined(__linux__) && (MI_INTPTR_SIZE >= 8)
+  CHECK_BODY("arena-file-reattach") {
+    // a child process allocates in a file backed arena, and we re-attach the arena afterwards
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/mimalloc-test-arena-%d", (int)getpid());
+    const pid_t pid = fork();
+    if (pid == 0) {
+      mi_arena_id_t arena_id;
+      if (mi_reserve_file_memory_ex(path, 64*1024*1024, true, &arena_id) != 0) { _exit(1); }
+      mi_heap_t* heap = mi_heap_new_in_arena(arena_id);
+      char* s = (char*)mi_heap_malloc(heap, 32);
+      if (s == NULL) { _exit(2); }
+      strcpy(s, "persistent");
+      *mi_arena_file_root(arena_id) = s;
+      _exit(0);
+    }
+    int status = 0;
+    result = (pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    mi_arena_id_t arena_id;
+    if (result && mi_reserve_file_memory_ex(path, 0, true, &arena_id) == 0) {
+      char* s = (char*)(*mi_arena_file_root(arena_id));
+      result = (s != NULL && strcmp(s, "persistent") == 0);
+      mi_free(s);
+      mi_heap_t* heap = mi_heap_new_in_arena(arena_id);
+      size_t size = 0;
+      uint8_t* start = (uint8_t*)mi_arena_area(arena_id, &size);
+      uint8_t* p = (uint8_t*)mi_heap_malloc(heap, 32);
+      result = result && (p != NULL && p >= start && p < start + size);
+      mi_free(p);
+      mi_heap_delete(heap);
+    }
+    else {
+      result = false;
+    }
+    unlink(path);
+  };
+  CHECK_BODY("arena-shared") {
+    // a child process attaches to our shared arena and passes us a block it allocated
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/mimalloc-test-shared-%d", (int)getpid());
+    int to_child[2], to_parent[2];
+    result = (pipe(to_child) == 0 && pipe(to_parent) == 0);
+    const pid_t pid = (result ? fork() : -1);
+    if (pid == 0) {
+      char c;
+      mi_arena_id_t arena_id;
+      if (read(to_child[0], &c, 1) != 1 || mi_reserve_shared_memory_ex(path, 0, &arena_id) != 0) { _exit(1); }
+      mi_heap_t* heap = mi_heap_new_in_arena(arena_id);
+      char* s = (char*)mi_heap_malloc(heap, 1024);
+      if (s == NULL) { _exit(2); }
+      strcpy(s, "shared");
+      if (write(to_parent[1], &s, sizeof(s)) != sizeof(s)) { _exit(3); }
+      _exit(0);
+    }
+    mi_arena_id_t arena_id;
+    result = result && (pid > 0 && mi_reserve_shared_memory_ex(path, 2*64*1024*1024, &arena_id) == 0);
+    if (result) {
+      mi_heap_t* heap = mi_heap_new_in_arena(arena_id);
+      uint8_t* p = (uint8_t*)mi_heap_malloc(heap, 1024);
+      char* s = NULL;
+      int status = 0;
+      result = (p != NULL && write(to_child[1], "x", 1) == 1 && read(to_parent[0], &s, sizeof(s)) == sizeof(s) &&
+                waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+      size_t size = 0;
+      uint8_t* start = (uint8_t*)mi_arena_area(arena_id, &size);
+      result = result && (s != NULL && strcmp(s, "shared") == 0 && (uint8_t*)s >= start && (uint8_t*)s < start + size);
+      result = result && ((uintptr_t)s / MI_SEGMENT_SIZE != (uintptr_t)p / MI_SEGMENT_SIZE);  // in different segments
+      mi_free(p);
+      mi_heap_delete(heap);
+    }
+    unlink(path);
+  };
+#endif
 
   //mi_stats_print(NULL);
 
+  CHECK_BODY("numa-node-stats") {
+    void* p = mi_malloc(1024);
+    size_t segments = 0;
+    size_t peak = 0;
+    mi_numa_node_stats(0, &segments, &peak, NULL, NULL);
+    result = (segments >= 1 && peak >= segments);
+    mi_free(p);
+  };
+  CHECK_BODY("purge-batch") {
+    // free every other huge block (each in its own arena block) so the purges are not adjacent
+    mi_arena_id_t arena_id = 0;
+    result = (mi_reserve_os_memory_ex(512*1024*1024, true, false, true /* exclusive */, &arena_id) == 0);
+    mi_heap_t* heap = mi_heap_new_in_arena(arena_id);
+    void* ps[8];
+    for (int i = 0; i < 8; i++) {
+      ps[i] = mi_heap_malloc(heap, 20*1024*1024);
+      result = result && (ps[i] != NULL);
+    }
+    for (int i = 1; i < 8; i += 2) { mi_free(ps[i]); }
+    const long long ranges = test_stats_counter("purge_ranges");
+    const long long calls = test_stats_counter("purge_calls");
+    mi_collect(true);
+    const long long ranges_purged = test_stats_counter("purge_ranges") - ranges;
+    const long long calls_purged = test_stats_counter("purge_calls") - calls;
+    result = result && (ranges_purged >= 4 && calls_purged >= 1 && calls_purged <= ranges_purged);
+    for (int i = 0; i < 8; i += 2) { mi_free(ps[i]); }
+    mi_heap_delete(heap);
+  };
+  CHECK_BODY("calloc-zero") {
+    // a dirty large block that is reused is zeroed by a decommit (the purge is delayed so it stays dirty)
+    const size_t size = 1024*1024;
+    const long purge_delay = mi_option_get(mi_option_purge_delay);
+    mi_option_set(mi_option_purge_delay, 10000);
+    mi_option_set(mi_option_calloc_decommit_min, 64);  // in KiB
+    uint8_t* p = (uint8_t*)mi_malloc(size);
+    memset(p, 0xAB, size);
+    mi_free(p);
+    const long long zeroed = test_stats_counter("zero_decommit");
+    uint8_t* q = (uint8_t*)mi_calloc(1, size);
+    result = (q != NULL && mem_is_zero(q, size));
+    #if defined(__linux__) || defined(_WIN32)
+    if (q == p) { result = result && (test_stats_counter("zero_decommit") > zeroed); }
+    #endif
+    mi_option_set(mi_option_calloc_decommit_min, 0);
+    // and once purged it reads as zero without clearing it
+    memset(q, 0xAB, size);
+    mi_free(q);
+    mi_option_set(mi_option_purge_delay, purge_delay);
+    mi_collect(true);
+    q = (uint8_t*)mi_calloc(1, size);
+    #if defined(__linux__) && (MI_DEBUG < 3)
+    // the block reuses (part of) the purged memory and the memset is skipped: only the first OS page (with the
+    // free list link) is touched (with MI_DEBUG_FULL the zero assertion reads all of it)
+    result = result && (q != NULL && q < p + size && p < q + size && test_resident_pages(q, size) <= 1);
+    #endif
+    result = result && (q != NULL && mem_is_zero(q, size));
+    mi_free(q);
+  };
+  CHECK_BODY("realloc-nontemporal") {
+    // large blocks are copied and zeroed with non-temporal stores (at unaligned sizes as well)
+    mi_option_set(mi_option_nontemporal_min, 1024);  // in KiB
+    const size_t size = 3*1024*1024 + 5;
+    uint8_t* p = (uint8_t*)mi_malloc(size);
+    memset(p, 0xAB, size);
+    mi_free(p);
+    p = (uint8_t*)mi_calloc(1, size);
+    result = (p != NULL && mem_is_zero(p, size));
+    p = (uint8_t*)mi_rezalloc(p, 2*size + 3);
+    result = result && (p != NULL && mem_is_zero(p, 2*size + 3));
+    for (size_t i = 0; p != NULL && i < size; i++) { p[i] = (uint8_t)(i % 251); }
+    uint8_t* q = (uint8_t*)mi_realloc(p, 5*size);
+    for (size_t i = 0; result && q != NULL && i < size; i++) { result = (q[i] == (uint8_t)(i % 251)); }
+    mi_free(q);
+    mi_option_set(mi_option_nontemporal_min, 0);
+  };
+  CHECK_BODY("memory-pressure") {
+    // polling is harmless when the cgroup pressure cannot be monitored (and then reports nothing)
+    mi_option_set(mi_option_pressure_interval, 1);
+    for (int i = 0; i < 10000; i++) { mi_free(mi_malloc(64*1024)); }
+    mi_collect(false);
+    bool active = true;
+    size_t episodes = 1, msecs = 1, collects = 1;
+    if (!mi_memory_pressure_stats(&active, &episodes, &msecs, &collects)) {
+      result = (!active && episodes == 0 && msecs == 0 && collects == 0);
+    }
+    mi_option_set(mi_option_pressure_interval, 0);
+  };
+  CHECK_BODY("memory-pressure-notify") {
+    // a simulated pressure signal is handled on the next poll, and the episode ends once the option is disabled
+    size_t episodes0 = 0, collects0 = 0;
+    mi_memory_pressure_stats(NULL, &episodes0, NULL, &collects0);
+    test_deferred_forced = false;
+    mi_register_deferred_free(&test_deferred_free, NULL);
+    mi_option_set(mi_option_pressure_interval, 1);
+    mi_memory_pressure_notify();
+    bool active = false;
+    size_t collects = collects0;
+    for (int i = 0; i < 1000000 && collects == collects0; i++) {  // polled every 64 heartbeats (and at most once per ms)
+      mi_collect(false);
+      mi_memory_pressure_stats(&active, NULL, NULL, &collects);
+    }
+    result = (active && collects == collects0 + 1 && test_deferred_forced);
+    mi_option_set(mi_option_pressure_interval, 0);
+    for (int i = 0; i < 64 && active; i++) {
+      mi_collect(false);
+      mi_memory_pressure_stats(&active, NULL, NULL, NULL);
+    }
+    size_t episodes = 0;
+    mi_memory_pressure_stats(&active, &episodes, NULL, NULL);
+    result = result && (!active && episodes == episodes0 + 1);
+    mi_register_deferred_free(NULL, NULL);
+  };
+  CHECK_BODY("stats-json") {
+    void* p = mi_malloc(1024);
+    char buf[256];
+    const size_t len = mi_stats_get_json(buf, sizeof(buf));  // truncated
+    result = (len >= sizeof(buf) && strlen(buf) == sizeof(buf) - 1 && buf[0] == '{');
+    char* full = (char*)mi_malloc(len + 256);   // the statistics may change between calls
+    result = result && (mi_stats_get_json(full, len + 256) < len + 256 && strstr(full, "\"arenas\"") != NULL);
+    mi_free(full);
+    mi_free(p);
+  };
+  CHECK_BODY("stats-json-no-reset") {
+    // getting the statistics does not merge (and reset) the statistics of the current thread
+    void* p = mi_malloc(1024);
+    char before[256];
+    char after[256];
+    result = test_thread_stats_line("pages:", before, sizeof(before));
+    char buf[64];
+    mi_stats_get_json(buf, sizeof(buf));
+    result = result && test_thread_stats_line("pages:", after, sizeof(after));
+    long long peak = 0, total = 0, freed = 0, current = 0;
+    result = result && (sscanf(before, "pages: %lld %lld %lld %lld", &peak, &total, &freed, &current) == 4);
+    result = result && (total != 0 || freed != 0) && strcmp(before, after) == 0;
+    mi_free(p);
+  };
+  #if defined(__linux__)
+  CHECK_BODY("reserve-huge-async") {
+    // `done` is reported exactly once, and the result is 0 iff (at least) the first page was reserved
+    const int err = mi_reserve_huge_os_pages_async(2, 0, 2000, &test_reserve_progress, NULL);
+    const pid_t pid = fork();
+    if (pid == 0) {
+      alarm(10);  // fail instead of waiting for a reservation thread that is not inherited
+      exit(0);
+    }
+    int status = 0;
+    result = (pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    for (int i = 0; i < 10000 && test_reserve_done == 0; i++) { usleep(1000); }
+    result = result && (test_reserve_done == 1 && (err == 0) == (test_reserve_pages > 0));
+  };
+  CHECK_BODY("purge-background-fork") {
+    // a forked child does not inherit the background purger and should not wait for it on exit
+    // (this starts the purger for the remaining tests)
+    mi_option_set(mi_option_purge_background_interval, 10);
+    mi_free(mi_malloc(64*1024*1024));  // freeing to an arena starts the purger
+    const pid_t pid = fork();
+    if (pid == 0) {
+      alarm(10);  // fail instead of hanging
+      mi_free(mi_malloc(64*1024*1024));
+      exit(0);
+    }
+    int status = 0;
+    result = (pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  };
+  #endif
+
   // ---------------------------------------------------
   // various
   // ---------------------------------------------------
@@ -340,6 +1396,13 @@ int main(void) {
     mi_free(s);
   };
   #endif
+  CHECK_BODY("option-env") {
+    // the `test-api-env` test sets options in the environment (see CMakeLists.txt)
+    const char* s = getenv("MIMALLOC_COMMIT_AHEAD");
+    if (s != NULL && strcmp(s, "1M") == 0) {
+      result = (mi_option_get(mi_option_commit_ahead) == 1024 && mi_option_get_size(mi_option_commit_ahead) == 1024*1024);
+    }
+  };
 
   CHECK("stl_allocator1", test_stl_allocator1());
   CHECK("stl_allocator2", test_stl_allocator2());
@@ -0,0 +1,428 @@
+/* ----------------------------------------------------------------------------
+Copyright (c) 2018-2025 Microsoft Research, Daan Leijen
+This is free software; you can redistribute it and/or modify it under the
+terms of the MIT license.
+-----------------------------------------------------------------------------*/
+
+/* This is a small benchmark suite with reproducible workloads to compare
+   allocator versions (or to compare against the system allocator with `USE_STD_MALLOC`):
+   - small:    single threaded small object churn with a fixed live set
+   - remote:   producer/consumer where all objects are freed by another thread
+   - realloc:  growing blocks with realloc
+   - aligned:  aligned allocation with various alignments
+   - threads:  short lived threads where objects survive their thread (abandon/reclaim)
+   All workloads use deterministic "randomness". For each workload it reports the
+   operations per second, the (sampled) operation latency percentiles, and the peak RSS.
+   The latency percentiles are bucketed in powers of two nano-seconds.
+   Note: the peak RSS is of the process, so it only increases over the workloads.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+// #define USE_STD_MALLOC
+
+// > mimalloc-bench [WORKLOAD|all] [SCALE] [THREADS]
+static int SCALE   = 10;      // scaling factor for the number of operations
+static int THREADS = 8;       // threads for the multi-threaded workloads
+
+#ifdef USE_STD_MALLOC
+#define custom_malloc(s)              malloc(s)
+#define custom_realloc(p,s)           realloc(p,s)
+#define custom_free(p)                free(p)
+#define custom_malloc_aligned(s,a)    bench_std_malloc_aligned(s,a)
+#define custom_free_aligned(p)        bench_std_free_aligned(p)
+#else
+#include <mimalloc.h>
+#define custom_malloc(s)              mi_malloc(s)
+#define custom_realloc(p,s)           mi_realloc(p,s)
+#define custom_free(p)                mi_free(p)
+#define custom_malloc_aligned(s,a)    mi_malloc_aligned(s,a)
+#define custom_free_aligned(p)        mi_free(p)
+#endif
+
+static void run_os_threads(size_t nthreads, void (*entry)(intptr_t tid));
+static int64_t bench_clock_nsecs(void);
+static size_t bench_peak_rss(void);
+#ifdef USE_STD_MALLOC
+static void* bench_std_malloc_aligned(size_t size, size_t alignment);
+static void  bench_std_free_aligned(void* p);
+#endif
+
+
+// ---------------------------------------------------------------------------
+// Deterministic random numbers and latency histograms
+// ---------------------------------------------------------------------------
+
+typedef uint64_t random_t;
+
+static uint64_t pick(random_t* r) {
+  // splitmix64
+  uint64_t x = (*r += 0x9e3779b97f4a7c15ULL);
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return (x ^ (x >> 31));
+}
+
+#define LAT_BUCKETS       (48)        // bucket `i` counts latencies in `[2^(i-1), 2^i)` nano-seconds
+#define LAT_SAMPLE_MASK   (63)        // time 1 out of 64 operations
+
+typedef struct bench_stats_s {
+  uint64_t ops;
+  uint64_t lat[LAT_BUCKETS];
+  int64_t  lat_max;
+} bench_stats_t;
+
+#define MAX_THREADS (256)
+static bench_stats_t thread_stats[MAX_THREADS];
+
+static void stats_record(bench_stats_t* st, int64_t nsecs) {
+  size_t i = 0;
+  while (i < LAT_BUCKETS - 1 && ((int64_t)1 << i) <= nsecs) { i++; }
+  st->lat[i]++;
+  if (nsecs > st->lat_max) { st->lat_max = nsecs; }
+}
+
+// perform an operation; 1 out of 64 operations is timed
+#define BENCH_OP(st,op) \
+  do { \
+    if (((st)->ops++ & LAT_SAMPLE_MASK) == 0) { \
+      const int64_t _start = bench_clock_nsecs(); \
+      op; \
+      stats_record(st, bench_clock_nsecs() - _start); \
+    } \
+    else { op; } \
+  } while(0)
+
+static void stats_merge(bench_stats_t* total, const bench_stats_t* st) {
+  total->ops += st->ops;
+  for (size_t i = 0; i < LAT_BUCKETS; i++) { total->lat[i] += st->lat[i]; }
+  if (st->lat_max > total->lat_max) { total->lat_max = st->lat_max; }
+}
+
+static int64_t stats_percentile(const bench_stats_t* st, double perc) {
+  uint64_t count = 0;
+  for (size_t i = 0; i < LAT_BUCKETS; i++) { count += st->lat[i]; }
+  const uint64_t target = (uint64_t)((double)count * perc / 100.0);
+  uint64_t sum = 0;
+  for (size_t i = 0; i < LAT_BUCKETS; i++) {
+    sum += st->lat[i];
+    if (sum > target) { const int64_t bound = ((int64_t)1 << i); return (bound < st->lat_max ? bound : st->lat_max); }
+  }
+  return st->lat_max;
+}
+
+static void stats_print(const char* name, size_t nthreads, const bench_stats_t* st, int64_t elapsed) {
+  const double secs = (double)(elapsed > 0 ? elapsed : 1) / 1e9;
+  printf("%-8s %3zu %12llu %14.0f %8lld %8lld %8lld %10lld %10zu\n", name, nthreads,
+         (unsigned long long)st->ops, (double)st->ops / secs,
+         (long long)stats_percentile(st, 50.0), (long long)stats_percentile(st, 99.0),
+         (long long)stats_percentile(st, 99.9), (long long)st->lat_max, bench_peak_rss() / 1024);
+}
+
+
+// ---------------------------------------------------------------------------
+// Workloads
+// ---------------------------------------------------------------------------
+
+// small object churn: replace random objects in a live set of 1000 small objects
+#define SMALL_LIVE  (1000)
+
+static void bench_small(intptr_t tid) {
+  bench_stats_t* const st = &thread_stats[tid];
+  random_t r = 42 + (random_t)tid;
+  void* live[SMALL_LIVE];
+  memset(live, 0, sizeof(live));
+  const size_t n = (size_t)SCALE * 100000;
+  for (size_t i = 0; i < n; i++) {
+    const size_t idx = (size_t)(pick(&r) % SMALL_LIVE);
+    const size_t size = 8 + (size_t)(pick(&r) % 1017);
+    if (live[idx] != NULL) { BENCH_OP(st, custom_free(live[idx])); }
+    BENCH_OP(st, live[idx] = custom_malloc(size));
+    ((uint8_t*)live[idx])[0] = (uint8_t)i;
+  }
+  for (size_t i = 0; i < SMALL_LIVE; i++) { BENCH_OP(st, custom_free(live[i])); }
+}
+
+// producer/consumer: each producer thread allocates a batch that is freed by another thread
+#define REMOTE_BATCH  (10000)
+static void** remote_batches[MAX_THREADS];
+
+static void bench_remote_produce(intptr_t tid) {
+  bench_stats_t* const st = &thread_stats[tid];
+  random_t r = 43 + (random_t)tid;
+  void** const batch = remote_batches[tid];
+  for (size_t i = 0; i < REMOTE_BATCH; i++) {
+    const size_t size = 16 + (size_t)(pick(&r) % 241);
+    BENCH_OP(st, batch[i] = custom_malloc(size));
+    ((uint8_t*)batch[i])[0] = (uint8_t)i;
+  }
+}
+
+static void bench_remote_consume(intptr_t tid) {
+  bench_stats_t* const st = &thread_stats[tid];
+  void** const batch = remote_batches[(tid + 1) % THREADS];  // free the batch of another producer
+  for (size_t i = 0; i < REMOTE_BATCH; i++) {
+    BENCH_OP(st, custom_free(batch[i]));
+  }
+}
+
+// realloc growth: grow blocks in small increments up to 64 KiB
+static void bench_realloc(intptr_t tid) {
+  bench_stats_t* const st = &thread_stats[tid];
+  random_t r = 44 + (random_t)tid;
+  const size_t n = (size_t)SCALE * 20;
+  for (size_t i = 0; i < n; i++) {
+    void* p = NULL;
+    size_t size = 0;
+    while (size < 64*1024) {
+      size += 16 + (size_t)(pick(&r) % 512);
+      BENCH_OP(st, p = custom_realloc(p, size));
+      ((uint8_t*)p)[size-1] = (uint8_t)size;
+    }
+    BENCH_OP(st, custom_free(p));
+  }
+}
+
+// aligned allocation: a live set of 256 objects with alignments from 16 to 4096 bytes
+#define ALIGNED_LIVE  (256)
+
+static void bench_aligned(intptr_t tid) {
+  bench_stats_t* const st = &thread_stats[tid];
+  random_t r = 45 + (random_t)tid;
+  void* live[ALIGNED_LIVE];
+  memset(live, 0, sizeof(live));
+  const size_t n = (size_t)SCALE * 50000;
+  for (size_t i = 0; i < n; i++) {
+    const size_t idx = (size_t)(pick(&r) % ALIGNED_LIVE);
+    const size_t align = (size_t)16 << (pick(&r) % 9);
+    const size_t size = 8 + (size_t)(pick(&r) % 2041);
+    if (live[idx] != NULL) { BENCH_OP(st, custom_free_aligned(live[idx])); }
+    BENCH_OP(st, live[idx] = custom_malloc_aligned(size, align));
+    ((uint8_t*)live[idx])[0] = (uint8_t)i;
+  }
+  for (size_t i = 0; i < ALIGNED_LIVE; i++) { BENCH_OP(st, custom_free_aligned(live[i])); }
+}
+
+// thread create/exit: objects survive their (short lived) thread and are freed by the next generation
+#define THREADS_LIVE  (500)
+static void* threads_live[MAX_THREADS][THREADS_LIVE];
+
+static void bench_threads(intptr_t tid) {
+  bench_stats_t* const st = &thread_stats[tid];
+  random_t r = 46 + (random_t)tid + st->ops;
+  void** const live = threads_live[tid];
+  for (size_t i = 0; i < THREADS_LIVE; i++) {
+    if (live[i] != NULL) { BENCH_OP(st, custom_free(live[i])); }
+    const size_t size = 8 + (size_t)(pick(&r) % 4089);
+    BENCH_OP(st, live[i] = custom_malloc(size));
+    ((uint8_t*)live[i])[0] = (uint8_t)i;
+  }
+}
+
+
+// ---------------------------------------------------------------------------
+// Running workloads
+// ---------------------------------------------------------------------------
+
+static void stats_reset(void) {
+  memset(thread_stats, 0, sizeof(thread_stats));
+}
+
+static void stats_report(const char* name, size_t nthreads, int64_t elapsed) {
+  bench_stats_t total;
+  memset(&total, 0, sizeof(total));
+  for (size_t i = 0; i < MAX_THREADS; i++) { stats_merge(&total, &thread_stats[i]); }
+  stats_print(name, nthreads, &total, elapsed);
+}
+
+static void run_small(void) {
+  stats_reset();
+  const int64_t start = bench_clock_nsecs();
+  bench_small(0);
+  stats_report("small", 1, bench_clock_nsecs() - start);
+}
+
+static void run_remote(void) {
+  stats_reset();
+  for (int i = 0; i < THREADS; i++) { remote_batches[i] = (void**)calloc(REMOTE_BATCH, sizeof(void*)); }
+  int64_t elapsed = 0;
+  const int rounds = SCALE * 2;
+  for (int n = 0; n < rounds; n++) {
+    const int64_t start = bench_clock_nsecs();
+    run_os_threads((size_t)THREADS, &bench_remote_produce);
+    run_os_threads((size_t)THREADS, &bench_remote_consume);
+    elapsed += bench_clock_nsecs() - start;
+  }
+  for (int i = 0; i < THREADS; i++) { free(remote_batches[i]); remote_batches[i] = NULL; }
+  stats_report("remote", (size_t)THREADS, elapsed);
+}
+
+static void run_realloc(void) {
+  stats_reset();
+  const int64_t start = bench_clock_nsecs();
+  bench_realloc(0);
+  stats_report("realloc", 1, bench_clock_nsecs() - start);
+}
+
+static void run_aligned(void) {
+  stats_reset();
+  const int64_t start = bench_clock_nsecs();
+  bench_aligned(0);
+  stats_report("aligned", 1, bench_clock_nsecs() - start);
+}
+
+static void run_threads(void) {
+  stats_reset();
+  memset(threads_live, 0, sizeof(threads_live));
+  const int64_t start = bench_clock_nsecs();
+  const int rounds = SCALE * 10;
+  for (int n = 0; n < rounds; n++) {
+    run_os_threads((size_t)THREADS, &bench_threads);
+  }
+  for (int i = 0; i < THREADS; i++) {
+    for (size_t j = 0; j < THREADS_LIVE; j++) { BENCH_OP(&thread_stats[i], custom_free(threads_live[i][j])); }
+  }
+  stats_report("threads", (size_t)THREADS, bench_clock_nsecs() - start);
+}
+
+typedef struct bench_workload_s {
+  const char* name;
+  void (*run)(void);
+} bench_workload_t;
+
+static const bench_workload_t workloads[] = {
+  { "small", &run_small },
+  { "remote", &run_remote },
+  { "realloc", &run_realloc },
+  { "aligned", &run_aligned },
+  { "threads", &run_threads },
+};
+
+int main(int argc, char** argv) {
+  // > mimalloc-bench [WORKLOAD|all] [SCALE] [THREADS]
+  const char* which = (argc >= 2 ? argv[1] : "all");
+  if (argc >= 3) {
+    char* end;
+    long n = strtol(argv[2], &end, 10);
+    if (n > 0) SCALE = (int)n;
+  }
+  if (argc >= 4) {
+    char* end;
+    long n = strtol(argv[3], &end, 10);
+    if (n > 0) THREADS = (int)(n > MAX_THREADS ? MAX_THREADS : n);
+  }
+
+  printf("%-8s %3s %12s %14s %8s %8s %8s %10s %10s\n", "workload", "thr", "ops", "ops/sec", "p50(ns)", "p99", "p99.9", "max", "peak(KiB)");
+  bool found = false;
+  for (size_t i = 0; i < sizeof(workloads)/sizeof(workloads[0]); i++) {
+    if (strcmp(which, "all") == 0 || strcmp(which, workloads[i].name) == 0) {
+      workloads[i].run();
+      found = true;
+    }
+  }
+  if (!found) {
+    fprintf(stderr, "unknown workload: %s\n", which);
+    return 1;
+  }
+  return 0;
+}
+
+
+// ---------------------------------------------------------------------------
+// Platform
+// ---------------------------------------------------------------------------
+
+#ifdef USE_STD_MALLOC
+// portable aligned allocation on top of malloc (stores the original pointer in front of the block)
+static void* bench_std_malloc_aligned(size_t size, size_t alignment) {
+  uint8_t* p = (uint8_t*)malloc(size + alignment + sizeof(void*));
+  if (p == NULL) return NULL;
+  uintptr_t q = ((uintptr_t)p + sizeof(void*) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+  ((void**)q)[-1] = p;
+  return (void*)q;
+}
+
+static void bench_std_free_aligned(void* p) {
+  if (p != NULL) { free(((void**)p)[-1]); }
+}
+
+static size_t bench_peak_rss(void) {
+  return 0;
+}
+#else
+static size_t bench_peak_rss(void) {
+  size_t peak_rss = 0;
+  mi_process_info(NULL, NULL, NULL, NULL, &peak_rss, NULL, NULL, NULL);
+  return peak_rss;
+}
+#endif
+
+static void (*thread_entry_fun)(intptr_t) = &bench_small;
+
+#ifdef _WIN32
+
+#include <windows.h>
+
+static DWORD WINAPI thread_entry(LPVOID param) {
+  thread_entry_fun((intptr_t)param);
+  return 0;
+}
+
+static void run_os_threads(size_t nthreads, void (*fun)(intptr_t)) {
+  thread_entry_fun = fun;
+  DWORD* tids = (DWORD*)malloc(nthreads * sizeof(DWORD));
+  HANDLE* thandles = (HANDLE*)malloc(nthreads * sizeof(HANDLE));
+  for (uintptr_t i = 0; i < nthreads; i++) {
+    thandles[i] = CreateThread(0, 8*1024, &thread_entry, (void*)(i), 0, &tids[i]);
+  }
+  for (size_t i = 0; i < nthreads; i++) {
+    WaitForSingleObject(thandles[i], INFINITE);
+  }
+  for (size_t i = 0; i < nthreads; i++) {
+    CloseHandle(thandles[i]);
+  }
+  free(tids);
+  free(thandles);
+}
+
+static int64_t bench_clock_nsecs(void) {
+  static LARGE_INTEGER freq = { 0 };
+  if (freq.QuadPart == 0) { QueryPerformanceFrequency(&freq); }
+  LARGE_INTEGER t;
+  QueryPerformanceCounter(&t);
+  return (int64_t)((double)t.QuadPart * (1e9 / (double)freq.QuadPart));
+}
+
+#else
+
+#include <pthread.h>
+#include <time.h>
+
+static void* thread_entry(void* param) {
+  thread_entry_fun((uintptr_t)param);
+  return NULL;
+}
+
+static void run_os_threads(size_t nthreads, void (*fun)(intptr_t)) {
+  thread_entry_fun = fun;
+  pthread_t* threads = (pthread_t*)calloc(nthreads, sizeof(pthread_t));
+  for (size_t i = 0; i < nthreads; i++) {
+    pthread_create(&threads[i], NULL, &thread_entry, (void*)i);
+  }
+  for (size_t i = 0; i < nthreads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+}
+
+static int64_t bench_clock_nsecs(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return ((int64_t)t.tv_sec * 1000000000LL) + t.tv_nsec;
+}
+
+#endif
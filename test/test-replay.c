@@ -0,0 +1,545 @@
+/* ----------------------------------------------------------------------------
+Copyright (c) 2018-2025 Microsoft Research, Daan Leijen
+This is free software; you can redistribute it and/or modify it under the
+terms of the MIT license.
+-----------------------------------------------------------------------------*/
+
+/* Replay recorded allocation sequences to evaluate allocator tunables on real workloads.
+
+   > mimalloc-replay <trace file> [REPEAT]
+
+   The trace is either a binary trace as written by a `MI_TRACK_TRACE=1` build
+   (for example with `MIMALLOC_TRACE_FILE=app.mitrace ./app`, see `mimalloc/trace.h`),
+   or a text file with one operation per line:
+
+     <thread> m <id> <size>            allocate block <id>
+     <thread> r <id> <new-id> <size>   reallocate block <id> as block <new-id>
+     <thread> f <id>                   free block <id>
+
+   where <thread> and <id> are arbitrary (non-zero) integers and lines starting with `#` are ignored.
+   Each traced thread is replayed by its own thread in its original order; a block freed by another
+   thread is freed by the corresponding replay thread after it is allocated, so the cross-thread
+   frees are preserved. Frees of blocks that were allocated before the trace started are skipped.
+   It reports the throughput, the peak RSS, and the page and segment statistics.
+   Options can be set as usual through the environment (e.g. `MIMALLOC_TARGET_SEGMENTS_PER_THREAD=2`).
+   Define `USE_STD_MALLOC` to replay against the system allocator instead.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <mimalloc.h>
+#include <mimalloc/trace.h>
+
+// #define USE_STD_MALLOC
+
+#ifdef USE_STD_MALLOC
+#define custom_malloc(s)      malloc(s)
+#define custom_realloc(p,s)   realloc(p,s)
+#define custom_free(p)        free(p)
+#else
+#define custom_malloc(s)      mi_malloc(s)
+#define custom_realloc(p,s)   mi_realloc(p,s)
+#define custom_free(p)        mi_free(p)
+#endif
+
+static void  run_os_threads(size_t nthreads, void (*entry)(intptr_t tid));
+static void* atomic_load_ptr(void* volatile* p);
+static void  atomic_store_ptr(void* volatile* p, void* x);
+static void  replay_yield(void);
+static int64_t replay_clock_nsecs(void);
+
+
+// ---------------------------------------------------------------------------
+// Map from traced keys (block addresses or ids) to values
+// (linear probing with backward shift deletion)
+// ---------------------------------------------------------------------------
+
+typedef struct map_entry_s {
+  uint64_t key;         // 0 if empty
+  size_t   value;
+} map_entry_t;
+
+typedef struct map_s {
+  map_entry_t* entries;
+  size_t       count;
+  size_t       size;    // power of 2
+} map_t;
+
+static size_t map_hash(const map_t* map, uint64_t key) {
+  return (size_t)((key >> 3) * 11400714819323198485ULL >> 16) & (map->size - 1);
+}
+
+static void map_insert(map_t* map, uint64_t key, size_t value);
+
+static void map_grow(map_t* map) {
+  map_entry_t* const old = map->entries;
+  const size_t old_size = map->size;
+  map->size = (map->size == 0 ? 1024 : 2*map->size);
+  map->entries = (map_entry_t*)calloc(map->size, sizeof(map_entry_t));
+  map->count = 0;
+  if (map->entries == NULL) { fprintf(stderr, "out of memory\n"); exit(1); }
+  for (size_t i = 0; i < old_size; i++) {
+    if (old[i].key != 0) { map_insert(map, old[i].key, old[i].value); }
+  }
+  free(old);
+}
+
+static map_entry_t* map_find(map_t* map, uint64_t key) {
+  if (map->size == 0) return NULL;
+  for (size_t i = map_hash(map, key); map->entries[i].key != 0; i = (i + 1) & (map->size - 1)) {
+    if (map->entries[i].key == key) return &map->entries[i];
+  }
+  return NULL;
+}
+
+static void map_insert(map_t* map, uint64_t key, size_t value) {
+  if (2*(map->count + 1) > map->size) { map_grow(map); }
+  size_t i = map_hash(map, key);
+  while (map->entries[i].key != 0) { i = (i + 1) & (map->size - 1); }
+  map->entries[i].key   = key;
+  map->entries[i].value = value;
+  map->count++;
+}
+
+static void map_remove(map_t* map, map_entry_t* e) {
+  size_t i = (size_t)(e - map->entries);
+  size_t j = i;
+  while (true) {
+    j = (j + 1) & (map->size - 1);
+    if (map->entries[j].key == 0) break;
+    const size_t k = map_hash(map, map->entries[j].key);
+    // move `j` into the hole at `i` if its home `k` is not cyclically in `(i,j]`
+    if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j)) continue;
+    map->entries[i] = map->entries[j];
+    i = j;
+  }
+  map->entries[i].key = 0;
+  map->count--;
+}
+
+
+// ---------------------------------------------------------------------------
+// Reading traces into a global sequence of operations
+// ---------------------------------------------------------------------------
+
+typedef enum op_e { OP_MALLOC, OP_REALLOC, OP_FREE } op_t;
+
+typedef struct trace_op_s {
+  uint64_t order;     // timestamp (or line number)
+  uint64_t index;     // file order for equal timestamps
+  uint64_t thread;
+  uint64_t key;
+  uint64_t new_key;   // for realloc
+  uint64_t size;
+  op_t     op;
+} trace_op_t;
+
+typedef struct trace_s {
+  trace_op_t* ops;
+  size_t      count;
+  size_t      capacity;
+} trace_t;
+
+static void trace_push(trace_t* trace, const trace_op_t* op) {
+  if (trace->count >= trace->capacity) {
+    trace->capacity = (trace->capacity == 0 ? 4096 : 2*trace->capacity);
+    trace->ops = (trace_op_t*)realloc(trace->ops, trace->capacity * sizeof(trace_op_t));
+    if (trace->ops == NULL) { fprintf(stderr, "out of memory\n"); exit(1); }
+  }
+  trace->ops[trace->count] = *op;
+  trace->ops[trace->count].index = trace->count;
+  trace->count++;
+}
+
+static int trace_op_cmp(const void* p1, const void* p2) {
+  const trace_op_t* const e1 = (const trace_op_t*)p1;
+  const trace_op_t* const e2 = (const trace_op_t*)p2;
+  if (e1->order != e2->order) return (e1->order < e2->order ? -1 : 1);
+  return (e1->index < e2->index ? -1 : (e1->index > e2->index ? 1 : 0));
+}
+
+static bool trace_read_binary(FILE* f, const char* path, trace_t* trace) {
+  mi_trace_header_t header;
+  if (fread(&header, sizeof(header), 1, f) != 1 || header.version != MI_TRACE_VERSION ||
+      header.record_size != sizeof(mi_trace_record_t) || header.size < 0) {
+    fprintf(stderr, "not a valid trace file: %s\n", path);
+    return false;
+  }
+  const size_t n = (size_t)header.size / sizeof(mi_trace_record_t);
+  mi_trace_record_t rec;
+  for (size_t i = 0; i < n && fread(&rec, sizeof(rec), 1, f) == 1; i++) {
+    if (rec.op != MI_TRACE_OP_MALLOC && rec.op != MI_TRACE_OP_FREE) continue;  // not written
+    trace_op_t op;
+    memset(&op, 0, sizeof(op));
+    op.order  = rec.nsecs;
+    op.thread = rec.thread;
+    op.key    = rec.ptr;
+    op.size   = rec.size;
+    op.op     = (rec.op == MI_TRACE_OP_MALLOC ? OP_MALLOC : OP_FREE);
+    trace_push(trace, &op);
+  }
+  if (header.dropped > 0) {
+    printf("note: %lld records were dropped when the trace was recorded\n", (long long)header.dropped);
+  }
+  // records of different threads are not ordered in the file
+  qsort(trace->ops, trace->count, sizeof(trace_op_t), &trace_op_cmp);
+  return true;
+}
+
+static bool trace_read_text(FILE* f, const char* path, trace_t* trace) {
+  char line[256];
+  size_t lineno = 0;
+  while (fgets(line, sizeof(line), f) != NULL) {
+    lineno++;
+    char* s = line;
+    while (*s == ' ' || *s == '\t') { s++; }
+    if (*s == '#' || *s == '\n' || *s == '\r' || *s == 0) continue;
+    trace_op_t op;
+    memset(&op, 0, sizeof(op));
+    op.order = lineno;
+    char* end;
+    op.thread = strtoull(s, &end, 0);
+    while (*end == ' ' || *end == '\t') { end++; }
+    const char kind = *end++;
+    op.key = strtoull(end, &end, 0);
+    if (kind == 'm') {
+      op.op = OP_MALLOC;
+      op.size = strtoull(end, &end, 0);
+    }
+    else if (kind == 'r') {
+      op.op = OP_REALLOC;
+      op.new_key = strtoull(end, &end, 0);
+      op.size = strtoull(end, &end, 0);
+    }
+    else if (kind == 'f') {
+      op.op = OP_FREE;
+    }
+    else {
+      fprintf(stderr, "%s:%zu: unknown operation '%c'\n", path, lineno, kind);
+      return false;
+    }
+    if (op.key == 0 || (op.op == OP_REALLOC && op.new_key == 0)) {
+      fprintf(stderr, "%s:%zu: block ids must be non-zero\n", path, lineno);
+      return false;
+    }
+    trace_push(trace, &op);
+  }
+  return true;
+}
+
+static bool trace_read(const char* path, trace_t* trace) {
+  memset(trace, 0, sizeof(*trace));
+  FILE* f = fopen(path, "rb");
+  if (f == NULL) { fprintf(stderr, "unable to open trace: %s\n", path); return false; }
+  uint64_t magic = 0;
+  const bool is_binary = (fread(&magic, sizeof(magic), 1, f) == 1 && magic == MI_TRACE_MAGIC);
+  rewind(f);
+  const bool ok = (is_binary ? trace_read_binary(f, path, trace) : trace_read_text(f, path, trace));
+  fclose(f);
+  return ok;
+}
+
+
+// ---------------------------------------------------------------------------
+// Per-thread replay programs
+//
+// Every allocated block gets a unique slot. A replay thread that frees (or
+// reallocates) a block waits until the slot of the block is filled by the
+// allocating thread. Since a block is always allocated before it is freed
+// in the order of the trace, the threads cannot wait on each other in a cycle.
+// ---------------------------------------------------------------------------
+
+#define NO_SLOT   (SIZE_MAX)
+#define FAILED    ((void*)(uintptr_t)1)
+
+typedef struct event_s {
+  op_t   op;
+  size_t size;
+  size_t src;         // slot of the freed/reallocated block (or NO_SLOT)
+  size_t dst;         // slot of the allocated block (or NO_SLOT)
+} event_t;
+
+typedef struct program_s {
+  uint64_t thread;
+  event_t* events;
+  size_t   count;
+  size_t   capacity;
+} program_t;
+
+static program_t* programs = NULL;
+static size_t     program_count = 0;
+static void* volatile* slots = NULL;
+static size_t     slot_count = 0;
+
+static void program_push(program_t* prog, const event_t* ev) {
+  if (prog->count >= prog->capacity) {
+    prog->capacity = (prog->capacity == 0 ? 1024 : 2*prog->capacity);
+    prog->events = (event_t*)realloc(prog->events, prog->capacity * sizeof(event_t));
+    if (prog->events == NULL) { fprintf(stderr, "out of memory\n"); exit(1); }
+  }
+  prog->events[prog->count++] = *ev;
+}
+
+// Split the global sequence into per-thread programs and link the frees to their allocations
+static size_t programs_create(const trace_t* trace) {
+  map_t threads;  memset(&threads, 0, sizeof(threads));   // traced thread -> program index
+  map_t live;     memset(&live, 0, sizeof(live));         // traced block -> slot
+  size_t skipped = 0;
+  programs = (program_t*)calloc(trace->count + 1, sizeof(program_t));  // at most one program per operation
+  if (programs == NULL) { fprintf(stderr, "out of memory\n"); exit(1); }
+  for (size_t i = 0; i < trace->count; i++) {
+    const trace_op_t* const op = &trace->ops[i];
+    const uint64_t tkey = op->thread + 1;   // keys must be non-zero
+    map_entry_t* const t = map_find(&threads, tkey);
+    size_t tidx;
+    if (t != NULL) { tidx = t->value; }
+    else {
+      tidx = program_count++;
+      programs[tidx].thread = op->thread;
+      map_insert(&threads, tkey, tidx);
+    }
+    program_t* const prog = &programs[tidx];
+    event_t ev = { op->op, (size_t)op->size, NO_SLOT, NO_SLOT };
+    map_entry_t* const b = map_find(&live, op->key);
+    if (op->op == OP_MALLOC) {
+      if (b != NULL) {
+        // missed a free (for example of a block that was reallocated in place)
+        event_t fev = { OP_FREE, 0, b->value, NO_SLOT };
+        program_push(prog, &fev);
+        map_remove(&live, b);
+      }
+      ev.dst = slot_count++;
+      map_insert(&live, op->key, ev.dst);
+    }
+    else if (op->op == OP_REALLOC) {
+      if (b != NULL) { ev.src = b->value; map_remove(&live, b); }
+      map_entry_t* const nb = map_find(&live, op->new_key);
+      if (nb != NULL) {
+        event_t fev = { OP_FREE, 0, nb->value, NO_SLOT };
+        program_push(prog, &fev);
+        map_remove(&live, nb);
+      }
+      ev.dst = slot_count++;
+      map_insert(&live, op->new_key, ev.dst);
+    }
+    else {
+      if (b == NULL) { skipped++; continue; }  // allocated before the trace started
+      ev.src = b->value;
+      map_remove(&live, b);
+    }
+    program_push(prog, &ev);
+  }
+  free(threads.entries);
+  free(live.entries);
+  slots = (void* volatile*)calloc(slot_count + 1, sizeof(void*));
+  if (slots == NULL) { fprintf(stderr, "out of memory\n"); exit(1); }
+  return skipped;
+}
+
+// wait until the block in `slot` is allocated and take it out
+static void* slot_take(size_t slot) {
+  void* p;
+  while ((p = atomic_load_ptr(&slots[slot])) == NULL) { replay_yield(); }
+  atomic_store_ptr(&slots[slot], FAILED);
+  return (p == FAILED ? NULL : p);
+}
+
+static void slot_set(size_t slot, void* p) {
+  atomic_store_ptr(&slots[slot], (p == NULL ? FAILED : p));
+}
+
+static void replay_thread(intptr_t tid) {
+  const program_t* const prog = &programs[tid];
+  for (size_t i = 0; i < prog->count; i++) {
+    const event_t* const ev = &prog->events[i];
+    if (ev->op == OP_MALLOC) {
+      void* const p = custom_malloc(ev->size);
+      if (p != NULL && ev->size > 0) { ((uint8_t*)p)[0] = 1; }
+      slot_set(ev->dst, p);
+    }
+    else if (ev->op == OP_REALLOC) {
+      void* const p = (ev->src == NO_SLOT ? NULL : slot_take(ev->src));
+      void* const q = custom_realloc(p, ev->size);
+      if (q != NULL && ev->size > 0) { ((uint8_t*)q)[ev->size - 1] = 1; }
+      slot_set(ev->dst, q);
+    }
+    else {
+      custom_free(slot_take(ev->src));
+    }
+  }
+}
+
+
+// ---------------------------------------------------------------------------
+// Main
+// ---------------------------------------------------------------------------
+
+// only print the page and segment statistics
+static char stats_line[512];
+static size_t stats_line_len = 0;
+
+static void stats_line_out(void) {
+  static const char* labels[] = { "segments:", "pages:", "-abandoned:", "-cached:", "-extended:", "-noretire:", "mmaps:", "commits:", "purges:", NULL };
+  stats_line[stats_line_len] = 0;
+  const char* s = stats_line;
+  while (*s == ' ') { s++; }
+  for (size_t i = 0; labels[i] != NULL; i++) {
+    if (strncmp(s, labels[i], strlen(labels[i])) == 0) { fputs(stats_line, stdout); break; }
+  }
+  stats_line_len = 0;
+}
+
+static void stats_out(const char* msg, void* arg) {
+  (void)arg;
+  for (const char* s = msg; *s != 0; s++) {
+    if (stats_line_len < sizeof(stats_line) - 2) { stats_line[stats_line_len++] = *s; }
+    if (*s == '\n') { stats_line_out(); }
+  }
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <trace file> [REPEAT]\n", argv[0]);
+    return 1;
+  }
+  const int repeat = (argc > 2 ? atoi(argv[2]) : 1);
+  trace_t trace;
+  if (!trace_read(argv[1], &trace)) return 1;
+  const size_t skipped = programs_create(&trace);
+  const size_t ops = trace.count - skipped;
+  free(trace.ops);
+  #ifdef USE_STD_MALLOC
+  const char* const allocator = "system";
+  #else
+  const char* const allocator = "mimalloc";
+  #endif
+  printf("replaying %zu operations (%zu skipped) of %zu threads from %s with %s\n", ops, skipped, program_count, argv[1], allocator);
+  #ifndef USE_STD_MALLOC
+  mi_stats_reset();
+  #endif
+  for (int r = 0; r < (repeat <= 0 ? 1 : repeat); r++) {
+    memset((void*)slots, 0, (slot_count + 1) * sizeof(void*));
+    const int64_t start = replay_clock_nsecs();
+    run_os_threads(program_count, &replay_thread);
+    const int64_t elapsed = replay_clock_nsecs() - start;
+    // free the blocks that are still live (the others are taken out of their slot)
+    for (size_t i = 0; i < slot_count; i++) {
+      void* const p = slots[i];
+      if (p != NULL && p != FAILED) { custom_free(p); }
+    }
+    printf("run %d: %.3f ms, %.1f ns/op, %.0f ops/sec\n", r + 1, (double)elapsed / 1e6,
+           (ops == 0 ? 0.0 : (double)elapsed / (double)ops), (elapsed <= 0 ? 0.0 : (double)ops * 1e9 / (double)elapsed));
+  }
+  size_t peak_rss = 0;
+  mi_process_info(NULL, NULL, NULL, NULL, &peak_rss, NULL, NULL, NULL);
+  printf("peak rss: %zu KiB\n", peak_rss / 1024);
+  #ifndef USE_STD_MALLOC
+  mi_stats_print_out(&stats_out, NULL);
+  #endif
+  return 0;
+}
+
+
+// ---------------------------------------------------------------------------
+// Threads, atomics, and clock
+// ---------------------------------------------------------------------------
+
+static void (*thread_entry_fun)(intptr_t) = &replay_thread;
+
+#ifdef _WIN32
+
+#include <windows.h>
+
+static DWORD WINAPI thread_entry(LPVOID param) {
+  thread_entry_fun((intptr_t)param);
+  return 0;
+}
+
+static void run_os_threads(size_t nthreads, void (*fun)(intptr_t)) {
+  thread_entry_fun = fun;
+  HANDLE* thandles = (HANDLE*)calloc(nthreads, sizeof(HANDLE));
+  for (uintptr_t i = 0; i < nthreads; i++) {
+    thandles[i] = CreateThread(0, 64*1024, &thread_entry, (void*)(i), 0, NULL);
+  }
+  for (size_t i = 0; i < nthreads; i++) {
+    WaitForSingleObject(thandles[i], INFINITE);
+    CloseHandle(thandles[i]);
+  }
+  free(thandles);
+}
+
+static void* atomic_load_ptr(void* volatile* p) {
+  return InterlockedCompareExchangePointer(p, NULL, NULL);
+}
+
+static void atomic_store_ptr(void* volatile* p, void* x) {
+  InterlockedExchangePointer(p, x);
+}
+
+static void replay_yield(void) {
+  SwitchToThread();
+}
+
+static int64_t replay_clock_nsecs(void) {
+  static LARGE_INTEGER freq = { 0 };
+  if (freq.QuadPart == 0) { QueryPerformanceFrequency(&freq); }
+  LARGE_INTEGER t;
+  QueryPerformanceCounter(&t);
+  return (int64_t)((double)t.QuadPart * (1e9 / (double)freq.QuadPart));
+}
+
+#else
+
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+static void* thread_entry(void* param) {
+  thread_entry_fun((intptr_t)param);
+  return NULL;
+}
+
+static void run_os_threads(size_t nthreads, void (*fun)(intptr_t)) {
+  thread_entry_fun = fun;
+  pthread_t* threads = (pthread_t*)calloc(nthreads, sizeof(pthread_t));
+  for (size_t i = 0; i < nthreads; i++) {
+    pthread_create(&threads[i], NULL, &thread_entry, (void*)i);
+  }
+  for (size_t i = 0; i < nthreads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+}
+
+#ifdef __cplusplus
+#include <atomic>
+static void* atomic_load_ptr(void* volatile* p) {
+  return std::atomic_load_explicit((volatile std::atomic<void*>*)p, std::memory_order_acquire);
+}
+static void atomic_store_ptr(void* volatile* p, void* x) {
+  std::atomic_store_explicit((volatile std::atomic<void*>*)p, x, std::memory_order_release);
+}
+#else
+#include <stdatomic.h>
+static void* atomic_load_ptr(void* volatile* p) {
+  return atomic_load_explicit((volatile _Atomic(void*)*)p, memory_order_acquire);
+}
+static void atomic_store_ptr(void* volatile* p, void* x) {
+  atomic_store_explicit((volatile _Atomic(void*)*)p, x, memory_order_release);
+}
+#endif
+
+static void replay_yield(void) {
+  sched_yield();
+}
+
+static int64_t replay_clock_nsecs(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return ((int64_t)t.tv_sec * 1000000000LL) + t.tv_nsec;
+}
+
+#endif
@@ -0,0 +1,156 @@
+/* ----------------------------------------------------------------------------
+Copyright (c) 2018-2025 Microsoft Research, Daan Leijen
+This is free software; you can redistribute it and/or modify it under the
+terms of the MIT license.
+-----------------------------------------------------------------------------*/
+
+/* Measure the time to the first allocation of a short lived process, with and without
+   fast start (`MIMALLOC_FAST_START`). The program starts itself RUNS times for each mode;
+   each child process records the time right after its first `mi_malloc` and exits.
+   The time is measured from just before the child is started, so it includes the process
+   creation and loading; only the difference between the modes is due to mimalloc.
+
+   > mimalloc-bench-startup [RUNS]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <mimalloc.h>
+
+#define MAX_RUNS  (1000)
+
+static int64_t bench_clock_nsecs(void);
+static int     bench_spawn(const char* self, const char* mode, const char* fname);
+static void    bench_setenv(const char* name, const char* value);
+
+static const char* const time_file = "mimalloc-bench-startup.tmp";
+
+
+// ---------------------------------------------------------------------------
+// Child: allocate once and record the time
+// ---------------------------------------------------------------------------
+
+static int child_main(const char* fname) {
+  void* p = mi_malloc(16);
+  const int64_t t = bench_clock_nsecs();
+  mi_free(p);
+  FILE* f = fopen(fname, "w");
+  if (f == NULL) return 1;
+  fprintf(f, "%lld\n", (long long)t);
+  fclose(f);
+  return 0;
+}
+
+
+// ---------------------------------------------------------------------------
+// Parent: start the children and report the median and minimum times
+// ---------------------------------------------------------------------------
+
+static int cmp_int64(const void* x, const void* y) {
+  const int64_t a = *(const int64_t*)x;
+  const int64_t b = *(const int64_t*)y;
+  return (a < b ? -1 : (a > b ? 1 : 0));
+}
+
+static bool run_mode(const char* self, const char* mode, int runs) {
+  static int64_t times[MAX_RUNS];
+  bench_setenv("MIMALLOC_FAST_START", mode);
+  for (int i = 0; i < runs; i++) {
+    remove(time_file);
+    const int64_t start = bench_clock_nsecs();
+    if (bench_spawn(self, "child", time_file) != 0) {
+      fprintf(stderr, "unable to run the child process: %s\n", self);
+      return false;
+    }
+    long long t = 0;
+    FILE* f = fopen(time_file, "r");
+    if (f == NULL || fscanf(f, "%lld", &t) != 1) {
+      fprintf(stderr, "no time recorded by the child process\n");
+      if (f != NULL) { fclose(f); }
+      return false;
+    }
+    fclose(f);
+    times[i] = (int64_t)t - start;
+  }
+  remove(time_file);
+  qsort(times, (size_t)runs, sizeof(int64_t), &cmp_int64);
+  printf("%-12s %6d %12.1f %12.1f\n", (strcmp(mode, "0") == 0 ? "default" : "fast-start"), runs,
+         (double)times[runs/2] / 1000.0, (double)times[0] / 1000.0);
+  return true;
+}
+
+int main(int argc, char** argv) {
+  if (argc == 3 && strcmp(argv[1], "child") == 0) {
+    return child_main(argv[2]);
+  }
+  // > mimalloc-bench-startup [RUNS]
+  int runs = 100;
+  if (argc >= 2) {
+    char* end;
+    long n = strtol(argv[1], &end, 10);
+    if (n > 0) runs = (int)(n > MAX_RUNS ? MAX_RUNS : n);
+  }
+  printf("%-12s %6s %12s %12s\n", "mode", "runs", "median(us)", "min(us)");
+  if (!run_mode(argv[0], "0", runs)) return 1;
+  if (!run_mode(argv[0], "1", runs)) return 1;
+  return 0;
+}
+
+
+// ---------------------------------------------------------------------------
+// Platform
+// ---------------------------------------------------------------------------
+
+#ifdef _WIN32
+
+#include <windows.h>
+#include <process.h>
+
+static int bench_spawn(const char* self, const char* mode, const char* fname) {
+  const char* const args[] = { self, mode, fname, NULL };
+  return (_spawnv(_P_WAIT, self, args) == 0 ? 0 : 1);
+}
+
+static void bench_setenv(const char* name, const char* value) {
+  _putenv_s(name, value);
+}
+
+static int64_t bench_clock_nsecs(void) {
+  static LARGE_INTEGER freq = { 0 };
+  if (freq.QuadPart == 0) { QueryPerformanceFrequency(&freq); }
+  LARGE_INTEGER t;
+  QueryPerformanceCounter(&t);
+  return (int64_t)((double)t.QuadPart * (1e9 / (double)freq.QuadPart));
+}
+
+#else
+
+#include <spawn.h>
+#include <sys/wait.h>
+#include <time.h>
+
+extern char** environ;
+
+static int bench_spawn(const char* self, const char* mode, const char* fname) {
+  char* const args[] = { (char*)self, (char*)mode, (char*)fname, NULL };
+  pid_t pid;
+  if (posix_spawnp(&pid, self, NULL, NULL, args, environ) != 0) return 1;
+  int status = 0;
+  if (waitpid(pid, &status, 0) != pid) return 1;
+  return (WIFEXITED(status) ? WEXITSTATUS(status) : 1);
+}
+
+static void bench_setenv(const char* name, const char* value) {
+  setenv(name, value, 1);
+}
+
+static int64_t bench_clock_nsecs(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return ((int64_t)t.tv_sec * 1000000000LL) + t.tv_nsec;
+}
+
+#endif
@@ -0,0 +1,256 @@
+/* ----------------------------------------------------------------------------
+Copyright (c) 2018-2025 Microsoft Research, Daan Leijen
+This is free software; you can redistribute it and/or modify it under the
+terms of the MIT license.
+-----------------------------------------------------------------------------*/
+
+/* Replay an allocation trace as written by a `MI_TRACK_TRACE=1` build
+   (for example with `MIMALLOC_TRACE_FILE=app.mitrace ./app`). The format is described
+   in `mimalloc/trace.h`.
+
+   > mimalloc-trace-replay <trace file> [REPEAT]
+
+   The records of all threads are replayed on a single thread in the order of their
+   timestamps, so blocks freed by another thread are freed by the replaying thread as well.
+   Frees of blocks that were allocated before the trace started are skipped.
+   It reports the replay time per operation and the peak of the live bytes.
+   Define `USE_STD_MALLOC` to replay against the system allocator instead.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <mimalloc/trace.h>
+
+// #define USE_STD_MALLOC
+
+#ifdef USE_STD_MALLOC
+#define custom_malloc(s)    malloc(s)
+#define custom_free(p)      free(p)
+#else
+#include <mimalloc.h>
+#define custom_malloc(s)    mi_malloc(s)
+#define custom_free(p)      mi_free(p)
+#endif
+
+static int64_t replay_clock_nsecs(void);
+
+
+// ---------------------------------------------------------------------------
+// Map from traced addresses to the replayed blocks
+// (linear probing with backward shift deletion)
+// ---------------------------------------------------------------------------
+
+typedef struct entry_s {
+  uint64_t traced;      // 0 if empty
+  void*    block;
+  size_t   size;
+} entry_t;
+
+static entry_t* map       = NULL;
+static size_t   map_count = 0;
+static size_t   map_size  = 0;   // power of 2
+
+static size_t map_hash(uint64_t traced) {
+  return (size_t)((traced >> 3) * 11400714819323198485ULL >> 16) & (map_size - 1);
+}
+
+static void map_insert(uint64_t traced, void* block, size_t size);
+
+static void map_grow(void) {
+  entry_t* const old = map;
+  const size_t old_size = map_size;
+  map_size = (map_size == 0 ? 1024 : 2*map_size);
+  map = (entry_t*)calloc(map_size, sizeof(entry_t));
+  map_count = 0;
+  if (map == NULL) { fprintf(stderr, "out of memory\n"); exit(1); }
+  for (size_t i = 0; i < old_size; i++) {
+    if (old[i].traced != 0) { map_insert(old[i].traced, old[i].block, old[i].size); }
+  }
+  free(old);
+}
+
+static entry_t* map_find(uint64_t traced) {
+  if (map_size == 0) return NULL;
+  for (size_t i = map_hash(traced); map[i].traced != 0; i = (i + 1) & (map_size - 1)) {
+    if (map[i].traced == traced) return &map[i];
+  }
+  return NULL;
+}
+
+static void map_insert(uint64_t traced, void* block, size_t size) {
+  if (2*(map_count + 1) > map_size) { map_grow(); }
+  size_t i = map_hash(traced);
+  while (map[i].traced != 0) { i = (i + 1) & (map_size - 1); }
+  map[i].traced = traced;
+  map[i].block  = block;
+  map[i].size   = size;
+  map_count++;
+}
+
+static void map_remove(entry_t* e) {
+  size_t i = (size_t)(e - map);
+  size_t j = i;
+  while (true) {
+    j = (j + 1) & (map_size - 1);
+    if (map[j].traced == 0) break;
+    const size_t k = map_hash(map[j].traced);
+    // move `j` into the hole at `i` if its home `k` is not cyclically in `(i,j]`
+    if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j)) continue;
+    map[i] = map[j];
+    i = j;
+  }
+  map[i].traced = 0;
+  map_count--;
+}
+
+
+// ---------------------------------------------------------------------------
+// Read and replay
+// ---------------------------------------------------------------------------
+
+typedef struct trace_entry_s {
+  mi_trace_record_t rec;
+  uint64_t          index;   // file order for equal timestamps
+} trace_entry_t;
+
+static int trace_entry_cmp(const void* p1, const void* p2) {
+  const trace_entry_t* const e1 = (const trace_entry_t*)p1;
+  const trace_entry_t* const e2 = (const trace_entry_t*)p2;
+  if (e1->rec.nsecs != e2->rec.nsecs) return (e1->rec.nsecs < e2->rec.nsecs ? -1 : 1);
+  return (e1->index < e2->index ? -1 : (e1->index > e2->index ? 1 : 0));
+}
+
+static trace_entry_t* trace_read(const char* path, size_t* count) {
+  *count = 0;
+  FILE* f = fopen(path, "rb");
+  if (f == NULL) { fprintf(stderr, "unable to open trace: %s\n", path); return NULL; }
+  mi_trace_header_t header;
+  if (fread(&header, sizeof(header), 1, f) != 1 || header.magic != MI_TRACE_MAGIC ||
+      header.version != MI_TRACE_VERSION || header.record_size != sizeof(mi_trace_record_t) || header.size < 0) {
+    fprintf(stderr, "not a valid trace file: %s\n", path);
+    fclose(f);
+    return NULL;
+  }
+  const size_t n = (size_t)header.size / sizeof(mi_trace_record_t);
+  trace_entry_t* const entries = (trace_entry_t*)malloc((n == 0 ? 1 : n) * sizeof(trace_entry_t));
+  if (entries == NULL) { fprintf(stderr, "out of memory\n"); fclose(f); return NULL; }
+  mi_trace_record_t rec;
+  for (size_t i = 0; i < n && fread(&rec, sizeof(rec), 1, f) == 1; i++) {
+    if (rec.op == MI_TRACE_OP_NONE) continue;  // not written
+    entries[*count].rec = rec;
+    entries[*count].index = i;
+    *count += 1;
+  }
+  fclose(f);
+  if (header.dropped > 0) {
+    printf("note: %lld records were dropped when the trace was recorded\n", (long long)header.dropped);
+  }
+  qsort(entries, *count, sizeof(trace_entry_t), &trace_entry_cmp);
+  return entries;
+}
+
+typedef struct replay_stats_s {
+  size_t  mallocs;
+  size_t  frees;
+  size_t  skipped;
+  size_t  live;
+  size_t  peak_live;
+} replay_stats_t;
+
+static void replay(const trace_entry_t* entries, size_t count, replay_stats_t* stats) {
+  for (size_t i = 0; i < count; i++) {
+    const mi_trace_record_t* const rec = &entries[i].rec;
+    entry_t* e = map_find(rec->ptr);
+    if (rec->op == MI_TRACE_OP_MALLOC) {
+      if (e != NULL) {
+        // missed a free (for example of a block that was reallocated in place)
+        stats->live -= e->size;
+        custom_free(e->block);
+        map_remove(e);
+      }
+      const size_t size = (size_t)rec->size;
+      void* const p = custom_malloc(size);
+      if (p != NULL && size > 0) { ((uint8_t*)p)[0] = 1; }
+      map_insert(rec->ptr, p, size);
+      stats->mallocs++;
+      stats->live += size;
+      if (stats->live > stats->peak_live) { stats->peak_live = stats->live; }
+    }
+    else if (rec->op == MI_TRACE_OP_FREE) {
+      if (e == NULL) { stats->skipped++; continue; }  // allocated before the trace started
+      stats->live -= e->size;
+      custom_free(e->block);
+      map_remove(e);
+      stats->frees++;
+    }
+    else {
+      stats->skipped++;
+    }
+  }
+  // free the blocks that are still live
+  for (size_t i = 0; i < map_size; i++) {
+    if (map[i].traced != 0) { custom_free(map[i].block); map[i].traced = 0; }
+  }
+  map_count = 0;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <trace file> [REPEAT]\n", argv[0]);
+    return 1;
+  }
+  const int repeat = (argc > 2 ? atoi(argv[2]) : 1);
+  size_t count = 0;
+  trace_entry_t* const entries = trace_read(argv[1], &count);
+  if (entries == NULL) return 1;
+  #ifdef USE_STD_MALLOC
+  const char* const allocator = "system";
+  #else
+  const char* const allocator = "mimalloc";
+  #endif
+  printf("replaying %zu records of %s with %s\n", count, argv[1], allocator);
+  for (int r = 0; r < (repeat <= 0 ? 1 : repeat); r++) {
+    replay_stats_t stats;
+    memset(&stats, 0, sizeof(stats));
+    const int64_t start = replay_clock_nsecs();
+    replay(entries, count, &stats);
+    const int64_t elapsed = replay_clock_nsecs() - start;
+    const size_t ops = stats.mallocs + stats.frees;
+    printf("%zu mallocs, %zu frees, %zu skipped: %.3f ms, %.1f ns/op, peak live %zu KiB\n",
+           stats.mallocs, stats.frees, stats.skipped, (double)elapsed / 1e6,
+           (ops == 0 ? 0.0 : (double)elapsed / (double)ops), stats.peak_live / 1024);
+  }
+  free(entries);
+  free(map);
+  return 0;
+}
+
+
+// ---------------------------------------------------------------------------
+// Clock
+// ---------------------------------------------------------------------------
+
+#ifdef _WIN32
+#include <windows.h>
+
+static int64_t replay_clock_nsecs(void) {
+  static LARGE_INTEGER freq = { 0 };
+  if (freq.QuadPart == 0) { QueryPerformanceFrequency(&freq); }
+  LARGE_INTEGER t;
+  QueryPerformanceCounter(&t);
+  return (int64_t)((double)t.QuadPart * (1e9 / (double)freq.QuadPart));
+}
+
+#else
+#include <time.h>
+
+static int64_t replay_clock_nsecs(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return ((int64_t)t.tv_sec * 1000000000LL) + t.tv_nsec;
+}
+
+#endif